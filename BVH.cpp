@@ -0,0 +1,475 @@
+//***************************************************************************************
+// BVH.cpp
+//***************************************************************************************
+
+#include "BVH.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	float SurfaceArea(const XMFLOAT3& mn, const XMFLOAT3& mx)
+	{
+		float dx = mx.x - mn.x;
+		float dy = mx.y - mn.y;
+		float dz = mx.z - mn.z;
+		return 2.0f*(dx*dy + dy*dz + dz*dx);
+	}
+
+	void Grow(XMFLOAT3& mn, XMFLOAT3& mx, const XMFLOAT3& pMin, const XMFLOAT3& pMax)
+	{
+		mn.x = std::min(mn.x, pMin.x); mn.y = std::min(mn.y, pMin.y); mn.z = std::min(mn.z, pMin.z);
+		mx.x = std::max(mx.x, pMax.x); mx.y = std::max(mx.y, pMax.y); mx.z = std::max(mx.z, pMax.z);
+	}
+
+	float Axis(const XMFLOAT3& v, int axis)
+	{
+		return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+	}
+
+	// Slab test against [mn, mx].  Returns the entry distance, or FLT_MAX on a miss.
+	float RayBox(const XMFLOAT3& o, const XMFLOAT3& invDir, float maxDist,
+		const XMFLOAT3& mn, const XMFLOAT3& mx)
+	{
+		float tx0 = (mn.x - o.x)*invDir.x, tx1 = (mx.x - o.x)*invDir.x;
+		float ty0 = (mn.y - o.y)*invDir.y, ty1 = (mx.y - o.y)*invDir.y;
+		float tz0 = (mn.z - o.z)*invDir.z, tz1 = (mx.z - o.z)*invDir.z;
+
+		float tNear = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::min(tz0, tz1));
+		float tFar = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::max(tz0, tz1));
+
+		if(tFar < std::max(tNear, 0.0f) || tNear > maxDist)
+			return FLT_MAX;
+
+		return std::max(tNear, 0.0f);
+	}
+
+	XMFLOAT3 SafeReciprocal(FXMVECTOR dir)
+	{
+		XMFLOAT3 d;
+		XMStoreFloat3(&d, dir);
+
+		// Keep the reciprocal finite so a zero component never produces 0 * inf.
+		const float eps = 1e-12f;
+		return XMFLOAT3(
+			1.0f / (std::fabs(d.x) > eps ? d.x : eps),
+			1.0f / (std::fabs(d.y) > eps ? d.y : eps),
+			1.0f / (std::fabs(d.z) > eps ? d.z : eps));
+	}
+
+	struct Bin
+	{
+		XMFLOAT3 Min = { +FLT_MAX, +FLT_MAX, +FLT_MAX };
+		XMFLOAT3 Max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		std::uint32_t Count = 0;
+	};
+}
+
+const BVH::uint32 BVH::InvalidId;
+
+BoundingBox BVH::ToBox(const XMFLOAT3& mn, const XMFLOAT3& mx)
+{
+	return BoundingBox(
+		XMFLOAT3(0.5f*(mn.x + mx.x), 0.5f*(mn.y + mx.y), 0.5f*(mn.z + mx.z)),
+		XMFLOAT3(0.5f*(mx.x - mn.x), 0.5f*(mx.y - mn.y), 0.5f*(mx.z - mn.z)));
+}
+
+void BVH::Build(const std::vector<Item>& items)
+{
+	mNodes.clear();
+	mPrims.clear();
+	mIdToPrim.clear();
+	mDirty = false;
+
+	if(items.empty())
+		return;
+
+	uint32 maxId = 0;
+	mPrims.resize(items.size());
+	for(size_t i = 0; i < items.size(); ++i)
+	{
+		const BoundingBox& b = items[i].Bounds;
+		Prim& p = mPrims[i];
+		p.Min = XMFLOAT3(b.Center.x - b.Extents.x, b.Center.y - b.Extents.y, b.Center.z - b.Extents.z);
+		p.Max = XMFLOAT3(b.Center.x + b.Extents.x, b.Center.y + b.Extents.y, b.Center.z + b.Extents.z);
+		p.Id = items[i].Id;
+		maxId = std::max(maxId, p.Id);
+	}
+
+	// A binary tree with n leaves never needs more than 2n - 1 nodes.
+	mNodes.reserve(2 * items.size());
+
+	Node root;
+	root.First = 0;
+	root.Count = (uint32)mPrims.size();
+	ComputeNodeBounds(root);
+	mNodes.push_back(root);
+
+	// Depth-first build so that children always follow their parent in the node
+	// array, which lets Refit() walk the nodes backwards.
+	struct Pending { uint32 Node; uint32 Depth; };
+	std::vector<Pending> stack;
+	stack.push_back({ 0, 1 });
+	while(!stack.empty())
+	{
+		Pending p = stack.back();
+		stack.pop_back();
+
+		if(SplitNode(p.Node, p.Depth))
+		{
+			uint32 left = mNodes[p.Node].Left;
+			stack.push_back({ left + 1, p.Depth + 1 });
+			stack.push_back({ left, p.Depth + 1 });
+		}
+	}
+
+	mIdToPrim.assign((size_t)maxId + 1, InvalidId);
+	for(uint32 i = 0; i < (uint32)mPrims.size(); ++i)
+	{
+		assert(mIdToPrim[mPrims[i].Id] == InvalidId && "BVH ids must be unique.");
+		mIdToPrim[mPrims[i].Id] = i;
+	}
+}
+
+void BVH::ComputeNodeBounds(Node& node)const
+{
+	node.Min = XMFLOAT3(+FLT_MAX, +FLT_MAX, +FLT_MAX);
+	node.Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for(uint32 i = node.First; i < node.First + node.Count; ++i)
+		Grow(node.Min, node.Max, mPrims[i].Min, mPrims[i].Max);
+}
+
+bool BVH::SplitNode(uint32 nodeIndex, uint32 depth)
+{
+	const uint32 first = mNodes[nodeIndex].First;
+	const uint32 count = mNodes[nodeIndex].Count;
+
+	if(count <= 1 || depth + 1 >= MaxDepth)
+		return false;
+
+	// Bin the primitive centroids along each axis and evaluate the SAH cost of
+	// splitting at every bin boundary.
+	XMFLOAT3 cMin(+FLT_MAX, +FLT_MAX, +FLT_MAX);
+	XMFLOAT3 cMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for(uint32 i = first; i < first + count; ++i)
+	{
+		const Prim& p = mPrims[i];
+		XMFLOAT3 c(p.Min.x + p.Max.x, p.Min.y + p.Max.y, p.Min.z + p.Max.z);
+		Grow(cMin, cMax, c, c);
+	}
+
+	int bestAxis = -1;
+	uint32 bestBin = 0;
+	float bestCost = FLT_MAX;
+
+	for(int axis = 0; axis < 3; ++axis)
+	{
+		float lo = Axis(cMin, axis);
+		float hi = Axis(cMax, axis);
+		if(hi <= lo)
+			continue;
+
+		float scale = BinCount / (hi - lo);
+
+		Bin bins[BinCount];
+		for(uint32 i = first; i < first + count; ++i)
+		{
+			const Prim& p = mPrims[i];
+			float c = Axis(p.Min, axis) + Axis(p.Max, axis);
+			uint32 b = std::min(BinCount - 1, (uint32)((c - lo)*scale));
+			bins[b].Count++;
+			Grow(bins[b].Min, bins[b].Max, p.Min, p.Max);
+		}
+
+		// Sweep from the right to get the cost of everything right of each boundary,
+		// then from the left to combine.
+		float rightArea[BinCount];
+		uint32 rightCount[BinCount];
+		Bin acc;
+		for(uint32 b = BinCount - 1; b > 0; --b)
+		{
+			acc.Count += bins[b].Count;
+			Grow(acc.Min, acc.Max, bins[b].Min, bins[b].Max);
+			rightCount[b] = acc.Count;
+			rightArea[b] = acc.Count ? SurfaceArea(acc.Min, acc.Max) : 0.0f;
+		}
+
+		acc = Bin();
+		for(uint32 b = 0; b < BinCount - 1; ++b)
+		{
+			acc.Count += bins[b].Count;
+			Grow(acc.Min, acc.Max, bins[b].Min, bins[b].Max);
+			if(acc.Count == 0 || rightCount[b + 1] == 0)
+				continue;
+
+			float cost = acc.Count*SurfaceArea(acc.Min, acc.Max) + rightCount[b + 1]*rightArea[b + 1];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	uint32 mid = 0;
+	if(bestAxis >= 0)
+	{
+		const Node& node = mNodes[nodeIndex];
+		float leafCost = count*SurfaceArea(node.Min, node.Max);
+		if(count <= MaxLeafSize && bestCost >= leafCost)
+			return false;
+
+		float lo = Axis(cMin, bestAxis);
+		float scale = BinCount / (Axis(cMax, bestAxis) - lo);
+		Prim* split = std::partition(mPrims.data() + first, mPrims.data() + first + count,
+			[&](const Prim& p)
+		{
+			float c = Axis(p.Min, bestAxis) + Axis(p.Max, bestAxis);
+			return std::min(BinCount - 1, (uint32)((c - lo)*scale)) <= bestBin;
+		});
+		mid = (uint32)(split - mPrims.data());
+	}
+	else
+	{
+		// All centroids coincide so no plane separates them.  Small groups become a
+		// leaf; large ones are halved so a degenerate scene cannot make one huge leaf.
+		if(count <= MaxLeafSize)
+			return false;
+		mid = first + count / 2;
+	}
+
+	uint32 left = (uint32)mNodes.size();
+
+	Node l;
+	l.First = first;
+	l.Count = mid - first;
+	ComputeNodeBounds(l);
+
+	Node r;
+	r.First = mid;
+	r.Count = first + count - mid;
+	ComputeNodeBounds(r);
+
+	mNodes.push_back(l);
+	mNodes.push_back(r);
+	mNodes[nodeIndex].Left = left;
+
+	return true;
+}
+
+void BVH::UpdateBounds(uint32 id, const BoundingBox& bounds)
+{
+	assert(id < mIdToPrim.size() && mIdToPrim[id] != InvalidId);
+
+	Prim& p = mPrims[mIdToPrim[id]];
+	p.Min = XMFLOAT3(bounds.Center.x - bounds.Extents.x, bounds.Center.y - bounds.Extents.y, bounds.Center.z - bounds.Extents.z);
+	p.Max = XMFLOAT3(bounds.Center.x + bounds.Extents.x, bounds.Center.y + bounds.Extents.y, bounds.Center.z + bounds.Extents.z);
+	mDirty = true;
+}
+
+void BVH::Refit()
+{
+	if(!mDirty)
+		return;
+
+	for(size_t i = mNodes.size(); i-- > 0; )
+	{
+		Node& node = mNodes[i];
+		if(node.Left == 0)
+		{
+			ComputeNodeBounds(node);
+		}
+		else
+		{
+			const Node& l = mNodes[node.Left];
+			const Node& r = mNodes[node.Left + 1];
+			node.Min = l.Min;
+			node.Max = l.Max;
+			Grow(node.Min, node.Max, r.Min, r.Max);
+		}
+	}
+
+	mDirty = false;
+}
+
+void BVH::QueryFrustum(const BoundingFrustum& frustum, std::vector<uint32>& result)const
+{
+	if(mNodes.empty())
+		return;
+
+	uint32 stack[MaxDepth];
+	uint32 top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const Node& node = mNodes[stack[--top]];
+
+		ContainmentType c = frustum.Contains(ToBox(node.Min, node.Max));
+		if(c == DISJOINT)
+			continue;
+
+		if(c == CONTAINS)
+		{
+			for(uint32 i = node.First; i < node.First + node.Count; ++i)
+				result.push_back(mPrims[i].Id);
+		}
+		else if(node.Left == 0)
+		{
+			for(uint32 i = node.First; i < node.First + node.Count; ++i)
+			{
+				if(frustum.Intersects(ToBox(mPrims[i].Min, mPrims[i].Max)))
+					result.push_back(mPrims[i].Id);
+			}
+		}
+		else
+		{
+			stack[top++] = node.Left + 1;
+			stack[top++] = node.Left;
+		}
+	}
+}
+
+void BVH::QuerySphere(const BoundingSphere& sphere, std::vector<uint32>& result)const
+{
+	if(mNodes.empty())
+		return;
+
+	uint32 stack[MaxDepth];
+	uint32 top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const Node& node = mNodes[stack[--top]];
+
+		ContainmentType c = sphere.Contains(ToBox(node.Min, node.Max));
+		if(c == DISJOINT)
+			continue;
+
+		if(c == CONTAINS)
+		{
+			for(uint32 i = node.First; i < node.First + node.Count; ++i)
+				result.push_back(mPrims[i].Id);
+		}
+		else if(node.Left == 0)
+		{
+			for(uint32 i = node.First; i < node.First + node.Count; ++i)
+			{
+				if(sphere.Intersects(ToBox(mPrims[i].Min, mPrims[i].Max)))
+					result.push_back(mPrims[i].Id);
+			}
+		}
+		else
+		{
+			stack[top++] = node.Left + 1;
+			stack[top++] = node.Left;
+		}
+	}
+}
+
+bool BVH::RayCast(FXMVECTOR origin, FXMVECTOR dir, float maxDist,
+	uint32& hitId, float& hitDist)const
+{
+	hitId = InvalidId;
+	hitDist = maxDist;
+
+	if(mNodes.empty())
+		return false;
+
+	XMFLOAT3 o;
+	XMStoreFloat3(&o, origin);
+	XMFLOAT3 invDir = SafeReciprocal(dir);
+
+	if(RayBox(o, invDir, hitDist, mNodes[0].Min, mNodes[0].Max) == FLT_MAX)
+		return false;
+
+	struct Entry { uint32 Node; float Dist; };
+	Entry stack[MaxDepth];
+	uint32 top = 0;
+	stack[top++] = { 0, 0.0f };
+	while(top > 0)
+	{
+		Entry e = stack[--top];
+		if(e.Dist > hitDist)
+			continue;
+
+		const Node& node = mNodes[e.Node];
+		if(node.Left == 0)
+		{
+			for(uint32 i = node.First; i < node.First + node.Count; ++i)
+			{
+				float t = RayBox(o, invDir, hitDist, mPrims[i].Min, mPrims[i].Max);
+				if(t < hitDist)
+				{
+					hitDist = t;
+					hitId = mPrims[i].Id;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so the farther one can be rejected by the
+		// closest hit found so far.
+		uint32 a = node.Left;
+		uint32 b = node.Left + 1;
+		float ta = RayBox(o, invDir, hitDist, mNodes[a].Min, mNodes[a].Max);
+		float tb = RayBox(o, invDir, hitDist, mNodes[b].Min, mNodes[b].Max);
+		if(ta > tb)
+		{
+			std::swap(a, b);
+			std::swap(ta, tb);
+		}
+		if(tb != FLT_MAX)
+			stack[top++] = { b, tb };
+		if(ta != FLT_MAX)
+			stack[top++] = { a, ta };
+	}
+
+	return hitId != InvalidId;
+}
+
+void BVH::QueryRay(FXMVECTOR origin, FXMVECTOR dir, float maxDist,
+	std::vector<RayHit>& result)const
+{
+	if(mNodes.empty())
+		return;
+
+	XMFLOAT3 o;
+	XMStoreFloat3(&o, origin);
+	XMFLOAT3 invDir = SafeReciprocal(dir);
+
+	uint32 stack[MaxDepth];
+	uint32 top = 0;
+	stack[top++] = 0;
+	while(top > 0)
+	{
+		const Node& node = mNodes[stack[--top]];
+		if(RayBox(o, invDir, maxDist, node.Min, node.Max) == FLT_MAX)
+			continue;
+
+		if(node.Left == 0)
+		{
+			for(uint32 i = node.First; i < node.First + node.Count; ++i)
+			{
+				float t = RayBox(o, invDir, maxDist, mPrims[i].Min, mPrims[i].Max);
+				if(t != FLT_MAX)
+				{
+					RayHit hit;
+					hit.Id = mPrims[i].Id;
+					hit.Dist = t;
+					result.push_back(hit);
+				}
+			}
+		}
+		else
+		{
+			stack[top++] = node.Left + 1;
+			stack[top++] = node.Left;
+		}
+	}
+}
@@ -0,0 +1,111 @@
+//***************************************************************************************
+// BVH.h
+//
+// Bounding volume hierarchy over axis-aligned world bounds.  The tree is built with a
+// binned surface area heuristic and can be refit in place when the bounds of its
+// primitives change, so it serves both static geometry (built once) and animated
+// geometry (refit whenever a transform changes).
+//
+// Every node covers a contiguous range of the primitive array, so a node that is
+// fully inside a query volume can emit its whole subtree without further tests.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class BVH
+{
+public:
+	using uint32 = std::uint32_t;
+
+	static const uint32 InvalidId = 0xffffffff;
+
+	struct Item
+	{
+		// Caller defined identifier reported back by the queries.
+		uint32 Id = InvalidId;
+		DirectX::BoundingBox Bounds;
+	};
+
+	struct RayHit
+	{
+		uint32 Id = InvalidId;
+		// Distance at which the ray enters the primitive's bounds.
+		float Dist = 0.0f;
+	};
+
+	BVH() = default;
+	BVH(const BVH& rhs) = delete;
+	BVH& operator=(const BVH& rhs) = delete;
+
+	// Builds the tree from scratch.  Ids must be unique; they do not need to be dense
+	// but the id-to-primitive table is sized by the largest id.
+	void Build(const std::vector<Item>& items);
+
+	// Changes the bounds of a primitive.  The node bounds are not touched until Refit().
+	void UpdateBounds(uint32 id, const DirectX::BoundingBox& bounds);
+
+	// Recomputes node bounds bottom-up after UpdateBounds() calls.  Does nothing if no
+	// bounds have changed since the last build or refit.
+	void Refit();
+
+	// Appends the ids of all primitives that intersect the given volume.
+	void QueryFrustum(const DirectX::BoundingFrustum& frustum, std::vector<uint32>& result)const;
+	void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<uint32>& result)const;
+
+	// Finds the nearest primitive whose bounds are hit by the ray.  The direction
+	// does not need to be normalized; hitDist is measured in units of its length.
+	bool RayCast(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist,
+		uint32& hitId, float& hitDist)const;
+
+	// Appends every primitive whose bounds are hit within maxDist, unordered.  Used
+	// when the caller refines box hits with an exact test of its own.
+	void QueryRay(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR dir, float maxDist,
+		std::vector<RayHit>& result)const;
+
+	uint32 PrimitiveCount()const { return (uint32)mPrims.size(); }
+	uint32 NodeCount()const { return (uint32)mNodes.size(); }
+	bool Empty()const { return mPrims.empty(); }
+
+private:
+	struct Node
+	{
+		DirectX::XMFLOAT3 Min;
+		// Index of the left child; the right child follows it.  Zero marks a leaf
+		// because the root can never be a child.
+		uint32 Left = 0;
+		DirectX::XMFLOAT3 Max;
+		// Range of primitives covered by the whole subtree.
+		uint32 First = 0;
+		uint32 Count = 0;
+	};
+
+	struct Prim
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+		uint32 Id = InvalidId;
+	};
+
+	static DirectX::BoundingBox ToBox(const DirectX::XMFLOAT3& mn, const DirectX::XMFLOAT3& mx);
+
+	void ComputeNodeBounds(Node& node)const;
+	bool SplitNode(uint32 nodeIndex, uint32 depth);
+
+	// Nodes up to this size become leaves when the SAH finds no cheaper split; larger
+	// nodes are always split.
+	static const uint32 MaxLeafSize = 4;
+	static const uint32 BinCount = 12;
+	// Fixed traversal stacks limit the depth of the tree.
+	static const uint32 MaxDepth = 64;
+
+	std::vector<Node> mNodes;
+	std::vector<Prim> mPrims;
+	std::vector<uint32> mIdToPrim;
+
+	bool mDirty = false;
+};
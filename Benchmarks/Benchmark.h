@@ -0,0 +1,68 @@
+//***************************************************************************************
+// Benchmark.h
+//
+// Timing helpers shared by the headless benchmarks.  Each benchmark is a plain console
+// program that prints a table; none of them need a GPU or a window.
+//***************************************************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace Benchmark
+{
+	using Clock = std::chrono::high_resolution_clock;
+
+	inline double MicrosecondsSince(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	}
+
+	// Calls fn() repeatCount times per round and returns the best round's average time
+	// in microseconds.  The best round is the one least disturbed by the rest of the
+	// machine.
+	template<typename Fn>
+	double Measure(int roundCount, int repeatCount, const Fn& fn)
+	{
+		double best = 0.0;
+		for(int round = 0; round < roundCount; ++round)
+		{
+			Clock::time_point start = Clock::now();
+			for(int i = 0; i < repeatCount; ++i)
+				fn();
+
+			double average = MicrosecondsSince(start) / repeatCount;
+			best = round == 0 ? average : std::min<double>(best, average);
+		}
+		return best;
+	}
+
+	// Keeps a result alive, so the optimizer cannot drop the work that made it.
+	template<typename T>
+	void Consume(const T& value)
+	{
+		static volatile T sink;
+		sink = value;
+	}
+
+	// Prints a time with a unit that keeps it readable.
+	inline void PrintTime(double microseconds)
+	{
+		if(microseconds >= 1000.0)
+			std::printf("%9.2f ms", microseconds / 1000.0);
+		else
+			std::printf("%9.2f us", microseconds);
+	}
+
+	// Benchmarks compare their results against a reference before timing anything, so a
+	// fast wrong answer fails loudly instead of printing a good number.
+	inline bool Check(bool condition, const char* what)
+	{
+		if(!condition)
+			std::fprintf(stderr, "FAILED: %s\n", what);
+		return condition;
+	}
+}
@@ -0,0 +1,213 @@
+//***************************************************************************************
+// BvhBenchmark.cpp
+//
+// Times BVH frustum, ray and sphere queries against a linear scan over the same boxes,
+// from 1k to 1M items.  The boxes are scattered over a wide flat area, as render items
+// are, and every query's result is checked against the scan before it is timed.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../BVH.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	const float WorldHalfSize = 500.0f;
+	const int QueryCount = 16;
+
+	std::vector<BVH::Item> MakeItems(std::uint32_t count)
+	{
+		std::mt19937 rng(count);
+		std::uniform_real_distribution<float> position(-WorldHalfSize, WorldHalfSize);
+		std::uniform_real_distribution<float> extent(0.2f, 3.0f);
+
+		std::vector<BVH::Item> items(count);
+		for(std::uint32_t i = 0; i < count; ++i)
+		{
+			items[i].Id = i;
+			items[i].Bounds = BoundingBox(
+				XMFLOAT3(position(rng), 0.05f*position(rng), position(rng)),
+				XMFLOAT3(extent(rng), extent(rng), extent(rng)));
+		}
+		return items;
+	}
+
+	// Cameras spread over the area, looking along +z with a 200 unit far plane.
+	std::vector<BoundingFrustum> MakeFrustums()
+	{
+		BoundingFrustum local;
+		BoundingFrustum::CreateFromMatrix(local, XMMatrixPerspectiveFovLH(0.25f*XM_PI, 1.5f, 1.0f, 200.0f));
+
+		std::vector<BoundingFrustum> frustums(QueryCount);
+		for(int i = 0; i < QueryCount; ++i)
+		{
+			float x = -WorldHalfSize + (i + 0.5f) * (2.0f*WorldHalfSize / QueryCount);
+			local.Transform(frustums[i], XMMatrixTranslation(x, 0.0f, -0.5f*WorldHalfSize));
+		}
+		return frustums;
+	}
+
+	std::vector<BoundingSphere> MakeSpheres()
+	{
+		std::vector<BoundingSphere> spheres(QueryCount);
+		for(int i = 0; i < QueryCount; ++i)
+		{
+			float t = (i + 0.5f) / QueryCount;
+			spheres[i] = BoundingSphere(XMFLOAT3(WorldHalfSize*(2.0f*t - 1.0f), 0.0f, WorldHalfSize*(1.0f - 2.0f*t)), 20.0f);
+		}
+		return spheres;
+	}
+
+	// Rays cross the whole area along x at different depths, so most of them hit
+	// something far from their origin.
+	XMVECTOR RayOrigin(int i)
+	{
+		float z = -WorldHalfSize + (i + 0.5f) * (2.0f*WorldHalfSize / QueryCount);
+		return XMVectorSet(-WorldHalfSize - 100.0f, 0.0f, z, 1.0f);
+	}
+
+	template<typename Volume>
+	void LinearQuery(const std::vector<BVH::Item>& items, const Volume& volume, std::vector<std::uint32_t>& result)
+	{
+		for(const BVH::Item& item : items)
+		{
+			if(volume.Intersects(item.Bounds))
+				result.push_back(item.Id);
+		}
+	}
+
+	bool LinearRayCast(const std::vector<BVH::Item>& items, FXMVECTOR origin, FXMVECTOR dir, float& hitDist)
+	{
+		hitDist = FLT_MAX;
+		for(const BVH::Item& item : items)
+		{
+			float dist;
+			if(item.Bounds.Intersects(origin, dir, dist) && dist < hitDist)
+				hitDist = dist;
+		}
+		return hitDist != FLT_MAX;
+	}
+
+	bool SameIds(std::vector<std::uint32_t> a, std::vector<std::uint32_t> b)
+	{
+		std::sort(a.begin(), a.end());
+		std::sort(b.begin(), b.end());
+		return a == b;
+	}
+
+	bool Run(std::uint32_t itemCount)
+	{
+		std::vector<BVH::Item> items = MakeItems(itemCount);
+		std::vector<BoundingFrustum> frustums = MakeFrustums();
+		std::vector<BoundingSphere> spheres = MakeSpheres();
+		const XMVECTOR rayDir = XMVectorSet(1.0f, 0.0f, 0.0f, 0.0f);
+
+		Benchmark::Clock::time_point buildStart = Benchmark::Clock::now();
+		BVH bvh;
+		bvh.Build(items);
+		double buildTime = Benchmark::MicrosecondsSince(buildStart);
+
+		// Check every query against the scan first.
+		std::vector<std::uint32_t> fast, slow;
+		size_t frustumHits = 0, sphereHits = 0;
+		for(int i = 0; i < QueryCount; ++i)
+		{
+			fast.clear();
+			slow.clear();
+			bvh.QueryFrustum(frustums[i], fast);
+			LinearQuery(items, frustums[i], slow);
+			if(!Benchmark::Check(SameIds(fast, slow), "frustum query differs from the linear scan"))
+				return false;
+			frustumHits += fast.size();
+
+			fast.clear();
+			slow.clear();
+			bvh.QuerySphere(spheres[i], fast);
+			LinearQuery(items, spheres[i], slow);
+			if(!Benchmark::Check(SameIds(fast, slow), "sphere query differs from the linear scan"))
+				return false;
+			sphereHits += fast.size();
+
+			BVH::uint32 hitId;
+			float fastDist, slowDist;
+			bool fastHit = bvh.RayCast(RayOrigin(i), rayDir, FLT_MAX, hitId, fastDist);
+			bool slowHit = LinearRayCast(items, RayOrigin(i), rayDir, slowDist);
+			if(!Benchmark::Check(fastHit == slowHit && (!fastHit || std::fabs(fastDist - slowDist) <= 1e-3f),
+				"ray cast differs from the linear scan"))
+				return false;
+		}
+
+		// The large sizes get fewer rounds, so the whole run stays short.
+		int rounds = itemCount >= 1000000 ? 3 : 5;
+		int i = 0;
+
+		double frustumBvh = Benchmark::Measure(rounds, QueryCount, [&]()
+		{
+			fast.clear();
+			bvh.QueryFrustum(frustums[i++ % QueryCount], fast);
+		});
+		double frustumScan = Benchmark::Measure(rounds, QueryCount, [&]()
+		{
+			slow.clear();
+			LinearQuery(items, frustums[i++ % QueryCount], slow);
+		});
+
+		double rayBvh = Benchmark::Measure(rounds, QueryCount, [&]()
+		{
+			BVH::uint32 hitId;
+			float dist;
+			bvh.RayCast(RayOrigin(i++ % QueryCount), rayDir, FLT_MAX, hitId, dist);
+			Benchmark::Consume(dist);
+		});
+		double rayScan = Benchmark::Measure(rounds, QueryCount, [&]()
+		{
+			float dist;
+			LinearRayCast(items, RayOrigin(i++ % QueryCount), rayDir, dist);
+			Benchmark::Consume(dist);
+		});
+
+		double sphereBvh = Benchmark::Measure(rounds, QueryCount, [&]()
+		{
+			fast.clear();
+			bvh.QuerySphere(spheres[i++ % QueryCount], fast);
+		});
+		double sphereScan = Benchmark::Measure(rounds, QueryCount, [&]()
+		{
+			slow.clear();
+			LinearQuery(items, spheres[i++ % QueryCount], slow);
+		});
+
+		std::printf("%8u items, build %.1f ms, %u nodes, %zu frustum and %zu sphere hits per query\n",
+			itemCount, buildTime / 1000.0, bvh.NodeCount(), frustumHits / QueryCount, sphereHits / QueryCount);
+
+		const char* names[] = { "frustum", "ray", "sphere" };
+		double bvhTimes[] = { frustumBvh, rayBvh, sphereBvh };
+		double scanTimes[] = { frustumScan, rayScan, sphereScan };
+		for(int q = 0; q < 3; ++q)
+		{
+			std::printf("    %-8s bvh", names[q]);
+			Benchmark::PrintTime(bvhTimes[q]);
+			std::printf("   scan");
+			Benchmark::PrintTime(scanTimes[q]);
+			std::printf("   %8.1fx\n", scanTimes[q] / bvhTimes[q]);
+		}
+		return true;
+	}
+}
+
+int main()
+{
+	const std::uint32_t itemCounts[] = { 1000, 10000, 100000, 1000000 };
+	for(std::uint32_t count : itemCounts)
+	{
+		if(!Run(count))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,198 @@
+//***************************************************************************************
+// GeometryBenchmark.cpp
+//
+// Times the ring generators at 1000 x 1000, the tessellation the sin/cos tables were
+// written for: each Create* function building MeshData, and the matching Write*
+// function writing 16-bit indices in parts straight into caller memory.  Every mesh
+// is checked before it is timed: its vertices must lie on the surface it describes,
+// with unit normals pointing out of it, and its indices must reach only its vertices.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "GeometryGenerator.h"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+
+using namespace DirectX;
+
+namespace
+{
+	using Gen = GeometryGenerator;
+
+	const float Tolerance = 1.0e-4f;
+
+	// Whether a vertex lies on the shape's surface, with the normal expected there.
+	using SurfaceCheck = std::function<bool(const Gen::Vertex& v)>;
+
+	struct Shape
+	{
+		const char* Name;
+		Gen::MeshSize Size;
+		std::function<Gen::MeshData(Gen& gen)> Create;
+		std::function<void(Gen::Vertex* vertices, std::uint16_t* indices, std::vector<Gen::MeshPart>* parts)> Write;
+		SurfaceCheck OnSurface;
+	};
+
+	bool NearlyEqual(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return std::fabs(a.x - b.x) <= Tolerance && std::fabs(a.y - b.y) <= Tolerance && std::fabs(a.z - b.z) <= Tolerance;
+	}
+
+	bool UnitLength(const XMFLOAT3& n)
+	{
+		return std::fabs(std::sqrt(n.x*n.x + n.y*n.y + n.z*n.z) - 1.0f) <= Tolerance;
+	}
+
+	bool CheckMesh(const Shape& shape, const Gen::MeshData& mesh)
+	{
+		if(!Benchmark::Check(mesh.Vertices.size() == shape.Size.VertexCount &&
+			mesh.Indices32.size() == shape.Size.IndexCount, "mesh size differs from its size function"))
+			return false;
+
+		for(std::uint32_t i : mesh.Indices32)
+		{
+			if(!Benchmark::Check(i < shape.Size.VertexCount, "index past the last vertex"))
+				return false;
+		}
+
+		for(const Gen::Vertex& v : mesh.Vertices)
+		{
+			if(!Benchmark::Check(UnitLength(v.Normal), "normal is not unit length") ||
+				!Benchmark::Check(shape.OnSurface(v), "vertex is off the surface or its normal is wrong"))
+				return false;
+		}
+		return true;
+	}
+
+	// The parts must cover the indices in order, and rebuild the 32-bit ones.
+	bool CheckParts(const Gen::MeshData& mesh, const std::vector<std::uint16_t>& indices,
+		const std::vector<Gen::MeshPart>& parts)
+	{
+		std::uint32_t next = 0;
+		for(const Gen::MeshPart& part : parts)
+		{
+			if(!Benchmark::Check(part.StartIndex == next && part.VertexCount <= Gen::MaxVertices16,
+				"parts do not follow each other"))
+				return false;
+
+			for(std::uint32_t i = part.StartIndex; i < part.StartIndex + part.IndexCount; ++i)
+			{
+				if(!Benchmark::Check(part.BaseVertex + indices[i] == mesh.Indices32[i], "16-bit index differs"))
+					return false;
+			}
+			next += part.IndexCount;
+		}
+		return Benchmark::Check(next == mesh.Indices32.size(), "parts do not cover the mesh");
+	}
+
+	bool Run(const Shape& shape)
+	{
+		Gen gen;
+		Gen::MeshData mesh = shape.Create(gen);
+		if(!CheckMesh(shape, mesh))
+			return false;
+
+		std::vector<Gen::Vertex> vertices(shape.Size.VertexCount);
+		std::vector<std::uint16_t> indices(shape.Size.IndexCount);
+		std::vector<Gen::MeshPart> parts;
+		shape.Write(vertices.data(), indices.data(), &parts);
+		if(!CheckParts(mesh, indices, parts))
+			return false;
+
+		double createTime = Benchmark::Measure(5, 1, [&]()
+		{
+			Gen::MeshData timed = shape.Create(gen);
+			Benchmark::Consume(timed.Vertices.back().Position.x);
+		});
+		double writeTime = Benchmark::Measure(5, 1, [&]()
+		{
+			parts.clear();
+			shape.Write(vertices.data(), indices.data(), &parts);
+			Benchmark::Consume(vertices.back().Position.x);
+		});
+
+		std::printf("%-9s %8u vertices  Create", shape.Name, shape.Size.VertexCount);
+		Benchmark::PrintTime(createTime);
+		std::printf("   Write, 16-bit in %2zu parts", parts.size());
+		Benchmark::PrintTime(writeTime);
+		std::printf("\n");
+		return true;
+	}
+}
+
+int main()
+{
+	const std::uint32_t n = 1000;
+	const float radius = 1.0f, bottomRadius = 1.0f, topRadius = 0.5f, height = 3.0f;
+	const float majorRadius = 2.0f, minorRadius = 0.5f;
+
+	Shape shapes[] =
+	{
+		{
+			"sphere", Gen::SphereSize(n, n),
+			[&](Gen& gen) { return gen.CreateSphere(radius, n, n); },
+			[&](Gen::Vertex* v, std::uint16_t* i, std::vector<Gen::MeshPart>* p)
+				{ Gen::WriteSphere<Gen::FullVertexLayout>(radius, n, n, v, i, p); },
+			[&](const Gen::Vertex& v)
+			{
+				XMFLOAT3 expected(v.Position.x / radius, v.Position.y / radius, v.Position.z / radius);
+				return UnitLength(expected) && NearlyEqual(expected, v.Normal);
+			}
+		},
+		{
+			"cylinder", Gen::CylinderSize(n, n),
+			[&](Gen& gen) { return gen.CreateCylinder(bottomRadius, topRadius, height, n, n); },
+			[&](Gen::Vertex* v, std::uint16_t* i, std::vector<Gen::MeshPart>* p)
+				{ Gen::WriteCylinder<Gen::FullVertexLayout>(bottomRadius, topRadius, height, n, n, v, i, p); },
+			[&](const Gen::Vertex& v)
+			{
+				// Caps face straight up or down; the side leans in as the radius shrinks.
+				if(std::fabs(v.Normal.y) == 1.0f)
+					return std::fabs(std::fabs(v.Position.y) - 0.5f*height) <= Tolerance;
+
+				float r = bottomRadius + (topRadius - bottomRadius) * (v.Position.y / height + 0.5f);
+				float slope = (bottomRadius - topRadius) / height;
+				float len = std::sqrt(1.0f + slope*slope);
+				float d = std::sqrt(v.Position.x*v.Position.x + v.Position.z*v.Position.z);
+				XMFLOAT3 expected(v.Position.x / (d*len), slope / len, v.Position.z / (d*len));
+				return std::fabs(d - r) <= Tolerance && NearlyEqual(expected, v.Normal);
+			}
+		},
+		{
+			"torus", Gen::TorusSize((int)n, (int)n),
+			[&](Gen& gen) { return gen.CreateTorus(majorRadius, minorRadius, (int)n, (int)n); },
+			[&](Gen::Vertex* v, std::uint16_t* i, std::vector<Gen::MeshPart>* p)
+				{ Gen::WriteTorus<Gen::FullVertexLayout>(majorRadius, minorRadius, (int)n, (int)n, v, i, p); },
+			[&](const Gen::Vertex& v)
+			{
+				// The torus lies in the xy plane, around the z axis.
+				float d = std::sqrt(v.Position.x*v.Position.x + v.Position.y*v.Position.y);
+				XMFLOAT3 center(majorRadius * v.Position.x / d, majorRadius * v.Position.y / d, 0.0f);
+				XMFLOAT3 expected((v.Position.x - center.x) / minorRadius, (v.Position.y - center.y) / minorRadius,
+					v.Position.z / minorRadius);
+				return UnitLength(expected) && NearlyEqual(expected, v.Normal);
+			}
+		},
+		{
+			"diamond", Gen::DiamondSize(n, n / 2),
+			[&](Gen& gen) { return gen.CreateDiamond(bottomRadius, height, n, n / 2); },
+			[&](Gen::Vertex* v, std::uint16_t* i, std::vector<Gen::MeshPart>* p)
+				{ Gen::WriteDiamond<Gen::FullVertexLayout>(bottomRadius, height, n, n / 2, v, i, p); },
+			[&](const Gen::Vertex& v)
+			{
+				// The facets' shape is the generator's own, so only check that the normals
+				// point away from the axis.
+				return v.Normal.x*v.Position.x + v.Normal.z*v.Position.z >= -Tolerance;
+			}
+		},
+	};
+
+	for(const Shape& shape : shapes)
+	{
+		if(!Run(shape))
+			return 1;
+	}
+	return 0;
+}
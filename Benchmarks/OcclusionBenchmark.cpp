@@ -0,0 +1,211 @@
+//***************************************************************************************
+// OcclusionBenchmark.cpp
+//
+// Times OcclusionCuller on the labyrinth: the walls are meshed in chunks as the app
+// meshes them and rasterized as occluders, and a box in every cell that passes the
+// frustum test, as in the app, is tested against the depth buffer.  Runs from eye
+// level, looking along the maze from outside it and from cells inside it, at the
+// app's 256 pixel wide buffer and at twice that.
+//
+// Usage: OcclusionBenchmark [generated maze size]...  With no arguments, the
+// hand-made maze and a generated 64 x 64 one are measured.
+//***************************************************************************************
+
+#include "Benchmark.h"
+#include "../Labyrinth.h"
+#include "../MazeMesher.h"
+#include "../OcclusionCuller.h"
+
+#include <cstdlib>
+#include <cstdio>
+#include <thread>
+
+using namespace DirectX;
+
+namespace
+{
+	// As in the app.
+	const std::uint32_t ChunkSize = 8;
+	const float WallThickness = 0.5f;
+	const float EyeHeight = 2.8f;
+	const float AspectRatio = 16.0f / 9.0f;
+
+	const int RenderRepeats = 50;
+
+	// Only positions are rasterized.
+	struct PositionLayout
+	{
+		using VertexType = XMFLOAT3;
+		static const bool Tangents = false;
+
+		static void Set(XMFLOAT3& v, const XMFLOAT3& position, const XMFLOAT3& normal, const XMFLOAT2& texC)
+		{
+			v = position;
+		}
+
+		static void SetTangent(XMFLOAT3& v, const XMFLOAT3& tangentU) {}
+	};
+
+	// Adds the maze's walls to the culler, a mesh and occluder per chunk.  Returns the
+	// triangle count.
+	std::uint32_t AddWalls(const Maze& maze, OcclusionCuller& culler)
+	{
+		MazeMesher mesher(maze, WallThickness, 2.0f);
+		XMFLOAT4X4 identity;
+		XMStoreFloat4x4(&identity, XMMatrixIdentity());
+
+		std::uint32_t triangleCount = 0;
+		std::vector<MazeMesher::Quad> quads;
+		std::vector<XMFLOAT3> positions;
+		std::vector<std::uint16_t> indices;
+		for(std::uint32_t z0 = 0; z0 < maze.Depth(); z0 += ChunkSize)
+		{
+			for(std::uint32_t x0 = 0; x0 < maze.Width(); x0 += ChunkSize)
+			{
+				quads.clear();
+				mesher.BuildQuads(x0, z0, std::min<std::uint32_t>(x0 + ChunkSize, maze.Width()),
+					std::min<std::uint32_t>(z0 + ChunkSize, maze.Depth()), quads);
+
+				positions.resize(MazeMesher::QuadVertexCount * quads.size());
+				indices.resize(MazeMesher::QuadIndexCount * quads.size());
+				mesher.WriteQuads<PositionLayout>(quads, positions.data(), indices.data());
+
+				std::uint32_t mesh = culler.AddMesh(positions.data(), sizeof(XMFLOAT3), (std::uint32_t)positions.size(),
+					indices.data(), (std::uint32_t)indices.size());
+				culler.AddOccluder(mesh, identity);
+				triangleCount += (std::uint32_t)indices.size() / 3;
+			}
+		}
+		return triangleCount;
+	}
+
+	XMFLOAT3 CellCenter(const Maze& maze, std::uint32_t x, std::uint32_t z, float y)
+	{
+		return XMFLOAT3(maze.Origin().x + (x + 0.5f) * maze.CellSize(), y,
+			maze.Origin().y + (z + 0.5f) * maze.CellSize());
+	}
+
+	struct View
+	{
+		XMFLOAT4X4 ViewProj;
+		BoundingFrustum Frustum;
+	};
+
+	// Views looking north along the maze at eye level: one from outside the south edge,
+	// and from cells spread along its diagonal.
+	std::vector<View> MakeViews(const Maze& maze)
+	{
+		XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, AspectRatio, 1.0f, 1000.0f);
+		BoundingFrustum localFrustum;
+		BoundingFrustum::CreateFromMatrix(localFrustum, proj);
+		std::vector<XMFLOAT3> eyes;
+
+		XMFLOAT3 outside = CellCenter(maze, maze.Width() / 2, 0, EyeHeight);
+		outside.z -= 10.0f;
+		eyes.push_back(outside);
+
+		const std::uint32_t insideCount = 8;
+		for(std::uint32_t i = 0; i < insideCount; ++i)
+		{
+			std::uint32_t x = (2*i + 1) * maze.Width() / (2*insideCount);
+			std::uint32_t z = (2*i + 1) * maze.Depth() / (2*insideCount);
+			eyes.push_back(CellCenter(maze, x, z, EyeHeight));
+		}
+
+		std::vector<View> views(eyes.size());
+		for(size_t i = 0; i < eyes.size(); ++i)
+		{
+			XMVECTOR eye = XMLoadFloat3(&eyes[i]);
+			XMMATRIX view = XMMatrixLookAtLH(eye, eye + XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f),
+				XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+			XMStoreFloat4x4(&views[i].ViewProj, XMMatrixMultiply(view, proj));
+			localFrustum.Transform(views[i].Frustum, XMMatrixInverse(nullptr, view));
+		}
+		return views;
+	}
+
+	// An item sized box at eye level in every cell, as the app's props are.
+	std::vector<BoundingBox> MakeBoxes(const Maze& maze)
+	{
+		std::vector<BoundingBox> boxes;
+		for(std::uint32_t z = 0; z < maze.Depth(); ++z)
+		{
+			for(std::uint32_t x = 0; x < maze.Width(); ++x)
+				boxes.push_back(BoundingBox(CellCenter(maze, x, z, EyeHeight), XMFLOAT3(0.3f, 0.3f, 0.3f)));
+		}
+		return boxes;
+	}
+
+	void Run(std::uint32_t generatedSize)
+	{
+		Maze maze;
+		BuildLabyrinthMaze(maze, generatedSize, 1);
+		std::vector<View> views = MakeViews(maze);
+		std::vector<BoundingBox> boxes = MakeBoxes(maze);
+
+		// Only boxes in the frustum reach the occlusion test.
+		std::vector<std::vector<BoundingBox>> viewBoxes(views.size());
+		size_t testedCount = 0;
+		for(size_t i = 0; i < views.size(); ++i)
+		{
+			for(const BoundingBox& box : boxes)
+			{
+				if(views[i].Frustum.Intersects(box))
+					viewBoxes[i].push_back(box);
+			}
+			testedCount += viewBoxes[i].size();
+		}
+
+		for(std::uint32_t width = 256; width <= 512; width *= 2)
+		{
+			OcclusionCuller culler;
+			culler.Resize(width, (std::uint32_t)(width / AspectRatio));
+			std::uint32_t triangleCount = AddWalls(maze, culler);
+
+			double renderTime = 0.0, testTime = 0.0;
+			std::uint64_t drawn = 0, occluded = 0;
+			for(size_t i = 0; i < views.size(); ++i)
+			{
+				renderTime += Benchmark::Measure(3, RenderRepeats, [&]() { culler.Render(views[i].ViewProj); });
+				drawn += culler.TrianglesDrawn();
+
+				std::uint32_t viewOccluded = 0;
+				testTime += Benchmark::Measure(3, RenderRepeats, [&]()
+				{
+					viewOccluded = 0;
+					for(const BoundingBox& box : viewBoxes[i])
+						viewOccluded += culler.IsVisible(box) ? 0 : 1;
+				});
+				occluded += viewOccluded;
+			}
+
+			if(width == 256)
+			{
+				std::printf("%s %ux%u maze, %u wall triangles, %zu views, %zu boxes in the frustum per view\n",
+					generatedSize > 0 ? "generated" : "hand-made", maze.Width(), maze.Depth(), triangleCount,
+					views.size(), testedCount / views.size());
+			}
+			std::printf("    %3ux%-3u render", culler.Width(), culler.Height());
+			Benchmark::PrintTime(renderTime / views.size());
+			std::printf(" (%llu triangles drawn)   box tests", (unsigned long long)(drawn / views.size()));
+			Benchmark::PrintTime(testTime / views.size());
+			std::printf("   %5.1f%% occluded\n", 100.0 * occluded / std::max<size_t>(testedCount, 1));
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::printf("%u hardware threads\n", std::thread::hardware_concurrency());
+
+	if(argc < 2)
+	{
+		Run(0);
+		Run(64);
+		return 0;
+	}
+
+	for(int i = 1; i < argc; ++i)
+		Run((std::uint32_t)std::strtoul(argv[i], nullptr, 10));
+	return 0;
+}
@@ -0,0 +1,203 @@
+//***************************************************************************************
+// DrawStateCache.h
+//
+// Thin wrapper over a graphics command list that remembers the pipeline state, input
+// assembler state and root arguments last set, and drops calls that would set the same
+// thing again.  Draw lists sorted by state get most of their calls removed this way.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class DrawStateCache
+{
+public:
+	DrawStateCache() = default;
+	DrawStateCache(const DrawStateCache& rhs) = delete;
+	DrawStateCache& operator=(const DrawStateCache& rhs) = delete;
+
+	// Starts recording into a freshly reset command list.  initialPSO is the pipeline
+	// state the list was reset with, or nullptr.
+	void Begin(ID3D12GraphicsCommandList* cmdList, ID3D12PipelineState* initialPSO)
+	{
+		mCmdList = cmdList;
+		mPSO = initialPSO;
+		mRootSignature = nullptr;
+		mVertexBuffer = nullptr;
+		mIndexBuffer = nullptr;
+		mTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		InvalidateRootArguments();
+
+		DrawCount = 0;
+		StateChangeCount = 0;
+		SkippedStateChangeCount = 0;
+	}
+
+	void SetPipelineState(ID3D12PipelineState* pso)
+	{
+		if(pso == mPSO)
+		{
+			SkippedStateChangeCount++;
+			return;
+		}
+
+		mCmdList->SetPipelineState(pso);
+		mPSO = pso;
+		StateChangeCount++;
+	}
+
+	void SetGraphicsRootSignature(ID3D12RootSignature* rootSignature)
+	{
+		if(rootSignature == mRootSignature)
+		{
+			SkippedStateChangeCount++;
+			return;
+		}
+
+		// Root arguments do not survive a root signature change.
+		mCmdList->SetGraphicsRootSignature(rootSignature);
+		mRootSignature = rootSignature;
+		InvalidateRootArguments();
+		StateChangeCount++;
+	}
+
+	// Binds the vertex and index buffers of the geometry.  Buffers rather than
+	// geometries are compared, because dynamic geometry swaps its vertex buffer
+	// every frame.
+	void SetGeometry(const MeshGeometry* geo)
+	{
+		if(geo->VertexBufferGPU.Get() != mVertexBuffer)
+		{
+			D3D12_VERTEX_BUFFER_VIEW vbv = geo->VertexBufferView();
+			mCmdList->IASetVertexBuffers(0, 1, &vbv);
+			mVertexBuffer = geo->VertexBufferGPU.Get();
+			StateChangeCount++;
+		}
+		else
+			SkippedStateChangeCount++;
+
+		if(geo->IndexBufferGPU.Get() != mIndexBuffer)
+		{
+			D3D12_INDEX_BUFFER_VIEW ibv = geo->IndexBufferView();
+			mCmdList->IASetIndexBuffer(&ibv);
+			mIndexBuffer = geo->IndexBufferGPU.Get();
+			StateChangeCount++;
+		}
+		else
+			SkippedStateChangeCount++;
+	}
+
+	void SetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+	{
+		if(topology == mTopology)
+		{
+			SkippedStateChangeCount++;
+			return;
+		}
+
+		mCmdList->IASetPrimitiveTopology(topology);
+		mTopology = topology;
+		StateChangeCount++;
+	}
+
+	void SetGraphicsRootDescriptorTable(UINT rootParameterIndex, D3D12_GPU_DESCRIPTOR_HANDLE baseDescriptor)
+	{
+		if(SameRootArgument(rootParameterIndex, baseDescriptor.ptr))
+			return;
+
+		mCmdList->SetGraphicsRootDescriptorTable(rootParameterIndex, baseDescriptor);
+	}
+
+	void SetGraphicsRootConstantBufferView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+	{
+		if(SameRootArgument(rootParameterIndex, bufferLocation))
+			return;
+
+		mCmdList->SetGraphicsRootConstantBufferView(rootParameterIndex, bufferLocation);
+	}
+
+	void SetGraphicsRootShaderResourceView(UINT rootParameterIndex, D3D12_GPU_VIRTUAL_ADDRESS bufferLocation)
+	{
+		if(SameRootArgument(rootParameterIndex, bufferLocation))
+			return;
+
+		mCmdList->SetGraphicsRootShaderResourceView(rootParameterIndex, bufferLocation);
+	}
+
+	// Root constants are compared by value, so they may come from a temporary.
+	void SetGraphicsRoot32BitConstants(UINT rootParameterIndex, UINT num32BitValues, const void* srcData)
+	{
+		assert(rootParameterIndex < MaxRootParameters && num32BitValues <= MaxRootConstants);
+
+		// The argument slot holds the number of constants.
+		UINT* constants = mRootConstants[rootParameterIndex];
+		if(mRootArgumentValid[rootParameterIndex] && mRootArguments[rootParameterIndex] == num32BitValues &&
+			memcmp(constants, srcData, num32BitValues * sizeof(UINT)) == 0)
+		{
+			SkippedStateChangeCount++;
+			return;
+		}
+
+		memcpy(constants, srcData, num32BitValues * sizeof(UINT));
+		mRootArguments[rootParameterIndex] = num32BitValues;
+		mRootArgumentValid[rootParameterIndex] = true;
+		StateChangeCount++;
+
+		mCmdList->SetGraphicsRoot32BitConstants(rootParameterIndex, num32BitValues, srcData, 0);
+	}
+
+	void DrawIndexedInstanced(UINT indexCountPerInstance, UINT instanceCount,
+		UINT startIndexLocation, INT baseVertexLocation, UINT startInstanceLocation)
+	{
+		mCmdList->DrawIndexedInstanced(indexCountPerInstance, instanceCount,
+			startIndexLocation, baseVertexLocation, startInstanceLocation);
+		DrawCount++;
+	}
+
+	ID3D12GraphicsCommandList* CommandList()const { return mCmdList; }
+
+	// Counters for the current recording, reset by Begin().
+	UINT DrawCount = 0;
+	UINT StateChangeCount = 0;
+	UINT SkippedStateChangeCount = 0;
+
+private:
+	static const UINT MaxRootParameters = 16;
+	static const UINT MaxRootConstants = 16;
+
+	void InvalidateRootArguments()
+	{
+		for(UINT i = 0; i < MaxRootParameters; ++i)
+			mRootArgumentValid[i] = false;
+	}
+
+	// Returns true if the root parameter already holds value; otherwise records it.
+	bool SameRootArgument(UINT rootParameterIndex, UINT64 value)
+	{
+		assert(rootParameterIndex < MaxRootParameters);
+
+		if(mRootArgumentValid[rootParameterIndex] && mRootArguments[rootParameterIndex] == value)
+		{
+			SkippedStateChangeCount++;
+			return true;
+		}
+
+		mRootArguments[rootParameterIndex] = value;
+		mRootArgumentValid[rootParameterIndex] = true;
+		StateChangeCount++;
+		return false;
+	}
+
+	ID3D12GraphicsCommandList* mCmdList = nullptr;
+
+	ID3D12PipelineState* mPSO = nullptr;
+	ID3D12RootSignature* mRootSignature = nullptr;
+	ID3D12Resource* mVertexBuffer = nullptr;
+	ID3D12Resource* mIndexBuffer = nullptr;
+	D3D12_PRIMITIVE_TOPOLOGY mTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+
+	UINT64 mRootArguments[MaxRootParameters] = {};
+	bool mRootArgumentValid[MaxRootParameters] = {};
+	UINT mRootConstants[MaxRootParameters][MaxRootConstants] = {};
+};
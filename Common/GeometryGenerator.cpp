@@ -4,274 +4,474 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <cfloat>
 
 using namespace DirectX;
 
-GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
-{
-    MeshData meshData;
-
-    //
-	// Create the vertices.
-	//
-
-	Vertex v[24];
-
-	float w2 = 0.5f*width;
-	float h2 = 0.5f*height;
-	float d2 = 0.5f*depth;
-    
-	// Fill in the front face vertex data.
-	v[0] = Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[1] = Vertex(-w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[2] = Vertex(+w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[3] = Vertex(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the back face vertex data.
-	v[4] = Vertex(-w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[5] = Vertex(+w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[6] = Vertex(+w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[7] = Vertex(-w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the top face vertex data.
-	v[8]  = Vertex(-w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[9]  = Vertex(-w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[10] = Vertex(+w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[11] = Vertex(+w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the bottom face vertex data.
-	v[12] = Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[13] = Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[14] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[15] = Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the left face vertex data.
-	v[16] = Vertex(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[17] = Vertex(-w2, +h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f);
-	v[18] = Vertex(-w2, +h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[19] = Vertex(-w2, -h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-
-	// Fill in the right face vertex data.
-	v[20] = Vertex(+w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f);
-	v[21] = Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
-	v[22] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
-	v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[24]);
- 
-	//
-	// Create the indices.
-	//
+const GeometryGenerator::uint32 GeometryGenerator::MaxSubdivisions;
+const GeometryGenerator::uint32 GeometryGenerator::MaxVertices16;
+const GeometryGenerator::uint32 GeometryGenerator::MaxMeshletVertices;
+const GeometryGenerator::uint32 GeometryGenerator::MaxMeshletTriangles;
 
-	uint32 i[36];
+namespace
+{
+	// Open addressing hash table from an undirected edge, a pair of vertex indices,
+	// to the index of its midpoint.  Sized once for the edges expected, so it never
+	// grows while in use.
+	class EdgeMidpointCache
+	{
+	public:
+		using uint32 = GeometryGenerator::uint32;
+		using uint64 = std::uint64_t;
 
-	// Fill in the front face index data
-	i[0] = 0; i[1] = 1; i[2] = 2;
-	i[3] = 0; i[4] = 2; i[5] = 3;
+		static const uint32 Empty = 0xffffffff;
 
-	// Fill in the back face index data
-	i[6] = 4; i[7]  = 5; i[8]  = 6;
-	i[9] = 4; i[10] = 6; i[11] = 7;
+		explicit EdgeMidpointCache(size_t maxEdges)
+		{
+			// At most half full keeps probe sequences short.
+			size_t capacity = 16;
+			while(capacity < 2*maxEdges)
+				capacity *= 2;
+
+			mKeys.assign(capacity, EmptyKey);
+			mValues.resize(capacity);
+			mMask = capacity - 1;
+		}
 
-	// Fill in the top face index data
-	i[12] = 8; i[13] =  9; i[14] = 10;
-	i[15] = 8; i[16] = 10; i[17] = 11;
+		// The midpoint index stored for edge (a, b), or a new slot holding Empty.
+		uint32& Find(uint32 a, uint32 b)
+		{
+			uint64 key = a < b ? ((uint64)a << 32) | b : ((uint64)b << 32) | a;
+			size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32) & mMask;
+			while(mKeys[slot] != key)
+			{
+				if(mKeys[slot] == EmptyKey)
+				{
+					mKeys[slot] = key;
+					mValues[slot] = Empty;
+					break;
+				}
+				slot = (slot + 1) & mMask;
+			}
+			return mValues[slot];
+		}
 
-	// Fill in the bottom face index data
-	i[18] = 12; i[19] = 13; i[20] = 14;
-	i[21] = 12; i[22] = 14; i[23] = 15;
+	private:
+		// No edge joins a vertex to itself.
+		static const uint64 EmptyKey = ~0ull;
 
-	// Fill in the left face index data
-	i[24] = 16; i[25] = 17; i[26] = 18;
-	i[27] = 16; i[28] = 18; i[29] = 19;
+		std::vector<uint64> mKeys;
+		std::vector<uint32> mValues;
+		size_t mMask = 0;
+	};
 
-	// Fill in the right face index data
-	i[30] = 20; i[31] = 21; i[32] = 22;
-	i[33] = 20; i[34] = 22; i[35] = 23;
+	const GeometryGenerator::uint32 EdgeMidpointCache::Empty;
+	const std::uint64_t EdgeMidpointCache::EmptyKey;
+}
 
-	meshData.Indices32.assign(&i[0], &i[36]);
+GeometryGenerator::SinCosTable::SinCosTable(float step, uint32 count)
+{
+	// Four angles per XMVectorSinCos, into storage rounded up to whole vectors.
+	uint32 padded = (count + 4) & ~3u;
+	Cos.resize(padded);
+	Sin.resize(padded);
 
-    // Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+	XMVECTOR lanes = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+	for(uint32 i = 0; i < padded; i += 4)
+	{
+		// Multiples of the step rather than a running sum, so the angles do not drift.
+		XMVECTOR s, c;
+		XMVectorSinCos(&s, &c, XMVectorScale(XMVectorAdd(lanes, XMVectorReplicate((float)i)), step));
+		XMStoreFloat4((XMFLOAT4*)&Sin[i], s);
+		XMStoreFloat4((XMFLOAT4*)&Cos[i], c);
+	}
 
-    for(uint32 i = 0; i < numSubdivisions; ++i)
-        Subdivide(meshData);
+	Cos.resize(count + 1);
+	Sin.resize(count + 1);
+}
 
-    return meshData;
+GeometryGenerator::SinCosTable GeometryGenerator::SinCosTable::Circle(uint32 count)
+{
+	SinCosTable table(2.0f*XM_PI/count, count);
+	table.Cos[count] = table.Cos[0];
+	table.Sin[count] = table.Sin[0];
+	return table;
 }
 
-GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
+GeometryGenerator::MeshData GeometryGenerator::CreateBox(float width, float height, float depth, uint32 numSubdivisions)
 {
-    MeshData meshData;
+	MeshSize size = BoxSize(numSubdivisions);
 
-	//
-	// Compute the vertices stating at the top pole and moving down the stacks.
-	//
+	MeshData meshData(mArena);
+	meshData.Vertices.resize(size.VertexCount);
+	meshData.Indices32.resize(size.IndexCount);
+	WriteBox<FullVertexLayout>(width, height, depth, numSubdivisions, meshData.Vertices.data(), meshData.Indices32.data());
 
-	// Poles: note that there will be texture coordinate distortion as there is
-	// not a unique point on the texture map to assign to the pole when mapping
-	// a rectangular texture onto a sphere.
-	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+	return meshData;
+}
 
-	meshData.Vertices.push_back( topVertex );
+GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32 sliceCount, uint32 stackCount)
+{
+	MeshSize size = SphereSize(sliceCount, stackCount);
 
-	float phiStep   = XM_PI/stackCount;
-	float thetaStep = 2.0f*XM_PI/sliceCount;
+	MeshData meshData(mArena);
+	meshData.Vertices.resize(size.VertexCount);
+	meshData.Indices32.resize(size.IndexCount);
+	WriteSphere<FullVertexLayout>(radius, sliceCount, stackCount, meshData.Vertices.data(), meshData.Indices32.data());
 
-	// Compute vertices for each stack ring (do not count the poles as rings).
-	for(uint32 i = 1; i <= stackCount-1; ++i)
+	return meshData;
+}
+ 
+void GeometryGenerator::Subdivide(MeshData& meshData)
+{
+	// The input triangles are replaced, but their corners are kept as they are and
+	// the new vertices appended.  A closed mesh of T triangles has 3T/2 edges, so
+	// that is how many midpoints to expect.
+	uint32 numTris = (uint32)meshData.Indices32.size()/3;
+	meshData.Vertices.reserve(meshData.Vertices.size() + (3*(size_t)numTris + 1)/2);
+
+	// Triangle i becomes indices [12i, 12i + 12), so going from the last triangle to
+	// the first, every triangle is read before its indices are overwritten.  The
+	// generators reserve the final size up front, so this does not reallocate.
+	meshData.Indices32.resize(12*(size_t)numTris);
+
+	// Triangles sharing an edge share its midpoint.
+	EdgeMidpointCache cache(3*(size_t)numTris);
+	auto midPoint = [&](uint32 a, uint32 b)
 	{
-		float phi = i*phiStep;
-
-		// Vertices of ring.
-        for(uint32 j = 0; j <= sliceCount; ++j)
+		uint32& index = cache.Find(a, b);
+		if(index == EdgeMidpointCache::Empty)
 		{
-			float theta = j*thetaStep;
-
-			Vertex v;
+			index = (uint32)meshData.Vertices.size();
+			meshData.Vertices.push_back(MidPoint(meshData.Vertices[a], meshData.Vertices[b]));
+		}
+		return index;
+	};
 
-			// spherical to cartesian
-			v.Position.x = radius*sinf(phi)*cosf(theta);
-			v.Position.y = radius*cosf(phi);
-			v.Position.z = radius*sinf(phi)*sinf(theta);
+	//       v1
+	//       *
+	//      / \
+	//     /   \
+	//  m0*-----*m1
+	//   / \   / \
+	//  /   \ /   \
+	// *-----*-----*
+	// v0    m2     v2
 
-			// Partial derivative of P with respect to theta
-			v.TangentU.x = -radius*sinf(phi)*sinf(theta);
-			v.TangentU.y = 0.0f;
-			v.TangentU.z = +radius*sinf(phi)*cosf(theta);
+	for(uint32 i = numTris; i-- > 0; )
+	{
+		uint32 v0 = meshData.Indices32[i*3+0];
+		uint32 v1 = meshData.Indices32[i*3+1];
+		uint32 v2 = meshData.Indices32[i*3+2];
 
-			XMVECTOR T = XMLoadFloat3(&v.TangentU);
-			XMStoreFloat3(&v.TangentU, XMVector3Normalize(T));
+		//
+		// Generate the midpoints.
+		//
 
-			XMVECTOR p = XMLoadFloat3(&v.Position);
-			XMStoreFloat3(&v.Normal, XMVector3Normalize(p));
+		uint32 m0 = midPoint(v0, v1);
+		uint32 m1 = midPoint(v1, v2);
+		uint32 m2 = midPoint(v0, v2);
 
-			v.TexC.x = theta / XM_2PI;
-			v.TexC.y = phi / XM_PI;
+		//
+		// Add new geometry.
+		//
 
-			meshData.Vertices.push_back( v );
-		}
+		uint32* tris = &meshData.Indices32[i*12];
+		tris[0] = v0; tris[1] = m0;  tris[2] = m2;
+		tris[3] = m0; tris[4] = m1;  tris[5] = m2;
+		tris[6] = m2; tris[7] = m1;  tris[8] = v2;
+		tris[9] = m0; tris[10] = v1; tris[11] = m1;
 	}
+}
+
+namespace
+{
+	using Meshlet = GeometryGenerator::Meshlet;
+	using uint32 = GeometryGenerator::uint32;
 
-	meshData.Vertices.push_back( bottomVertex );
+	// When no neighbor of a meshlet fits, this many triangles from the first one left
+	// are searched for the nearest that faces within about 45 degrees of it.
+	const uint32 MeshletSearchWindow = 64;
+	const float MeshletJoinCos = 0.7f;
 
-	//
-	// Compute indices for top stack.  The top stack was written first to the vertex buffer
-	// and connects the top pole to the first ring.
-	//
+	// Normals spread wider than this from the cone axis leave too few viewpoints to
+	// cull from to be worth testing.
+	const float MeshletMinConeCos = 0.1f;
 
-    for(uint32 i = 1; i <= sliceCount; ++i)
+	// Unit normal, in the winding's front direction, and centroid of a triangle.  A
+	// degenerate triangle's normal is zero.
+	struct MeshletTriangle
 	{
-		meshData.Indices32.push_back(0);
-		meshData.Indices32.push_back(i+1);
-		meshData.Indices32.push_back(i);
-	}
-	
-	//
-	// Compute indices for inner stacks (not connected to poles).
-	//
-
-	// Offset the indices to the index of the first vertex in the first ring.
-	// This is just skipping the top pole vertex.
-    uint32 baseIndex = 1;
-    uint32 ringVertexCount = sliceCount + 1;
-	for(uint32 i = 0; i < stackCount-2; ++i)
+		XMFLOAT3 Normal;
+		XMFLOAT3 Centroid;
+	};
+
+	// Positions stride bytes apart.
+	struct PositionReader
 	{
-		for(uint32 j = 0; j < sliceCount; ++j)
+		const char* Bytes;
+		uint32 Stride;
+
+		XMVECTOR operator()(uint32 v)const
 		{
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
+			return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(Bytes + (size_t)v*Stride));
+		}
+	};
 
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back(baseIndex + i*ringVertexCount + j+1);
-			meshData.Indices32.push_back(baseIndex + (i+1)*ringVertexCount + j+1);
+	// The sphere about the meshlet's vertices' bounding box, and the cone of its
+	// triangles' normals.
+	template<typename Index>
+	void ComputeMeshletBounds(Meshlet& m, const Index* indices, const uint32* vertices,
+		const std::vector<MeshletTriangle>& triangles, const uint32* triangleIds, const PositionReader& position)
+	{
+		XMVECTOR vMin = position(vertices[0]);
+		XMVECTOR vMax = vMin;
+		for(uint32 i = 1; i < m.VertexCount; ++i)
+		{
+			vMin = XMVectorMin(vMin, position(vertices[i]));
+			vMax = XMVectorMax(vMax, position(vertices[i]));
 		}
-	}
 
-	//
-	// Compute indices for bottom stack.  The bottom stack was written last to the vertex buffer
-	// and connects the bottom pole to the bottom ring.
-	//
+		XMVECTOR center = 0.5f*(vMin + vMax);
+		float radius = 0.0f;
+		for(uint32 i = 0; i < m.VertexCount; ++i)
+			radius = std::max<float>(radius, XMVectorGetX(XMVector3Length(position(vertices[i]) - center)));
 
-	// South pole vertex was added last.
-	uint32 southPoleIndex = (uint32)meshData.Vertices.size()-1;
+		XMStoreFloat3(&m.Center, center);
+		m.Radius = radius;
 
-	// Offset the indices to the index of the first vertex in the last ring.
-	baseIndex = southPoleIndex - ringVertexCount;
-	
-	for(uint32 i = 0; i < sliceCount; ++i)
-	{
-		meshData.Indices32.push_back(southPoleIndex);
-		meshData.Indices32.push_back(baseIndex+i);
-		meshData.Indices32.push_back(baseIndex+i+1);
-	}
+		uint32 triangleCount = m.IndexCount / 3;
+		XMVECTOR normalSum = XMVectorZero();
+		for(uint32 i = 0; i < triangleCount; ++i)
+			normalSum += XMLoadFloat3(&triangles[triangleIds[i]].Normal);
 
-    return meshData;
-}
- 
-void GeometryGenerator::Subdivide(MeshData& meshData)
-{
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
+		float length = XMVectorGetX(XMVector3Length(normalSum));
+		if(length <= 0.0f)
+			return;
+		XMVECTOR axis = normalSum / length;
 
+		float minDot = 1.0f;
+		for(uint32 i = 0; i < triangleCount; ++i)
+		{
+			XMVECTOR n = XMLoadFloat3(&triangles[triangleIds[i]].Normal);
+			if(XMVectorGetX(XMVector3Dot(n, n)) > 0.0f)
+				minDot = std::min<float>(minDot, XMVectorGetX(XMVector3Dot(n, axis)));
+		}
+		if(minDot <= MeshletMinConeCos)
+			return;
+
+		// Back the apex off along the axis until it is behind every triangle's plane.
+		// From a point behind it within 90 degrees less the cone's spread of the axis,
+		// each plane is then seen from behind.
+		float apexDistance = 0.0f;
+		for(uint32 i = 0; i < triangleCount; ++i)
+		{
+			XMVECTOR n = XMLoadFloat3(&triangles[triangleIds[i]].Normal);
+			float along = XMVectorGetX(XMVector3Dot(n, axis));
+			if(along <= 0.0f)
+				continue;
 
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
+			XMVECTOR p0 = position(indices[3*triangleIds[i]]);
+			apexDistance = std::max<float>(apexDistance, XMVectorGetX(XMVector3Dot(center - p0, n)) / along);
+		}
 
-	//       v1
-	//       *
-	//      / \
-	//     /   \
-	//  m0*-----*m1
-	//   / \   / \
-	//  /   \ /   \
-	// *-----*-----*
-	// v0    m2     v2
+		XMStoreFloat3(&m.ConeApex, center - apexDistance*axis);
+		XMStoreFloat3(&m.ConeAxis, axis);
+		m.ConeCutoff = sqrtf(1.0f - minDot*minDot);
+	}
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
-	for(uint32 i = 0; i < numTris; ++i)
+	template<typename Index>
+	void BuildMeshletsFromIndices(Index* indices, uint32 indexCount, const XMFLOAT3* positions,
+		uint32 vertexCount, uint32 stride, std::vector<Meshlet>& meshlets)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
+		const uint32 maxVertices = GeometryGenerator::MaxMeshletVertices;
+		const uint32 maxTriangles = GeometryGenerator::MaxMeshletTriangles;
+		const uint32 None = ~0u;
 
-		//
-		// Generate the midpoints.
-		//
+		uint32 triangleCount = indexCount / 3;
+		if(triangleCount == 0)
+			return;
 
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
+		PositionReader position = { reinterpret_cast<const char*>(positions), stride };
 
-		//
-		// Add new geometry.
-		//
+		std::vector<MeshletTriangle> triangles(triangleCount);
+		for(uint32 t = 0; t < triangleCount; ++t)
+		{
+			XMVECTOR p0 = position(indices[3*t + 0]);
+			XMVECTOR p1 = position(indices[3*t + 1]);
+			XMVECTOR p2 = position(indices[3*t + 2]);
+
+			XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+			float length = XMVectorGetX(XMVector3Length(n));
+			XMStoreFloat3(&triangles[t].Normal, length > 0.0f ? n / length : XMVectorZero());
+			XMStoreFloat3(&triangles[t].Centroid, (p0 + p1 + p2) / 3.0f);
+		}
 
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+		// The triangles using each vertex.
+		std::vector<uint32> firstTriangle(vertexCount + 1, 0);
+		for(uint32 i = 0; i < 3*triangleCount; ++i)
+			firstTriangle[indices[i] + 1]++;
+		for(uint32 v = 0; v < vertexCount; ++v)
+			firstTriangle[v + 1] += firstTriangle[v];
+
+		std::vector<uint32> vertexTriangles(3*triangleCount);
+		std::vector<uint32> fill(firstTriangle.begin(), firstTriangle.end() - 1);
+		for(uint32 i = 0; i < 3*triangleCount; ++i)
+			vertexTriangles[fill[indices[i]]++] = i / 3;
+
+		// Meshlet number each vertex was last added to and each triangle was last made
+		// a candidate of, so neither needs clearing between meshlets.
+		std::vector<uint32> vertexMeshlet(vertexCount, None);
+		std::vector<uint32> candidateMeshlet(triangleCount, None);
+		std::vector<std::uint8_t> emitted(triangleCount, 0);
+
+		std::vector<uint32> order;
+		order.reserve(triangleCount);
+		std::vector<uint32> candidates;
+		uint32 meshletVertices[maxVertices];
+
+		uint32 firstLeft = 0;
+		while(order.size() < triangleCount)
+		{
+			uint32 id = (uint32)meshlets.size();
+			Meshlet m;
+			m.StartIndex = (uint32)order.size() * 3;
+
+			XMVECTOR normalSum = XMVectorZero();
+			XMVECTOR centroidSum = XMVectorZero();
+			candidates.clear();
+
+			while(emitted[firstLeft])
+				++firstLeft;
+
+			for(uint32 next = firstLeft; next != None; )
+			{
+				emitted[next] = 1;
+				order.push_back(next);
+				m.IndexCount += 3;
+				normalSum += XMLoadFloat3(&triangles[next].Normal);
+				centroidSum += XMLoadFloat3(&triangles[next].Centroid);
+
+				for(uint32 k = 0; k < 3; ++k)
+				{
+					uint32 v = indices[3*next + k];
+					if(vertexMeshlet[v] == id)
+						continue;
+
+					vertexMeshlet[v] = id;
+					meshletVertices[m.VertexCount++] = v;
+					for(uint32 i = firstTriangle[v]; i < firstTriangle[v + 1]; ++i)
+					{
+						uint32 t = vertexTriangles[i];
+						if(!emitted[t] && candidateMeshlet[t] != id)
+						{
+							candidateMeshlet[t] = id;
+							candidates.push_back(t);
+						}
+					}
+				}
+
+				if(m.IndexCount / 3 == maxTriangles)
+					break;
+
+				float normalLength = XMVectorGetX(XMVector3Length(normalSum));
+				XMVECTOR axis = normalLength > 0.0f ? normalSum / normalLength : XMVectorZero();
+
+				auto newVertices = [&](uint32 t)
+				{
+					uint32 count = 0;
+					for(uint32 k = 0; k < 3; ++k)
+						count += vertexMeshlet[indices[3*t + k]] != id;
+					return count;
+				};
+
+				// Fewest new vertices first; a vertex fewer is worth up to 60 degrees of
+				// bend in the normals.
+				next = None;
+				float bestScore = FLT_MAX;
+				size_t kept = 0;
+				for(uint32 t : candidates)
+				{
+					if(emitted[t])
+						continue;
+					candidates[kept++] = t;
+
+					uint32 added = newVertices(t);
+					if(m.VertexCount + added > maxVertices)
+						continue;
+
+					float bend = 1.0f - XMVectorGetX(XMVector3Dot(XMLoadFloat3(&triangles[t].Normal), axis));
+					float score = added + bend;
+					if(score < bestScore)
+					{
+						bestScore = score;
+						next = t;
+					}
+				}
+				candidates.resize(kept);
+
+				if(next != None)
+					continue;
+
+				// No neighbor fits: take the nearest triangle facing the same way from the
+				// next ones in order, or end the meshlet.
+				XMVECTOR centroid = centroidSum / (float)(m.IndexCount / 3);
+				float bestDistance = FLT_MAX;
+				uint32 end = std::min<uint32>(firstLeft + MeshletSearchWindow, triangleCount);
+				for(uint32 t = firstLeft; t < end; ++t)
+				{
+					if(emitted[t] || m.VertexCount + newVertices(t) > maxVertices)
+						continue;
+
+					XMVECTOR n = XMLoadFloat3(&triangles[t].Normal);
+					if(normalLength > 0.0f && XMVectorGetX(XMVector3Dot(n, axis)) < MeshletJoinCos)
+						continue;
+
+					float distance = XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&triangles[t].Centroid) - centroid));
+					if(distance < bestDistance)
+					{
+						bestDistance = distance;
+						next = t;
+					}
+				}
+			}
+
+			// The indices are still in the original order; they are moved once every
+			// triangle has its place.
+			ComputeMeshletBounds(m, indices, meshletVertices, triangles, &order[m.StartIndex / 3], position);
+			meshlets.push_back(m);
+		}
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+		std::vector<Index> original(indices, indices + 3*triangleCount);
+		for(uint32 i = 0; i < triangleCount; ++i)
+		{
+			for(uint32 k = 0; k < 3; ++k)
+				indices[3*i + k] = original[3*order[i] + k];
+		}
+	}
+}
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+void GeometryGenerator::BuildMeshlets(uint16* indices, uint32 indexCount, const XMFLOAT3* positions,
+	uint32 vertexCount, uint32 stride, std::vector<Meshlet>& meshlets)
+{
+	BuildMeshletsFromIndices(indices, indexCount, positions, vertexCount, stride, meshlets);
+}
+
+void GeometryGenerator::BuildMeshlets(uint32* indices, uint32 indexCount, const XMFLOAT3* positions,
+	uint32 vertexCount, uint32 stride, std::vector<Meshlet>& meshlets)
+{
+	BuildMeshletsFromIndices(indices, indexCount, positions, vertexCount, stride, meshlets);
+}
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+std::vector<GeometryGenerator::Meshlet> GeometryGenerator::BuildMeshlets(MeshData& mesh)
+{
+	std::vector<Meshlet> meshlets;
+	if(!mesh.Vertices.empty())
+	{
+		BuildMeshlets(mesh.Indices32.data(), (uint32)mesh.Indices32.size(), &mesh.Vertices[0].Position,
+			(uint32)mesh.Vertices.size(), sizeof(Vertex), meshlets);
 	}
+	return meshlets;
 }
 
 GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Vertex& v1)
@@ -306,10 +506,11 @@ GeometryGenerator::Vertex GeometryGenerator::MidPoint(const Vertex& v0, const Ve
 
 GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uint32 numSubdivisions)
 {
-    MeshData meshData;
+    MeshData meshData(mArena);
+    meshData.Reserve(GeosphereSize(numSubdivisions));
 
 	// Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
+    numSubdivisions = std::min<uint32>(numSubdivisions, MaxSubdivisions);
 
 	// Approximate a sphere by tessellating an icosahedron.
 
@@ -381,171 +582,14 @@ GeometryGenerator::MeshData GeometryGenerator::CreateGeosphere(float radius, uin
 
 GeometryGenerator::MeshData GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
-    MeshData meshData;
-
-	//
-	// Build Stacks.
-	// 
-
-	float stackHeight = height / stackCount;
-
-	// Amount to increment radius as we move up each stack level from bottom to top.
-	float radiusStep = (topRadius - bottomRadius) / stackCount;
-
-	uint32 ringCount = stackCount+1;
-
-	// Compute vertices for each stack ring starting at the bottom and moving up.
-	for(uint32 i = 0; i < ringCount; ++i)
-	{
-		float y = -0.5f*height + i*stackHeight;
-		float r = bottomRadius + i*radiusStep;
-
-		// vertices of ring
-		float dTheta = 2.0f*XM_PI/sliceCount;
-		for(uint32 j = 0; j <= sliceCount; ++j)
-		{
-			Vertex vertex;
-
-			float c = cosf(j*dTheta);
-			float s = sinf(j*dTheta);
-
-			vertex.Position = XMFLOAT3(r*c, y, r*s);
-
-			vertex.TexC.x = (float)j/sliceCount;
-			vertex.TexC.y = 1.0f - (float)i/stackCount;
-
-			// Cylinder can be parameterized as follows, where we introduce v
-			// parameter that goes in the same direction as the v tex-coord
-			// so that the bitangent goes in the same direction as the v tex-coord.
-			//   Let r0 be the bottom radius and let r1 be the top radius.
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(t, v) = r(v)*cos(t)
-			//   y(t, v) = h - hv
-			//   z(t, v) = r(v)*sin(t)
-			// 
-			//  dx/dt = -r(v)*sin(t)
-			//  dy/dt = 0
-			//  dz/dt = +r(v)*cos(t)
-			//
-			//  dx/dv = (r0-r1)*cos(t)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(t)
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = bottomRadius-topRadius;
-			XMFLOAT3 bitangent(dr*c, -height, dr*s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
-	}
-
-	// Add one because we duplicate the first and last vertex per ring
-	// since the texture coordinates are different.
-	uint32 ringVertexCount = sliceCount+1;
-
-	// Compute indices for each stack.
-	for(uint32 i = 0; i < stackCount; ++i)
-	{
-		for(uint32 j = 0; j < sliceCount; ++j)
-		{
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-
-			meshData.Indices32.push_back(i*ringVertexCount + j);
-			meshData.Indices32.push_back((i+1)*ringVertexCount + j+1);
-			meshData.Indices32.push_back(i*ringVertexCount + j+1);
-		}
-	}
-
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-
-    return meshData;
-}
-
-void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-											uint32 sliceCount, uint32 stackCount, MeshData& meshData)
-{
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
-
-	float y = 0.5f*height;
-	float dTheta = 2.0f*XM_PI/sliceCount;
-
-	// Duplicate cap ring vertices because the texture coordinates and normals differ.
-	for(uint32 i = 0; i <= sliceCount; ++i)
-	{
-		float x = topRadius*cosf(i*dTheta);
-		float z = topRadius*sinf(i*dTheta);
-
-		// Scale down by the height to try and make top cap texture coord area
-		// proportional to base.
-		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
-
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
-	}
-
-	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
-
-	// Index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
-
-	for(uint32 i = 0; i < sliceCount; ++i)
-	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i+1);
-		meshData.Indices32.push_back(baseIndex + i);
-	}
-}
-
-void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-											   uint32 sliceCount, uint32 stackCount, MeshData& meshData)
-{
-	// 
-	// Build bottom cap.
-	//
+	MeshSize size = CylinderSize(sliceCount, stackCount);
 
-	uint32 baseIndex = (uint32)meshData.Vertices.size();
-	float y = -0.5f*height;
+	MeshData meshData(mArena);
+	meshData.Vertices.resize(size.VertexCount);
+	meshData.Indices32.resize(size.IndexCount);
+	WriteCylinder<FullVertexLayout>(bottomRadius, topRadius, height, sliceCount, stackCount, meshData.Vertices.data(), meshData.Indices32.data());
 
-	// vertices of ring
-	float dTheta = 2.0f*XM_PI/sliceCount;
-	for(uint32 i = 0; i <= sliceCount; ++i)
-	{
-		float x = bottomRadius*cosf(i*dTheta);
-		float z = bottomRadius*sinf(i*dTheta);
-
-		// Scale down by the height to try and make top cap texture coord area
-		// proportional to base.
-		float u = x/height + 0.5f;
-		float v = z/height + 0.5f;
-
-		meshData.Vertices.push_back( Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v) );
-	}
-
-	// Cap center vertex.
-	meshData.Vertices.push_back( Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f) );
-
-	// Cache the index of center vertex.
-	uint32 centerIndex = (uint32)meshData.Vertices.size()-1;
-
-	for(uint32 i = 0; i < sliceCount; ++i)
-	{
-		meshData.Indices32.push_back(centerIndex);
-		meshData.Indices32.push_back(baseIndex + i);
-		meshData.Indices32.push_back(baseIndex + i+1);
-	}
+	return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateCone(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount) {
@@ -554,72 +598,19 @@ GeometryGenerator::MeshData GeometryGenerator::CreateCone(float bottomRadius, fl
 
 GeometryGenerator::MeshData GeometryGenerator::CreateGrid(float width, float depth, uint32 m, uint32 n)
 {
-    MeshData meshData;
-
-	uint32 vertexCount = m*n;
-	uint32 faceCount   = (m-1)*(n-1)*2;
-
-	//
-	// Create the vertices.
-	//
-
-	float halfWidth = 0.5f*width;
-	float halfDepth = 0.5f*depth;
-
-	float dx = width / (n-1);
-	float dz = depth / (m-1);
-
-	float du = 1.0f / (n-1);
-	float dv = 1.0f / (m-1);
-
-	meshData.Vertices.resize(vertexCount);
-	for(uint32 i = 0; i < m; ++i)
-	{
-		float z = halfDepth - i*dz;
-		for(uint32 j = 0; j < n; ++j)
-		{
-			float x = -halfWidth + j*dx;
-
-			meshData.Vertices[i*n+j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i*n+j].Normal   = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i*n+j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
-
-			// Stretch texture over grid.
-			meshData.Vertices[i*n+j].TexC.x = j*du;
-			meshData.Vertices[i*n+j].TexC.y = i*dv;
-		}
-	}
- 
-    //
-	// Create the indices.
-	//
+	MeshSize size = GridSize(m, n);
 
-	meshData.Indices32.resize(faceCount*3); // 3 indices per face
+	MeshData meshData(mArena);
+	meshData.Vertices.resize(size.VertexCount);
+	meshData.Indices32.resize(size.IndexCount);
+	WriteGrid<FullVertexLayout>(width, depth, m, n, meshData.Vertices.data(), meshData.Indices32.data());
 
-	// Iterate over each quad and compute indices.
-	uint32 k = 0;
-	for(uint32 i = 0; i < m-1; ++i)
-	{
-		for(uint32 j = 0; j < n-1; ++j)
-		{
-			meshData.Indices32[k]   = i*n+j;
-			meshData.Indices32[k+1] = i*n+j+1;
-			meshData.Indices32[k+2] = (i+1)*n+j;
-
-			meshData.Indices32[k+3] = (i+1)*n+j;
-			meshData.Indices32[k+4] = i*n+j+1;
-			meshData.Indices32[k+5] = (i+1)*n+j+1;
-
-			k += 6; // next quad
-		}
-	}
-
-    return meshData;
+	return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, float w, float h, float depth)
 {
-    MeshData meshData;
+    MeshData meshData(mArena);
 
 	meshData.Vertices.resize(4);
 	meshData.Indices32.resize(6);
@@ -663,85 +654,14 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
 
 GeometryGenerator::MeshData GeometryGenerator::CreateWedge(float width, float height, float depth, uint32 numSubdivisions)
 {
-    MeshData meshData;
-
-    //
-	// Create the vertices.
-	//
-
-	Vertex v[18];
-
-	float w2 = 0.5f*width;
-	float h2 = 0.5f*height;
-	float d2 = 0.5f*depth;
-
-	float frontFaceSideLength = sqrt(pow((float)height, 2) + pow((float)depth,2));
-	float sinTheta = height / frontFaceSideLength;
-	float cosTheta = height / frontFaceSideLength; 
-    
-	// Fill in the bottom face vertex data.
-	v[0] = Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[1] = Vertex(-w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[2] = Vertex(+w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[3] = Vertex(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the top face vertex data.
-	v[4]  = Vertex(-w2, +h2, -d2, 0.0f, sinTheta, cosTheta, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[5]  = Vertex(-w2, -h2, +d2, 0.0f, sinTheta, cosTheta, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[6] = Vertex(+w2, -h2, +d2, 0.0f, sinTheta, cosTheta, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-	v[7] = Vertex(+w2, +h2, -d2, 0.0f, sinTheta, cosTheta, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-
-	// Fill in the back face vertex data.
-	v[8] = Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f);
-	v[9] = Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
-	v[10] = Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
-	v[11] = Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f);
-
-	// Fill in the left face vertex data.
-	v[12] = Vertex(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f);
-	v[13] = Vertex(-w2, +h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f);
-	v[14] = Vertex(-w2, -h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
-
-	// Fill in the right face vertex data.
-	v[15] = Vertex(+w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f);
-	v[16] = Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f);
-	v[17] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
-
-	meshData.Vertices.assign(&v[0], &v[18]);
- 
-	//
-	// Create the indices.
-	//
-
-	uint32 i[24];
-
-	// Fill in the bottom face index data
-	i[0] = 0; i[1] = 1; i[2] = 2;
-	i[3] = 0; i[4] = 2; i[5] = 3;
-
-	// Fill in the top face index data
-	i[6] = 4; i[7] =  5; i[8] = 6;
-	i[9] = 4; i[10] = 6; i[11] = 7;
-
-	// Fill in the back face index data
-	i[12] = 8; i[13] = 9; i[14] = 10;
-	i[15] = 8; i[16] = 10; i[17] = 11;
-
-	// Fill in the left face index data
-	i[18] = 12; i[19] = 13; i[20] = 14;
+	MeshSize size = WedgeSize(numSubdivisions);
 
-	// Fill in the right face index data
-	i[21] = 15; i[22] = 16; i[23] = 17;
+	MeshData meshData(mArena);
+	meshData.Vertices.resize(size.VertexCount);
+	meshData.Indices32.resize(size.IndexCount);
+	WriteWedge<FullVertexLayout>(width, height, depth, numSubdivisions, meshData.Vertices.data(), meshData.Indices32.data());
 
-	meshData.Indices32.assign(&i[0], &i[24]);
-
-    // Put a cap on the number of subdivisions.
-    numSubdivisions = std::min<uint32>(numSubdivisions, 6u);
-
-    for(uint32 i = 0; i < numSubdivisions; ++i)
-        Subdivide(meshData);
-
-    return meshData;
+	return meshData;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreatePyramid(float bottomWidth, float topWidth, float height, uint32 stackCount) {
@@ -760,213 +680,104 @@ GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float width
 
 GeometryGenerator::MeshData GeometryGenerator::CreateDiamond(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount)
 {
-	MeshData meshData;
-
-	//
-	// Build Stacks.
-	// 
-
-	float stackHeight = 0.5f * height / stackCount;
-
-	// Amount to increment radius as we move up each stack level from bottom to top.
-	float radiusStep = bottomRadius / stackCount;
-
-	uint32 ringCount = stackCount + 1;
-
-	// Compute vertices for each stack ring starting at the bottom and moving up.
-	for (uint32 i = 0; i < ringCount; ++i)
-	{
-		float y = -0.5f * height + i * stackHeight;
-		float r = i * radiusStep;
-
-		// vertices of ring
-		float dTheta = 2.0f * XM_PI / sliceCount;
-		for (uint32 j = 0; j <= sliceCount; ++j)
-		{
-			Vertex vertex;
-
-			float c = cosf(j * dTheta);
-			float s = sinf(j * dTheta);
-
-			vertex.Position = XMFLOAT3(r * c, y, r * s);
-
-			vertex.TexC.x = (float)j / sliceCount;
-			vertex.TexC.y = 1.0f - (float)i / stackCount;
-
-			// Cylinder can be parameterized as follows, where we introduce v
-			// parameter that goes in the same direction as the v tex-coord
-			// so that the bitangent goes in the same direction as the v tex-coord.
-			//   Let r0 be the bottom radius and let r1 be the top radius.
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(t, v) = r(v)*cos(t)
-			//   y(t, v) = h - hv
-			//   z(t, v) = r(v)*sin(t)
-			// 
-			//  dx/dt = -r(v)*sin(t)
-			//  dy/dt = 0
-			//  dz/dt = +r(v)*cos(t)
-			//
-			//  dx/dv = (r0-r1)*cos(t)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(t)
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = bottomRadius;
-			XMFLOAT3 bitangent(dr * c, -height, dr * s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
-	}
+	MeshSize size = DiamondSize(sliceCount, stackCount);
 
-	stackHeight = 0.5f * height / stackCount;
-	radiusStep = -bottomRadius / stackCount;
-
-	for (uint32 i = 0; i < ringCount; ++i)
-	{
-		float y = i * stackHeight;
-		float r = bottomRadius + i * radiusStep;
-
-		// vertices of ring
-		float dTheta = 2.0f * XM_PI / sliceCount;
-		for (uint32 j = 0; j <= sliceCount; ++j)
-		{
-			Vertex vertex;
-
-			float c = cosf(j * dTheta);
-			float s = sinf(j * dTheta);
-
-			vertex.Position = XMFLOAT3(r * c, y, r * s);
-
-			vertex.TexC.x = (float)j / sliceCount;
-			vertex.TexC.y = 1.0f - (float)i / stackCount;
-
-			// Cylinder can be parameterized as follows, where we introduce v
-			// parameter that goes in the same direction as the v tex-coord
-			// so that the bitangent goes in the same direction as the v tex-coord.
-			//   Let r0 be the bottom radius and let r1 be the top radius.
-			//   y(v) = h - hv for v in [0,1].
-			//   r(v) = r1 + (r0-r1)v
-			//
-			//   x(t, v) = r(v)*cos(t)
-			//   y(t, v) = h - hv
-			//   z(t, v) = r(v)*sin(t)
-			// 
-			//  dx/dt = -r(v)*sin(t)
-			//  dy/dt = 0
-			//  dz/dt = +r(v)*cos(t)
-			//
-			//  dx/dv = (r0-r1)*cos(t)
-			//  dy/dv = -h
-			//  dz/dv = (r0-r1)*sin(t)
-
-			// This is unit length.
-			vertex.TangentU = XMFLOAT3(-s, 0.0f, c);
-
-			float dr = -bottomRadius;
-			XMFLOAT3 bitangent(dr * c, -height, dr * s);
-
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			XMStoreFloat3(&vertex.Normal, N);
-
-			meshData.Vertices.push_back(vertex);
-		}
-	}
-
-	// Add one because we duplicate the first and last vertex per ring
-	// since the texture coordinates are different.
-	uint32 ringVertexCount = sliceCount + 1;
-
-	// Compute indices for each stack.
-	for (uint32 i = 0; i < stackCount * 2 + 1; ++i)
-	{
-		for (uint32 j = 0; j < sliceCount; ++j)
-		{
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
-
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
-			meshData.Indices32.push_back(i * ringVertexCount + j + 1);
-		}
-	}
-
-	BuildCylinderTopCap(0.0f, 0.0f, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(0.0f, 0.0f, height, sliceCount, stackCount, meshData);
+	MeshData meshData(mArena);
+	meshData.Vertices.resize(size.VertexCount);
+	meshData.Indices32.resize(size.IndexCount);
+	WriteDiamond<FullVertexLayout>(bottomRadius, height, sliceCount, stackCount, meshData.Vertices.data(), meshData.Indices32.data());
 
 	return meshData;
 }
 
 
-GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float majorRadius, float minorRadius, int numMajor, int numMinor) {
-
-	MeshData meshData;
-
-	double majorStep = 2 * XM_PI / numMajor;
-	double minorStep = 2 * XM_PI / numMinor;
-	int i, j;
-
-	for (i = 0; i <= numMajor; i++)
-	{
-		double a0 = i * majorStep;
-		float c0 = cosf(a0);
-		float s0 = sinf(a0);
+GeometryGenerator::MeshData GeometryGenerator::CreateTorus(float majorRadius, float minorRadius, int numMajor, int numMinor)
+{
+	MeshSize size = TorusSize(numMajor, numMinor);
 
-		for (j = 0; j <= numMinor; j++)
-		{
-			Vertex vertex;
-			double b = j * minorStep;
-			float c1 = cosf(b);
-			float s1 = sinf(b);
-			float r = minorRadius * c1 + majorRadius;
-			float z = minorRadius * s1;
+	MeshData meshData(mArena);
+	meshData.Vertices.resize(size.VertexCount);
+	meshData.Indices32.resize(size.IndexCount);
+	WriteTorus<FullVertexLayout>(majorRadius, minorRadius, numMajor, numMinor, meshData.Vertices.data(), meshData.Indices32.data());
 
-			vertex.TexC.x = (float)i / (float)(numMajor);
-			vertex.TexC.y = (float)(j) / (float)(numMinor);
+	return meshData;
+}
 
-			vertex.TangentU = XMFLOAT3(-s0, c0, 0.0f);
+GeometryGenerator::MeshSize GeometryGenerator::BoxSize(uint32 numSubdivisions)
+{
+	// Each face is a quad; subdividing it n times makes a (2^n + 1)^2 vertex grid.
+	uint32 edge = (1u << std::min<uint32>(numSubdivisions, MaxSubdivisions)) + 1;
+	uint32 quads = (edge - 1)*(edge - 1);
+
+	MeshSize size;
+	size.VertexCount = 6*edge*edge;
+	size.IndexCount = 6*quads*6;
+	return size;
+}
 
-			XMFLOAT3 bitangent(-c0 * s1, -s0 * s1, c1);
+GeometryGenerator::MeshSize GeometryGenerator::SphereSize(uint32 sliceCount, uint32 stackCount)
+{
+	// Rings between the poles, and a triangle fan at each pole.
+	MeshSize size;
+	size.VertexCount = (stackCount - 1)*(sliceCount + 1) + 2;
+	size.IndexCount = 6*sliceCount*(stackCount - 1);
+	return size;
+}
 
-			XMVECTOR T = XMLoadFloat3(&vertex.TangentU);
-			XMVECTOR B = XMLoadFloat3(&bitangent);
-			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B));
-			
+GeometryGenerator::MeshSize GeometryGenerator::GeosphereSize(uint32 numSubdivisions)
+{
+	// Every level splits each edge once and each triangle in four.
+	uint32 scale = 1u << (2*std::min<uint32>(numSubdivisions, MaxSubdivisions));
 
-			vertex.Position = XMFLOAT3(r * c0, r * s0, z);
-			XMStoreFloat3(&vertex.Normal, N);
+	MeshSize size;
+	size.VertexCount = 10*scale + 2;
+	size.IndexCount = 60*scale;
+	return size;
+}
 
-			meshData.Vertices.push_back(vertex);
-		}
-	}
+GeometryGenerator::MeshSize GeometryGenerator::CylinderSize(uint32 sliceCount, uint32 stackCount)
+{
+	// Side rings, then each cap's ring and center.
+	MeshSize size;
+	size.VertexCount = (stackCount + 1)*(sliceCount + 1) + 2*(sliceCount + 2);
+	size.IndexCount = 6*sliceCount*stackCount + 6*sliceCount;
+	return size;
+}
 
-	uint32 ringVertexCount = numMinor + 1;
+GeometryGenerator::MeshSize GeometryGenerator::GridSize(uint32 m, uint32 n)
+{
+	MeshSize size;
+	size.VertexCount = m*n;
+	size.IndexCount = 6*(m - 1)*(n - 1);
+	return size;
+}
 
-	// Compute indices for each stack.
-	for (uint32 i = 0; i < numMajor; ++i)
-	{
-		for (uint32 j = 0; j < numMinor; ++j)
-		{
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
+GeometryGenerator::MeshSize GeometryGenerator::WedgeSize(uint32 numSubdivisions)
+{
+	// Three quad faces, subdivided as the box's are, and two triangles, which become
+	// triangular grids with (2^n + 1)(2^n + 2)/2 vertices.
+	uint32 segments = 1u << std::min<uint32>(numSubdivisions, MaxSubdivisions);
+	uint32 edge = segments + 1;
+
+	MeshSize size;
+	size.VertexCount = 3*edge*edge + edge*(edge + 1);
+	size.IndexCount = 3*(3*2*segments*segments + 2*segments*segments);
+	return size;
+}
 
-			meshData.Indices32.push_back(i * ringVertexCount + j);
-			meshData.Indices32.push_back((i + 1) * ringVertexCount + j + 1);
-			meshData.Indices32.push_back(i * ringVertexCount + j + 1);
-		}
-	}
+GeometryGenerator::MeshSize GeometryGenerator::DiamondSize(uint32 sliceCount, uint32 stackCount)
+{
+	// Two cones of rings, and the caps CreateCylinder would add.
+	MeshSize size;
+	size.VertexCount = 2*(stackCount + 1)*(sliceCount + 1) + 2*(sliceCount + 2);
+	size.IndexCount = 6*sliceCount*(2*stackCount + 1) + 6*sliceCount;
+	return size;
+}
 
-	return meshData;
+GeometryGenerator::MeshSize GeometryGenerator::TorusSize(int numMajor, int numMinor)
+{
+	MeshSize size;
+	size.VertexCount = (uint32)((numMajor + 1)*(numMinor + 1));
+	size.IndexCount = (uint32)(6*numMajor*numMinor);
+	return size;
 }
@@ -14,9 +14,12 @@
 
 #pragma once
 
+#include <cassert>
 #include <cstdint>
 #include <DirectXMath.h>
+#include <stdexcept>
 #include <vector>
+#include "MeshArena.h"
 
 class GeometryGenerator
 {
@@ -53,27 +56,94 @@ public:
         DirectX::XMFLOAT2 TexC;
 	};
 
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+	// Vertex and index counts of a mesh.
+	struct MeshSize
+	{
+		uint32 VertexCount = 0;
+		uint32 IndexCount = 0;
+	};
+
 	struct MeshData
 	{
-		std::vector<Vertex> Vertices;
-        std::vector<uint32> Indices32;
+		MeshData() = default;
 
-        std::vector<uint16>& GetIndices16()
-        {
-			if(mIndices16.empty())
-			{
-				mIndices16.resize(Indices32.size());
-				for(size_t i = 0; i < Indices32.size(); ++i)
-					mIndices16[i] = static_cast<uint16>(Indices32[i]);
-			}
+		// The mesh's arrays are allocated from arena, which must outlive them.
+		explicit MeshData(MeshArena* arena) :
+			Vertices(ArenaAllocator<Vertex>(arena)),
+			Indices32(ArenaAllocator<uint32>(arena)) {}
+
+		ArenaVector<Vertex> Vertices;
+        ArenaVector<uint32> Indices32;
+
+		// Allocates room for exactly size, so the arrays are never reallocated.
+		void Reserve(const MeshSize& size)
+		{
+			Vertices.reserve(size.VertexCount);
+			Indices32.reserve(size.IndexCount);
+		}
+	};
+
+	// Most vertices a mesh, or a part of one, drawn with 16-bit indices can have.
+	static const uint32 MaxVertices16 = 0x10000;
+
+	// Whether a mesh of this size can be written with 16-bit indices in one part.
+	// Larger ones are written in parts; see the Write* functions.
+	static bool Fits16(const MeshSize& size) { return size.VertexCount <= MaxVertices16; }
+
+	// Index i as an Index.  The size functions say which meshes fit an index type;
+	// this fails, in every build, rather than let a narrowed index point at the wrong
+	// vertex.  Everything writing 16-bit indices goes through it.
+	template<typename Index>
+	static Index NarrowIndex(uint32 i)
+	{
+		if(static_cast<Index>(i) != i)
+			throw std::length_error("GeometryGenerator: index does not fit the mesh's index type");
+		return static_cast<Index>(i);
+	}
+
+	// A run of a mesh's triangles drawn on its own: IndexCount indices starting at
+	// StartIndex, relative to vertex BaseVertex.
+	struct MeshPart
+	{
+		uint32 BaseVertex = 0;
+		uint32 VertexCount = 0;
+		uint32 StartIndex = 0;
+		uint32 IndexCount = 0;
+	};
+
+	///<summary>
+	/// Vertex layout policies tell the Write* functions what a vertex holds.  A layout
+	/// names its VertexType and stores position, normal and texture coordinates with
+	/// Set.  Tangents are computed, and passed to SetTangent, only if Tangents is true.
+	/// This layout fills Vertex, as the Create* functions do.
+	///</summary>
+	struct FullVertexLayout
+	{
+		using VertexType = Vertex;
+		static const bool Tangents = true;
 
-			return mIndices16;
-        }
+		static void Set(Vertex& v, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal,
+			const DirectX::XMFLOAT2& texC)
+		{
+			v.Position = position;
+			v.Normal = normal;
+			v.TexC = texC;
+		}
 
-	private:
-		std::vector<uint16> mIndices16;
+		static void SetTangent(Vertex& v, const DirectX::XMFLOAT3& tangentU) { v.TangentU = tangentU; }
 	};
 
+	// Deepest subdivision the generators allow.  Each level has four times the
+	// triangles of the one before; a geosphere at 8 levels has 1.3M.
+	static const uint32 MaxSubdivisions = 8;
+
+	// Meshes are allocated from arena if given, otherwise from the heap.
+	GeometryGenerator() = default;
+	explicit GeometryGenerator(MeshArena* arena) : mArena(arena) {}
+
 	///<summary>
 	/// Creates a box centered at the origin with the given dimensions, where each
     /// face has m rows and n columns of vertices.
@@ -111,6 +181,59 @@ public:
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
 	void Subdivide(MeshData& meshData);
 
+	// Most vertices and triangles a meshlet holds, the sizes mesh shader hardware is
+	// tuned for.  124 triangles rather than 128 leave room for per-meshlet data in
+	// the output limits of such shaders.
+	static const uint32 MaxMeshletVertices = 64;
+	static const uint32 MaxMeshletTriangles = 124;
+
+	///<summary>
+	/// A small cluster of a mesh's triangles, culled on its own: IndexCount indices
+	/// from StartIndex, using VertexCount distinct vertices.  All its triangles lie in
+	/// the bounding sphere, and their normals in a cone about ConeAxis, so that seen
+	/// from any point p with
+	///    dot(ConeApex - p, ConeAxis) > ConeCutoff*|ConeApex - p|
+	/// every one of them faces away.  Meshlets whose normals spread too far for that to
+	/// be useful have a zero axis and a cutoff of 1, which no point passes.
+	///</summary>
+	struct Meshlet
+	{
+		uint32 StartIndex = 0;
+		uint32 IndexCount = 0;
+		uint32 VertexCount = 0;
+
+		DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+		float Radius = 0.0f;
+
+		DirectX::XMFLOAT3 ConeApex = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 0.0f };
+		float ConeCutoff = 1.0f;
+	};
+
+	///<summary>
+	/// Partitions a mesh's triangles into meshlets, reordering them so each meshlet's
+	/// are contiguous, and appends the meshlets to meshlets in index order.  Meshlets
+	/// are grown greedily from the triangle order given, adding the neighboring
+	/// triangle that brings the fewest new vertices and bends the normal cone least.
+	/// StartIndex counts from indices; vertex i's position is stride bytes after
+	/// vertex i - 1's, starting at positions.
+	///</summary>
+	static void BuildMeshlets(uint16* indices, uint32 indexCount, const DirectX::XMFLOAT3* positions,
+		uint32 vertexCount, uint32 stride, std::vector<Meshlet>& meshlets);
+	static void BuildMeshlets(uint32* indices, uint32 indexCount, const DirectX::XMFLOAT3* positions,
+		uint32 vertexCount, uint32 stride, std::vector<Meshlet>& meshlets);
+	static std::vector<Meshlet> BuildMeshlets(MeshData& mesh);
+
+	// Whether every triangle of the meshlet faces away from eye, given in the space
+	// of the mesh.  The test holds under any transform that does not mirror.
+	static bool MeshletBackfacing(const Meshlet& meshlet, DirectX::FXMVECTOR eye)
+	{
+		using namespace DirectX;
+		XMVECTOR toApex = XMVectorSubtract(XMLoadFloat3(&meshlet.ConeApex), eye);
+		return XMVectorGetX(XMVector3Dot(toApex, XMLoadFloat3(&meshlet.ConeAxis))) >
+			meshlet.ConeCutoff * XMVectorGetX(XMVector3Length(toApex));
+	}
+
 
 	MeshData CreateCone(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount);
 	MeshData CreateTriangularPrism(float width, float height, uint32 stackCount);
@@ -119,10 +242,706 @@ public:
 	MeshData CreateDiamond(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount);
 	MeshData CreateTorus(float majorRadius, float minorRadius, int numMajor, int numMinor);
 
+	///<summary>
+	/// Exact vertex and index counts of the meshes the functions above create from
+	/// the same parameters, for sizing buffers before generating anything.
+	///</summary>
+	static MeshSize BoxSize(uint32 numSubdivisions);
+	static MeshSize SphereSize(uint32 sliceCount, uint32 stackCount);
+	static MeshSize GeosphereSize(uint32 numSubdivisions);
+	static MeshSize CylinderSize(uint32 sliceCount, uint32 stackCount);
+	static MeshSize GridSize(uint32 m, uint32 n);
+	static MeshSize WedgeSize(uint32 numSubdivisions);
+	static MeshSize DiamondSize(uint32 sliceCount, uint32 stackCount);
+	static MeshSize TorusSize(int numMajor, int numMinor);
+
+	///<summary>
+	/// Write the meshes the Create* functions make straight into caller memory, such as
+	/// a merged vertex buffer at the mesh's offset, with the vertex format chosen by
+	/// Layout.  vertices and indices must have room for the counts the matching *Size
+	/// function gives.  Indices count from the first vertex written, so they fit Index
+	/// types as small as the mesh allows; one that does not fit throws.
+	///
+	/// Given parts, meshes of any size can be written with 16-bit indices.  Triangles
+	/// are grouped, as they are written, into parts whose vertices all lie within
+	/// MaxVertices16 of the part's BaseVertex, and indices count from that instead.
+	/// The parts are appended to parts, with BaseVertex and StartIndex counting from
+	/// the first vertex and index written; a mesh that fits gives a single part.
+	///</summary>
+	template<typename Layout, typename Index>
+	static void WriteBox(float width, float height, float depth, uint32 numSubdivisions,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr);
+
+	template<typename Layout, typename Index>
+	static void WriteSphere(float radius, uint32 sliceCount, uint32 stackCount,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr);
+
+	template<typename Layout, typename Index>
+	static void WriteCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr);
+
+	template<typename Layout, typename Index>
+	static void WriteGrid(float width, float depth, uint32 m, uint32 n,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr);
+
+	template<typename Layout, typename Index>
+	static void WriteWedge(float width, float height, float depth, uint32 numSubdivisions,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr);
+
+	template<typename Layout, typename Index>
+	static void WriteDiamond(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr);
+
+	template<typename Layout, typename Index>
+	static void WriteTorus(float majorRadius, float minorRadius, int numMajor, int numMinor,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr);
+
+	// Cones, pyramids and prisms are cylinders; their sizes are CylinderSize's.
+	template<typename Layout, typename Index>
+	static void WriteCone(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr)
+	{
+		WriteCylinder<Layout>(bottomRadius, 0.0f, height, sliceCount, stackCount, vertices, indices, parts);
+	}
+
+	template<typename Layout, typename Index>
+	static void WritePyramid(float bottomWidth, float topWidth, float height, uint32 stackCount,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr)
+	{
+		WriteCylinder<Layout>(bottomWidth / sqrtf(2.0f), topWidth / sqrtf(2.0f), height, 4, stackCount, vertices, indices,
+			parts);
+	}
+
+	template<typename Layout, typename Index>
+	static void WriteTriangularPrism(float width, float height, uint32 stackCount,
+		typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts = nullptr)
+	{
+		float radius = width / sqrtf(2.0f);
+		WriteCylinder<Layout>(radius, radius, height, 3, stackCount, vertices, indices, parts);
+	}
+
 private:
-	
+	// Where the next vertex and index of a mesh go, and the parts the triangles are
+	// grouped in if Parts is set.
+	template<typename Layout, typename Index>
+	struct MeshWriter
+	{
+		typename Layout::VertexType* Vertices;
+		Index* Indices;
+		std::vector<MeshPart>* Parts;
+
+		// Vertices and indices written so far; the vertex count is the index of the
+		// next vertex.
+		uint32 VertexCount;
+		uint32 IndexCount;
+
+		// Parts before this one were there before the mesh.
+		size_t FirstPart;
+
+		MeshWriter(typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts) :
+			Vertices(vertices), Indices(indices), Parts(parts), VertexCount(0), IndexCount(0),
+			FirstPart(parts ? parts->size() : 0) {}
+
+		typename Layout::VertexType& NextVertex()
+		{
+			++VertexCount;
+			return *Vertices++;
+		}
+
+		void AddTriangle(uint32 a, uint32 b, uint32 c)
+		{
+			uint32 base = Parts ? PartBase(a, b, c) : 0;
+			Indices[0] = NarrowIndex<Index>(a - base);
+			Indices[1] = NarrowIndex<Index>(b - base);
+			Indices[2] = NarrowIndex<Index>(c - base);
+			Indices += 3;
+			IndexCount += 3;
+		}
+
+		// The base vertex of the part the triangle goes in.  A new part starts at the
+		// triangle's lowest vertex when the last one cannot reach all three.
+		uint32 PartBase(uint32 a, uint32 b, uint32 c)
+		{
+			uint32 lo = a < b ? (a < c ? a : c) : (b < c ? b : c);
+			uint32 hi = a > b ? (a > c ? a : c) : (b > c ? b : c);
+			if(Parts->size() == FirstPart || lo < Parts->back().BaseVertex ||
+				hi - Parts->back().BaseVertex >= MaxVertices16)
+			{
+				MeshPart part;
+				part.BaseVertex = lo;
+				part.StartIndex = IndexCount;
+				Parts->push_back(part);
+			}
+
+			MeshPart& part = Parts->back();
+			if(hi - part.BaseVertex + 1 > part.VertexCount)
+				part.VertexCount = hi - part.BaseVertex + 1;
+			part.IndexCount += 3;
+			return part.BaseVertex;
+		}
+	};
+
+	// The vertex with the given attributes, its tangent only if the layout keeps it.
+	template<typename Layout>
+	static void SetVertex(typename Layout::VertexType& v, const Vertex& attributes);
+
+	// A planar quad c[0] c[1] c[2] c[3] split into segments x segments cells, and a
+	// triangle c[0] c[1] c[2] into segments^2 triangles, as Subdivide splits the two
+	// triangles (c0, c1, c2) (c0, c2, c3) and the one triangle.
+	template<typename Layout, typename Index>
+	static void WriteQuadGrid(const Vertex* c, uint32 segments, MeshWriter<Layout, Index>& out);
+
+	template<typename Layout, typename Index>
+	static void WriteTriangleGrid(const Vertex* c, uint32 segments, MeshWriter<Layout, Index>& out);
+
+	// Cosines and sines of the angles i*step for i = 0..count, computed four at a time
+	// with XMVectorSinCos.  The ring generators look them up instead of calling sinf
+	// and cosf per vertex.
+	struct SinCosTable
+	{
+		SinCosTable(float step, uint32 count);
+
+		// count steps around the circle.  The last angle is the first, exactly, so the
+		// duplicated seam vertices of a ring land on each other.
+		static SinCosTable Circle(uint32 count);
+
+		uint32 Count()const { return (uint32)Cos.size() - 1; }
+
+		std::vector<float> Cos;
+		std::vector<float> Sin;
+	};
+
+	// Rings of a vertex per angle in ring up the side of a cylinder or cone, starting
+	// at radius r0 and height y0.  dr and height give the slope the normals follow.
+	template<typename Layout, typename Index>
+	static void WriteRings(float y0, float stackHeight, float r0, float radiusStep, float dr, float height,
+		const SinCosTable& ring, uint32 stackCount, MeshWriter<Layout, Index>& out);
+
+	// The quads between stripCount + 1 consecutive rings starting at vertex base.
+	template<typename Layout, typename Index>
+	static void WriteRingStrips(uint32 base, uint32 sliceCount, uint32 stripCount, MeshWriter<Layout, Index>& out);
+
+	template<typename Layout, typename Index>
+	static void WriteCylinderCap(float radius, float y, float height, const SinCosTable& ring, bool top,
+		MeshWriter<Layout, Index>& out);
+
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
-    void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
-    void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, MeshData& meshData);
+
+	MeshArena* mArena = nullptr;
 };
 
+template<typename Layout>
+void GeometryGenerator::SetVertex(typename Layout::VertexType& v, const Vertex& attributes)
+{
+	Layout::Set(v, attributes.Position, attributes.Normal, attributes.TexC);
+	if(Layout::Tangents)
+		Layout::SetTangent(v, attributes.TangentU);
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteQuadGrid(const Vertex* c, uint32 segments, MeshWriter<Layout, Index>& out)
+{
+	using namespace DirectX;
+
+	// Bilinear in (u, v), u running from c0 to c1 and v from c0 to c3.
+	uint32 base = out.VertexCount;
+	float step = 1.0f / segments;
+	for(uint32 j = 0; j <= segments; ++j)
+	{
+		float v = j*step;
+		for(uint32 i = 0; i <= segments; ++i)
+		{
+			float u = i*step;
+			float w[4] = { (1.0f - u)*(1.0f - v), u*(1.0f - v), u*v, (1.0f - u)*v };
+
+			Vertex vertex = c[0];
+			XMVECTOR p = XMVectorZero();
+			XMVECTOR t = XMVectorZero();
+			for(int k = 0; k < 4; ++k)
+			{
+				p += w[k]*XMLoadFloat3(&c[k].Position);
+				t += w[k]*XMLoadFloat2(&c[k].TexC);
+			}
+			XMStoreFloat3(&vertex.Position, p);
+			XMStoreFloat2(&vertex.TexC, t);
+			SetVertex<Layout>(out.NextVertex(), vertex);
+		}
+	}
+
+	uint32 row = segments + 1;
+	for(uint32 j = 0; j < segments; ++j)
+	{
+		for(uint32 i = 0; i < segments; ++i)
+		{
+			uint32 a = base + j*row + i;
+			out.AddTriangle(a, a + 1, a + row + 1);
+			out.AddTriangle(a, a + row + 1, a + row);
+		}
+	}
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteTriangleGrid(const Vertex* c, uint32 segments, MeshWriter<Layout, Index>& out)
+{
+	using namespace DirectX;
+
+	// Lattice point (i, j) is c0 + i/segments (c1 - c0) + j/segments (c2 - c0), for
+	// i + j <= segments, stored row by row of j.
+	uint32 base = out.VertexCount;
+	float step = 1.0f / segments;
+	for(uint32 j = 0; j <= segments; ++j)
+	{
+		for(uint32 i = 0; i + j <= segments; ++i)
+		{
+			float w1 = i*step;
+			float w2 = j*step;
+			float w0 = 1.0f - w1 - w2;
+
+			Vertex vertex = c[0];
+			XMStoreFloat3(&vertex.Position, w0*XMLoadFloat3(&c[0].Position) + w1*XMLoadFloat3(&c[1].Position) +
+				w2*XMLoadFloat3(&c[2].Position));
+			XMStoreFloat2(&vertex.TexC, w0*XMLoadFloat2(&c[0].TexC) + w1*XMLoadFloat2(&c[1].TexC) +
+				w2*XMLoadFloat2(&c[2].TexC));
+			SetVertex<Layout>(out.NextVertex(), vertex);
+		}
+	}
+
+	uint32 rowStart = base;
+	for(uint32 j = 0; j < segments; ++j)
+	{
+		uint32 rowLength = segments + 1 - j;
+		uint32 nextRow = rowStart + rowLength;
+		for(uint32 i = 0; i + j < segments; ++i)
+		{
+			out.AddTriangle(rowStart + i, rowStart + i + 1, nextRow + i);
+			if(i + j + 1 < segments)
+				out.AddTriangle(rowStart + i + 1, nextRow + i + 1, nextRow + i);
+		}
+		rowStart = nextRow;
+	}
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteRings(float y0, float stackHeight, float r0, float radiusStep, float dr, float height,
+	const SinCosTable& ring, uint32 stackCount, MeshWriter<Layout, Index>& out)
+{
+	using namespace DirectX;
+
+	// The side is parameterized by the angle t and a v running down it:
+	//   P(t, v) = (r(v) cos t, h - hv, r(v) sin t)
+	// so dP/dt is the unit tangent (-sin t, 0, cos t), dP/dv the bitangent
+	// (dr cos t, -h, dr sin t), and their cross product the normal (h cos t, dr, h sin t),
+	// which has the same length all the way round.
+	float length = sqrtf(height*height + dr*dr);
+	float normalScale = length > 0.0f ? 1.0f/length : 0.0f;
+	float normalXZ = height*normalScale;
+	float normalY = dr*normalScale;
+
+	uint32 sliceCount = ring.Count();
+	for(uint32 i = 0; i <= stackCount; ++i)
+	{
+		float y = y0 + i*stackHeight;
+		float r = r0 + i*radiusStep;
+		float v = 1.0f - (float)i/stackCount;
+
+		for(uint32 j = 0; j <= sliceCount; ++j)
+		{
+			float c = ring.Cos[j];
+			float s = ring.Sin[j];
+
+			auto& vertex = out.NextVertex();
+			Layout::Set(vertex, XMFLOAT3(r*c, y, r*s), XMFLOAT3(normalXZ*c, normalY, normalXZ*s),
+				XMFLOAT2((float)j/sliceCount, v));
+			if(Layout::Tangents)
+				Layout::SetTangent(vertex, XMFLOAT3(-s, 0.0f, c));
+		}
+	}
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteRingStrips(uint32 base, uint32 sliceCount, uint32 stripCount, MeshWriter<Layout, Index>& out)
+{
+	// Add one because we duplicate the first and last vertex per ring
+	// since the texture coordinates are different.
+	uint32 ringVertexCount = sliceCount + 1;
+	for(uint32 i = 0; i < stripCount; ++i)
+	{
+		for(uint32 j = 0; j < sliceCount; ++j)
+		{
+			uint32 a = base + i*ringVertexCount + j;
+			out.AddTriangle(a, a + ringVertexCount, a + ringVertexCount + 1);
+			out.AddTriangle(a, a + ringVertexCount + 1, a + 1);
+		}
+	}
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteCylinderCap(float radius, float y, float height, const SinCosTable& ring, bool top,
+	MeshWriter<Layout, Index>& out)
+{
+	using namespace DirectX;
+
+	XMFLOAT3 normal(0.0f, top ? 1.0f : -1.0f, 0.0f);
+	XMFLOAT3 tangent(1.0f, 0.0f, 0.0f);
+
+	// Duplicate cap ring vertices because the texture coordinates and normals differ.
+	uint32 baseIndex = out.VertexCount;
+	uint32 sliceCount = ring.Count();
+	for(uint32 i = 0; i <= sliceCount; ++i)
+	{
+		float x = radius*ring.Cos[i];
+		float z = radius*ring.Sin[i];
+
+		// Scale down by the height to try and make top cap texture coord area
+		// proportional to base.
+		auto& vertex = out.NextVertex();
+		Layout::Set(vertex, XMFLOAT3(x, y, z), normal, XMFLOAT2(x/height + 0.5f, z/height + 0.5f));
+		if(Layout::Tangents)
+			Layout::SetTangent(vertex, tangent);
+	}
+
+	// Cap center vertex.
+	uint32 centerIndex = out.VertexCount;
+	auto& center = out.NextVertex();
+	Layout::Set(center, XMFLOAT3(0.0f, y, 0.0f), normal, XMFLOAT2(0.5f, 0.5f));
+	if(Layout::Tangents)
+		Layout::SetTangent(center, tangent);
+
+	for(uint32 i = 0; i < sliceCount; ++i)
+	{
+		if(top)
+			out.AddTriangle(centerIndex, baseIndex + i+1, baseIndex + i);
+		else
+			out.AddTriangle(centerIndex, baseIndex + i, baseIndex + i+1);
+	}
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteBox(float width, float height, float depth, uint32 numSubdivisions,
+	typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts)
+{
+	float w2 = 0.5f*width;
+	float h2 = 0.5f*height;
+	float d2 = 0.5f*depth;
+
+	// The corners of each face, in the order the face's two triangles
+	// (0, 1, 2) (0, 2, 3) use them.
+	const Vertex v[24] =
+	{
+		// Front face.
+		Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+		Vertex(-w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(+w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+		Vertex(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+
+		// Back face.
+		Vertex(-w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+		Vertex(+w2, -h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+		Vertex(+w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(-w2, +h2, +d2, 0.0f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+
+		// Top face.
+		Vertex(-w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+		Vertex(-w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(+w2, +h2, +d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+		Vertex(+w2, +h2, -d2, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+
+		// Bottom face.
+		Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+		Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+		Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+
+		// Left face.
+		Vertex(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f),
+		Vertex(-w2, +h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f),
+		Vertex(-w2, +h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f),
+		Vertex(-w2, -h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f),
+
+		// Right face.
+		Vertex(+w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f),
+		Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f),
+		Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f),
+		Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f)
+	};
+
+	uint32 segments = 1u << (numSubdivisions < MaxSubdivisions ? numSubdivisions : MaxSubdivisions);
+
+	MeshWriter<Layout, Index> out(vertices, indices, parts);
+	for(int face = 0; face < 6; ++face)
+		WriteQuadGrid(&v[face*4], segments, out);
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteSphere(float radius, uint32 sliceCount, uint32 stackCount,
+	typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts)
+{
+	using namespace DirectX;
+
+	MeshWriter<Layout, Index> out(vertices, indices, parts);
+
+	//
+	// Compute the vertices stating at the top pole and moving down the stacks.
+	//
+
+	// Poles: note that there will be texture coordinate distortion as there is
+	// not a unique point on the texture map to assign to the pole when mapping
+	// a rectangular texture onto a sphere.
+	SetVertex<Layout>(out.NextVertex(), Vertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f));
+
+	float phiStep   = XM_PI/stackCount;
+	float thetaStep = 2.0f*XM_PI/sliceCount;
+
+	SinCosTable stacks(phiStep, stackCount);
+	SinCosTable ring = SinCosTable::Circle(sliceCount);
+
+	// Compute vertices for each stack ring (do not count the poles as rings).
+	for(uint32 i = 1; i <= stackCount-1; ++i)
+	{
+		float phi = i*phiStep;
+		float sinPhi = stacks.Sin[i];
+		float cosPhi = stacks.Cos[i];
+
+		// Vertices of ring.
+		for(uint32 j = 0; j <= sliceCount; ++j)
+		{
+			float theta = j*thetaStep;
+
+			// Spherical to cartesian.  The point on the unit sphere is the normal.
+			XMFLOAT3 normal(sinPhi*ring.Cos[j], cosPhi, sinPhi*ring.Sin[j]);
+
+			auto& vertex = out.NextVertex();
+			Layout::Set(vertex, XMFLOAT3(radius*normal.x, radius*normal.y, radius*normal.z), normal,
+				XMFLOAT2(theta / XM_2PI, phi / XM_PI));
+
+			// Partial derivative of P with respect to theta, normalized.  Between the
+			// poles sin(phi) is positive and drops out.
+			if(Layout::Tangents)
+				Layout::SetTangent(vertex, XMFLOAT3(-ring.Sin[j], 0.0f, ring.Cos[j]));
+		}
+	}
+
+	uint32 southPoleIndex = out.VertexCount;
+	SetVertex<Layout>(out.NextVertex(), Vertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f));
+
+	//
+	// Compute indices for top stack.  The top stack was written first to the vertex buffer
+	// and connects the top pole to the first ring.
+	//
+
+	for(uint32 i = 1; i <= sliceCount; ++i)
+		out.AddTriangle(0, i+1, i);
+
+	//
+	// Compute indices for inner stacks (not connected to poles).
+	//
+
+	// Offset the indices to the index of the first vertex in the first ring.
+	// This is just skipping the top pole vertex.
+	uint32 baseIndex = 1;
+	uint32 ringVertexCount = sliceCount + 1;
+	for(uint32 i = 0; i < stackCount-2; ++i)
+	{
+		for(uint32 j = 0; j < sliceCount; ++j)
+		{
+			out.AddTriangle(baseIndex + i*ringVertexCount + j, baseIndex + i*ringVertexCount + j+1,
+				baseIndex + (i+1)*ringVertexCount + j);
+			out.AddTriangle(baseIndex + (i+1)*ringVertexCount + j, baseIndex + i*ringVertexCount + j+1,
+				baseIndex + (i+1)*ringVertexCount + j+1);
+		}
+	}
+
+	//
+	// Compute indices for bottom stack.  The bottom stack was written last to the vertex buffer
+	// and connects the bottom pole to the bottom ring.
+	//
+
+	// Offset the indices to the index of the first vertex in the last ring.
+	baseIndex = southPoleIndex - ringVertexCount;
+	for(uint32 i = 0; i < sliceCount; ++i)
+		out.AddTriangle(southPoleIndex, baseIndex+i, baseIndex+i+1);
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteCylinder(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount,
+	typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts)
+{
+	MeshWriter<Layout, Index> out(vertices, indices, parts);
+	SinCosTable ring = SinCosTable::Circle(sliceCount);
+
+	// Rings from the bottom up, the radius moving towards the top radius by a step
+	// per stack.
+	WriteRings(-0.5f*height, height/stackCount, bottomRadius, (topRadius - bottomRadius)/stackCount,
+		bottomRadius - topRadius, height, ring, stackCount, out);
+	WriteRingStrips(0, sliceCount, stackCount, out);
+
+	WriteCylinderCap(topRadius, 0.5f*height, height, ring, true, out);
+	WriteCylinderCap(bottomRadius, -0.5f*height, height, ring, false, out);
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteGrid(float width, float depth, uint32 m, uint32 n,
+	typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts)
+{
+	using namespace DirectX;
+
+	MeshWriter<Layout, Index> out(vertices, indices, parts);
+
+	float halfWidth = 0.5f*width;
+	float halfDepth = 0.5f*depth;
+
+	float dx = width / (n-1);
+	float dz = depth / (m-1);
+
+	float du = 1.0f / (n-1);
+	float dv = 1.0f / (m-1);
+
+	for(uint32 i = 0; i < m; ++i)
+	{
+		float z = halfDepth - i*dz;
+		for(uint32 j = 0; j < n; ++j)
+		{
+			float x = -halfWidth + j*dx;
+
+			// Stretch texture over grid.
+			auto& vertex = out.NextVertex();
+			Layout::Set(vertex, XMFLOAT3(x, 0.0f, z), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT2(j*du, i*dv));
+			if(Layout::Tangents)
+				Layout::SetTangent(vertex, XMFLOAT3(1.0f, 0.0f, 0.0f));
+		}
+	}
+
+	// Iterate over each quad and compute indices.
+	for(uint32 i = 0; i < m-1; ++i)
+	{
+		for(uint32 j = 0; j < n-1; ++j)
+		{
+			out.AddTriangle(i*n+j, i*n+j+1, (i+1)*n+j);
+			out.AddTriangle((i+1)*n+j, i*n+j+1, (i+1)*n+j+1);
+		}
+	}
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteWedge(float width, float height, float depth, uint32 numSubdivisions,
+	typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts)
+{
+	float w2 = 0.5f*width;
+	float h2 = 0.5f*height;
+	float d2 = 0.5f*depth;
+
+	float frontFaceSideLength = sqrtf(height*height + depth*depth);
+	float sinTheta = height / frontFaceSideLength;
+	float cosTheta = height / frontFaceSideLength;
+
+	// Three quads, then the two triangular ends.
+	const Vertex v[18] =
+	{
+		// Bottom face.
+		Vertex(-w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+		Vertex(-w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(+w2, +h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+		Vertex(+w2, -h2, -d2, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+
+		// Top face.
+		Vertex(-w2, +h2, -d2, 0.0f, sinTheta, cosTheta, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+		Vertex(-w2, -h2, +d2, 0.0f, sinTheta, cosTheta, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(+w2, -h2, +d2, 0.0f, sinTheta, cosTheta, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+		Vertex(+w2, +h2, -d2, 0.0f, sinTheta, cosTheta, 1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+
+		// Back face.
+		Vertex(-w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 1.0f),
+		Vertex(+w2, -h2, -d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f),
+		Vertex(+w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+		Vertex(-w2, -h2, +d2, 0.0f, -1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f),
+
+		// Left face.
+		Vertex(-w2, -h2, +d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f),
+		Vertex(-w2, +h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 0.0f),
+		Vertex(-w2, -h2, -d2, -1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f),
+
+		// Right face.
+		Vertex(+w2, -h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f),
+		Vertex(+w2, +h2, -d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f),
+		Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f)
+	};
+
+	uint32 segments = 1u << (numSubdivisions < MaxSubdivisions ? numSubdivisions : MaxSubdivisions);
+
+	MeshWriter<Layout, Index> out(vertices, indices, parts);
+	for(int face = 0; face < 3; ++face)
+		WriteQuadGrid(&v[face*4], segments, out);
+	WriteTriangleGrid(&v[12], segments, out);
+	WriteTriangleGrid(&v[15], segments, out);
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteDiamond(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount,
+	typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts)
+{
+	MeshWriter<Layout, Index> out(vertices, indices, parts);
+	SinCosTable ring = SinCosTable::Circle(sliceCount);
+
+	// The lower half widens from the bottom tip to the girdle at y = 0 and the upper
+	// half narrows from there to the top tip.  Both girdle rings are kept, since their
+	// normals differ, with a strip of zero height between them.
+	float stackHeight = 0.5f * height / stackCount;
+	WriteRings(-0.5f*height, stackHeight, 0.0f, bottomRadius/stackCount, bottomRadius, height,
+		ring, stackCount, out);
+	WriteRings(0.0f, stackHeight, bottomRadius, -bottomRadius/stackCount, -bottomRadius, height,
+		ring, stackCount, out);
+	WriteRingStrips(0, sliceCount, 2*stackCount + 1, out);
+
+	WriteCylinderCap(0.0f, 0.5f*height, height, ring, true, out);
+	WriteCylinderCap(0.0f, -0.5f*height, height, ring, false, out);
+}
+
+template<typename Layout, typename Index>
+void GeometryGenerator::WriteTorus(float majorRadius, float minorRadius, int numMajor, int numMinor,
+	typename Layout::VertexType* vertices, Index* indices, std::vector<MeshPart>* parts)
+{
+	using namespace DirectX;
+
+	MeshWriter<Layout, Index> out(vertices, indices, parts);
+
+	SinCosTable major = SinCosTable::Circle((uint32)numMajor);
+	SinCosTable minor = SinCosTable::Circle((uint32)numMinor);
+
+	for(int i = 0; i <= numMajor; i++)
+	{
+		float c0 = major.Cos[i];
+		float s0 = major.Sin[i];
+		XMFLOAT3 tangent(-s0, c0, 0.0f);
+
+		for(int j = 0; j <= numMinor; j++)
+		{
+			float c1 = minor.Cos[j];
+			float s1 = minor.Sin[j];
+			float r = minorRadius * c1 + majorRadius;
+			float z = minorRadius * s1;
+
+			// The cross product of the tangent and the bitangent (-c0 s1, -s0 s1, c1)
+			// around the tube, both unit length and at right angles.
+			XMFLOAT3 normal(c0 * c1, s0 * c1, s1);
+
+			auto& vertex = out.NextVertex();
+			Layout::Set(vertex, XMFLOAT3(r * c0, r * s0, z), normal,
+				XMFLOAT2((float)i / (float)numMajor, (float)j / (float)numMinor));
+			if(Layout::Tangents)
+				Layout::SetTangent(vertex, tangent);
+		}
+	}
+
+	uint32 ringVertexCount = numMinor + 1;
+
+	// Compute indices for each stack.
+	for(uint32 i = 0; i < (uint32)numMajor; ++i)
+	{
+		for(uint32 j = 0; j < (uint32)numMinor; ++j)
+		{
+			out.AddTriangle(i * ringVertexCount + j, (i + 1) * ringVertexCount + j, (i + 1) * ringVertexCount + j + 1);
+			out.AddTriangle(i * ringVertexCount + j, (i + 1) * ringVertexCount + j + 1, i * ringVertexCount + j + 1);
+		}
+	}
+}
+
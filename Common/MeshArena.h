@@ -0,0 +1,118 @@
+//***************************************************************************************
+// MeshArena.h
+//
+// Bump allocator for generated geometry.  Memory is carved from large blocks and only
+// handed back all at once, when the arena is reset or destroyed, so building many
+// meshes costs a few block allocations instead of one per vector.  Containers should
+// be sized once; of the memory freed, only the most recent allocation is reused.
+//
+// ArenaAllocator adapts an arena to the standard containers; without one it falls
+// back to the heap.  An arena is not safe to allocate from on several threads at once.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+class MeshArena
+{
+public:
+	explicit MeshArena(size_t blockSize = 1 << 20) : mBlockSize(blockSize) {}
+	MeshArena(const MeshArena& rhs) = delete;
+	MeshArena& operator=(const MeshArena& rhs) = delete;
+
+	void* Allocate(size_t bytes, size_t alignment)
+	{
+		size_t start = (mUsed + alignment - 1) & ~(alignment - 1);
+		if(mBlocks.empty() || start + bytes > mBlocks.back().Size)
+		{
+			// The rest of the current block is left unused.
+			Block block;
+			block.Size = bytes > mBlockSize ? bytes : mBlockSize;
+			block.Memory.reset(new char[block.Size]);
+			mBlocks.push_back(std::move(block));
+			start = 0;
+		}
+
+		mLast = start;
+		mUsed = start + bytes;
+		return mBlocks.back().Memory.get() + start;
+	}
+
+	void Deallocate(void* p, size_t bytes)
+	{
+		if(!mBlocks.empty() && p == mBlocks.back().Memory.get() + mLast && mLast + bytes == mUsed)
+			mUsed = mLast;
+	}
+
+	// Frees every block.  Nothing allocated from the arena may be used afterwards.
+	void Reset()
+	{
+		mBlocks.clear();
+		mUsed = 0;
+		mLast = 0;
+	}
+
+	size_t BlockCount()const { return mBlocks.size(); }
+
+private:
+	struct Block
+	{
+		std::unique_ptr<char[]> Memory;
+		size_t Size = 0;
+	};
+
+	size_t mBlockSize;
+	std::vector<Block> mBlocks;
+
+	// Bytes used of the last block, and where its latest allocation starts.
+	size_t mUsed = 0;
+	size_t mLast = 0;
+};
+
+template<typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+
+	// Containers moved or swapped take their memory's arena with them.
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	ArenaAllocator() = default;
+	explicit ArenaAllocator(MeshArena* arena) : mArena(arena) {}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& rhs) : mArena(rhs.Arena()) {}
+
+	T* allocate(size_t n)
+	{
+		if(mArena == nullptr)
+			return static_cast<T*>(::operator new(n * sizeof(T)));
+		return static_cast<T*>(mArena->Allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* p, size_t n)
+	{
+		if(mArena == nullptr)
+			::operator delete(p);
+		else
+			mArena->Deallocate(p, n * sizeof(T));
+	}
+
+	MeshArena* Arena()const { return mArena; }
+
+private:
+	MeshArena* mArena = nullptr;
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.Arena() == b.Arena(); }
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.Arena() != b.Arena(); }
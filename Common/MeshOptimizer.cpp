@@ -0,0 +1,378 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+const MeshOptimizer::uint32 MeshOptimizer::AnalysisCacheSize;
+
+namespace
+{
+	using uint32 = MeshOptimizer::uint32;
+
+	// The LRU cache Forsyth's scores model, bigger than the FIFO the analysis uses so
+	// the order keeps working on hardware that reuses more.
+	const uint32 ForsythCacheSize = 32;
+
+	// Valences past this score the same; a vertex with this many triangles left is
+	// hardly worth finishing off anyway.
+	const uint32 ForsythMaxValence = 32;
+
+	const uint32 NotCached = ~0u;
+
+	class ForsythScores
+	{
+	public:
+		ForsythScores()
+		{
+			// The last triangle's vertices score the same whichever order they are in,
+			// and a bit lower than the next most recent, so the triangle just drawn
+			// is not simply drawn again from a different corner.
+			for(uint32 i = 0; i < ForsythCacheSize; ++i)
+			{
+				if(i < 3)
+					mCache[i] = 0.75f;
+				else
+					mCache[i] = std::pow(1.0f - (float)(i - 3) / (ForsythCacheSize - 3), 1.5f);
+			}
+
+			// Vertices with few triangles left score higher, so they are finished and
+			// leave the working set.
+			mValence[0] = 0.0f;
+			for(uint32 i = 1; i <= ForsythMaxValence; ++i)
+				mValence[i] = 2.0f / std::sqrt((float)i);
+		}
+
+		float Vertex(uint32 cachePosition, uint32 remaining)const
+		{
+			// No triangles left: the vertex never matters again.
+			if(remaining == 0)
+				return -1.0f;
+
+			float score = mValence[std::min<uint32>(remaining, ForsythMaxValence)];
+			if(cachePosition != NotCached)
+				score += mCache[cachePosition];
+			return score;
+		}
+
+	private:
+		float mCache[ForsythCacheSize];
+		float mValence[ForsythMaxValence + 1];
+	};
+
+	template<typename Index>
+	void ForsythOrder(Index* indices, uint32 indexCount, uint32 vertexCount)
+	{
+		static const ForsythScores scores;
+
+		uint32 triangleCount = indexCount / 3;
+		if(triangleCount < 2)
+			return;
+
+		// The triangles still to draw of each vertex, packed: vertex v's are the first
+		// remaining[v] entries from offsets[v].
+		std::vector<uint32> remaining(vertexCount, 0);
+		for(uint32 i = 0; i < triangleCount * 3; ++i)
+			remaining[indices[i]]++;
+
+		std::vector<uint32> offsets(vertexCount);
+		uint32 offset = 0;
+		for(uint32 v = 0; v < vertexCount; ++v)
+		{
+			offsets[v] = offset;
+			offset += remaining[v];
+		}
+
+		std::vector<uint32> vertexTriangles(triangleCount * 3);
+		std::vector<uint32> filled(vertexCount, 0);
+		for(uint32 i = 0; i < triangleCount * 3; ++i)
+		{
+			uint32 v = indices[i];
+			vertexTriangles[offsets[v] + filled[v]++] = i / 3;
+		}
+
+		std::vector<uint32> cachePosition(vertexCount, NotCached);
+		std::vector<float> vertexScore(vertexCount);
+		for(uint32 v = 0; v < vertexCount; ++v)
+			vertexScore[v] = scores.Vertex(NotCached, remaining[v]);
+
+		std::vector<float> triangleScore(triangleCount);
+		for(uint32 t = 0; t < triangleCount; ++t)
+		{
+			const Index* tri = &indices[3 * t];
+			triangleScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+		}
+
+		std::vector<std::uint8_t> emitted(triangleCount, 0);
+		std::vector<Index> output(triangleCount * 3);
+
+		uint32 cache[ForsythCacheSize + 3];
+		uint32 cacheCount = 0;
+
+		// Triangles the cache runs dry on start a new run with the earliest triangle
+		// left, which is where the input order resumes.
+		uint32 nextUnemitted = 0;
+		uint32 best = 0;
+		for(uint32 out = 0; out < triangleCount; ++out)
+		{
+			if(best == NotCached)
+			{
+				while(emitted[nextUnemitted])
+					++nextUnemitted;
+				best = nextUnemitted;
+			}
+
+			uint32 t = best;
+			emitted[t] = 1;
+			const Index* tri = &indices[3 * t];
+			output[3 * out] = tri[0];
+			output[3 * out + 1] = tri[1];
+			output[3 * out + 2] = tri[2];
+
+			// The triangle leaves its vertices' lists.
+			for(int k = 0; k < 3; ++k)
+			{
+				uint32 v = tri[k];
+				uint32* list = &vertexTriangles[offsets[v]];
+				uint32* last = list + remaining[v] - 1;
+				*std::find(list, last + 1, t) = *last;
+				remaining[v]--;
+			}
+
+			// Its vertices move to the front of the cache, pushing the rest back.
+			uint32 newCache[ForsythCacheSize + 3];
+			uint32 newCount = 0;
+			for(int k = 0; k < 3; ++k)
+			{
+				uint32 v = tri[k];
+				if(std::find(newCache, newCache + newCount, v) == newCache + newCount)
+					newCache[newCount++] = v;
+			}
+			uint32 triangleVertexCount = newCount;
+			for(uint32 i = 0; i < cacheCount; ++i)
+			{
+				uint32 v = cache[i];
+				if(std::find(newCache, newCache + triangleVertexCount, v) == newCache + triangleVertexCount)
+					newCache[newCount++] = v;
+			}
+
+			// Rescore every vertex that moved, and with them their triangles, looking
+			// for the best of those to draw next.
+			best = NotCached;
+			float bestScore = -1.0f;
+			for(uint32 i = 0; i < newCount; ++i)
+			{
+				uint32 v = newCache[i];
+				cachePosition[v] = i < ForsythCacheSize ? i : NotCached;
+
+				float score = scores.Vertex(cachePosition[v], remaining[v]);
+				float delta = score - vertexScore[v];
+				vertexScore[v] = score;
+
+				const uint32* list = &vertexTriangles[offsets[v]];
+				for(uint32 j = 0; j < remaining[v]; ++j)
+				{
+					uint32 u = list[j];
+					triangleScore[u] += delta;
+					if(triangleScore[u] > bestScore)
+					{
+						bestScore = triangleScore[u];
+						best = u;
+					}
+				}
+			}
+
+			cacheCount = std::min<uint32>(newCount, ForsythCacheSize);
+			std::copy(newCache, newCache + cacheCount, cache);
+		}
+
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	template<typename Index>
+	void SortClusters(Index* indices, uint32 indexCount, const XMFLOAT3* positions, uint32 vertexCount, uint32 stride)
+	{
+		uint32 triangleCount = indexCount / 3;
+		if(triangleCount < 2)
+			return;
+
+		auto position = [positions, stride](uint32 v)
+		{
+			return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const char*>(positions) + v * stride));
+		};
+
+		// Runs start where a triangle finds none of its vertices in the cache.
+		std::vector<uint32> clusterStarts;
+		std::vector<uint32> timestamps(vertexCount, 0);
+		uint32 time = MeshOptimizer::AnalysisCacheSize + 1;
+		for(uint32 t = 0; t < triangleCount; ++t)
+		{
+			uint32 misses = 0;
+			for(int k = 0; k < 3; ++k)
+			{
+				uint32 v = indices[3 * t + k];
+				if(time - timestamps[v] > MeshOptimizer::AnalysisCacheSize)
+				{
+					timestamps[v] = time++;
+					misses++;
+				}
+			}
+			if(t == 0 || misses == 3)
+				clusterStarts.push_back(t);
+		}
+		clusterStarts.push_back(triangleCount);
+
+		uint32 clusterCount = (uint32)clusterStarts.size() - 1;
+		if(clusterCount < 2)
+			return;
+
+		// Area weighted centre and normal of each run, and of the whole mesh.
+		std::vector<XMFLOAT3> centroids(clusterCount);
+		std::vector<XMFLOAT3> normals(clusterCount);
+		XMVECTOR meshCentroid = XMVectorZero();
+		float meshArea = 0.0f;
+		for(uint32 c = 0; c < clusterCount; ++c)
+		{
+			XMVECTOR centroid = XMVectorZero();
+			XMVECTOR normal = XMVectorZero();
+			float area = 0.0f;
+			for(uint32 t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+			{
+				XMVECTOR p0 = position(indices[3 * t]);
+				XMVECTOR p1 = position(indices[3 * t + 1]);
+				XMVECTOR p2 = position(indices[3 * t + 2]);
+
+				// Twice the area, pointing along the normal.
+				XMVECTOR n = XMVector3Cross(p1 - p0, p2 - p0);
+				float a = XMVectorGetX(XMVector3Length(n));
+
+				centroid += (p0 + p1 + p2) * (a / 3.0f);
+				normal += n;
+				area += a;
+			}
+
+			meshCentroid += centroid;
+			meshArea += area;
+			XMStoreFloat3(&centroids[c], area > 0.0f ? centroid / area : position(indices[3 * clusterStarts[c]]));
+			XMStoreFloat3(&normals[c], XMVector3Normalize(normal));
+		}
+		if(meshArea > 0.0f)
+			meshCentroid /= meshArea;
+
+		// How far out along its normal each run sits from the middle.  Runs on the
+		// outside of the mesh come first, most outward first.
+		std::vector<float> keys(clusterCount);
+		std::vector<uint32> order(clusterCount);
+		for(uint32 c = 0; c < clusterCount; ++c)
+		{
+			keys[c] = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&centroids[c]) - meshCentroid, XMLoadFloat3(&normals[c])));
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&keys](uint32 a, uint32 b) { return keys[a] > keys[b]; });
+
+		std::vector<Index> output;
+		output.reserve(triangleCount * 3);
+		for(uint32 c : order)
+			output.insert(output.end(), indices + 3 * clusterStarts[c], indices + 3 * clusterStarts[c + 1]);
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	template<typename Index>
+	uint32 RemapByFirstUse(Index* indices, uint32 indexCount, uint32 vertexCount, uint32* remap)
+	{
+		std::fill(remap, remap + vertexCount, NotCached);
+
+		uint32 next = 0;
+		for(uint32 i = 0; i < indexCount; ++i)
+		{
+			uint32 v = indices[i];
+			if(remap[v] == NotCached)
+				remap[v] = next++;
+			indices[i] = static_cast<Index>(remap[v]);
+		}
+
+		uint32 used = next;
+		for(uint32 v = 0; v < vertexCount; ++v)
+		{
+			if(remap[v] == NotCached)
+				remap[v] = next++;
+		}
+		return used;
+	}
+
+	template<typename Index>
+	MeshOptimizer::CacheStats SimulateFifo(const Index* indices, uint32 indexCount, uint32 vertexCount, uint32 cacheSize)
+	{
+		MeshOptimizer::CacheStats stats;
+		stats.Triangles = indexCount / 3;
+
+		// A vertex is cached while fewer than cacheSize others were loaded after it.
+		std::vector<uint32> timestamps(vertexCount, 0);
+		std::vector<std::uint8_t> used(vertexCount, 0);
+		uint32 time = cacheSize + 1;
+		for(uint32 i = 0; i < indexCount; ++i)
+		{
+			uint32 v = indices[i];
+			if(time - timestamps[v] > cacheSize)
+			{
+				timestamps[v] = time++;
+				stats.Transforms++;
+			}
+			if(!used[v])
+			{
+				used[v] = 1;
+				stats.Vertices++;
+			}
+		}
+		return stats;
+	}
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint16* indices, uint32 indexCount, uint32 vertexCount)
+{
+	ForsythOrder(indices, indexCount, vertexCount);
+}
+
+void MeshOptimizer::OptimizeVertexCache(uint32* indices, uint32 indexCount, uint32 vertexCount)
+{
+	ForsythOrder(indices, indexCount, vertexCount);
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint16* indices, uint32 indexCount, const XMFLOAT3* positions,
+	uint32 vertexCount, uint32 stride)
+{
+	SortClusters(indices, indexCount, positions, vertexCount, stride);
+}
+
+void MeshOptimizer::OptimizeOverdraw(uint32* indices, uint32 indexCount, const XMFLOAT3* positions,
+	uint32 vertexCount, uint32 stride)
+{
+	SortClusters(indices, indexCount, positions, vertexCount, stride);
+}
+
+MeshOptimizer::uint32 MeshOptimizer::RemapVertexFetch(uint16* indices, uint32 indexCount, uint32 vertexCount, uint32* remap)
+{
+	return RemapByFirstUse(indices, indexCount, vertexCount, remap);
+}
+
+MeshOptimizer::uint32 MeshOptimizer::RemapVertexFetch(uint32* indices, uint32 indexCount, uint32 vertexCount, uint32* remap)
+{
+	return RemapByFirstUse(indices, indexCount, vertexCount, remap);
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const uint16* indices, uint32 indexCount, uint32 vertexCount,
+	uint32 cacheSize)
+{
+	return SimulateFifo(indices, indexCount, vertexCount, cacheSize);
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::AnalyzeVertexCache(const uint32* indices, uint32 indexCount, uint32 vertexCount,
+	uint32 cacheSize)
+{
+	return SimulateFifo(indices, indexCount, vertexCount, cacheSize);
+}
@@ -0,0 +1,48 @@
+//***************************************************************************************
+// ParallelFor.h
+//
+// ParallelFor(first, last, fn) calls fn(i) for every i in [first, last) spread over the
+// available cores, and returns once all calls are done.  Uses the Concurrency Runtime
+// when building with MSVC, as Waves does, and plain threads elsewhere so code built on
+// it can also run in headless tools.
+//***************************************************************************************
+
+#pragma once
+
+#if defined(_MSC_VER)
+#include <ppl.h>
+#else
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#endif
+
+template<typename Fn>
+void ParallelFor(int first, int last, const Fn& fn)
+{
+#if defined(_MSC_VER)
+	concurrency::parallel_for(first, last, fn);
+#else
+	if(last <= first)
+		return;
+
+	int threadCount = std::min<int>(last - first, std::max<int>(1, (int)std::thread::hardware_concurrency()));
+
+	// Workers take indices one at a time, so uneven work still balances.
+	std::atomic<int> next(first);
+	auto worker = [&]()
+	{
+		for(int i = next++; i < last; i = next++)
+			fn(i);
+	};
+
+	std::vector<std::thread> threads;
+	for(int i = 1; i < threadCount; ++i)
+		threads.emplace_back(worker);
+	worker();
+
+	for(auto& t : threads)
+		t.join();
+#endif
+}
@@ -0,0 +1,121 @@
+//***************************************************************************************
+// RadixSort.h
+//
+// Stable LSD radix sort of (key, value) pairs with unsigned integer keys.  One
+// histogram pass counts every byte of every key, then one scatter pass is made per
+// byte, skipping bytes that are the same in all keys.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <type_traits>
+#include <utility>
+
+template<typename KeyType>
+struct RadixEntry
+{
+	KeyType Key;
+	std::uint32_t Value;
+};
+
+// Maps a float to an unsigned integer with the same ordering, so floats can be used
+// as (part of) a radix sort key.  Negative values have all bits flipped, positive
+// values only the sign bit.
+inline std::uint32_t FloatToSortableUint(float f)
+{
+	std::uint32_t u;
+	std::memcpy(&u, &f, sizeof(u));
+	std::uint32_t mask = (std::uint32_t)(-(std::int32_t)(u >> 31)) | 0x80000000u;
+	return u ^ mask;
+}
+
+// Sorts entries by ascending key.  scratch is resized as needed and can be kept
+// around between calls to avoid reallocating.
+template<typename KeyType>
+void RadixSort(std::vector<RadixEntry<KeyType>>& entries, std::vector<RadixEntry<KeyType>>& scratch)
+{
+	static_assert(std::is_unsigned<KeyType>::value, "RadixSort needs an unsigned key.");
+
+	const size_t byteCount = sizeof(KeyType);
+	const size_t n = entries.size();
+	if(n < 2)
+		return;
+
+	std::uint32_t counts[byteCount][256];
+	std::memset(counts, 0, sizeof(counts));
+
+	for(size_t i = 0; i < n; ++i)
+	{
+		KeyType key = entries[i].Key;
+		for(size_t b = 0; b < byteCount; ++b)
+			counts[b][(key >> (8*b)) & 0xff]++;
+	}
+
+	scratch.resize(n);
+	RadixEntry<KeyType>* src = entries.data();
+	RadixEntry<KeyType>* dst = scratch.data();
+
+	for(size_t b = 0; b < byteCount; ++b)
+	{
+		std::uint32_t* count = counts[b];
+
+		// Every key has the same value in this byte, so the pass would not move anything.
+		if(count[(src[0].Key >> (8*b)) & 0xff] == n)
+			continue;
+
+		std::uint32_t offset = 0;
+		for(int i = 0; i < 256; ++i)
+		{
+			std::uint32_t c = count[i];
+			count[i] = offset;
+			offset += c;
+		}
+
+		for(size_t i = 0; i < n; ++i)
+			dst[count[(src[i].Key >> (8*b)) & 0xff]++] = src[i];
+
+		std::swap(src, dst);
+	}
+
+	// An odd number of passes leaves the result in scratch.
+	if(src != entries.data())
+		entries.swap(scratch);
+}
+
+// Sorts entries that are expected to be in nearly the right order already, such as
+// last frame's order with slightly changed keys.  Insertion sort handles that in
+// close to linear time; once it has moved more than a few entries per element the
+// input was not nearly sorted after all, and a radix sort finishes the job.
+// Returns true if the insertion sort was enough.
+template<typename KeyType>
+bool SortNearlySorted(std::vector<RadixEntry<KeyType>>& entries, std::vector<RadixEntry<KeyType>>& scratch)
+{
+	const size_t n = entries.size();
+	const size_t maxMoves = 4*n + 16;
+
+	size_t moves = 0;
+	for(size_t i = 1; i < n; ++i)
+	{
+		RadixEntry<KeyType> e = entries[i];
+
+		size_t j = i;
+		while(j > 0 && entries[j - 1].Key > e.Key)
+		{
+			entries[j] = entries[j - 1];
+			--j;
+		}
+		entries[j] = e;
+
+		moves += i - j;
+		if(moves > maxMoves)
+		{
+			RadixSort(entries, scratch);
+			return false;
+		}
+	}
+
+	return true;
+}
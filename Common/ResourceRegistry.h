@@ -0,0 +1,111 @@
+//***************************************************************************************
+// ResourceRegistry.h
+//
+// Owns named resources of one type in a dense array and hands out 32-bit handles to
+// them.  Names are only looked up when resources are created or wired together at load
+// time; per-frame code keeps handles, which resolve with one array read and no hashing.
+//
+// Resources live as long as the registry, so a handle is just the resource's index
+// plus one and never goes stale.
+//***************************************************************************************
+
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+template<typename T>
+class ResourceRegistry;
+
+template<typename T>
+class ResourceHandle
+{
+public:
+	ResourceHandle() = default;
+
+	bool IsNull()const { return mValue == 0; }
+	explicit operator bool()const { return mValue != 0; }
+
+	std::uint32_t Value()const { return mValue; }
+
+	bool operator==(const ResourceHandle& rhs)const { return mValue == rhs.mValue; }
+	bool operator!=(const ResourceHandle& rhs)const { return mValue != rhs.mValue; }
+
+private:
+	friend class ResourceRegistry<T>;
+
+	explicit ResourceHandle(std::uint32_t value) : mValue(value) {}
+
+	// Zero is never a valid handle because indices are stored plus one.
+	std::uint32_t mValue = 0;
+};
+
+template<typename T>
+class ResourceRegistry
+{
+public:
+	using Handle = ResourceHandle<T>;
+
+	ResourceRegistry() = default;
+	ResourceRegistry(const ResourceRegistry& rhs) = delete;
+	ResourceRegistry& operator=(const ResourceRegistry& rhs) = delete;
+
+	// Adds a resource under a name that is not in use yet.
+	Handle Add(const std::string& name, T&& resource)
+	{
+		assert(mNameToHandle.find(name) == mNameToHandle.end() && "Resource name already in use.");
+
+		Handle handle((std::uint32_t)mResources.size() + 1);
+		mNameToHandle[name] = handle;
+		mResources.push_back(std::move(resource));
+		return handle;
+	}
+
+	// Load time lookup.  Returns a null handle for unknown names.
+	Handle Find(const std::string& name)const
+	{
+		auto it = mNameToHandle.find(name);
+		return it != mNameToHandle.end() ? it->second : Handle();
+	}
+
+	bool Valid(Handle handle)const
+	{
+		return !handle.IsNull() && handle.mValue <= mResources.size();
+	}
+
+	T& Get(Handle handle)
+	{
+		assert(Valid(handle) && "Null or foreign resource handle.");
+		return mResources[handle.mValue - 1];
+	}
+
+	const T& Get(Handle handle)const
+	{
+		assert(Valid(handle) && "Null or foreign resource handle.");
+		return mResources[handle.mValue - 1];
+	}
+
+	// Load time convenience; the name must exist.
+	T& Get(const std::string& name)
+	{
+		Handle handle = Find(name);
+		assert(!handle.IsNull() && "Unknown resource name.");
+		return Get(handle);
+	}
+
+	std::uint32_t Count()const { return (std::uint32_t)mResources.size(); }
+
+	// Iterates the resources in the order they were added.
+	typename std::vector<T>::iterator begin() { return mResources.begin(); }
+	typename std::vector<T>::iterator end() { return mResources.end(); }
+	typename std::vector<T>::const_iterator begin()const { return mResources.begin(); }
+	typename std::vector<T>::const_iterator end()const { return mResources.end(); }
+
+private:
+	std::vector<T> mResources;
+	std::unordered_map<std::string, Handle> mNameToHandle;
+};
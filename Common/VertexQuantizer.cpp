@@ -0,0 +1,159 @@
+//***************************************************************************************
+// VertexQuantizer.cpp
+//***************************************************************************************
+
+#include "VertexQuantizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	const float UnormMax = 65535.0f;
+	const float SnormMax = 32767.0f;
+
+	float SnormToFloat(std::int16_t v)
+	{
+		// -32768 and -32767 both decode to -1, as on the GPU.
+		return std::max<float>(v / SnormMax, -1.0f);
+	}
+
+	float SignNotZero(float v)
+	{
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+}
+
+VertexQuantizer::EncodeError& VertexQuantizer::EncodeError::operator+=(const EncodeError& rhs)
+{
+	Position = std::max<float>(Position, rhs.Position);
+	NormalDegrees = std::max<float>(NormalDegrees, rhs.NormalDegrees);
+	TexC = std::max<float>(TexC, rhs.TexC);
+	return *this;
+}
+
+VertexQuantizer::PositionDecode VertexQuantizer::GetPositionDecode(const BoundingBox& bounds)
+{
+	PositionDecode decode;
+	decode.Scale = XMFLOAT4(2.0f * bounds.Extents.x, 2.0f * bounds.Extents.y, 2.0f * bounds.Extents.z, 0.0f);
+	decode.Offset = XMFLOAT4(bounds.Center.x - bounds.Extents.x, bounds.Center.y - bounds.Extents.y,
+		bounds.Center.z - bounds.Extents.z, 0.0f);
+	return decode;
+}
+
+void VertexQuantizer::EncodePosition(const XMFLOAT3& p, const BoundingBox& bounds, std::uint16_t out[4])
+{
+	PositionDecode decode = GetPositionDecode(bounds);
+	const float* position = &p.x;
+	const float* scale = &decode.Scale.x;
+	const float* offset = &decode.Offset.x;
+
+	for(int i = 0; i < 3; ++i)
+	{
+		// A box flat along an axis decodes every position to its one value there.
+		float t = scale[i] > 0.0f ? (position[i] - offset[i]) / scale[i] : 0.0f;
+		t = std::min<float>(std::max<float>(t, 0.0f), 1.0f);
+		out[i] = (std::uint16_t)std::floor(t * UnormMax + 0.5f);
+	}
+	out[3] = 0;
+}
+
+XMFLOAT3 VertexQuantizer::DecodePosition(const std::uint16_t in[4], const BoundingBox& bounds)
+{
+	PositionDecode decode = GetPositionDecode(bounds);
+	return XMFLOAT3(
+		in[0] / UnormMax * decode.Scale.x + decode.Offset.x,
+		in[1] / UnormMax * decode.Scale.y + decode.Offset.y,
+		in[2] / UnormMax * decode.Scale.z + decode.Offset.z);
+}
+
+void VertexQuantizer::EncodeOctahedral(const XMFLOAT3& n, std::int16_t out[2])
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1, and fold the lower half over
+	// the upper half's edges.
+	float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	if(l1 == 0.0f)
+	{
+		out[0] = out[1] = 0;
+		return;
+	}
+
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if(n.z < 0.0f)
+	{
+		float folded = (1.0f - std::fabs(y)) * SignNotZero(x);
+		y = (1.0f - std::fabs(x)) * SignNotZero(y);
+		x = folded;
+	}
+
+	// Rounding each coordinate to the nearest value is not always nearest on the
+	// sphere, so keep whichever neighbor decodes closest to n.
+	XMVECTOR target = XMVector3Normalize(XMLoadFloat3(&n));
+	float baseX = std::floor(std::min<float>(std::max<float>(x, -1.0f), 1.0f) * SnormMax);
+	float baseY = std::floor(std::min<float>(std::max<float>(y, -1.0f), 1.0f) * SnormMax);
+	float bestDot = -2.0f;
+	for(int i = 0; i < 4; ++i)
+	{
+		std::int16_t candidate[2] =
+		{
+			(std::int16_t)std::min<float>(baseX + (i & 1), SnormMax),
+			(std::int16_t)std::min<float>(baseY + (i >> 1), SnormMax)
+		};
+
+		XMFLOAT3 decoded = DecodeOctahedral(candidate);
+		float dot = XMVectorGetX(XMVector3Dot(XMLoadFloat3(&decoded), target));
+		if(dot > bestDot)
+		{
+			bestDot = dot;
+			out[0] = candidate[0];
+			out[1] = candidate[1];
+		}
+	}
+}
+
+XMFLOAT3 VertexQuantizer::DecodeOctahedral(const std::int16_t in[2])
+{
+	float x = SnormToFloat(in[0]);
+	float y = SnormToFloat(in[1]);
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+
+	// Unfold the lower half.
+	float t = std::max<float>(-z, 0.0f);
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+
+	XMFLOAT3 n;
+	XMStoreFloat3(&n, XMVector3Normalize(XMVectorSet(x, y, z, 0.0f)));
+	return n;
+}
+
+void VertexQuantizer::EncodeVertex(const XMFLOAT3& position, const XMFLOAT3& normal, const XMFLOAT2& texC,
+	const BoundingBox& bounds, CompactVertex& out, EncodeError& error)
+{
+	EncodePosition(position, bounds, out.Pos);
+	EncodeOctahedral(normal, out.Normal);
+	out.TexC[0] = XMConvertFloatToHalf(texC.x);
+	out.TexC[1] = XMConvertFloatToHalf(texC.y);
+
+	XMFLOAT3 decodedPosition = DecodePosition(out.Pos, bounds);
+	float positionError = XMVectorGetX(XMVector3Length(XMLoadFloat3(&decodedPosition) - XMLoadFloat3(&position)));
+
+	// The generators write unit normals, but measure against the direction anyway.
+	// acos loses the small angles in rounding; atan2 of sine and cosine keeps them.
+	XMFLOAT3 decodedNormal = DecodeOctahedral(out.Normal);
+	XMVECTOR a = XMLoadFloat3(&decodedNormal);
+	XMVECTOR b = XMVector3Normalize(XMLoadFloat3(&normal));
+	float normalError = XMConvertToDegrees(std::atan2(XMVectorGetX(XMVector3Length(XMVector3Cross(a, b))),
+		XMVectorGetX(XMVector3Dot(a, b))));
+
+	float texCError = std::max<float>(std::fabs(XMConvertHalfToFloat(out.TexC[0]) - texC.x),
+		std::fabs(XMConvertHalfToFloat(out.TexC[1]) - texC.y));
+
+	error.Position = std::max<float>(error.Position, positionError);
+	error.NormalDegrees = std::max<float>(error.NormalDegrees, normalError);
+	error.TexC = std::max<float>(error.TexC, texCError);
+}
@@ -0,0 +1,93 @@
+//***************************************************************************************
+// VertexQuantizer.h
+//
+// Packs static geometry into CompactVertex, 16 bytes instead of the 32 of a float
+// position, normal and texture coordinate:
+//
+//   Position: three 16-bit unorms across a box, normally the bounds of the submesh the
+//   vertex belongs to, so precision scales with the submesh instead of the world.
+//   The box goes to the shader with each draw; the fourth value is padding.
+//
+//   Normal: octahedral, as two 16-bit snorms.  The unit sphere is projected onto an
+//   octahedron and the octahedron unfolded into the square [-1, 1]^2, which spends
+//   the bits evenly over all directions.  Tangents encode the same way.
+//
+//   Texture coordinate: two half floats.
+//
+// Encoding reports the largest error it made on each attribute, so a mesh that does
+// not survive quantization shows up in the debug output rather than on screen.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <DirectXCollision.h>
+
+// Matches VertexIn of the COMPACT_VERTEX variant of Default.hlsl.
+struct CompactVertex
+{
+	std::uint16_t Pos[4];
+	std::int16_t Normal[2];
+	DirectX::PackedVector::HALF TexC[2];
+};
+
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex must stay 16 bytes.");
+
+class VertexQuantizer
+{
+public:
+	// Largest errors of the vertices encoded: the distance between original and
+	// decoded positions, in the units of the mesh; the angle between original and
+	// decoded normals, in degrees; and the largest difference in a texture coordinate.
+	// Errors of several meshes combine to the largest of each.
+	struct EncodeError
+	{
+		float Position = 0.0f;
+		float NormalDegrees = 0.0f;
+		float TexC = 0.0f;
+
+		EncodeError& operator+=(const EncodeError& rhs);
+	};
+
+	// Scale and offset that turn the unorm positions quantized in bounds back into
+	// positions, as the shader does: p = unorm * Scale + Offset.
+	struct PositionDecode
+	{
+		DirectX::XMFLOAT4 Scale;
+		DirectX::XMFLOAT4 Offset;
+	};
+
+	static PositionDecode GetPositionDecode(const DirectX::BoundingBox& bounds);
+
+	static void EncodePosition(const DirectX::XMFLOAT3& p, const DirectX::BoundingBox& bounds, std::uint16_t out[4]);
+	static DirectX::XMFLOAT3 DecodePosition(const std::uint16_t in[4], const DirectX::BoundingBox& bounds);
+
+	// n need not be unit length.
+	static void EncodeOctahedral(const DirectX::XMFLOAT3& n, std::int16_t out[2]);
+	static DirectX::XMFLOAT3 DecodeOctahedral(const std::int16_t in[2]);
+
+	///<summary>
+	/// Encodes count vertices, quantizing their positions in bounds, which must hold
+	/// them all.  The members name where each vertex keeps its position, normal and
+	/// texture coordinate.  Adds the errors made to error.
+	///</summary>
+	template<typename Vertex>
+	static void Encode(const Vertex* vertices, std::uint32_t count, const DirectX::BoundingBox& bounds,
+		DirectX::XMFLOAT3 Vertex::* position, DirectX::XMFLOAT3 Vertex::* normal, DirectX::XMFLOAT2 Vertex::* texC,
+		CompactVertex* out, EncodeError& error);
+
+private:
+	static void EncodeVertex(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal,
+		const DirectX::XMFLOAT2& texC, const DirectX::BoundingBox& bounds, CompactVertex& out, EncodeError& error);
+};
+
+template<typename Vertex>
+void VertexQuantizer::Encode(const Vertex* vertices, std::uint32_t count, const DirectX::BoundingBox& bounds,
+	DirectX::XMFLOAT3 Vertex::* position, DirectX::XMFLOAT3 Vertex::* normal, DirectX::XMFLOAT2 Vertex::* texC,
+	CompactVertex* out, EncodeError& error)
+{
+	for(std::uint32_t i = 0; i < count; ++i)
+		EncodeVertex(vertices[i].*position, vertices[i].*normal, vertices[i].*texC, bounds, out[i], error);
+}
@@ -24,6 +24,7 @@
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
 #include "MathHelper.h"
+#include "GeometryGenerator.h"
 
 extern const int gNumFrameResources;
 
@@ -56,6 +57,24 @@ inline std::wstring AnsiToWString(const std::string& str)
 	return std::wstring(buffer);
 }
 
+// Sized by a first call, so names of any length convert whole.  A failed conversion
+// gives an empty string.
+inline std::string WStringToAnsi(const std::wstring& str)
+{
+	if(str.empty())
+		return std::string();
+
+	int size = WideCharToMultiByte(CP_ACP, 0, str.data(), (int)str.size(), nullptr, 0, nullptr, nullptr);
+	if(size <= 0)
+		return std::string();
+
+	std::string result(size, '\0');
+	if(WideCharToMultiByte(CP_ACP, 0, str.data(), (int)str.size(), &result[0], size, nullptr, nullptr) != size)
+		return std::string();
+
+	return result;
+}
+
 /*
 #if defined(_DEBUG)
 	#ifndef Assert
@@ -151,6 +170,12 @@ struct SubmeshGeometry
 	// Bounding box of the geometry defined by this submesh. 
 	// This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+
+	// The submesh's meshlets, MeshletCount of them from FirstMeshlet in the
+	// geometry's Meshlets, which together cover its indices.  None if it was not
+	// split into meshlets.
+	UINT FirstMeshlet = 0;
+	UINT MeshletCount = 0;
 };
 
 struct MeshGeometry
@@ -186,6 +211,14 @@ struct MeshGeometry
 	UINT ColorByteStride = 0;
 	UINT ColorBufferByteSize = 0;
 
+	// The vertices are CompactVertex, positions quantized in the Bounds of the
+	// submesh they belong to, rather than full floats.
+	bool CompactVertices = false;
+
+	// Meshlets of the submeshes that have them.  Their StartIndex is an index
+	// location in the index buffer, like StartIndexLocation.
+	std::vector<GeometryGenerator::Meshlet> Meshlets;
+
 
 	// A MeshGeometry may store multiple geometries in one vertex/index buffer.
 	// Use this container to define the Submesh geometries so we can draw
@@ -0,0 +1,289 @@
+//***************************************************************************************
+// Crowd.cpp
+//***************************************************************************************
+
+#include "Crowd.h"
+#include "Common/ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <emmintrin.h>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	// Agents updated by one task; a multiple of four.
+	const Crowd::uint32 BlockSize = 512;
+
+	// Walking speeds spread evenly over [MinSpeed, MaxSpeed], in units per second.
+	const float MinSpeed = 2.0f;
+	const float MaxSpeed = 3.0f;
+
+	// Largest change of velocity per second.
+	const float MaxAcceleration = 12.0f;
+
+	// Agents slow down within this distance of where they are heading.
+	const float ArriveDistance = 0.5f;
+
+	// Longest step taken at once, so a long frame cannot carry an agent through a wall.
+	const float MaxTimeStep = 1.0f / 30.0f;
+
+	// Fraction of the free width of a corridor agents' offsets spread over.
+	const float OffsetSpread = 0.6f;
+}
+
+void Crowd::Init(const Maze& maze, const MazeNavigator& navigator, uint32 agentCount, uint32 goalCount,
+	float radius, float wallThickness, uint32 seed)
+{
+	assert(agentCount > 0 && goalCount > 1);
+	assert(navigator.Width() == maze.Width() && navigator.Depth() == maze.Depth());
+
+	mMaze = &maze;
+	mNavigator = &navigator;
+	mRadius = radius;
+	mHalfThickness = 0.5f * wallThickness;
+
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<uint32> anyCell(0, maze.CellCount() - 1);
+
+	std::vector<uint32> goals(goalCount);
+	for(auto& goal : goals)
+		goal = anyCell(rng);
+	navigator.BuildFlowFields(goals, mFields);
+
+	// Offsets keep a disc of the agent's radius inside the corridor around the middle.
+	float freeHalfWidth = std::max<float>(0.5f * maze.CellSize() - mHalfThickness - radius, 0.0f);
+	std::uniform_real_distribution<float> offset(-OffsetSpread * freeHalfWidth, OffsetSpread * freeHalfWidth);
+	std::uniform_real_distribution<float> speed(MinSpeed, MaxSpeed);
+	std::uniform_int_distribution<uint32> anyGoal(0, goalCount - 1);
+
+	mAgentCount = agentCount;
+	uint32 paddedCount = (agentCount + 3) & ~3u;
+	for(auto array : { &mPosX, &mPosZ, &mVelX, &mVelZ, &mHeadX, &mHeadZ, &mOffsetX, &mOffsetZ, &mSpeed })
+		array->assign(paddedCount, 0.0f);
+	mGoal.assign(paddedCount, 0);
+	mCell.assign(paddedCount, 0);
+	mTransforms.resize(agentCount);
+
+	for(uint32 i = 0; i < paddedCount; ++i)
+	{
+		uint32 agent = i < agentCount ? i : 0;
+		if(agent != i)
+		{
+			mPosX[i] = mPosX[0];
+			mPosZ[i] = mPosZ[0];
+			mHeadZ[i] = 1.0f;
+			mOffsetX[i] = mOffsetX[0];
+			mOffsetZ[i] = mOffsetZ[0];
+			mSpeed[i] = mSpeed[0];
+			mGoal[i] = mGoal[0];
+			mCell[i] = mCell[0];
+			continue;
+		}
+
+		uint32 cell = anyCell(rng);
+		mOffsetX[i] = offset(rng);
+		mOffsetZ[i] = offset(rng);
+		mPosX[i] = maze.Origin().x + ((cell % maze.Width()) + 0.5f) * maze.CellSize() + mOffsetX[i];
+		mPosZ[i] = maze.Origin().y + ((cell / maze.Width()) + 0.5f) * maze.CellSize() + mOffsetZ[i];
+		mHeadZ[i] = 1.0f;
+		mSpeed[i] = speed(rng);
+		mGoal[i] = anyGoal(rng);
+		mCell[i] = cell;
+	}
+
+	XMStoreFloat4x4(&mMazeWorld, XMMatrixIdentity());
+}
+
+void Crowd::SetModelTransform(const XMFLOAT3& modelScale, float modelHeight, const XMFLOAT4X4& mazeWorld)
+{
+	mModelScale = modelScale;
+	mModelHeight = modelHeight;
+	mMazeWorld = mazeWorld;
+}
+
+void Crowd::Update(float dt)
+{
+	dt = std::min<float>(dt, MaxTimeStep);
+
+	uint32 paddedCount = (uint32)mPosX.size();
+	int blockCount = (int)((paddedCount + BlockSize - 1) / BlockSize);
+	ParallelFor(0, blockCount, [this, paddedCount, dt](int block)
+	{
+		uint32 first = (uint32)block * BlockSize;
+		UpdateBlock(first, std::min<uint32>(first + BlockSize, paddedCount), dt);
+	});
+}
+
+void Crowd::UpdateBlock(uint32 first, uint32 last, float dt)
+{
+	const uint32 width = mMaze->Width();
+	const uint32 depth = mMaze->Depth();
+	const uint32 goalCount = (uint32)mFields.size();
+	const float originX = mMaze->Origin().x;
+	const float originZ = mMaze->Origin().y;
+	const float cellSize = mMaze->CellSize();
+	const float invCellSize = 1.0f / cellSize;
+
+	// Distance from a wall's grid line the middle of an agent has to stay.
+	const float clearance = mHalfThickness + mRadius;
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signBit = _mm_set1_ps(-0.0f);
+	const __m128 tiny = _mm_set1_ps(1.0e-8f);
+	const __m128 timeStep = _mm_set1_ps(dt);
+	const __m128 maxDeltaV = _mm_set1_ps(MaxAcceleration * dt);
+	const __m128 invArrive = _mm_set1_ps(1.0f / ArriveDistance);
+	const __m128 minMoving = _mm_set1_ps(1.0e-4f);
+	const __m128 clearanceV = _mm_set1_ps(clearance);
+	const __m128 originXV = _mm_set1_ps(originX);
+	const __m128 originZV = _mm_set1_ps(originZ);
+	const __m128 cellSizeV = _mm_set1_ps(cellSize);
+	const __m128 invCellSizeV = _mm_set1_ps(invCellSize);
+
+	// Rows of the maze's world matrix, for the agent transforms.
+	const __m128 w0 = _mm_loadu_ps(&mMazeWorld.m[0][0]);
+	const __m128 w1 = _mm_loadu_ps(&mMazeWorld.m[1][0]);
+	const __m128 w2 = _mm_loadu_ps(&mMazeWorld.m[2][0]);
+	const __m128 w3 = _mm_loadu_ps(&mMazeWorld.m[3][0]);
+	const __m128 scaleX = _mm_set1_ps(mModelScale.x);
+	const __m128 scaleY = _mm_set1_ps(mModelScale.y);
+	const __m128 scaleZ = _mm_set1_ps(mModelScale.z);
+	const __m128 upRow = _mm_mul_ps(scaleY, w1);
+	const float modelY = mMaze->WallBottom() + mModelHeight;
+
+	for(uint32 i = first; i < last; i += 4)
+	{
+		// Looking up the flow fields is a gather, so where each agent heads, and the
+		// bounds of its cell, are worked out one agent at a time.
+		alignas(16) float targetX[4], targetZ[4];
+		alignas(16) float minX[4], maxX[4], minZ[4], maxZ[4];
+		for(uint32 lane = 0; lane < 4; ++lane)
+		{
+			uint32 a = i + lane;
+			uint32 x = (uint32)std::min<float>(std::max<float>((mPosX[a] - originX) * invCellSize, 0.0f), (float)(width - 1));
+			uint32 z = (uint32)std::min<float>(std::max<float>((mPosZ[a] - originZ) * invCellSize, 0.0f), (float)(depth - 1));
+			uint32 cell = z * width + x;
+			mCell[a] = cell;
+
+			std::uint8_t dir = mFields[mGoal[a]].Directions[cell];
+			if(dir == MazeNavigator::AtGoal)
+			{
+				mGoal[a] = (mGoal[a] + 1) % goalCount;
+				dir = mFields[mGoal[a]].Directions[cell];
+			}
+
+			// Agents that cannot reach their goal stay where they are.
+			uint32 nextX = x, nextZ = z;
+			switch(dir)
+			{
+			case MazeNavigator::West: --nextX; break;
+			case MazeNavigator::East: ++nextX; break;
+			case MazeNavigator::South: --nextZ; break;
+			case MazeNavigator::North: ++nextZ; break;
+			default: break;
+			}
+			targetX[lane] = originX + (nextX + 0.5f) * cellSize + mOffsetX[a];
+			targetZ[lane] = originZ + (nextZ + 0.5f) * cellSize + mOffsetZ[a];
+
+			// Open sides do not limit the agent; it moves on into the next cell.
+			float cellX = originX + x * cellSize;
+			float cellZ = originZ + z * cellSize;
+			minX[lane] = mNavigator->CanStep(cell, MazeNavigator::West) ? -FLT_MAX : cellX + clearance;
+			maxX[lane] = mNavigator->CanStep(cell, MazeNavigator::East) ? FLT_MAX : cellX + cellSize - clearance;
+			minZ[lane] = mNavigator->CanStep(cell, MazeNavigator::South) ? -FLT_MAX : cellZ + clearance;
+			maxZ[lane] = mNavigator->CanStep(cell, MazeNavigator::North) ? FLT_MAX : cellZ + cellSize - clearance;
+		}
+
+		__m128 px = _mm_loadu_ps(&mPosX[i]);
+		__m128 pz = _mm_loadu_ps(&mPosZ[i]);
+		__m128 vx = _mm_loadu_ps(&mVelX[i]);
+		__m128 vz = _mm_loadu_ps(&mVelZ[i]);
+
+		// Desired velocity: full speed towards the target, slowing down close to it.
+		__m128 dx = _mm_sub_ps(_mm_load_ps(targetX), px);
+		__m128 dz = _mm_sub_ps(_mm_load_ps(targetZ), pz);
+		__m128 distSq = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), tiny);
+		__m128 invDist = _mm_rsqrt_ps(distSq);
+		__m128 arrive = _mm_min_ps(_mm_mul_ps(_mm_mul_ps(distSq, invDist), invArrive), one);
+		__m128 desired = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&mSpeed[i]), arrive), invDist);
+
+		// Steer towards it, changing velocity no faster than the agent can accelerate.
+		__m128 sx = _mm_sub_ps(_mm_mul_ps(dx, desired), vx);
+		__m128 sz = _mm_sub_ps(_mm_mul_ps(dz, desired), vz);
+		__m128 steerSq = _mm_max_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sz, sz)), tiny);
+		__m128 limit = _mm_min_ps(_mm_mul_ps(maxDeltaV, _mm_rsqrt_ps(steerSq)), one);
+		vx = _mm_add_ps(vx, _mm_mul_ps(sx, limit));
+		vz = _mm_add_ps(vz, _mm_mul_ps(sz, limit));
+
+		px = _mm_add_ps(px, _mm_mul_ps(vx, timeStep));
+		pz = _mm_add_ps(pz, _mm_mul_ps(vz, timeStep));
+
+		// Keep clear of the cell's walls, stopping whatever ran into one.
+		__m128 cx = _mm_min_ps(_mm_max_ps(px, _mm_load_ps(minX)), _mm_load_ps(maxX));
+		__m128 cz = _mm_min_ps(_mm_max_ps(pz, _mm_load_ps(minZ)), _mm_load_ps(maxZ));
+		vx = _mm_andnot_ps(_mm_cmpneq_ps(cx, px), vx);
+		vz = _mm_andnot_ps(_mm_cmpneq_ps(cz, pz), vz);
+		px = cx;
+		pz = cz;
+
+		// Posts stand on every grid corner, also between two open sides.  An agent
+		// overlapping the nearest one is pushed out along the shallower axis.
+		__m128 gx = _mm_add_ps(originXV, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtps_epi32(
+			_mm_mul_ps(_mm_sub_ps(px, originXV), invCellSizeV))), cellSizeV));
+		__m128 gz = _mm_add_ps(originZV, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvtps_epi32(
+			_mm_mul_ps(_mm_sub_ps(pz, originZV), invCellSizeV))), cellSizeV));
+		__m128 offX = _mm_sub_ps(px, gx);
+		__m128 offZ = _mm_sub_ps(pz, gz);
+		__m128 depthX = _mm_sub_ps(clearanceV, _mm_andnot_ps(signBit, offX));
+		__m128 depthZ = _mm_sub_ps(clearanceV, _mm_andnot_ps(signBit, offZ));
+		__m128 overlap = _mm_and_ps(_mm_cmpgt_ps(depthX, zero), _mm_cmpgt_ps(depthZ, zero));
+		__m128 pushX = _mm_and_ps(overlap, _mm_cmple_ps(depthX, depthZ));
+		__m128 pushZ = _mm_andnot_ps(pushX, overlap);
+		px = _mm_add_ps(px, _mm_and_ps(pushX, _mm_or_ps(depthX, _mm_and_ps(signBit, offX))));
+		pz = _mm_add_ps(pz, _mm_and_ps(pushZ, _mm_or_ps(depthZ, _mm_and_ps(signBit, offZ))));
+		vx = _mm_andnot_ps(pushX, vx);
+		vz = _mm_andnot_ps(pushZ, vz);
+
+		// Face the way the agent is going; standing agents keep their heading.
+		__m128 speedSq = _mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vz, vz));
+		__m128 moving = _mm_cmpgt_ps(speedSq, minMoving);
+		__m128 invSpeed = _mm_rsqrt_ps(_mm_max_ps(speedSq, minMoving));
+		__m128 hx = _mm_loadu_ps(&mHeadX[i]);
+		__m128 hz = _mm_loadu_ps(&mHeadZ[i]);
+		hx = _mm_or_ps(_mm_and_ps(moving, _mm_mul_ps(vx, invSpeed)), _mm_andnot_ps(moving, hx));
+		hz = _mm_or_ps(_mm_and_ps(moving, _mm_mul_ps(vz, invSpeed)), _mm_andnot_ps(moving, hz));
+
+		_mm_storeu_ps(&mPosX[i], px);
+		_mm_storeu_ps(&mPosZ[i], pz);
+		_mm_storeu_ps(&mVelX[i], vx);
+		_mm_storeu_ps(&mVelZ[i], vz);
+		_mm_storeu_ps(&mHeadX[i], hx);
+		_mm_storeu_ps(&mHeadZ[i], hz);
+
+		// World matrix: scale, turn the model's +z onto the heading, move to the agent,
+		// then the maze's world transform, folded into one combination of its rows.
+		uint32 count = std::min<uint32>(4, mAgentCount > i ? mAgentCount - i : 0);
+		for(uint32 lane = 0; lane < count; ++lane)
+		{
+			uint32 a = i + lane;
+			__m128 headX = _mm_set1_ps(mHeadX[a]);
+			__m128 headZ = _mm_set1_ps(mHeadZ[a]);
+
+			__m128 right = _mm_sub_ps(_mm_mul_ps(headZ, w0), _mm_mul_ps(headX, w2));
+			__m128 forward = _mm_add_ps(_mm_mul_ps(headX, w0), _mm_mul_ps(headZ, w2));
+			__m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(mPosX[a]), w0),
+				_mm_mul_ps(_mm_set1_ps(modelY), w1)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(mPosZ[a]), w2), w3));
+
+			XMFLOAT4X4& world = mTransforms[a];
+			_mm_storeu_ps(&world.m[0][0], _mm_mul_ps(scaleX, right));
+			_mm_storeu_ps(&world.m[1][0], upRow);
+			_mm_storeu_ps(&world.m[2][0], _mm_mul_ps(scaleZ, forward));
+			_mm_storeu_ps(&world.m[3][0], position);
+		}
+	}
+}
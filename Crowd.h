@@ -0,0 +1,79 @@
+//***************************************************************************************
+// Crowd.h
+//
+// Agents walking a Maze.  Every agent heads for one of a few goal cells by following
+// that goal's flow field, and on arriving sets off for the next goal.  Agent state is
+// a structure of arrays, one float array per component, so steering, integration and
+// collision run on four agents at a time with SSE.
+//
+// Agents steer for the middle of the next cell on their way, shifted by an offset of
+// their own so they spread across the corridors, and are kept out of the walls and the
+// corner posts of the cell they are in.  They do not avoid each other.
+//***************************************************************************************
+
+#pragma once
+
+#include "MazeNavigator.h"
+
+class Crowd
+{
+public:
+	using uint32 = std::uint32_t;
+
+	Crowd() = default;
+	Crowd(const Crowd& rhs) = delete;
+	Crowd& operator=(const Crowd& rhs) = delete;
+
+	// Builds a flow field for each of goalCount random goal cells and places agentCount
+	// agents on random cells.  Agents are discs of the given radius; walls and posts are
+	// wallThickness wide.  The maze and navigator must outlive the crowd.
+	void Init(const Maze& maze, const MazeNavigator& navigator, uint32 agentCount, uint32 goalCount,
+		float radius, float wallThickness, uint32 seed);
+
+	// How Transforms places the agent model: scaled by modelScale, raised modelHeight
+	// above the bottom of the walls, turned to face the way the agent walks, and put in
+	// the world by mazeWorld.
+	void SetModelTransform(const DirectX::XMFLOAT3& modelScale, float modelHeight, const DirectX::XMFLOAT4X4& mazeWorld);
+
+	// Moves the agents on by dt seconds and rebuilds their transforms.  Blocks of agents
+	// are updated in parallel.
+	void Update(float dt);
+
+	uint32 AgentCount()const { return mAgentCount; }
+
+	// Cell each agent was in at the start of the last update.
+	uint32 AgentCell(uint32 agent)const { return mCell[agent]; }
+
+	// World matrix of each agent.
+	const std::vector<DirectX::XMFLOAT4X4>& Transforms()const { return mTransforms; }
+
+private:
+	void UpdateBlock(uint32 first, uint32 last, float dt);
+
+	const Maze* mMaze = nullptr;
+	const MazeNavigator* mNavigator = nullptr;
+	std::vector<MazeNavigator::FlowField> mFields;
+
+	// Agents; the arrays are padded to a multiple of four with copies of the first.
+	uint32 mAgentCount = 0;
+	std::vector<float> mPosX;
+	std::vector<float> mPosZ;
+	std::vector<float> mVelX;
+	std::vector<float> mVelZ;
+	std::vector<float> mHeadX;
+	std::vector<float> mHeadZ;
+	std::vector<float> mOffsetX;
+	std::vector<float> mOffsetZ;
+	std::vector<float> mSpeed;
+	std::vector<uint32> mGoal;
+	std::vector<uint32> mCell;
+
+	float mRadius = 0.0f;
+	float mHalfThickness = 0.0f;
+
+	DirectX::XMFLOAT3 mModelScale = { 1.0f, 1.0f, 1.0f };
+	float mModelHeight = 0.0f;
+	DirectX::XMFLOAT4X4 mMazeWorld;
+
+	std::vector<DirectX::XMFLOAT4X4> mTransforms;
+};
@@ -0,0 +1,75 @@
+//***************************************************************************************
+// Labyrinth.cpp
+//***************************************************************************************
+
+#include "Labyrinth.h"
+
+void BuildLabyrinthMaze(Maze& maze, std::uint32_t generatedSize, std::uint32_t seed)
+{
+	// The hand-made maze: the gaps in each horizontal grid line and the walls on each
+	// vertical one.
+	const std::vector<std::vector<std::uint32_t>> emptyHorizontal{
+		{0},
+		{3, 4, 6, 8, 12, 13, 15, 17},
+		{0, 1, 3, 6, 9, 13, 15, 16, 17},
+		{0, 2, 3, 5, 6, 8, 10, 12, 14, 17},
+		{1, 5, 6, 8, 10, 11, 13, 14, 15, 17},
+		{0, 1, 2, 5, 7, 8, 10, 11, 13, 15},
+		{0, 2, 4, 5, 8, 9, 11, 12, 15, 16},
+		{2, 3, 5, 6, 8, 11, 12, 14, 16},
+		{2, 5, 8, 11, 12, 14, 16},
+		{0, 2, 3, 4, 5, 7, 8, 10, 13, 14, 16, 17},
+		{1, 4, 5, 8, 10, 11, 15, 16, 17},
+		{1, 2, 5, 8, 9, 11, 14, 16},
+		{0, 1, 3, 5, 8, 9, 11, 12, 13, 16},
+		{0, 4, 5, 6, 8, 11, 14, 16},
+		{3, 4, 9, 10, 11, 12, 13, 15, 16},
+		{0, 2, 5, 7, 10, 11, 13, 14, 15, 16},
+		{1, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 15, 16},
+		{2, 3, 5, 6, 7, 8, 11, 12, 14, 16},
+		{17}
+	};
+
+	const std::vector<std::vector<std::uint32_t>> drawVertical{
+		{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17},
+		{1, 2, 4, 6, 9, 11, 15},
+		{2, 4, 11, 13, 15},
+		{3, 4, 6, 9, 11, 15, 17},
+		{0, 1, 5, 6, 8, 9, 13, 17},
+		{2, 3, 5, 7 , 8, 9, 10, 11, 13, 14, 15},
+		{1, 2, 4, 6, 8, 9, 11, 12, 14, 15, 17},
+		{1, 4, 7, 10, 15, 16},
+		{2, 3, 4, 5, 6, 8, 12, 14, 15, 16},
+		{1, 2, 5, 9, 10, 12, 15, 16},
+		{0, 1, 3, 5, 6, 8, 10, 14, 15},
+		{3, 4, 5, 7, 9, 11, 12, 13, 14, 16},
+		{2, 3, 4, 5, 6, 7, 11, 14, 15, 16},
+		{1, 3, 5, 8, 9, 12, 13, 14, 15, 16},
+		{3, 4, 6, 7, 8, 10, 12, 13, 14, 15},
+		{0, 2, 3, 6, 9, 10, 11, 13, 14},
+		{1, 2, 5, 7, 9, 13, 14, 15, 17},
+		{0, 2, 4, 8, 9},
+		{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17}
+	};
+
+	// Grid line j of the tables is the line z = 2(j - 9) for horizontal walls and
+	// x = 2(j - 9) for vertical ones, so cell (x, z) starts at (2(x - 9), 2(z - 9)).
+	// Generated mazes are centered the same way.
+	if(generatedSize > 0)
+		maze.Generate(generatedSize, generatedSize, seed);
+	else
+	{
+		const std::uint32_t mazeSize = 18;
+		maze.Reset(mazeSize, mazeSize);
+		for(std::uint32_t j = 0; j <= mazeSize; ++j)
+		{
+			for(std::uint32_t i = 0; i < mazeSize; ++i)
+				maze.SetWallX(j, i, false);
+			for(std::uint32_t i : drawVertical.at(j))
+				maze.SetWallX(j, i, true);
+			for(std::uint32_t i : emptyHorizontal.at(j))
+				maze.SetWallZ(i, j, false);
+		}
+	}
+	maze.SetPlacement(DirectX::XMFLOAT2(-(float)maze.Width(), -(float)maze.Depth()), 2.0f, 1.8f, 3.8f);
+}
@@ -0,0 +1,15 @@
+//***************************************************************************************
+// Labyrinth.h
+//
+// The maze the app's labyrinth is built from, shared with the headless benchmarks so
+// they measure the walls the app draws.
+//***************************************************************************************
+
+#pragma once
+
+#include "Maze.h"
+
+// Builds the hand-made 18 x 18 maze into maze or, if generatedSize is not 0, a random
+// generatedSize x generatedSize one from seed.  Either is placed centered on the origin
+// of its local space, with 2 unit cells and walls from 1.8 to 3.8.
+void BuildLabyrinthMaze(Maze& maze, std::uint32_t generatedSize, std::uint32_t seed);
@@ -0,0 +1,533 @@
+//***************************************************************************************
+// Maze.cpp
+//***************************************************************************************
+
+#include "Maze.h"
+#include "Common/ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t PvsMagic = 0x5356504d; // "MPVS"
+	const std::uint32_t PvsVersion = 2;
+
+	struct PvsFileHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+		std::uint32_t Width;
+		std::uint32_t Depth;
+		std::uint64_t WallHash;
+		std::uint32_t CellCount;
+		std::uint32_t EntryCount;
+	};
+
+	// Portal ends are placed on a grid PortalScale times finer than the cells, so they
+	// can be pulled in from the corners by one step.
+	const std::int32_t PortalScale = 1024;
+
+	// Stops the run time traversal from blowing up in open areas with many loops.
+	const std::uint32_t VisitsPerCell = 16;
+
+	float Cross(float ax, float az, float bx, float bz)
+	{
+		return ax * bz - az * bx;
+	}
+
+	std::uint64_t Fnv1a(std::uint64_t hash, const void* data, size_t size)
+	{
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		for(size_t i = 0; i < size; ++i)
+		{
+			hash ^= p[i];
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+}
+
+const Maze::uint32 Maze::InvalidCell;
+
+void Maze::Reset(uint32 width, uint32 depth)
+{
+	mWidth = width;
+	mDepth = depth;
+	mWallsX.assign(((width + 1) * depth + 63) / 64, ~std::uint64_t(0));
+	mWallsZ.assign((width * (depth + 1) + 63) / 64, ~std::uint64_t(0));
+
+	mPvsOffsets.clear();
+	mPvsCells.clear();
+}
+
+void Maze::SetPlacement(const XMFLOAT2& origin, float cellSize, float wallBottom, float wallTop)
+{
+	mOrigin = origin;
+	mCellSize = cellSize;
+	mWallBottom = wallBottom;
+	mWallTop = wallTop;
+}
+
+void Maze::SetWallX(uint32 x, uint32 z, bool wall)
+{
+	assert(x <= mWidth && z < mDepth);
+	SetBit(mWallsX, z * (mWidth + 1) + x, wall);
+}
+
+void Maze::SetWallZ(uint32 x, uint32 z, bool wall)
+{
+	assert(x < mWidth && z <= mDepth);
+	SetBit(mWallsZ, z * mWidth + x, wall);
+}
+
+bool Maze::Generate(uint32 width, uint32 depth, uint32 seed)
+{
+	// There is no cell to start the walk from.
+	if(width == 0 || depth == 0)
+	{
+		Reset(0, 0);
+		return false;
+	}
+
+	Reset(width, depth);
+
+	// Walk from a random cell, each step knocking through to a random unvisited
+	// neighbor, and back up along the walk when the current cell has none left.
+	std::mt19937 rng(seed);
+	std::vector<std::uint64_t> visited((CellCount() + 63) / 64, 0);
+	std::vector<uint32> stack;
+	stack.reserve(CellCount());
+
+	uint32 start = rng() % CellCount();
+	SetBit(visited, start, true);
+	stack.push_back(start);
+	while(!stack.empty())
+	{
+		uint32 cell = stack.back();
+		uint32 x = cell % mWidth;
+		uint32 z = cell / mWidth;
+
+		uint32 neighbors[4];
+		int count = 0;
+		if(x > 0 && !TestBit(visited, cell - 1))
+			neighbors[count++] = cell - 1;
+		if(x + 1 < mWidth && !TestBit(visited, cell + 1))
+			neighbors[count++] = cell + 1;
+		if(z > 0 && !TestBit(visited, cell - mWidth))
+			neighbors[count++] = cell - mWidth;
+		if(z + 1 < mDepth && !TestBit(visited, cell + mWidth))
+			neighbors[count++] = cell + mWidth;
+
+		if(count == 0)
+		{
+			stack.pop_back();
+			continue;
+		}
+
+		uint32 next = neighbors[count == 1 ? 0 : rng() % count];
+		if(next == cell - 1)
+			SetWallX(x, z, false);
+		else if(next == cell + 1)
+			SetWallX(x + 1, z, false);
+		else if(next == cell - mWidth)
+			SetWallZ(x, z, false);
+		else
+			SetWallZ(x, z + 1, false);
+
+		SetBit(visited, next, true);
+		stack.push_back(next);
+	}
+
+	SetWallZ(0, 0, false);
+	SetWallZ(mWidth - 1, mDepth, false);
+	return true;
+}
+
+Maze::uint32 Maze::CellAt(float x, float z)const
+{
+	float cx = std::floor((x - mOrigin.x) / mCellSize);
+	float cz = std::floor((z - mOrigin.y) / mCellSize);
+	if(cx < 0.0f || cz < 0.0f || cx >= (float)mWidth || cz >= (float)mDepth)
+		return InvalidCell;
+
+	return CellIndex((uint32)cx, (uint32)cz);
+}
+
+std::int64_t Maze::StabbingLine::Side(const GridPoint& p)const
+{
+	return DX * (p.Z - Point.Z) - DZ * (p.X - Point.X);
+}
+
+bool Maze::FindStabbingLine(const PvsSearch& search, StabbingLine& line)
+{
+	// A line stabs every portal, in order, exactly when it has all their left ends on
+	// one side and all their right ends on the other: it then enters each cell through
+	// one portal and leaves it through the next.  Points on the line count for either
+	// side, which only errs towards visibility.  The ends are integers, so the tests
+	// are exact.
+	const GridPoint& newLeft = search.Left.back();
+	const GridPoint& newRight = search.Right.back();
+	if(search.Left.size() > 1 && line.Side(newLeft) >= 0 && line.Side(newRight) <= 0)
+		return true;
+
+	// Otherwise a line that stabs them all can be turned until it passes through one
+	// of the new portal's ends, and then about that end until it meets another, so only
+	// lines through a new end and some other end need trying.
+	const GridPoint* ends[2] = { &newLeft, &newRight };
+	const std::vector<GridPoint>* sides[2] = { &search.Left, &search.Right };
+	for(const GridPoint* end : ends)
+	{
+		for(const std::vector<GridPoint>* side : sides)
+		{
+			for(const GridPoint& other : *side)
+			{
+				StabbingLine candidate = { *end, (std::int64_t)other.X - end->X, (std::int64_t)other.Z - end->Z };
+				if(candidate.DX == 0 && candidate.DZ == 0)
+					continue;
+
+				bool leftPositive = true, leftNegative = true;
+				for(const GridPoint& p : search.Left)
+				{
+					std::int64_t s = candidate.Side(p);
+					leftPositive = leftPositive && s >= 0;
+					leftNegative = leftNegative && s <= 0;
+				}
+
+				bool rightPositive = true, rightNegative = true;
+				for(const GridPoint& p : search.Right)
+				{
+					std::int64_t s = candidate.Side(p);
+					rightPositive = rightPositive && s >= 0;
+					rightNegative = rightNegative && s <= 0;
+				}
+
+				if(leftPositive && rightNegative)
+				{
+					line = candidate;
+					return true;
+				}
+				if(leftNegative && rightPositive)
+				{
+					line = { candidate.Point, -candidate.DX, -candidate.DZ };
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+void Maze::ExtendPvs(uint32 cell, int stepX, int stepZ, const StabbingLine& line, PvsSearch& search,
+	std::vector<uint32>& pvs)const
+{
+	int x = (int)(cell % mWidth);
+	int z = (int)(cell / mWidth);
+
+	// Each opening as its neighbor, the step to it and the corners at the ends of the
+	// portal, left and right as seen looking through it.
+	struct Portal
+	{
+		bool Open;
+		uint32 Neighbor;
+		int StepX, StepZ;
+		GridPoint Left, Right;
+	};
+	const Portal portals[4] =
+	{
+		{ x > 0 && !WallX(x, z), cell - 1, -1, 0, { x, z }, { x, z + 1 } },
+		{ x + 1 < (int)mWidth && !WallX(x + 1, z), cell + 1, 1, 0, { x + 1, z + 1 }, { x + 1, z } },
+		{ z > 0 && !WallZ(x, z), cell - mWidth, 0, -1, { x + 1, z }, { x, z } },
+		{ z + 1 < (int)mDepth && !WallZ(x, z + 1), cell + mWidth, 0, 1, { x, z + 1 }, { x + 1, z + 1 } },
+	};
+
+	for(const Portal& p : portals)
+	{
+		// A line never turns back, so once a path has stepped one way along an axis it
+		// cannot step the other.
+		if(!p.Open || p.StepX * stepX < 0 || p.StepZ * stepZ < 0)
+			continue;
+
+		// Both ends are pulled in, so a line through a corner stabs neither portal
+		// meeting there.  Lines just beside it do, and see the same cells if no wall
+		// touches the corner.
+		GridPoint left = { p.Left.X * PortalScale + p.Right.X - p.Left.X, p.Left.Z * PortalScale + p.Right.Z - p.Left.Z };
+		GridPoint right = { p.Right.X * PortalScale + p.Left.X - p.Right.X, p.Right.Z * PortalScale + p.Left.Z - p.Right.Z };
+
+		search.Left.push_back(left);
+		search.Right.push_back(right);
+		StabbingLine next = line;
+		if(FindStabbingLine(search, next))
+		{
+			if(search.Stamp[p.Neighbor] != search.CurrentStamp)
+			{
+				search.Stamp[p.Neighbor] = search.CurrentStamp;
+				pvs.push_back(p.Neighbor);
+			}
+			ExtendPvs(p.Neighbor, p.StepX != 0 ? p.StepX : stepX, p.StepZ != 0 ? p.StepZ : stepZ, next, search, pvs);
+		}
+		search.Left.pop_back();
+		search.Right.pop_back();
+	}
+}
+
+void Maze::BuildCellPvs(uint32 cell, PvsSearch& search, std::vector<uint32>& pvs)const
+{
+	// Start a new search; on wrapping around, old stamps could match again.
+	if(++search.CurrentStamp == 0)
+	{
+		std::fill(search.Stamp.begin(), search.Stamp.end(), 0);
+		search.CurrentStamp = 1;
+	}
+	search.Stamp[cell] = search.CurrentStamp;
+
+	// Every line of sight leaves the cell through a sequence of portals, so walking
+	// all the sequences some line stabs finds every visible cell.
+
+	pvs.assign(1, cell);
+	ExtendPvs(cell, 0, 0, StabbingLine(), search, pvs);
+
+	std::sort(pvs.begin(), pvs.end());
+}
+
+void Maze::BuildPvs()
+{
+	// Idle searches, reused across cells as MazeNavigator reuses its contexts, so no
+	// cell pays for clearing a buffer the size of the maze.
+	std::mutex searchLock;
+	std::vector<std::unique_ptr<PvsSearch>> freeSearches;
+
+	std::vector<std::vector<uint32>> lists(CellCount());
+	ParallelFor(0, (int)CellCount(), [this, &lists, &searchLock, &freeSearches](int cell)
+	{
+		std::unique_ptr<PvsSearch> search;
+		{
+			std::lock_guard<std::mutex> lock(searchLock);
+			if(!freeSearches.empty())
+			{
+				search = std::move(freeSearches.back());
+				freeSearches.pop_back();
+			}
+		}
+
+		if(!search)
+		{
+			search = std::make_unique<PvsSearch>();
+			search->Stamp.assign(CellCount(), 0);
+		}
+
+		BuildCellPvs((uint32)cell, *search, lists[cell]);
+
+		std::lock_guard<std::mutex> lock(searchLock);
+		freeSearches.push_back(std::move(search));
+	});
+
+	mPvsOffsets.assign(CellCount() + 1, 0);
+	mPvsCells.clear();
+	for(uint32 c = 0; c < CellCount(); ++c)
+	{
+		mPvsOffsets[c] = (uint32)mPvsCells.size();
+		mPvsCells.insert(mPvsCells.end(), lists[c].begin(), lists[c].end());
+	}
+	mPvsOffsets[CellCount()] = (uint32)mPvsCells.size();
+}
+
+std::uint64_t Maze::WallHash()const
+{
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	hash = Fnv1a(hash, &mWidth, sizeof(mWidth));
+	hash = Fnv1a(hash, &mDepth, sizeof(mDepth));
+	hash = Fnv1a(hash, mWallsX.data(), mWallsX.size() * sizeof(std::uint64_t));
+	hash = Fnv1a(hash, mWallsZ.data(), mWallsZ.size() * sizeof(std::uint64_t));
+	return hash;
+}
+
+bool Maze::SavePvs(const std::string& filename)const
+{
+	assert(HasPvs());
+
+	PvsFileHeader header;
+	header.Magic = PvsMagic;
+	header.Version = PvsVersion;
+	header.Width = mWidth;
+	header.Depth = mDepth;
+	header.WallHash = WallHash();
+	header.CellCount = CellCount();
+	header.EntryCount = (uint32)mPvsCells.size();
+
+	std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fout.write(reinterpret_cast<const char*>(mPvsOffsets.data()), mPvsOffsets.size() * sizeof(uint32));
+	fout.write(reinterpret_cast<const char*>(mPvsCells.data()), mPvsCells.size() * sizeof(uint32));
+	return fout.good();
+}
+
+bool Maze::LoadPvs(const std::string& filename)
+{
+	std::ifstream fin(filename, std::ios::binary);
+	if(!fin)
+		return false;
+
+	PvsFileHeader header;
+	if(!fin.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+
+	if(header.Magic != PvsMagic || header.Version != PvsVersion ||
+		header.Width != mWidth || header.Depth != mDepth || header.WallHash != WallHash() ||
+		header.CellCount != CellCount())
+		return false;
+
+	std::vector<uint32> offsets(header.CellCount + 1);
+	std::vector<uint32> cells(header.EntryCount);
+	fin.read(reinterpret_cast<char*>(offsets.data()), offsets.size() * sizeof(uint32));
+	fin.read(reinterpret_cast<char*>(cells.data()), cells.size() * sizeof(uint32));
+	if(!fin)
+		return false;
+
+	// Make sure the lists can be walked without further checks.
+	if(offsets[0] != 0 || offsets[header.CellCount] != header.EntryCount)
+		return false;
+	for(uint32 c = 0; c < header.CellCount; ++c)
+	{
+		if(offsets[c] > offsets[c + 1])
+			return false;
+	}
+	for(uint32 cell : cells)
+	{
+		if(cell >= header.CellCount)
+			return false;
+	}
+
+	mPvsOffsets.swap(offsets);
+	mPvsCells.swap(cells);
+	return true;
+}
+
+bool Maze::FindVisibleCells(const XMFLOAT3& eye, std::vector<std::uint8_t>& visible)
+{
+	assert(HasPvs());
+
+	uint32 cell = CellAt(eye.x, eye.z);
+	if(cell == InvalidCell || eye.y < mWallBottom || eye.y > mWallTop)
+		return false;
+
+	visible.assign(CellCount(), 0);
+	mInPvs.assign(CellCount(), 0);
+	mOnPath.assign(CellCount(), 0);
+	for(const uint32* c = PvsBegin(cell); c != PvsEnd(cell); ++c)
+		mInPvs[*c] = 1;
+
+	mVisitBudget = VisitsPerCell * (uint32)(PvsEnd(cell) - PvsBegin(cell));
+
+	float eyeX = (eye.x - mOrigin.x) / mCellSize;
+	float eyeZ = (eye.z - mOrigin.y) / mCellSize;
+	VisitCell(cell, Cone(), eyeX, eyeZ, visible);
+	return true;
+}
+
+void Maze::VisitCell(uint32 cell, const Cone& cone, float eyeX, float eyeZ, std::vector<std::uint8_t>& visible)
+{
+	visible[cell] = 1;
+
+	// Out of budget, see everything the PVS allows instead of walking further.
+	if(mVisitBudget == 0)
+	{
+		for(uint32 c = 0; c < CellCount(); ++c)
+			visible[c] |= mInPvs[c];
+		return;
+	}
+	--mVisitBudget;
+
+	mOnPath[cell] = 1;
+
+	uint32 x = cell % mWidth;
+	uint32 z = cell / mWidth;
+
+	// Each opening as its neighbor and the two ends of the portal, in cell units.
+	struct Portal
+	{
+		bool Open;
+		uint32 Neighbor;
+		float AX, AZ, BX, BZ;
+	};
+	Portal portals[4] =
+	{
+		{ x > 0 && !WallX(x, z), cell - 1, (float)x, (float)z, (float)x, (float)z + 1.0f },
+		{ x + 1 < mWidth && !WallX(x + 1, z), cell + 1, (float)x + 1.0f, (float)z, (float)x + 1.0f, (float)z + 1.0f },
+		{ z > 0 && !WallZ(x, z), cell - mWidth, (float)x, (float)z, (float)x + 1.0f, (float)z },
+		{ z + 1 < mDepth && !WallZ(x, z + 1), cell + mWidth, (float)x, (float)z + 1.0f, (float)x + 1.0f, (float)z + 1.0f },
+	};
+
+	const float eps = 1.0e-6f;
+	for(const Portal& p : portals)
+	{
+		if(!p.Open || !mInPvs[p.Neighbor] || mOnPath[p.Neighbor])
+			continue;
+
+		// The cone the portal subtends from the eye.  An eye on the portal's line
+		// sees through it in every direction that matters.
+		float ax = p.AX - eyeX, az = p.AZ - eyeZ;
+		float bx = p.BX - eyeX, bz = p.BZ - eyeZ;
+		float side = Cross(ax, az, bx, bz);
+
+		Cone portalCone;
+		if(std::abs(side) > eps)
+		{
+			portalCone.Full = false;
+			if(side > 0.0f)
+			{
+				portalCone.RightX = ax; portalCone.RightZ = az;
+				portalCone.LeftX = bx; portalCone.LeftZ = bz;
+			}
+			else
+			{
+				portalCone.RightX = bx; portalCone.RightZ = bz;
+				portalCone.LeftX = ax; portalCone.LeftZ = az;
+			}
+		}
+
+		// Intersect with the cone that reached this cell: the inner of the two right
+		// edges and the inner of the two left edges.
+		Cone next;
+		if(cone.Full)
+			next = portalCone;
+		else if(portalCone.Full)
+			next = cone;
+		else
+		{
+			next.Full = false;
+
+			bool portalRightInner = Cross(cone.RightX, cone.RightZ, portalCone.RightX, portalCone.RightZ) > 0.0f;
+			next.RightX = portalRightInner ? portalCone.RightX : cone.RightX;
+			next.RightZ = portalRightInner ? portalCone.RightZ : cone.RightZ;
+
+			bool portalLeftInner = Cross(cone.LeftX, cone.LeftZ, portalCone.LeftX, portalCone.LeftZ) < 0.0f;
+			next.LeftX = portalLeftInner ? portalCone.LeftX : cone.LeftX;
+			next.LeftZ = portalLeftInner ? portalCone.LeftZ : cone.LeftZ;
+
+			// Empty unless the edges are in order and each lies in both cones; the
+			// second check catches cones on opposite sides of the eye.
+			auto inside = [eps](const Cone& c, float dx, float dz)
+			{
+				return Cross(c.RightX, c.RightZ, dx, dz) >= -eps && Cross(dx, dz, c.LeftX, c.LeftZ) >= -eps;
+			};
+			if(Cross(next.RightX, next.RightZ, next.LeftX, next.LeftZ) < -eps)
+				continue;
+			if(!inside(cone, next.RightX, next.RightZ) || !inside(cone, next.LeftX, next.LeftZ) ||
+				!inside(portalCone, next.RightX, next.RightZ) || !inside(portalCone, next.LeftX, next.LeftZ))
+				continue;
+		}
+
+		VisitCell(p.Neighbor, next, eyeX, eyeZ, visible);
+	}
+
+	mOnPath[cell] = 0;
+}
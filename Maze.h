@@ -0,0 +1,179 @@
+//***************************************************************************************
+// Maze.h
+//
+// A grid maze: Width x Depth square cells with walls on the grid lines between them,
+// and the visibility information used to cull everything in the maze that cannot be
+// seen from the camera's cell.
+//
+// Walls are stored a bit each, so a 1000 x 1000 maze takes about 250KB, and Generate
+// carves random perfect mazes of that size in a few tens of milliseconds.
+//
+// Visibility has two parts.  The potentially visible set (PVS) of a cell lists every
+// cell that some line of sight from inside it reaches without crossing a wall; it is
+// built once, in parallel, and cached on disk.  At run time the cells of the camera's
+// PVS are walked through the openings (portals) in the walls, narrowing the view cone
+// at every portal, which leaves the cells actually visible from the eye.
+//
+// Both work in the horizontal plane and treat the walls as infinitely thin, which
+// only errs towards visibility.  They hold for an eye and targets between the bottom
+// and the top of the walls.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+
+class Maze
+{
+public:
+	using uint32 = std::uint32_t;
+
+	static const uint32 InvalidCell = 0xffffffff;
+
+	Maze() = default;
+	Maze(const Maze& rhs) = delete;
+	Maze& operator=(const Maze& rhs) = delete;
+
+	// Makes a width x depth maze with every wall standing, and clears the PVS.
+	void Reset(uint32 width, uint32 depth);
+
+	// Makes a random width x depth maze in which every cell reaches every other by
+	// exactly one path (a depth first "recursive backtracker" maze, with long winding
+	// corridors), with an entrance in the south wall of cell (0, 0) and an exit in the
+	// north wall of the last cell.  The same seed gives the same maze.  Returns false,
+	// leaving an empty maze, if width or depth is 0.
+	bool Generate(uint32 width, uint32 depth, uint32 seed);
+
+	// Maps the grid into the maze's local space: cell (x, z) covers
+	// [origin.x + x*cellSize, origin.x + (x+1)*cellSize] and likewise in z, and the walls
+	// reach from wallBottom to wallTop.
+	void SetPlacement(const DirectX::XMFLOAT2& origin, float cellSize, float wallBottom, float wallTop);
+
+	uint32 Width()const { return mWidth; }
+	uint32 Depth()const { return mDepth; }
+	uint32 CellCount()const { return mWidth * mDepth; }
+	uint32 CellIndex(uint32 x, uint32 z)const { return z * mWidth + x; }
+
+	const DirectX::XMFLOAT2& Origin()const { return mOrigin; }
+	float CellSize()const { return mCellSize; }
+	float WallBottom()const { return mWallBottom; }
+	float WallTop()const { return mWallTop; }
+
+	// WallX(x, z) is the wall on grid line x between cells (x-1, z) and (x, z), for x in
+	// [0, Width].  WallZ(x, z) is the wall on grid line z between cells (x, z-1) and
+	// (x, z), for z in [0, Depth].
+	bool WallX(uint32 x, uint32 z)const { return TestBit(mWallsX, z * (mWidth + 1) + x); }
+	bool WallZ(uint32 x, uint32 z)const { return TestBit(mWallsZ, z * mWidth + x); }
+	void SetWallX(uint32 x, uint32 z, bool wall);
+	void SetWallZ(uint32 x, uint32 z, bool wall);
+
+	// The cell containing a point of local space, or InvalidCell.
+	uint32 CellAt(float x, float z)const;
+
+	// Computes the PVS of every cell.  Wall changes invalidate it.
+	void BuildPvs();
+	bool HasPvs()const { return !mPvsOffsets.empty(); }
+
+	// The PVS is stored with a hash of the walls; LoadPvs fails if the file is missing,
+	// damaged, or was built for other walls.
+	bool SavePvs(const std::string& filename)const;
+	bool LoadPvs(const std::string& filename);
+
+	// Hash of the size and walls, for caches of anything built from them.
+	std::uint64_t WallHash()const;
+
+	// Cells visible from a cell, in increasing order and including itself.
+	const uint32* PvsBegin(uint32 cell)const { return mPvsCells.data() + mPvsOffsets[cell]; }
+	const uint32* PvsEnd(uint32 cell)const { return mPvsCells.data() + mPvsOffsets[cell + 1]; }
+
+	// Sets visible[cell] to 1 for the cells seen from an eye in local space and to 0
+	// for the rest.  Returns false, leaving visible alone, if the eye is outside the
+	// maze or above or below its walls, where the PVS says nothing.
+	bool FindVisibleCells(const DirectX::XMFLOAT3& eye, std::vector<std::uint8_t>& visible);
+
+private:
+	// View cone in the horizontal plane, from direction Right counterclockwise to
+	// direction Left, less than a half turn wide.  Full cones cover every direction.
+	struct Cone
+	{
+		bool Full = true;
+		float RightX = 0.0f, RightZ = 0.0f;
+		float LeftX = 0.0f, LeftZ = 0.0f;
+	};
+
+	static bool TestBit(const std::vector<std::uint64_t>& bits, uint32 i)
+	{
+		return ((bits[i >> 6] >> (i & 63)) & 1) != 0;
+	}
+	static void SetBit(std::vector<std::uint64_t>& bits, uint32 i, bool value)
+	{
+		std::uint64_t mask = std::uint64_t(1) << (i & 63);
+		bits[i >> 6] = value ? bits[i >> 6] | mask : bits[i >> 6] & ~mask;
+	}
+
+	// A point on the grid of portal ends; see PortalScale.
+	struct GridPoint
+	{
+		std::int32_t X;
+		std::int32_t Z;
+	};
+
+	// A line through Point along (DX, DZ).  Stabbing lines have the portals' left ends
+	// on their left, where Side is positive.
+	struct StabbingLine
+	{
+		GridPoint Point;
+		std::int64_t DX;
+		std::int64_t DZ;
+
+		std::int64_t Side(const GridPoint& p)const;
+	};
+
+	// State of the search for the cells a cell sees: the ends of the portals on the
+	// current path, and the cells found so far, which are those whose Stamp matches the
+	// search under way.
+	struct PvsSearch
+	{
+		std::vector<GridPoint> Left;
+		std::vector<GridPoint> Right;
+		std::vector<uint32> Stamp;
+		uint32 CurrentStamp = 0;
+	};
+
+	// True if some line passes every portal on the search's path.  line is one that
+	// passes all but the last, and is replaced by one passing them all.
+	static bool FindStabbingLine(const PvsSearch& search, StabbingLine& line);
+
+	// Follows the portals out of cell that some line through the path so far can also
+	// pass.  stepX and stepZ are the signs of the path's steps along each axis, and
+	// line passes the whole path.
+	void ExtendPvs(uint32 cell, int stepX, int stepZ, const StabbingLine& line, PvsSearch& search,
+		std::vector<uint32>& pvs)const;
+	void BuildCellPvs(uint32 cell, PvsSearch& search, std::vector<uint32>& pvs)const;
+	void VisitCell(uint32 cell, const Cone& cone, float eyeX, float eyeZ, std::vector<std::uint8_t>& visible);
+
+	uint32 mWidth = 0;
+	uint32 mDepth = 0;
+
+	DirectX::XMFLOAT2 mOrigin = { 0.0f, 0.0f };
+	float mCellSize = 1.0f;
+	float mWallBottom = 0.0f;
+	float mWallTop = 1.0f;
+
+	// Bit z*(Width + 1) + x of mWallsX is WallX(x, z), bit z*Width + x of mWallsZ is
+	// WallZ(x, z).
+	std::vector<std::uint64_t> mWallsX;
+	std::vector<std::uint64_t> mWallsZ;
+
+	// PVS of cell c is mPvsCells[mPvsOffsets[c], mPvsOffsets[c + 1]).
+	std::vector<uint32> mPvsOffsets;
+	std::vector<uint32> mPvsCells;
+
+	// Traversal state for FindVisibleCells.
+	std::vector<std::uint8_t> mInPvs;
+	std::vector<std::uint8_t> mOnPath;
+	uint32 mVisitBudget = 0;
+};
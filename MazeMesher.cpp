@@ -0,0 +1,164 @@
+//***************************************************************************************
+// MazeMesher.cpp
+//***************************************************************************************
+
+#include "MazeMesher.h"
+
+using namespace DirectX;
+
+MazeMesher::MazeMesher(const Maze& maze, float wallThickness, float texTileLength) :
+	mMaze(maze),
+	mHalfThickness(0.5f * wallThickness),
+	mTexScale(1.0f / texTileLength)
+{
+}
+
+bool MazeMesher::Solid(int tx, int tz)const
+{
+	if(tx < 0 || tz < 0 || tx > 2 * (int)mMaze.Width() || tz > 2 * (int)mMaze.Depth())
+		return false;
+
+	bool oddX = (tx & 1) != 0;
+	bool oddZ = (tz & 1) != 0;
+	if(oddX && oddZ)
+		return false;
+	if(oddX)
+		return mMaze.WallZ(tx / 2, tz / 2);
+	if(oddZ)
+		return mMaze.WallX(tx / 2, tz / 2);
+	return true;
+}
+
+float MazeMesher::TileEdgeX(int tx)const
+{
+	// Post columns start half a thickness before their grid line, wall spans half a
+	// thickness after it.
+	float line = mMaze.Origin().x + (tx / 2) * mMaze.CellSize();
+	return (tx & 1) ? line + mHalfThickness : line - mHalfThickness;
+}
+
+float MazeMesher::TileEdgeZ(int tz)const
+{
+	float line = mMaze.Origin().y + (tz / 2) * mMaze.CellSize();
+	return (tz & 1) ? line + mHalfThickness : line - mHalfThickness;
+}
+
+void MazeMesher::BuildQuads(uint32 x0, uint32 z0, uint32 x1, uint32 z1, std::vector<Quad>& quads)const
+{
+	// Tile range of the block, with the outer post and wall line on the far edges.
+	int tx0 = 2 * (int)x0;
+	int tz0 = 2 * (int)z0;
+	int tx1 = x1 == mMaze.Width() ? 2 * (int)x1 + 1 : 2 * (int)x1;
+	int tz1 = z1 == mMaze.Depth() ? 2 * (int)z1 + 1 : 2 * (int)z1;
+	int cols = tx1 - tx0;
+	int rows = tz1 - tz0;
+
+	float bottom = mMaze.WallBottom();
+	float top = mMaze.WallTop();
+	float height = top - bottom;
+
+	// Sides start the texture at the top of the wall, as the boxes did.
+	float sideVOffset = top * mTexScale;
+
+	// Tops and bottoms.  Each rectangle grows along x as far as it can, then along z
+	// while every tile of its width stays solid.
+	std::vector<std::uint8_t> used(cols * rows, 0);
+	auto available = [&](int c, int r) { return !used[r * cols + c] && Solid(tx0 + c, tz0 + r); };
+	for(int r = 0; r < rows; ++r)
+	{
+		for(int c = 0; c < cols; ++c)
+		{
+			if(!available(c, r))
+				continue;
+
+			int c1 = c + 1;
+			while(c1 < cols && available(c1, r))
+				++c1;
+
+			int r1 = r + 1;
+			for(; r1 < rows; ++r1)
+			{
+				int k = c;
+				while(k < c1 && available(k, r1))
+					++k;
+				if(k < c1)
+					break;
+			}
+
+			for(int rr = r; rr < r1; ++rr)
+				for(int cc = c; cc < c1; ++cc)
+					used[rr * cols + cc] = 1;
+
+			float xa = TileEdgeX(tx0 + c), xb = TileEdgeX(tx0 + c1);
+			float za = TileEdgeZ(tz0 + r), zb = TileEdgeZ(tz0 + r1);
+			quads.push_back({ XMFLOAT3(xa, top, za), XMFLOAT3(0.0f, 0.0f, zb - za), XMFLOAT3(xb - xa, 0.0f, 0.0f),
+				XMFLOAT3(0.0f, 1.0f, 0.0f), 0.0f });
+			quads.push_back({ XMFLOAT3(xa, bottom, zb), XMFLOAT3(0.0f, 0.0f, za - zb), XMFLOAT3(xb - xa, 0.0f, 0.0f),
+				XMFLOAT3(0.0f, -1.0f, 0.0f), 0.0f });
+		}
+	}
+
+	XMFLOAT3 up(0.0f, height, 0.0f);
+
+	// Sides facing -x and +x, each a run of exposed tiles along a column.
+	for(int c = 0; c < cols; ++c)
+	{
+		int tx = tx0 + c;
+		for(int side = -1; side <= 1; side += 2)
+		{
+			auto exposed = [&](int r) { return Solid(tx, tz0 + r) && !Solid(tx + side, tz0 + r); };
+			for(int r = 0; r < rows; )
+			{
+				if(!exposed(r))
+				{
+					++r;
+					continue;
+				}
+
+				int r1 = r + 1;
+				while(r1 < rows && exposed(r1))
+					++r1;
+
+				float za = TileEdgeZ(tz0 + r), zb = TileEdgeZ(tz0 + r1);
+				if(side < 0)
+					quads.push_back({ XMFLOAT3(TileEdgeX(tx), bottom, zb), up, XMFLOAT3(0.0f, 0.0f, za - zb),
+						XMFLOAT3(-1.0f, 0.0f, 0.0f), sideVOffset });
+				else
+					quads.push_back({ XMFLOAT3(TileEdgeX(tx + 1), bottom, za), up, XMFLOAT3(0.0f, 0.0f, zb - za),
+						XMFLOAT3(1.0f, 0.0f, 0.0f), sideVOffset });
+				r = r1;
+			}
+		}
+	}
+
+	// Sides facing -z and +z, each a run of exposed tiles along a row.
+	for(int r = 0; r < rows; ++r)
+	{
+		int tz = tz0 + r;
+		for(int side = -1; side <= 1; side += 2)
+		{
+			auto exposed = [&](int c) { return Solid(tx0 + c, tz) && !Solid(tx0 + c, tz + side); };
+			for(int c = 0; c < cols; )
+			{
+				if(!exposed(c))
+				{
+					++c;
+					continue;
+				}
+
+				int c1 = c + 1;
+				while(c1 < cols && exposed(c1))
+					++c1;
+
+				float xa = TileEdgeX(tx0 + c), xb = TileEdgeX(tx0 + c1);
+				if(side < 0)
+					quads.push_back({ XMFLOAT3(xa, bottom, TileEdgeZ(tz)), up, XMFLOAT3(xb - xa, 0.0f, 0.0f),
+						XMFLOAT3(0.0f, 0.0f, -1.0f), sideVOffset });
+				else
+					quads.push_back({ XMFLOAT3(xb, bottom, TileEdgeZ(tz + 1)), up, XMFLOAT3(xa - xb, 0.0f, 0.0f),
+						XMFLOAT3(0.0f, 0.0f, 1.0f), sideVOffset });
+				c = c1;
+			}
+		}
+	}
+}
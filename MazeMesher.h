@@ -0,0 +1,123 @@
+//***************************************************************************************
+// MazeMesher.h
+//
+// Builds the wall geometry of a Maze.  The walls and the posts at the grid corners are
+// all the same height, so the maze is a 2D grid of solid tiles, posts alternating with
+// the wall spans between them, extruded between the bottom and top of the walls.
+//
+// Runs of solid tiles are merged into long slabs: tops and bottoms are greedy rectangles
+// and sides are emitted only where a solid tile borders an empty one, merged along the
+// wall.  Texture coordinates come from world position, so the wall texture tiles at the
+// same rate however long a slab is.
+//
+// Blocks are meshed as a list of quads first, so the caller knows every block's size
+// before writing the vertices, in its own vertex format, straight into a merged buffer.
+//***************************************************************************************
+
+#pragma once
+
+#include "Maze.h"
+#include "Common/GeometryGenerator.h"
+
+#include <cmath>
+
+class MazeMesher
+{
+public:
+	using uint32 = std::uint32_t;
+
+	// The quad with corners P, P + Up, P + Up + Right and P + Right, facing away along
+	// Normal.  Its texture v coordinate starts at VOffset.
+	struct Quad
+	{
+		DirectX::XMFLOAT3 P;
+		DirectX::XMFLOAT3 Up;
+		DirectX::XMFLOAT3 Right;
+		DirectX::XMFLOAT3 Normal;
+		float VOffset;
+	};
+
+	// Vertices and indices WriteQuads writes per quad.
+	static const uint32 QuadVertexCount = 4;
+	static const uint32 QuadIndexCount = 6;
+
+	// The maze must outlive the mesher.  Walls and posts are wallThickness wide, and the
+	// texture repeats every texTileLength units.
+	MazeMesher(const Maze& maze, float wallThickness, float texTileLength);
+	MazeMesher(const MazeMesher& rhs) = delete;
+	MazeMesher& operator=(const MazeMesher& rhs) = delete;
+
+	// Appends the quads of the walls belonging to cells [x0, x1) x [z0, z1).  A cell owns
+	// its west and south walls and the post between them; the cells on the east and
+	// north edges of the maze also own the walls and posts on those edges.  Meshing
+	// every block of a partition of the maze gives the whole maze without hidden faces.
+	void BuildQuads(uint32 x0, uint32 z0, uint32 x1, uint32 z1, std::vector<Quad>& quads)const;
+
+	// Writes the quads through a GeometryGenerator vertex layout, QuadVertexCount
+	// vertices and QuadIndexCount indices each, indices counting from the first vertex.
+	template<typename Layout, typename Index>
+	void WriteQuads(const std::vector<Quad>& quads, typename Layout::VertexType* vertices, Index* indices)const;
+
+private:
+	// Tile (tx, tz) of the (2*Width + 1) x (2*Depth + 1) tile grid: posts at even
+	// (tx, tz), walls where one is odd, cell interiors where both are.
+	bool Solid(int tx, int tz)const;
+
+	// Position of the low edge of a tile column or row.
+	float TileEdgeX(int tx)const;
+	float TileEdgeZ(int tz)const;
+
+	const Maze& mMaze;
+	float mHalfThickness;
+	float mTexScale;
+};
+
+template<typename Layout, typename Index>
+void MazeMesher::WriteQuads(const std::vector<Quad>& quads, typename Layout::VertexType* vertices, Index* indices)const
+{
+	using namespace DirectX;
+
+	for(size_t q = 0; q < quads.size(); ++q)
+	{
+		const Quad& quad = quads[q];
+		const XMFLOAT3& p = quad.P;
+		const XMFLOAT3& up = quad.Up;
+		const XMFLOAT3& right = quad.Right;
+
+		// Quads are axis aligned, so the texture axes are the unit edge directions.
+		float upLength = std::sqrt(up.x * up.x + up.y * up.y + up.z * up.z);
+		float rightLength = std::sqrt(right.x * right.x + right.y * right.y + right.z * right.z);
+		XMFLOAT3 uAxis(right.x / rightLength, right.y / rightLength, right.z / rightLength);
+		XMFLOAT3 vAxis(up.x / upLength, up.y / upLength, up.z / upLength);
+
+		XMFLOAT3 corners[4] =
+		{
+			p,
+			XMFLOAT3(p.x + up.x, p.y + up.y, p.z + up.z),
+			XMFLOAT3(p.x + up.x + right.x, p.y + up.y + right.y, p.z + up.z + right.z),
+			XMFLOAT3(p.x + right.x, p.y + right.y, p.z + right.z)
+		};
+
+		for(int i = 0; i < 4; ++i)
+		{
+			// Texture space follows the world, so abutting quads line up.
+			const XMFLOAT3& c = corners[i];
+			float u = (c.x * uAxis.x + c.y * uAxis.y + c.z * uAxis.z) * mTexScale;
+			float v = quad.VOffset - (c.x * vAxis.x + c.y * vAxis.y + c.z * vAxis.z) * mTexScale;
+
+			auto& vertex = vertices[QuadVertexCount * q + i];
+			Layout::Set(vertex, c, quad.Normal, XMFLOAT2(u, v));
+			if(Layout::Tangents)
+				Layout::SetTangent(vertex, uAxis);
+		}
+
+		uint32 base = QuadVertexCount * (uint32)q;
+		Index* out = indices + QuadIndexCount * q;
+		out[0] = GeometryGenerator::NarrowIndex<Index>(base);
+		out[1] = GeometryGenerator::NarrowIndex<Index>(base + 1);
+		out[2] = GeometryGenerator::NarrowIndex<Index>(base + 2);
+		out[3] = GeometryGenerator::NarrowIndex<Index>(base);
+		out[4] = GeometryGenerator::NarrowIndex<Index>(base + 2);
+		out[5] = GeometryGenerator::NarrowIndex<Index>(base + 3);
+	}
+}
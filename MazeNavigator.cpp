@@ -0,0 +1,314 @@
+//***************************************************************************************
+// MazeNavigator.cpp
+//***************************************************************************************
+
+#include "MazeNavigator.h"
+#include "Common/ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+namespace
+{
+	MazeNavigator::Direction Opposite(MazeNavigator::Direction dir)
+	{
+		return (MazeNavigator::Direction)(dir ^ 1);
+	}
+}
+
+void MazeNavigator::Build(const Maze& maze)
+{
+	mWidth = maze.Width();
+	mDepth = maze.Depth();
+	mOpen.assign(maze.CellCount(), 0);
+
+	ParallelFor(0, (int)mDepth, [this, &maze](int row)
+	{
+		uint32 z = (uint32)row;
+		for(uint32 x = 0; x < mWidth; ++x)
+		{
+			// Openings in the outer wall lead out of the grid, so they are not steps.
+			std::uint8_t open = 0;
+			if(x > 0 && !maze.WallX(x, z))
+				open |= 1 << West;
+			if(x + 1 < mWidth && !maze.WallX(x + 1, z))
+				open |= 1 << East;
+			if(z > 0 && !maze.WallZ(x, z))
+				open |= 1 << South;
+			if(z + 1 < mDepth && !maze.WallZ(x, z + 1))
+				open |= 1 << North;
+			mOpen[z * mWidth + x] = open;
+		}
+	});
+
+	std::lock_guard<std::mutex> lock(mContextLock);
+	mFreeContexts.clear();
+}
+
+MazeNavigator::uint32 MazeNavigator::Neighbor(uint32 cell, Direction dir)const
+{
+	switch(dir)
+	{
+	case West: return cell - 1;
+	case East: return cell + 1;
+	case South: return cell - mWidth;
+	default: return cell + mWidth;
+	}
+}
+
+MazeNavigator::uint32 MazeNavigator::Heuristic(uint32 cell, uint32 goal)const
+{
+	int dx = (int)(cell % mWidth) - (int)(goal % mWidth);
+	int dz = (int)(cell / mWidth) - (int)(goal / mWidth);
+	return (uint32)(std::abs(dx) + std::abs(dz));
+}
+
+MazeNavigator::uint32 MazeNavigator::Jump(uint32 cell, Direction dir, uint32 goal, uint32& steps)const
+{
+	// Moving along x the sides are south and north, and the other way round.
+	std::uint8_t sides = dir <= East ? (1 << South) | (1 << North) : (1 << West) | (1 << East);
+
+	steps = 0;
+	while(CanStep(cell, dir))
+	{
+		cell = Neighbor(cell, dir);
+		++steps;
+
+		if(cell == goal || (mOpen[cell] & sides) != 0)
+			return cell;
+	}
+
+	// Ran into a wall with no way off the line: a dead end.
+	return Maze::InvalidCell;
+}
+
+std::unique_ptr<MazeNavigator::SearchContext> MazeNavigator::AcquireContext()const
+{
+	std::unique_ptr<SearchContext> context;
+	{
+		std::lock_guard<std::mutex> lock(mContextLock);
+		if(!mFreeContexts.empty())
+		{
+			context = std::move(mFreeContexts.back());
+			mFreeContexts.pop_back();
+		}
+	}
+
+	if(!context)
+		context = std::make_unique<SearchContext>();
+
+	if(context->Stamp.size() != mOpen.size())
+	{
+		context->Stamp.assign(mOpen.size(), 0);
+		context->Cost.resize(mOpen.size());
+		context->Parent.resize(mOpen.size());
+		context->CurrentStamp = 0;
+	}
+
+	// Start a new search; on wrapping around, old stamps could match again.
+	if(++context->CurrentStamp == 0)
+	{
+		std::fill(context->Stamp.begin(), context->Stamp.end(), 0);
+		context->CurrentStamp = 1;
+	}
+	return context;
+}
+
+void MazeNavigator::ReleaseContext(std::unique_ptr<SearchContext> context)const
+{
+	std::lock_guard<std::mutex> lock(mContextLock);
+	mFreeContexts.push_back(std::move(context));
+}
+
+bool MazeNavigator::FindPath(uint32 start, uint32 goal, PathResult& result)const
+{
+	assert(start < mOpen.size() && goal < mOpen.size());
+
+	result.Found = false;
+	result.Length = 0;
+	result.Waypoints.clear();
+
+	std::unique_ptr<SearchContext> context = AcquireContext();
+	SearchContext& s = *context;
+	const uint32 stamp = s.CurrentStamp;
+
+	s.Open.clear();
+	s.Stamp[start] = stamp;
+	s.Cost[start] = 0;
+	s.Parent[start] = start;
+	s.Open.push_back({ Heuristic(start, goal), start });
+
+	while(!s.Open.empty())
+	{
+		std::pop_heap(s.Open.begin(), s.Open.end());
+		SearchContext::OpenNode node = s.Open.back();
+		s.Open.pop_back();
+
+		uint32 cell = node.Cell;
+		uint32 cost = s.Cost[cell];
+
+		// A later, cheaper visit already replaced this entry.
+		if(node.F != cost + Heuristic(cell, goal))
+			continue;
+
+		if(cell == goal)
+		{
+			result.Found = true;
+			result.Length = cost;
+			for(uint32 c = goal; ; c = s.Parent[c])
+			{
+				result.Waypoints.push_back(c);
+				if(c == start)
+					break;
+			}
+			std::reverse(result.Waypoints.begin(), result.Waypoints.end());
+			break;
+		}
+
+		// Never straight back the way the search came.
+		uint32 parent = s.Parent[cell];
+		int back = DirectionCount;
+		if(parent != cell)
+		{
+			Direction arrived;
+			if(parent / mWidth == cell / mWidth)
+				arrived = parent < cell ? East : West;
+			else
+				arrived = parent < cell ? North : South;
+			back = Opposite(arrived);
+		}
+
+		for(int d = 0; d < DirectionCount; ++d)
+		{
+			Direction dir = (Direction)d;
+			if(d == back || !CanStep(cell, dir))
+				continue;
+
+			uint32 steps = 0;
+			uint32 next = Jump(cell, dir, goal, steps);
+			if(next == Maze::InvalidCell)
+				continue;
+
+			uint32 nextCost = cost + steps;
+			if(s.Stamp[next] == stamp && s.Cost[next] <= nextCost)
+				continue;
+
+			s.Stamp[next] = stamp;
+			s.Cost[next] = nextCost;
+			s.Parent[next] = cell;
+			s.Open.push_back({ nextCost + Heuristic(next, goal), next });
+			std::push_heap(s.Open.begin(), s.Open.end());
+		}
+	}
+
+	ReleaseContext(std::move(context));
+
+	// Drop waypoints where the path goes straight on, left by jumps that stopped at
+	// a junction without turning.
+	if(result.Waypoints.size() > 2)
+	{
+		size_t kept = 1;
+		for(size_t i = 1; i + 1 < result.Waypoints.size(); ++i)
+		{
+			uint32 prev = result.Waypoints[kept - 1];
+			uint32 curr = result.Waypoints[i];
+			uint32 next = result.Waypoints[i + 1];
+			bool straightX = prev / mWidth == curr / mWidth && curr / mWidth == next / mWidth;
+			bool straightZ = prev % mWidth == curr % mWidth && curr % mWidth == next % mWidth;
+			if(!straightX && !straightZ)
+				result.Waypoints[kept++] = curr;
+		}
+		result.Waypoints[kept++] = result.Waypoints.back();
+		result.Waypoints.resize(kept);
+	}
+
+	return result.Found;
+}
+
+void MazeNavigator::FindPaths(const std::vector<PathQuery>& queries, std::vector<PathResult>& results)const
+{
+	results.resize(queries.size());
+	ParallelFor(0, (int)queries.size(), [this, &queries, &results](int i)
+	{
+		FindPath(queries[i].Start, queries[i].Goal, results[i]);
+	});
+}
+
+void MazeNavigator::FillFlowDistances(uint32 goal, FlowField& field)const
+{
+	assert(goal < mOpen.size());
+
+	field.Goal = goal;
+	field.Distance.assign(mOpen.size(), Maze::InvalidCell);
+	field.Directions.resize(mOpen.size());
+
+	// Breadth first out from the goal gives every cell its distance.  Maze frontiers
+	// are only a few cells wide, so this part stays on one thread.
+	std::vector<uint32> queue;
+	queue.reserve(mOpen.size());
+	queue.push_back(goal);
+	field.Distance[goal] = 0;
+	for(size_t head = 0; head < queue.size(); ++head)
+	{
+		uint32 cell = queue[head];
+		uint32 next = field.Distance[cell] + 1;
+		for(int d = 0; d < DirectionCount; ++d)
+		{
+			if(!CanStep(cell, (Direction)d))
+				continue;
+
+			uint32 n = Neighbor(cell, (Direction)d);
+			if(field.Distance[n] == Maze::InvalidCell)
+			{
+				field.Distance[n] = next;
+				queue.push_back(n);
+			}
+		}
+	}
+}
+
+void MazeNavigator::FillFlowDirections(uint32 z, FlowField& field)const
+{
+	// Each cell steps to a neighbor one closer to the goal.
+	for(uint32 cell = z * mWidth; cell < (z + 1) * mWidth; ++cell)
+	{
+		uint32 dist = field.Distance[cell];
+		std::uint8_t dir = Unreachable;
+		if(dist == 0)
+			dir = AtGoal;
+		else if(dist != Maze::InvalidCell)
+		{
+			for(int d = 0; d < DirectionCount; ++d)
+			{
+				if(CanStep(cell, (Direction)d) && field.Distance[Neighbor(cell, (Direction)d)] == dist - 1)
+				{
+					dir = (std::uint8_t)d;
+					break;
+				}
+			}
+		}
+		field.Directions[cell] = dir;
+	}
+}
+
+void MazeNavigator::BuildFlowField(uint32 goal, FlowField& field)const
+{
+	FillFlowDistances(goal, field);
+	ParallelFor(0, (int)mDepth, [this, &field](int row)
+	{
+		FillFlowDirections((uint32)row, field);
+	});
+}
+
+void MazeNavigator::BuildFlowFields(const std::vector<uint32>& goals, std::vector<FlowField>& fields)const
+{
+	// The goals already keep every core busy, so the rows are not split again.
+	fields.resize(goals.size());
+	ParallelFor(0, (int)goals.size(), [this, &goals, &fields](int i)
+	{
+		FillFlowDistances(goals[i], fields[i]);
+		for(uint32 z = 0; z < mDepth; ++z)
+			FillFlowDirections(z, fields[i]);
+	});
+}
@@ -0,0 +1,136 @@
+//***************************************************************************************
+// MazeNavigator.h
+//
+// Path finding over a Maze.  The navigation grid is a byte per cell holding the sides
+// it can be left through.
+//
+// Paths are found with A* and jump point search: a search step runs straight down a
+// corridor until it reaches the goal or a cell with an opening to the side, so the
+// cells between junctions are never put on the open list and corridors that end in a
+// wall are dropped without any.  Paths are the turning points from start to goal;
+// agents walk straight between them.  Batches of queries run in parallel.
+//
+// Agents heading for the same goal should share a flow field instead: it holds the
+// direction to step in from every cell, so following it costs one lookup per agent.
+//***************************************************************************************
+
+#pragma once
+
+#include "Maze.h"
+
+#include <memory>
+#include <mutex>
+
+class MazeNavigator
+{
+public:
+	using uint32 = std::uint32_t;
+
+	// Sides of a cell, as bits of the navigation grid and as flow field directions.
+	enum Direction : std::uint8_t
+	{
+		West = 0,	// -x
+		East,		// +x
+		South,		// -z
+		North,		// +z
+		DirectionCount,
+
+		// Flow field values of the goal cell and of cells that cannot reach it.
+		AtGoal = 0xfe,
+		Unreachable = 0xff
+	};
+
+	struct PathQuery
+	{
+		uint32 Start = Maze::InvalidCell;
+		uint32 Goal = Maze::InvalidCell;
+	};
+
+	struct PathResult
+	{
+		bool Found = false;
+
+		// Steps from cell to cell along the path.
+		uint32 Length = 0;
+
+		// Start, each cell where the path turns, and goal.
+		std::vector<uint32> Waypoints;
+	};
+
+	struct FlowField
+	{
+		uint32 Goal = Maze::InvalidCell;
+
+		// Per cell: steps to the goal, or Maze::InvalidCell if it cannot be reached,
+		// and the Direction to step in.
+		std::vector<uint32> Distance;
+		std::vector<std::uint8_t> Directions;
+	};
+
+	MazeNavigator() = default;
+	MazeNavigator(const MazeNavigator& rhs) = delete;
+	MazeNavigator& operator=(const MazeNavigator& rhs) = delete;
+
+	// Builds the navigation grid from the maze's walls.  Call again after they change.
+	void Build(const Maze& maze);
+
+	uint32 Width()const { return mWidth; }
+	uint32 Depth()const { return mDepth; }
+
+	bool CanStep(uint32 cell, Direction dir)const { return (mOpen[cell] >> dir) & 1; }
+	uint32 Neighbor(uint32 cell, Direction dir)const;
+
+	// Finds a shortest path.  Safe to call from several threads at once.
+	bool FindPath(uint32 start, uint32 goal, PathResult& result)const;
+
+	// Answers every query, spread over the available cores.
+	void FindPaths(const std::vector<PathQuery>& queries, std::vector<PathResult>& results)const;
+
+	// Fills a flow field towards goal.  The per-cell directions are worked out in
+	// parallel once the distances are known.
+	void BuildFlowField(uint32 goal, FlowField& field)const;
+
+	// Builds a flow field per goal, in parallel over the goals; each field's rows are
+	// filled on the thread building it.
+	void BuildFlowFields(const std::vector<uint32>& goals, std::vector<FlowField>& fields)const;
+
+private:
+	// Per-search bookkeeping.  Entries are valid only where Stamp matches the search
+	// under way, so nothing has to be cleared between searches.
+	struct SearchContext
+	{
+		struct OpenNode
+		{
+			uint32 F;
+			uint32 Cell;
+			bool operator<(const OpenNode& rhs)const { return F > rhs.F; }
+		};
+
+		std::vector<uint32> Stamp;
+		std::vector<uint32> Cost;
+		std::vector<uint32> Parent;
+		std::vector<OpenNode> Open;
+		uint32 CurrentStamp = 0;
+	};
+
+	// The two halves of a flow field: the distances from the goal, then the directions
+	// of the cells in row z.
+	void FillFlowDistances(uint32 goal, FlowField& field)const;
+	void FillFlowDirections(uint32 z, FlowField& field)const;
+
+	uint32 Jump(uint32 cell, Direction dir, uint32 goal, uint32& steps)const;
+	uint32 Heuristic(uint32 cell, uint32 goal)const;
+
+	std::unique_ptr<SearchContext> AcquireContext()const;
+	void ReleaseContext(std::unique_ptr<SearchContext> context)const;
+
+	uint32 mWidth = 0;
+	uint32 mDepth = 0;
+
+	// Bit d of mOpen[cell] is set if the cell can be left in direction d.
+	std::vector<std::uint8_t> mOpen;
+
+	// Idle search contexts, reused across queries and threads.
+	mutable std::mutex mContextLock;
+	mutable std::vector<std::unique_ptr<SearchContext>> mFreeContexts;
+};
@@ -0,0 +1,356 @@
+//***************************************************************************************
+// MeshCache.cpp
+//***************************************************************************************
+
+#include "MeshCache.h"
+#include <cstddef>
+#include <cstring>
+
+using namespace DirectX;
+
+const std::uint32_t MeshCache::Magic;
+const std::uint32_t MeshCache::Version;
+
+namespace
+{
+	const std::uint64_t FnvOffsetBasis = 0xcbf29ce484222325ull;
+	const std::uint64_t FnvPrime = 0x100000001b3ull;
+
+	std::uint64_t Fnv1a(std::uint64_t hash, const void* data, size_t size)
+	{
+		const BYTE* bytes = static_cast<const BYTE*>(data);
+		for(size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= FnvPrime;
+		}
+		return hash;
+	}
+
+	std::uint64_t AlignTo16(std::uint64_t size)
+	{
+		return (size + 15) & ~std::uint64_t(15);
+	}
+
+	// The checksum covers the entry after its Key and Checksum, seeded with the key.
+	const size_t ChecksumStart = offsetof(MeshCacheEntry, EntrySize);
+
+	std::uint64_t EntryChecksum(const MeshCacheEntry& entry)
+	{
+		std::uint64_t hash = Fnv1a(FnvOffsetBasis, &entry.Key, sizeof(entry.Key));
+		return Fnv1a(hash, reinterpret_cast<const BYTE*>(&entry) + ChecksumStart, entry.EntrySize - ChecksumStart);
+	}
+
+	// Read only blob over part of the mapped file.  It holds a reference to the mapping,
+	// so the geometry's system memory copies outlive the cache.
+	class MappedBlob final : public ID3DBlob
+	{
+	public:
+		MappedBlob(std::shared_ptr<const void> owner, const void* data, SIZE_T size) :
+			mOwner(std::move(owner)), mData(data), mSize(size)
+		{
+		}
+
+		HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object)override
+		{
+			if(object == nullptr)
+				return E_POINTER;
+
+			if(riid == __uuidof(IUnknown) || riid == __uuidof(ID3DBlob))
+			{
+				*object = static_cast<ID3DBlob*>(this);
+				AddRef();
+				return S_OK;
+			}
+
+			*object = nullptr;
+			return E_NOINTERFACE;
+		}
+
+		ULONG STDMETHODCALLTYPE AddRef()override
+		{
+			return InterlockedIncrement(&mRefCount);
+		}
+
+		ULONG STDMETHODCALLTYPE Release()override
+		{
+			ULONG count = InterlockedDecrement(&mRefCount);
+			if(count == 0)
+				delete this;
+			return count;
+		}
+
+		LPVOID STDMETHODCALLTYPE GetBufferPointer()override { return const_cast<void*>(mData); }
+		SIZE_T STDMETHODCALLTYPE GetBufferSize()override { return mSize; }
+
+	private:
+		ULONG mRefCount = 1;
+		std::shared_ptr<const void> mOwner;
+		const void* mData;
+		SIZE_T mSize;
+	};
+}
+
+MeshCacheKey::MeshCacheKey(const char* generator) :
+	mHash(FnvOffsetBasis)
+{
+	AddString(generator);
+}
+
+MeshCacheKey& MeshCacheKey::Add(const void* data, size_t size)
+{
+	mHash = Fnv1a(mHash, data, size);
+	return *this;
+}
+
+MeshCacheKey& MeshCacheKey::AddString(const char* s)
+{
+	// With the terminator, so "ab" + "c" and "a" + "bc" differ.
+	return Add(s, strlen(s) + 1);
+}
+
+MeshCache::MappedFile::~MappedFile()
+{
+	if(Data != nullptr)
+		UnmapViewOfFile(Data);
+	if(Mapping != nullptr)
+		CloseHandle(Mapping);
+	if(File != INVALID_HANDLE_VALUE)
+		CloseHandle(File);
+}
+
+MeshCache::~MeshCache()
+{
+	Close();
+}
+
+HRESULT MeshCache::Open(const std::wstring& filename)
+{
+	Close();
+	mFilename = filename;
+
+	// Shared for writing, so Store can append while the file is mapped.
+	auto file = std::make_shared<MappedFile>();
+	file->File = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file->File == INVALID_HANDLE_VALUE)
+	{
+		DWORD error = GetLastError();
+		if(error == ERROR_FILE_NOT_FOUND)
+			return S_OK;
+		return HRESULT_FROM_WIN32(error);
+	}
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file->File, &fileSize))
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	// Too short for a header; the first Store rewrites it.
+	if((std::uint64_t)fileSize.QuadPart < sizeof(MeshCacheHeader))
+		return S_OK;
+
+	file->Mapping = CreateFileMappingW(file->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(file->Mapping != nullptr)
+		file->Data = (const BYTE*)MapViewOfFile(file->Mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(file->Data == nullptr)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	const MeshCacheHeader* header = reinterpret_cast<const MeshCacheHeader*>(file->Data);
+	if(header->Magic != Magic || header->Version != Version)
+		return S_OK;
+
+	std::uint64_t offset = sizeof(MeshCacheHeader);
+	mFile = file;
+	while(ValidEntry(offset, fileSize.QuadPart))
+	{
+		const MeshCacheEntry* entry = reinterpret_cast<const MeshCacheEntry*>(file->Data + offset);
+		mEntries[entry->Key] = entry;
+		offset += entry->EntrySize;
+	}
+	mAppendOffset = offset;
+
+	return S_OK;
+}
+
+void MeshCache::Close()
+{
+	// Blobs made by Load keep the mapping until they are released.
+	mFile = nullptr;
+	mEntries.clear();
+	mAppendOffset = 0;
+}
+
+bool MeshCache::ValidEntry(std::uint64_t offset, std::uint64_t fileSize)const
+{
+	if(offset > fileSize || fileSize - offset < sizeof(MeshCacheEntry))
+		return false;
+
+	const MeshCacheEntry& entry = *reinterpret_cast<const MeshCacheEntry*>(mFile->Data + offset);
+	std::uint64_t entrySize = entry.EntrySize;
+	if(entrySize < sizeof(MeshCacheEntry) || entrySize % 16 != 0 || entrySize > fileSize - offset)
+		return false;
+
+	std::uint64_t submeshEnd = sizeof(MeshCacheEntry) + (std::uint64_t)entry.SubmeshCount * sizeof(MeshCacheSubmesh);
+	if(submeshEnd > entrySize ||
+		entry.VertexDataOffset % 16 != 0 || entry.VertexDataOffset < submeshEnd || entry.VertexDataOffset > entrySize ||
+		entry.VertexDataSize > entrySize - entry.VertexDataOffset ||
+		entry.IndexDataOffset % 16 != 0 || entry.IndexDataOffset < submeshEnd || entry.IndexDataOffset > entrySize ||
+		entry.IndexDataSize > entrySize - entry.IndexDataOffset ||
+		entry.MeshletDataOffset % 16 != 0 || entry.MeshletDataOffset < submeshEnd || entry.MeshletDataOffset > entrySize ||
+		entry.MeshletCount > (entrySize - entry.MeshletDataOffset) / sizeof(GeometryGenerator::Meshlet))
+		return false;
+
+	const MeshCacheSubmesh* submeshes = reinterpret_cast<const MeshCacheSubmesh*>(&entry + 1);
+	for(UINT i = 0; i < entry.SubmeshCount; ++i)
+	{
+		if(submeshes[i].Name[sizeof(submeshes[i].Name) - 1] != '\0' ||
+			submeshes[i].FirstMeshlet > entry.MeshletCount ||
+			submeshes[i].MeshletCount > entry.MeshletCount - submeshes[i].FirstMeshlet)
+			return false;
+	}
+
+	return EntryChecksum(entry) == entry.Checksum;
+}
+
+bool MeshCache::Load(std::uint64_t key, ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, MeshGeometry& geo)const
+{
+	auto it = mEntries.find(key);
+	if(it == mEntries.end())
+		return false;
+
+	const MeshCacheEntry& entry = *it->second;
+	const BYTE* base = reinterpret_cast<const BYTE*>(&entry);
+
+	geo.VertexByteStride = entry.VertexByteStride;
+	geo.VertexBufferByteSize = entry.VertexBufferByteSize;
+	geo.IndexFormat = (DXGI_FORMAT)entry.IndexFormat;
+	geo.IndexBufferByteSize = entry.IndexDataSize;
+	geo.CompactVertices = (entry.Flags & EntryCompactVertices) != 0;
+
+	// Uploaded from the mapping; the system memory copies are the mapping.
+	if(entry.VertexDataSize > 0)
+	{
+		const BYTE* vertices = base + entry.VertexDataOffset;
+		geo.VertexBufferCPU.Attach(new MappedBlob(mFile, vertices, entry.VertexDataSize));
+		geo.VertexBufferGPU = d3dUtil::CreateDefaultBuffer(device, cmdList, vertices, entry.VertexDataSize,
+			geo.VertexBufferUploader);
+	}
+
+	if(entry.IndexDataSize > 0)
+	{
+		const BYTE* indices = base + entry.IndexDataOffset;
+		geo.IndexBufferCPU.Attach(new MappedBlob(mFile, indices, entry.IndexDataSize));
+		geo.IndexBufferGPU = d3dUtil::CreateDefaultBuffer(device, cmdList, indices, entry.IndexDataSize,
+			geo.IndexBufferUploader);
+	}
+
+	const MeshCacheSubmesh* submeshes = reinterpret_cast<const MeshCacheSubmesh*>(&entry + 1);
+	for(UINT i = 0; i < entry.SubmeshCount; ++i)
+	{
+		const MeshCacheSubmesh& s = submeshes[i];
+
+		SubmeshGeometry submesh;
+		submesh.IndexCount = s.IndexCount;
+		submesh.StartIndexLocation = s.StartIndexLocation;
+		submesh.BaseVertexLocation = s.BaseVertexLocation;
+		submesh.Bounds = BoundingBox(s.BoundsCenter, s.BoundsExtents);
+		submesh.FirstMeshlet = s.FirstMeshlet;
+		submesh.MeshletCount = s.MeshletCount;
+		geo.DrawArgs[s.Name] = submesh;
+	}
+
+	const GeometryGenerator::Meshlet* meshlets = reinterpret_cast<const GeometryGenerator::Meshlet*>(base + entry.MeshletDataOffset);
+	geo.Meshlets.assign(meshlets, meshlets + entry.MeshletCount);
+
+	return true;
+}
+
+HRESULT MeshCache::Store(std::uint64_t key, const MeshGeometry& geo)
+{
+	const UINT vertexDataSize = geo.VertexBufferCPU ? (UINT)geo.VertexBufferCPU->GetBufferSize() : 0;
+	const UINT indexDataSize = geo.IndexBufferCPU ? (UINT)geo.IndexBufferCPU->GetBufferSize() : 0;
+	const UINT meshletDataSize = (UINT)(geo.Meshlets.size() * sizeof(GeometryGenerator::Meshlet));
+
+	MeshCacheEntry header = {};
+	header.Key = key;
+	header.Flags = geo.CompactVertices ? EntryCompactVertices : 0;
+	header.VertexByteStride = geo.VertexByteStride;
+	header.VertexBufferByteSize = geo.VertexBufferByteSize;
+	header.IndexFormat = geo.IndexFormat;
+	header.SubmeshCount = (std::uint32_t)geo.DrawArgs.size();
+	header.VertexDataOffset = (std::uint32_t)AlignTo16(sizeof(MeshCacheEntry) + header.SubmeshCount * sizeof(MeshCacheSubmesh));
+	header.VertexDataSize = vertexDataSize;
+	header.IndexDataOffset = (std::uint32_t)AlignTo16(header.VertexDataOffset + vertexDataSize);
+	header.IndexDataSize = indexDataSize;
+	header.MeshletDataOffset = (std::uint32_t)AlignTo16(header.IndexDataOffset + indexDataSize);
+	header.MeshletCount = (std::uint32_t)geo.Meshlets.size();
+	header.EntrySize = (std::uint32_t)AlignTo16(header.MeshletDataOffset + meshletDataSize);
+
+	// Built whole in memory, so the file only ever sees complete entries appended.
+	std::vector<BYTE> entry(header.EntrySize, 0);
+	MeshCacheSubmesh* submeshes = reinterpret_cast<MeshCacheSubmesh*>(entry.data() + sizeof(MeshCacheEntry));
+	for(const auto& drawArg : geo.DrawArgs)
+	{
+		if(drawArg.first.size() >= sizeof(submeshes->Name))
+			return E_INVALIDARG;
+
+		const SubmeshGeometry& submesh = drawArg.second;
+		MeshCacheSubmesh& s = *submeshes++;
+		memcpy(s.Name, drawArg.first.c_str(), drawArg.first.size());
+		s.IndexCount = submesh.IndexCount;
+		s.StartIndexLocation = submesh.StartIndexLocation;
+		s.BaseVertexLocation = submesh.BaseVertexLocation;
+		s.BoundsCenter = submesh.Bounds.Center;
+		s.BoundsExtents = submesh.Bounds.Extents;
+		s.FirstMeshlet = submesh.FirstMeshlet;
+		s.MeshletCount = submesh.MeshletCount;
+	}
+
+	if(vertexDataSize > 0)
+		memcpy(entry.data() + header.VertexDataOffset, geo.VertexBufferCPU->GetBufferPointer(), vertexDataSize);
+	if(indexDataSize > 0)
+		memcpy(entry.data() + header.IndexDataOffset, geo.IndexBufferCPU->GetBufferPointer(), indexDataSize);
+	if(meshletDataSize > 0)
+		memcpy(entry.data() + header.MeshletDataOffset, geo.Meshlets.data(), meshletDataSize);
+
+	memcpy(entry.data(), &header, sizeof(header));
+	reinterpret_cast<MeshCacheEntry*>(entry.data())->Checksum = EntryChecksum(*reinterpret_cast<MeshCacheEntry*>(entry.data()));
+
+	// Without valid entries to keep, the file starts over.  Otherwise the entry goes
+	// after the last valid one, over any damaged tail; the file cannot be cut shorter
+	// while it is mapped, but a damaged tail fails its checksum.
+	bool newFile = mAppendOffset == 0;
+	HANDLE file = CreateFileW(mFilename.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+		newFile ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	std::uint64_t offset = mAppendOffset;
+	BOOL written = TRUE;
+	DWORD byteCount = 0;
+	if(newFile)
+	{
+		MeshCacheHeader fileHeader = {};
+		fileHeader.Magic = Magic;
+		fileHeader.Version = Version;
+		written = WriteFile(file, &fileHeader, sizeof(fileHeader), &byteCount, nullptr) && byteCount == sizeof(fileHeader);
+		offset = sizeof(fileHeader);
+	}
+	else
+	{
+		LARGE_INTEGER position;
+		position.QuadPart = (LONGLONG)offset;
+		written = SetFilePointerEx(file, position, nullptr, FILE_BEGIN);
+	}
+
+	if(written)
+		written = WriteFile(file, entry.data(), (DWORD)entry.size(), &byteCount, nullptr) && byteCount == entry.size();
+
+	HRESULT hr = written ? S_OK : HRESULT_FROM_WIN32(ERROR_WRITE_FAULT);
+	CloseHandle(file);
+
+	if(SUCCEEDED(hr))
+		mAppendOffset = offset + entry.size();
+	return hr;
+}
@@ -0,0 +1,159 @@
+//***************************************************************************************
+// MeshCache.h
+//
+// On-disk cache of generated geometry, so meshes that take time to generate, optimize
+// and quantize are only built when what they are built from changes.  Each entry is a
+// MeshGeometry's vertex and index data, ready to upload, and its submeshes, stored
+// under a key the caller hashes from the generator's name and parameters and the
+// vertex layout (see MeshCacheKey).
+//
+// The file is memory-mapped when opened.  Loading an entry uploads its data straight
+// from the mapping, and the geometry's system memory copies point into the mapping
+// rather than being copied out of it.
+//
+// New entries are appended; entries that are no longer asked for stay in the file
+// until it is deleted.  Keys cannot see code, so generator changes must change the
+// keys, normally through a version number hashed into all of them.
+//
+// Layout, all offsets 16 byte aligned:
+//    MeshCacheHeader
+//    entries, each:
+//       MeshCacheEntry
+//       MeshCacheSubmesh[SubmeshCount]
+//       vertex data, at VertexDataOffset from the entry
+//       index data, at IndexDataOffset from the entry
+//       GeometryGenerator::Meshlet[MeshletCount], at MeshletDataOffset from the entry
+//***************************************************************************************
+
+#pragma once
+
+#include "Common/d3dUtil.h"
+#include <cstdint>
+
+struct MeshCacheHeader
+{
+	std::uint32_t Magic;
+	std::uint32_t Version;
+	std::uint32_t Reserved[2];
+};
+
+static_assert(sizeof(MeshCacheHeader) % 16 == 0, "Entries start right after the header.");
+
+struct MeshCacheEntry
+{
+	std::uint64_t Key;
+
+	// Hash of the rest of the entry, submeshes and data.  An append cut short fails it.
+	std::uint64_t Checksum;
+
+	// Size of the entry with its submeshes and data, to the start of the next.
+	std::uint32_t EntrySize;
+
+	// MeshCache::EntryFlags.
+	std::uint32_t Flags;
+
+	std::uint32_t VertexByteStride;
+	std::uint32_t VertexBufferByteSize;
+	std::uint32_t IndexFormat;
+	std::uint32_t SubmeshCount;
+
+	// Geometry with a dynamic vertex buffer stores no vertex data, only its size.
+	std::uint32_t VertexDataOffset;
+	std::uint32_t VertexDataSize;
+	std::uint32_t IndexDataOffset;
+	std::uint32_t IndexDataSize;
+
+	std::uint32_t MeshletDataOffset;
+	std::uint32_t MeshletCount;
+};
+
+struct MeshCacheSubmesh
+{
+	char Name[32];
+	std::uint32_t IndexCount;
+	std::uint32_t StartIndexLocation;
+	std::int32_t BaseVertexLocation;
+	DirectX::XMFLOAT3 BoundsCenter;
+	DirectX::XMFLOAT3 BoundsExtents;
+	std::uint32_t FirstMeshlet;
+	std::uint32_t MeshletCount;
+};
+
+// Meshlets are stored as they are in memory.
+static_assert(sizeof(GeometryGenerator::Meshlet) == 56, "Meshlet layout changed; bump MeshCache::Version.");
+
+// FNV-1a hash of what a mesh is generated from.  Values are hashed as their bytes, so
+// add scalars and padding free structs only.
+class MeshCacheKey
+{
+public:
+	explicit MeshCacheKey(const char* generator);
+
+	MeshCacheKey& Add(const void* data, size_t size);
+	MeshCacheKey& AddString(const char* s);
+
+	template<typename T>
+	MeshCacheKey& Add(const T& value) { return Add(&value, sizeof(T)); }
+
+	std::uint64_t Value()const { return mHash; }
+
+private:
+	std::uint64_t mHash;
+};
+
+class MeshCache
+{
+public:
+	static const std::uint32_t Magic = 0x4843534d; // "MSCH"
+	static const std::uint32_t Version = 2;
+
+	enum EntryFlags : std::uint32_t
+	{
+		// MeshGeometry::CompactVertices.
+		EntryCompactVertices = 0x1,
+	};
+
+	MeshCache() = default;
+	MeshCache(const MeshCache& rhs) = delete;
+	MeshCache& operator=(const MeshCache& rhs) = delete;
+	~MeshCache();
+
+	// Maps the cache file and indexes its entries.  A missing file is an empty cache,
+	// created by the first Store.  Entries after a damaged one are dropped, and a file
+	// of another version is replaced as a whole.
+	HRESULT Open(const std::wstring& filename);
+	void Close();
+
+	// Fills in geo from the entry for key: buffers, formats and submeshes, with the GPU
+	// buffers created and their uploads recorded on cmdList.  The name is left alone.
+	// Returns false, leaving geo alone, if there is no such entry.
+	bool Load(std::uint64_t key, ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, MeshGeometry& geo)const;
+
+	// Appends geo, as built, under key.  Submesh names must be shorter than
+	// MeshCacheSubmesh::Name.  The entry can be loaded the next time the file is opened.
+	HRESULT Store(std::uint64_t key, const MeshGeometry& geo);
+
+	UINT EntryCount()const { return (UINT)mEntries.size(); }
+
+private:
+	// A mapped view of the file, kept alive by the blobs made over it.
+	struct MappedFile
+	{
+		~MappedFile();
+
+		HANDLE File = INVALID_HANDLE_VALUE;
+		HANDLE Mapping = nullptr;
+		const BYTE* Data = nullptr;
+	};
+
+	bool ValidEntry(std::uint64_t offset, std::uint64_t fileSize)const;
+
+	std::wstring mFilename;
+	std::shared_ptr<MappedFile> mFile;
+
+	// Where the next entry is written: the end of the valid entries, or 0 if the file
+	// needs a new header.
+	std::uint64_t mAppendOffset = 0;
+
+	std::unordered_map<std::uint64_t, const MeshCacheEntry*> mEntries;
+};
@@ -0,0 +1,404 @@
+//***************************************************************************************
+// OcclusionCuller.cpp
+//***************************************************************************************
+
+#include "OcclusionCuller.h"
+#include "Common/ParallelFor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <emmintrin.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// Slack for rounding in the interpolated occluder depth, so the surface of an
+	// occluder does not hide the occluder's own bounds.
+	const float DepthBias = 1.0e-6f;
+
+	__m128 LoadRow(const XMFLOAT4X4& m, int row)
+	{
+		return _mm_loadu_ps(&m.m[row][0]);
+	}
+
+	// Row vector times matrix, as DirectXMath does it.
+	__m128 TransformPoint(float x, float y, float z, __m128 r0, __m128 r1, __m128 r2, __m128 r3)
+	{
+		__m128 v = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(x), r0), _mm_mul_ps(_mm_set1_ps(y), r1));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(z), r2));
+		return _mm_add_ps(v, r3);
+	}
+}
+
+void OcclusionCuller::Resize(uint32 width, uint32 height)
+{
+	mTilesX = std::max<uint32>(1, (width + TileWidth - 1) / TileWidth);
+	mTilesY = std::max<uint32>(1, (height + TileHeight - 1) / TileHeight);
+	mWidth = mTilesX * TileWidth;
+	mHeight = mTilesY * TileHeight;
+
+	mDepth.assign(mWidth * mHeight, 1.0f);
+	mTileMaxDepth.assign(mTilesX * mTilesY, 1.0f);
+}
+
+OcclusionCuller::uint32 OcclusionCuller::AddMesh(const XMFLOAT3* positions, uint32 vertexStride, uint32 vertexCount,
+	const std::uint16_t* indices, uint32 indexCount)
+{
+	assert(indexCount % 3 == 0);
+
+	Mesh mesh;
+	mesh.FirstVertex = (uint32)mMeshPositions.size();
+	mesh.VertexCount = vertexCount;
+	mesh.FirstIndex = (uint32)mMeshIndices.size();
+	mesh.IndexCount = indexCount;
+
+	const char* p = reinterpret_cast<const char*>(positions);
+	for(uint32 i = 0; i < vertexCount; ++i, p += vertexStride)
+		mMeshPositions.push_back(*reinterpret_cast<const XMFLOAT3*>(p));
+
+	mMeshIndices.insert(mMeshIndices.end(), indices, indices + indexCount);
+
+	mMeshes.push_back(mesh);
+	return (uint32)mMeshes.size() - 1;
+}
+
+void OcclusionCuller::AddOccluder(uint32 mesh, const XMFLOAT4X4& world)
+{
+	assert(mesh < mMeshes.size());
+
+	Occluder occluder;
+	occluder.Mesh = mesh;
+	occluder.World = world;
+	occluder.FirstVertex = mOccluderVertexCount;
+	occluder.FirstTriangle = mOccluderTriangleCount;
+	mOccluders.push_back(occluder);
+
+	mOccluderVertexCount += mMeshes[mesh].VertexCount;
+	mOccluderTriangleCount += mMeshes[mesh].IndexCount / 3;
+}
+
+void OcclusionCuller::ClearOccluders()
+{
+	mOccluders.clear();
+	mOccluderVertexCount = 0;
+	mOccluderTriangleCount = 0;
+}
+
+void OcclusionCuller::Render(const XMFLOAT4X4& viewProj)
+{
+	assert(mWidth > 0 && "Resize must be called before Render.");
+
+	mViewProj = viewProj;
+	mScreenVertices.resize(mOccluderVertexCount);
+	mTriangles.resize(mOccluderTriangleCount);
+
+	// Occluders write disjoint ranges of the vertex and triangle arrays, and tile rows
+	// disjoint ranges of the depth buffer, so neither parallel pass needs locking.
+	ParallelFor(0, (int)mOccluders.size(), [this](int i)
+	{
+		TransformOccluder(mOccluders[i], mViewProj);
+	});
+
+	// Most triangles are culled or cover few tile rows; binning them keeps each row
+	// from reading every triangle.
+	mRowBins.resize(mTilesY);
+	for(auto& bin : mRowBins)
+		bin.clear();
+
+	mTrianglesDrawn = 0;
+	for(uint32 i = 0; i < (uint32)mTriangles.size(); ++i)
+	{
+		const Triangle& tri = mTriangles[i];
+		if(tri.MinY > tri.MaxY)
+			continue;
+
+		for(int row = tri.MinY / (int)TileHeight; row <= tri.MaxY / (int)TileHeight; ++row)
+			mRowBins[row].push_back(i);
+		++mTrianglesDrawn;
+	}
+
+	ParallelFor(0, (int)mTilesY, [this](int row)
+	{
+		RasterizeTileRow((uint32)row);
+	});
+}
+
+void OcclusionCuller::TransformOccluder(const Occluder& occluder, const XMFLOAT4X4& viewProj)
+{
+	const Mesh& mesh = mMeshes[occluder.Mesh];
+
+	XMFLOAT4X4 worldViewProj;
+	XMStoreFloat4x4(&worldViewProj, XMMatrixMultiply(XMLoadFloat4x4(&occluder.World), XMLoadFloat4x4(&viewProj)));
+
+	__m128 r0 = LoadRow(worldViewProj, 0);
+	__m128 r1 = LoadRow(worldViewProj, 1);
+	__m128 r2 = LoadRow(worldViewProj, 2);
+	__m128 r3 = LoadRow(worldViewProj, 3);
+
+	float halfWidth = 0.5f * mWidth;
+	float halfHeight = 0.5f * mHeight;
+
+	// Project every vertex once; triangles share them.
+	XMFLOAT3* screen = &mScreenVertices[occluder.FirstVertex];
+	const XMFLOAT3* positions = &mMeshPositions[mesh.FirstVertex];
+	for(uint32 i = 0; i < mesh.VertexCount; ++i)
+	{
+		const XMFLOAT3& p = positions[i];
+
+		XMFLOAT4 clip;
+		_mm_storeu_ps(&clip.x, TransformPoint(p.x, p.y, p.z, r0, r1, r2, r3));
+
+		// Negative depth marks a vertex in front of the near plane.
+		if(clip.z < 0.0f)
+		{
+			screen[i].z = -1.0f;
+			continue;
+		}
+
+		float invW = 1.0f / clip.w;
+		screen[i].x = (clip.x * invW + 1.0f) * halfWidth;
+		screen[i].y = (1.0f - clip.y * invW) * halfHeight;
+		screen[i].z = clip.z * invW;
+	}
+
+	// A mirroring transform turns front faces counterclockwise.
+	const XMFLOAT4X4& w = occluder.World;
+	float det =
+		w._11 * (w._22 * w._33 - w._23 * w._32) -
+		w._12 * (w._21 * w._33 - w._23 * w._31) +
+		w._13 * (w._21 * w._32 - w._22 * w._31);
+	bool mirrored = det < 0.0f;
+
+	const std::uint16_t* indices = &mMeshIndices[mesh.FirstIndex];
+	Triangle* triangles = &mTriangles[occluder.FirstTriangle];
+	for(uint32 t = 0; t < mesh.IndexCount / 3; ++t)
+	{
+		Triangle& tri = triangles[t];
+		tri.MinY = 1;
+		tri.MaxY = 0;
+
+		const XMFLOAT3* v[3] =
+		{
+			&screen[indices[3*t + 0]],
+			&screen[indices[3*t + 1]],
+			&screen[indices[3*t + 2]]
+		};
+		if(mirrored)
+			std::swap(v[1], v[2]);
+
+		// Dropping a triangle only loses occlusion, so the ones that reach in front
+		// of the near plane are skipped instead of clipped.
+		if(v[0]->z < 0.0f || v[1]->z < 0.0f || v[2]->z < 0.0f)
+			continue;
+
+		float x[3] = { v[0]->x, v[1]->x, v[2]->x };
+		float y[3] = { v[0]->y, v[1]->y, v[2]->y };
+		float z[3] = { v[0]->z, v[1]->z, v[2]->z };
+
+		// Twice the signed area; positive for clockwise triangles, as y points down.
+		float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+		if(area <= 0.0f)
+			continue;
+
+		// Pixels whose centers can be inside the triangle.
+		float minX = std::min<float>(x[0], std::min<float>(x[1], x[2]));
+		float maxX = std::max<float>(x[0], std::max<float>(x[1], x[2]));
+		float minY = std::min<float>(y[0], std::min<float>(y[1], y[2]));
+		float maxY = std::max<float>(y[0], std::max<float>(y[1], y[2]));
+		tri.MinX = std::max<int>(0, (int)std::ceil(minX - 0.5f));
+		tri.MaxX = std::min<int>((int)mWidth - 1, (int)std::floor(maxX - 0.5f));
+		int triMinY = std::max<int>(0, (int)std::ceil(minY - 0.5f));
+		int triMaxY = std::min<int>((int)mHeight - 1, (int)std::floor(maxY - 0.5f));
+		if(tri.MinX > tri.MaxX || triMinY > triMaxY)
+			continue;
+
+		// Edge i runs from vertex i to the next one.
+		for(int i = 0; i < 3; ++i)
+		{
+			int j = (i + 1) % 3;
+			tri.EdgeA[i] = y[i] - y[j];
+			tri.EdgeB[i] = x[j] - x[i];
+			tri.EdgeC[i] = (y[j] - y[i]) * x[i] - (x[j] - x[i]) * y[i];
+			tri.EdgeInvA[i] = tri.EdgeA[i] != 0.0f ? 1.0f / tri.EdgeA[i] : 0.0f;
+		}
+
+		// z/w is linear in screen space.
+		float invArea = 1.0f / area;
+		tri.DepthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) * invArea;
+		tri.DepthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) * invArea;
+		tri.DepthC = z[0] - tri.DepthA * x[0] - tri.DepthB * y[0];
+
+		tri.MinY = triMinY;
+		tri.MaxY = triMaxY;
+	}
+}
+
+void OcclusionCuller::RasterizeTileRow(uint32 tileRow)
+{
+	int rowMinY = (int)(tileRow * TileHeight);
+	int rowMaxY = rowMinY + (int)TileHeight - 1;
+
+	float* rowDepth = &mDepth[rowMinY * mWidth];
+	std::fill(rowDepth, rowDepth + TileHeight * mWidth, 1.0f);
+
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+	for(uint32 index : mRowBins[tileRow])
+	{
+		const Triangle& tri = mTriangles[index];
+
+		int minY = std::max<int>(tri.MinY, rowMinY);
+		int maxY = std::min<int>(tri.MaxY, rowMaxY);
+
+		__m128 a0 = _mm_set1_ps(tri.EdgeA[0]);
+		__m128 a1 = _mm_set1_ps(tri.EdgeA[1]);
+		__m128 a2 = _mm_set1_ps(tri.EdgeA[2]);
+		__m128 depthA = _mm_set1_ps(tri.DepthA);
+
+		for(int y = minY; y <= maxY; ++y)
+		{
+			float py = y + 0.5f;
+			float rowEdge[3];
+			for(int i = 0; i < 3; ++i)
+				rowEdge[i] = tri.EdgeB[i] * py + tri.EdgeC[i];
+
+			// Narrow the bounding box to the span the edges allow on this row; long
+			// thin triangles cover a small part of their boxes.  The span is widened
+			// by a pixel against rounding, and the edge tests below have the last word.
+			float spanMin = (float)tri.MinX;
+			float spanMax = (float)tri.MaxX;
+			for(int i = 0; i < 3; ++i)
+			{
+				if(tri.EdgeA[i] > 0.0f)
+					spanMin = std::max<float>(spanMin, -rowEdge[i] * tri.EdgeInvA[i] - 1.5f);
+				else if(tri.EdgeA[i] < 0.0f)
+					spanMax = std::min<float>(spanMax, -rowEdge[i] * tri.EdgeInvA[i] + 0.5f);
+				else if(rowEdge[i] < 0.0f)
+					spanMax = -1.0f;
+			}
+			if(spanMin > spanMax)
+				continue;
+
+			// Blocks of four pixels start at multiples of four; the width is a multiple
+			// of four too, so the last block never runs past the row.
+			int minX = (int)spanMin & ~3;
+			int maxX = (int)spanMax;
+
+			__m128 c0 = _mm_set1_ps(rowEdge[0]);
+			__m128 c1 = _mm_set1_ps(rowEdge[1]);
+			__m128 c2 = _mm_set1_ps(rowEdge[2]);
+			__m128 depthC = _mm_set1_ps(tri.DepthB * py + tri.DepthC);
+
+			float* depthRow = &mDepth[y * mWidth];
+			for(int x = minX; x <= maxX; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), c0);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), c1);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), c2);
+				__m128 inside = _mm_cmpge_ps(_mm_min_ps(e0, _mm_min_ps(e1, e2)), zero);
+				if(_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 z = _mm_add_ps(_mm_mul_ps(depthA, px), depthC);
+				__m128 depth = _mm_loadu_ps(depthRow + x);
+				__m128 closer = _mm_min_ps(depth, z);
+				depth = _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, depth));
+				_mm_storeu_ps(depthRow + x, depth);
+			}
+		}
+	}
+
+	// Farthest depth of each tile in the row.
+	for(uint32 tx = 0; tx < mTilesX; ++tx)
+	{
+		__m128 tileMax = zero;
+		for(int y = rowMinY; y <= rowMaxY; ++y)
+		{
+			const float* p = &mDepth[y * mWidth + tx * TileWidth];
+			for(uint32 x = 0; x < TileWidth; x += 4)
+				tileMax = _mm_max_ps(tileMax, _mm_loadu_ps(p + x));
+		}
+
+		float lanes[4];
+		_mm_storeu_ps(lanes, tileMax);
+		mTileMaxDepth[tileRow * mTilesX + tx] =
+			std::max<float>(std::max<float>(lanes[0], lanes[1]), std::max<float>(lanes[2], lanes[3]));
+	}
+}
+
+bool OcclusionCuller::IsVisible(const BoundingBox& worldBounds)const
+{
+	XMFLOAT3 corners[BoundingBox::CORNER_COUNT];
+	worldBounds.GetCorners(corners);
+
+	__m128 r0 = LoadRow(mViewProj, 0);
+	__m128 r1 = LoadRow(mViewProj, 1);
+	__m128 r2 = LoadRow(mViewProj, 2);
+	__m128 r3 = LoadRow(mViewProj, 3);
+
+	float minX = (float)mWidth, maxX = 0.0f;
+	float minY = (float)mHeight, maxY = 0.0f;
+	float minZ = 1.0f;
+	for(size_t i = 0; i < BoundingBox::CORNER_COUNT; ++i)
+	{
+		XMFLOAT4 clip;
+		_mm_storeu_ps(&clip.x, TransformPoint(corners[i].x, corners[i].y, corners[i].z, r0, r1, r2, r3));
+
+		// Nothing can be in front of a box that reaches the near plane.
+		if(clip.z < 0.0f)
+			return true;
+
+		float invW = 1.0f / clip.w;
+		float x = (clip.x * invW + 1.0f) * 0.5f * mWidth;
+		float y = (1.0f - clip.y * invW) * 0.5f * mHeight;
+
+		minX = std::min<float>(minX, x);
+		maxX = std::max<float>(maxX, x);
+		minY = std::min<float>(minY, y);
+		maxY = std::max<float>(maxY, y);
+		minZ = std::min<float>(minZ, clip.z * invW);
+	}
+
+	// Every pixel the box touches, even partly.
+	int x0 = std::max<int>(0, (int)std::floor(minX));
+	int x1 = std::min<int>((int)mWidth - 1, (int)std::floor(maxX));
+	int y0 = std::max<int>(0, (int)std::floor(minY));
+	int y1 = std::min<int>((int)mHeight - 1, (int)std::floor(maxY));
+
+	// Off screen; that is for frustum culling to decide.
+	if(x0 > x1 || y0 > y1)
+		return true;
+
+	minZ -= DepthBias;
+
+	for(int ty = y0 / (int)TileHeight; ty <= y1 / (int)TileHeight; ++ty)
+	{
+		for(int tx = x0 / (int)TileWidth; tx <= x1 / (int)TileWidth; ++tx)
+		{
+			// The whole tile is in front of the box.
+			if(mTileMaxDepth[ty * mTilesX + tx] < minZ)
+				continue;
+
+			int px0 = std::max<int>(x0, tx * (int)TileWidth);
+			int px1 = std::min<int>(x1, (tx + 1) * (int)TileWidth - 1);
+			int py0 = std::max<int>(y0, ty * (int)TileHeight);
+			int py1 = std::min<int>(y1, (ty + 1) * (int)TileHeight - 1);
+			for(int y = py0; y <= py1; ++y)
+			{
+				const float* depthRow = &mDepth[y * mWidth];
+				for(int x = px0; x <= px1; ++x)
+				{
+					if(depthRow[x] >= minZ)
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
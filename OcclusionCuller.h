@@ -0,0 +1,123 @@
+//***************************************************************************************
+// OcclusionCuller.h
+//
+// Software occlusion culling.  A few large, solid occluders are rasterized on the CPU
+// into a small depth buffer each frame, and bounding boxes are tested against it before
+// their items are drawn.
+//
+// The buffer is split into tiles that each keep the farthest depth written to them, so
+// a box whose nearest point is behind a tile's farthest depth is rejected without
+// touching the tile's pixels.  The rasterizer processes four pixels at a time with SSE
+// and rows of tiles are rasterized in parallel.  Nothing here depends on Direct3D.
+//
+// The test is conservative: an occluder triangle that crosses the near plane is
+// dropped rather than clipped, and a box that reaches in front of the near plane is
+// always reported visible.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class OcclusionCuller
+{
+public:
+	using uint32 = std::uint32_t;
+
+	// Tile size in pixels.  The buffer width is a multiple of TileWidth, which is a
+	// multiple of the SIMD width, and the height a multiple of TileHeight.
+	static const uint32 TileWidth = 32;
+	static const uint32 TileHeight = 8;
+
+	OcclusionCuller() = default;
+	OcclusionCuller(const OcclusionCuller& rhs) = delete;
+	OcclusionCuller& operator=(const OcclusionCuller& rhs) = delete;
+
+	// Sets the depth buffer size.  Both are rounded up to whole tiles.
+	void Resize(uint32 width, uint32 height);
+
+	// Copies an occluder mesh; returns the id AddOccluder takes.  positions points at
+	// the first vertex position, vertexStride bytes apart; indices are relative to it.
+	uint32 AddMesh(const DirectX::XMFLOAT3* positions, uint32 vertexStride, uint32 vertexCount,
+		const std::uint16_t* indices, uint32 indexCount);
+
+	// Places a mesh in the world.  Occluders stay until ClearOccluders.  Only the front
+	// faces (clockwise, as Direct3D draws them) are rasterized.
+	void AddOccluder(uint32 mesh, const DirectX::XMFLOAT4X4& world);
+	void ClearOccluders();
+
+	// Clears the depth buffer and rasterizes every occluder with the given view
+	// projection matrix.
+	void Render(const DirectX::XMFLOAT4X4& viewProj);
+
+	// Returns false if the box is entirely behind the occluders drawn by Render.
+	bool IsVisible(const DirectX::BoundingBox& worldBounds)const;
+
+	uint32 Width()const { return mWidth; }
+	uint32 Height()const { return mHeight; }
+
+	// Triangles rasterized by the last Render.
+	uint32 TrianglesDrawn()const { return mTrianglesDrawn; }
+
+private:
+	struct Mesh
+	{
+		uint32 FirstVertex = 0;
+		uint32 VertexCount = 0;
+		uint32 FirstIndex = 0;
+		uint32 IndexCount = 0;
+	};
+
+	struct Occluder
+	{
+		uint32 Mesh = 0;
+		DirectX::XMFLOAT4X4 World;
+
+		// Offsets of this occluder's vertices and triangles in the per-frame arrays.
+		uint32 FirstVertex = 0;
+		uint32 FirstTriangle = 0;
+	};
+
+	// A set up triangle.  Edge and depth functions are planes a*x + b*y + c in pixel
+	// coordinates; a pixel is covered where all three edges are non-negative.
+	struct Triangle
+	{
+		float EdgeA[3];
+		float EdgeB[3];
+		float EdgeC[3];
+		float EdgeInvA[3];
+		float DepthA, DepthB, DepthC;
+
+		// Pixel bounds, inclusive.  MinY > MaxY marks a culled triangle.
+		int MinX, MaxX, MinY, MaxY;
+	};
+
+	void TransformOccluder(const Occluder& occluder, const DirectX::XMFLOAT4X4& viewProj);
+	void RasterizeTileRow(uint32 tileRow);
+
+	uint32 mWidth = 0;
+	uint32 mHeight = 0;
+	uint32 mTilesX = 0;
+	uint32 mTilesY = 0;
+
+	std::vector<float> mDepth;
+	std::vector<float> mTileMaxDepth;
+
+	std::vector<DirectX::XMFLOAT3> mMeshPositions;
+	std::vector<std::uint16_t> mMeshIndices;
+	std::vector<Mesh> mMeshes;
+	std::vector<Occluder> mOccluders;
+	uint32 mOccluderVertexCount = 0;
+	uint32 mOccluderTriangleCount = 0;
+
+	// Screen space vertices and set up triangles of all occluders, and the triangles
+	// touching each row of tiles, rebuilt every Render.
+	std::vector<DirectX::XMFLOAT3> mScreenVertices;
+	std::vector<Triangle> mTriangles;
+	std::vector<std::vector<uint32>> mRowBins;
+	DirectX::XMFLOAT4X4 mViewProj;
+	uint32 mTrianglesDrawn = 0;
+};
@@ -0,0 +1,429 @@
+//***************************************************************************************
+// SceneFile.cpp
+//***************************************************************************************
+
+#include "SceneFile.h"
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+
+using namespace DirectX;
+
+const std::uint32_t SceneFile::Magic;
+const std::uint32_t SceneFile::Version;
+const std::uint32_t SceneFile::NoString;
+
+namespace
+{
+	// True if count elements of elementSize bytes at offset lie inside the file and
+	// are 4 byte aligned.
+	bool TableInFile(std::uint64_t offset, std::uint64_t count, std::uint64_t elementSize, std::uint64_t fileSize)
+	{
+		return (offset % 4) == 0 && offset <= fileSize && count*elementSize <= fileSize - offset;
+	}
+
+	std::uint32_t AlignTo4(std::uint32_t size)
+	{
+		return (size + 3) & ~3u;
+	}
+
+	// Tables of the file being written, with the maps that deduplicate their entries.
+	struct SceneTables
+	{
+		std::vector<SceneFileItem> Items;
+		std::vector<SceneFileMesh> Meshes;
+		std::vector<std::uint32_t> Materials;
+		std::vector<std::uint32_t> StringOffsets;
+		std::string StringData;
+
+		std::map<std::string, std::uint32_t> StringIds;
+		std::map<std::pair<std::uint32_t, std::uint32_t>, std::uint32_t> MeshIds;
+		std::map<std::uint32_t, std::uint32_t> MaterialIds;
+
+		std::uint32_t AddString(const std::string& s)
+		{
+			auto it = StringIds.find(s);
+			if(it != StringIds.end())
+				return it->second;
+
+			std::uint32_t id = (std::uint32_t)StringOffsets.size();
+			StringOffsets.push_back((std::uint32_t)StringData.size());
+			StringData.append(s.c_str(), s.size() + 1);
+			StringIds[s] = id;
+			return id;
+		}
+
+		std::uint32_t AddMesh(const std::string& geometry, const std::string& submesh)
+		{
+			std::pair<std::uint32_t, std::uint32_t> key(AddString(geometry), AddString(submesh));
+			auto it = MeshIds.find(key);
+			if(it != MeshIds.end())
+				return it->second;
+
+			SceneFileMesh mesh;
+			mesh.Geometry = key.first;
+			mesh.Submesh = key.second;
+
+			std::uint32_t id = (std::uint32_t)Meshes.size();
+			Meshes.push_back(mesh);
+			MeshIds[key] = id;
+			return id;
+		}
+
+		std::uint32_t AddMaterial(const std::string& material)
+		{
+			std::uint32_t name = AddString(material);
+			auto it = MaterialIds.find(name);
+			if(it != MaterialIds.end())
+				return it->second;
+
+			std::uint32_t id = (std::uint32_t)Materials.size();
+			Materials.push_back(name);
+			MaterialIds[name] = id;
+			return id;
+		}
+	};
+
+	HRESULT WriteSceneFile(const std::wstring& filename, const SceneTables& tables)
+	{
+		SceneFileHeader header = {};
+		header.Magic = SceneFile::Magic;
+		header.Version = SceneFile::Version;
+		header.ItemCount = (std::uint32_t)tables.Items.size();
+		header.MeshCount = (std::uint32_t)tables.Meshes.size();
+		header.MaterialCount = (std::uint32_t)tables.Materials.size();
+		header.StringCount = (std::uint32_t)tables.StringOffsets.size();
+		header.StringDataSize = (std::uint32_t)tables.StringData.size();
+
+		header.ItemsOffset = AlignTo4(sizeof(SceneFileHeader));
+		header.MeshesOffset = header.ItemsOffset + header.ItemCount*sizeof(SceneFileItem);
+		header.MaterialsOffset = header.MeshesOffset + header.MeshCount*sizeof(SceneFileMesh);
+		header.StringOffsetsOffset = header.MaterialsOffset + header.MaterialCount*sizeof(std::uint32_t);
+		header.StringDataOffset = header.StringOffsetsOffset + header.StringCount*sizeof(std::uint32_t);
+		header.FileSize = AlignTo4(header.StringDataOffset + header.StringDataSize);
+
+		std::ofstream fout(filename, std::ios::binary | std::ios::trunc);
+		if(!fout)
+			return HRESULT_FROM_WIN32(ERROR_CANNOT_MAKE);
+
+		const char padding[4] = {};
+
+		fout.write((const char*)&header, sizeof(header));
+		fout.write(padding, header.ItemsOffset - sizeof(header));
+		fout.write((const char*)tables.Items.data(), header.ItemCount*sizeof(SceneFileItem));
+		fout.write((const char*)tables.Meshes.data(), header.MeshCount*sizeof(SceneFileMesh));
+		fout.write((const char*)tables.Materials.data(), header.MaterialCount*sizeof(std::uint32_t));
+		fout.write((const char*)tables.StringOffsets.data(), header.StringCount*sizeof(std::uint32_t));
+		fout.write(tables.StringData.data(), header.StringDataSize);
+		fout.write(padding, header.FileSize - header.StringDataOffset - header.StringDataSize);
+
+		fout.close();
+		return fout.fail() ? HRESULT_FROM_WIN32(ERROR_WRITE_FAULT) : S_OK;
+	}
+}
+
+SceneFile::~SceneFile()
+{
+	Close();
+}
+
+HRESULT SceneFile::Open(const std::wstring& filename)
+{
+	Close();
+
+	mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(mFile == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(mFile, &fileSize))
+	{
+		HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+		Close();
+		return hr;
+	}
+
+	if((std::uint64_t)fileSize.QuadPart < sizeof(SceneFileHeader))
+	{
+		Close();
+		return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+	}
+
+	mMapping = CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mMapping != nullptr)
+		mData = (const BYTE*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+
+	if(mData == nullptr)
+	{
+		HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+		Close();
+		return hr;
+	}
+
+	HRESULT hr = Validate(fileSize.QuadPart);
+	if(FAILED(hr))
+	{
+		Close();
+		return hr;
+	}
+
+	mItems = (const SceneFileItem*)(mData + mHeader->ItemsOffset);
+	mMeshes = (const SceneFileMesh*)(mData + mHeader->MeshesOffset);
+	mMaterials = (const std::uint32_t*)(mData + mHeader->MaterialsOffset);
+	mStringOffsets = (const std::uint32_t*)(mData + mHeader->StringOffsetsOffset);
+	mStringData = (const char*)(mData + mHeader->StringDataOffset);
+
+	return S_OK;
+}
+
+void SceneFile::Close()
+{
+	if(mData != nullptr)
+		UnmapViewOfFile(mData);
+	if(mMapping != nullptr)
+		CloseHandle(mMapping);
+	if(mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = nullptr;
+	mData = nullptr;
+
+	mHeader = nullptr;
+	mItems = nullptr;
+	mMeshes = nullptr;
+	mMaterials = nullptr;
+	mStringOffsets = nullptr;
+	mStringData = nullptr;
+}
+
+HRESULT SceneFile::Validate(std::uint64_t fileSize)
+{
+	const HRESULT invalid = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+	mHeader = (const SceneFileHeader*)mData;
+	const SceneFileHeader& h = *mHeader;
+
+	if(h.Magic != Magic)
+		return invalid;
+	if(h.Version != Version)
+		return HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH);
+	if(h.FileSize != fileSize)
+		return invalid;
+
+	if(!TableInFile(h.ItemsOffset, h.ItemCount, sizeof(SceneFileItem), fileSize) ||
+	   !TableInFile(h.MeshesOffset, h.MeshCount, sizeof(SceneFileMesh), fileSize) ||
+	   !TableInFile(h.MaterialsOffset, h.MaterialCount, sizeof(std::uint32_t), fileSize) ||
+	   !TableInFile(h.StringOffsetsOffset, h.StringCount, sizeof(std::uint32_t), fileSize) ||
+	   !TableInFile(h.StringDataOffset, h.StringDataSize, 1, fileSize))
+		return invalid;
+
+	// Every string has to start inside the string data, and the data has to end
+	// with a terminator, so no string can run past it.
+	const std::uint32_t* stringOffsets = (const std::uint32_t*)(mData + h.StringOffsetsOffset);
+	const char* stringData = (const char*)(mData + h.StringDataOffset);
+	if(h.StringCount > 0 && (h.StringDataSize == 0 || stringData[h.StringDataSize - 1] != '\0'))
+		return invalid;
+	for(std::uint32_t i = 0; i < h.StringCount; ++i)
+	{
+		if(stringOffsets[i] >= h.StringDataSize)
+			return invalid;
+	}
+
+	const SceneFileMesh* meshes = (const SceneFileMesh*)(mData + h.MeshesOffset);
+	for(std::uint32_t i = 0; i < h.MeshCount; ++i)
+	{
+		if(meshes[i].Geometry >= h.StringCount || meshes[i].Submesh >= h.StringCount)
+			return invalid;
+	}
+
+	const std::uint32_t* materials = (const std::uint32_t*)(mData + h.MaterialsOffset);
+	for(std::uint32_t i = 0; i < h.MaterialCount; ++i)
+	{
+		if(materials[i] >= h.StringCount)
+			return invalid;
+	}
+
+	const SceneFileItem* items = (const SceneFileItem*)(mData + h.ItemsOffset);
+	for(std::uint32_t i = 0; i < h.ItemCount; ++i)
+	{
+		const SceneFileItem& item = items[i];
+		if(item.Mesh >= h.MeshCount || item.Material >= h.MaterialCount)
+			return invalid;
+		if(item.Name != NoString && item.Name >= h.StringCount)
+			return invalid;
+	}
+
+	return S_OK;
+}
+
+HRESULT SceneFile::ConvertText(const std::wstring& textFilename, const std::wstring& binaryFilename,
+	const std::vector<std::string>& layerNames, std::string& error)
+{
+	std::ifstream fin(textFilename);
+	if(!fin)
+	{
+		error = "Cannot open " + WStringToAnsi(textFilename);
+		return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+	}
+
+	SceneTables tables;
+
+	SceneFileItem item;
+	bool inItem = false;
+
+	std::string line;
+	int lineNumber = 0;
+
+	auto fail = [&](const std::string& message)
+	{
+		error = WStringToAnsi(textFilename) + "(" + std::to_string(lineNumber) + "): " + message;
+		return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+	};
+
+	while(std::getline(fin, line))
+	{
+		++lineNumber;
+
+		size_t comment = line.find('#');
+		if(comment != std::string::npos)
+			line.erase(comment);
+
+		std::istringstream ss(line);
+		std::string keyword;
+		if(!(ss >> keyword))
+			continue;
+
+		if(keyword == "item")
+		{
+			if(inItem)
+				return fail("'item' before the 'end' of the previous item");
+
+			std::string geometry, submesh, material;
+			if(!(ss >> geometry >> submesh >> material))
+				return fail("expected 'item <geometry> <submesh> <material>'");
+
+			item = SceneFileItem();
+			XMStoreFloat4x4(&item.World, XMMatrixIdentity());
+			XMStoreFloat4x4(&item.TexTransform, XMMatrixIdentity());
+			item.Name = NoString;
+			item.Mesh = tables.AddMesh(geometry, submesh);
+			item.Material = tables.AddMaterial(material);
+			item.Topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			inItem = true;
+		}
+		else if(!inItem)
+		{
+			return fail("'" + keyword + "' outside of an item");
+		}
+		else if(keyword == "end")
+		{
+			tables.Items.push_back(item);
+			inItem = false;
+		}
+		else if(keyword == "name")
+		{
+			std::string name;
+			if(!(ss >> name))
+				return fail("expected 'name <name>'");
+			item.Name = tables.AddString(name);
+		}
+		else if(keyword == "layers")
+		{
+			std::string layer;
+			while(ss >> layer)
+			{
+				auto it = std::find(layerNames.begin(), layerNames.end(), layer);
+				if(it == layerNames.end())
+					return fail("unknown layer '" + layer + "'");
+				item.LayerMask |= 1u << (it - layerNames.begin());
+			}
+		}
+		else if(keyword == "topology")
+		{
+			std::string topology;
+			ss >> topology;
+			if(topology == "triangles")
+				item.Topology = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+			else if(topology == "lines")
+				item.Topology = D3D_PRIMITIVE_TOPOLOGY_LINELIST;
+			else if(topology == "points")
+				item.Topology = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
+			else
+				return fail("expected 'topology triangles|lines|points'");
+		}
+		else if(keyword == "dynamic")
+		{
+			item.Flags |= ItemDynamic;
+		}
+		else if(keyword == "occluder")
+		{
+			item.Flags |= ItemOccluder;
+		}
+		else if(keyword == "scale" || keyword == "translate" || keyword == "texscale")
+		{
+			float x, y, z;
+			if(!(ss >> x >> y >> z))
+				return fail("expected '" + keyword + " <x> <y> <z>'");
+
+			// Transforms are applied in the order they are listed.
+			XMFLOAT4X4& target = keyword == "texscale" ? item.TexTransform : item.World;
+			XMMATRIX op = keyword == "translate" ? XMMatrixTranslation(x, y, z) : XMMatrixScaling(x, y, z);
+			XMStoreFloat4x4(&target, XMLoadFloat4x4(&target) * op);
+		}
+		else if(keyword == "rotatex" || keyword == "rotatey" || keyword == "rotatez")
+		{
+			float degrees;
+			if(!(ss >> degrees))
+				return fail("expected '" + keyword + " <degrees>'");
+
+			float radians = XMConvertToRadians(degrees);
+			XMMATRIX op = keyword == "rotatex" ? XMMatrixRotationX(radians) :
+				keyword == "rotatey" ? XMMatrixRotationY(radians) : XMMatrixRotationZ(radians);
+			XMStoreFloat4x4(&item.World, XMLoadFloat4x4(&item.World) * op);
+		}
+		else
+		{
+			return fail("unknown keyword '" + keyword + "'");
+		}
+
+		std::string extra;
+		if(ss >> extra)
+			return fail("unexpected '" + extra + "' after '" + keyword + "'");
+	}
+
+	if(inItem)
+		return fail("missing 'end' of the last item");
+
+	HRESULT hr = WriteSceneFile(binaryFilename, tables);
+	if(FAILED(hr))
+		error = "Cannot write " + WStringToAnsi(binaryFilename);
+	return hr;
+}
+
+HRESULT SceneFile::ConvertTextIfNewer(const std::wstring& textFilename, const std::wstring& binaryFilename,
+	const std::vector<std::string>& layerNames, std::string& error)
+{
+	WIN32_FILE_ATTRIBUTE_DATA text, binary;
+	if(!GetFileAttributesExW(textFilename.c_str(), GetFileExInfoStandard, &text))
+		return S_OK;
+
+	bool upToDate = GetFileAttributesExW(binaryFilename.c_str(), GetFileExInfoStandard, &binary) &&
+		CompareFileTime(&text.ftLastWriteTime, &binary.ftLastWriteTime) <= 0;
+
+	// A file written by an older version of the format has to be redone as well.
+	if(upToDate)
+	{
+		SceneFileHeader header = {};
+		std::ifstream fin(binaryFilename, std::ios::binary);
+		fin.read((char*)&header, sizeof(header));
+		upToDate = fin.good() && header.Magic == Magic && header.Version == Version;
+	}
+
+	if(upToDate)
+		return S_OK;
+
+	return ConvertText(textFilename, binaryFilename, layerNames, error);
+}
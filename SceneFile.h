@@ -0,0 +1,140 @@
+//***************************************************************************************
+// SceneFile.h
+//
+// Versioned binary scene description: the render items of a scene with their
+// transforms, layers, and references to geometry, submesh and material by name.  The
+// file is memory-mapped and read in place; everything in it is fixed size records and
+// offsets, so opening it does not allocate and loading is one pass over the items.
+//
+// Scenes are authored in a line based text form (see Scenes/TexColumns.txt) and
+// turned into the binary form by ConvertText.
+//
+// Layout, all offsets from the start of the file and 4 byte aligned:
+//    SceneFileHeader
+//    SceneFileItem[ItemCount]
+//    SceneFileMesh[MeshCount]
+//    uint32 material name string indices[MaterialCount]
+//    uint32 string offsets into the string data[StringCount]
+//    string data, null terminated strings
+//***************************************************************************************
+
+#pragma once
+
+#include "Common/d3dUtil.h"
+#include <cstdint>
+
+struct SceneFileHeader
+{
+	std::uint32_t Magic;
+	std::uint32_t Version;
+	std::uint32_t FileSize;
+
+	std::uint32_t ItemCount;
+	std::uint32_t MeshCount;
+	std::uint32_t MaterialCount;
+	std::uint32_t StringCount;
+	std::uint32_t StringDataSize;
+
+	std::uint32_t ItemsOffset;
+	std::uint32_t MeshesOffset;
+	std::uint32_t MaterialsOffset;
+	std::uint32_t StringOffsetsOffset;
+	std::uint32_t StringDataOffset;
+};
+
+// A (geometry, submesh) pair, as string indices.  Items share these, so a loader can
+// resolve each once instead of once per item.
+struct SceneFileMesh
+{
+	std::uint32_t Geometry;
+	std::uint32_t Submesh;
+};
+
+struct SceneFileItem
+{
+	DirectX::XMFLOAT4X4 World;
+	DirectX::XMFLOAT4X4 TexTransform;
+
+	// String index of the item's name, or SceneFile::NoString.  Only items the
+	// application needs to find are named.
+	std::uint32_t Name;
+
+	// Indices into the mesh and material tables.
+	std::uint32_t Mesh;
+	std::uint32_t Material;
+
+	// Bit per layer the item is drawn in, numbered as in the layer names the file
+	// was converted with.
+	std::uint32_t LayerMask;
+
+	// D3D_PRIMITIVE_TOPOLOGY value.
+	std::uint32_t Topology;
+
+	// SceneFile::ItemFlags.
+	std::uint32_t Flags;
+
+	std::uint32_t Reserved[2];
+};
+
+class SceneFile
+{
+public:
+	static const std::uint32_t Magic = 0x454e4353; // "SCNE"
+	static const std::uint32_t Version = 1;
+	static const std::uint32_t NoString = 0xffffffff;
+
+	enum ItemFlags : std::uint32_t
+	{
+		// The item moves or deforms after loading.
+		ItemDynamic = 0x1,
+
+		// The item is large and solid enough to hide others; it is rasterized into
+		// the software occlusion buffer.
+		ItemOccluder = 0x2,
+	};
+
+	SceneFile() = default;
+	SceneFile(const SceneFile& rhs) = delete;
+	SceneFile& operator=(const SceneFile& rhs) = delete;
+	~SceneFile();
+
+	// Maps the file and validates its header, tables and indices, so the accessors
+	// below can be used without further checks.
+	HRESULT Open(const std::wstring& filename);
+	void Close();
+
+	UINT ItemCount()const { return mHeader->ItemCount; }
+	const SceneFileItem& Item(UINT i)const { return mItems[i]; }
+
+	UINT MeshCount()const { return mHeader->MeshCount; }
+	const SceneFileMesh& Mesh(UINT i)const { return mMeshes[i]; }
+
+	UINT MaterialCount()const { return mHeader->MaterialCount; }
+	const char* MaterialName(UINT i)const { return String(mMaterials[i]); }
+
+	const char* String(std::uint32_t index)const { return mStringData + mStringOffsets[index]; }
+
+	// Builds a binary scene file from the text form.  layerNames names the layer bits,
+	// lowest first.  Syntax errors are described in error, with the line number.
+	static HRESULT ConvertText(const std::wstring& textFilename, const std::wstring& binaryFilename,
+		const std::vector<std::string>& layerNames, std::string& error);
+
+	// Runs ConvertText when the binary file is missing or older than the text file.
+	// Does nothing when there is no text file, so a binary file can be shipped alone.
+	static HRESULT ConvertTextIfNewer(const std::wstring& textFilename, const std::wstring& binaryFilename,
+		const std::vector<std::string>& layerNames, std::string& error);
+
+private:
+	HRESULT Validate(std::uint64_t fileSize);
+
+	HANDLE mFile = INVALID_HANDLE_VALUE;
+	HANDLE mMapping = nullptr;
+	const BYTE* mData = nullptr;
+
+	const SceneFileHeader* mHeader = nullptr;
+	const SceneFileItem* mItems = nullptr;
+	const SceneFileMesh* mMeshes = nullptr;
+	const std::uint32_t* mMaterials = nullptr;
+	const std::uint32_t* mStringOffsets = nullptr;
+	const char* mStringData = nullptr;
+};
@@ -69,12 +69,55 @@ cbuffer cbMaterial : register(b2)
 	float4x4 gMatTransform;
 };
 
+#ifdef INSTANCED
+// Per-instance data for batches of items that share geometry and material.  The
+// root SRV is bound at the first instance of the batch, so SV_InstanceID indexes
+// it directly.
+struct InstanceData
+{
+	float4x4 World;
+	float4x4 TexTransform;
+};
+
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+#endif
+
+#ifdef COMPACT_VERTEX
+// Box the positions of the submesh drawn were quantized in, set with each draw.
+cbuffer cbVertexDecode : register(b3)
+{
+	float3 gPosScale;
+	float cbVertexDecodePad;
+	float3 gPosOffset;
+};
+
+// CompactVertex: the position as unorms across the box, the normal octahedral
+// encoded, and the texture coordinate as half floats, which the input assembler
+// widens to float.
+struct VertexIn
+{
+	float3 PosL    : POSITION;
+	float2 NormalL : NORMAL;
+	float2 TexC    : TEXCOORD;
+};
+
+// Unfolds a point of the square [-1, 1]^2 onto the octahedron, and from there onto
+// the unit sphere.
+float3 DecodeOctahedral(float2 e)
+{
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return normalize(n);
+}
+#else
 struct VertexIn
 {
 	float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
 	float2 TexC    : TEXCOORD;
 };
+#endif
 
 struct VertexOut
 {
@@ -84,22 +127,42 @@ struct VertexOut
 	float2 TexC    : TEXCOORD;
 };
 
+#ifdef INSTANCED
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
+#else
 VertexOut VS(VertexIn vin)
+#endif
 {
 	VertexOut vout = (VertexOut)0.0f;
+
+#ifdef INSTANCED
+	float4x4 world = gInstanceData[instanceID].World;
+	float4x4 texTransform = gInstanceData[instanceID].TexTransform;
+#else
+	float4x4 world = gWorld;
+	float4x4 texTransform = gTexTransform;
+#endif
+
+#ifdef COMPACT_VERTEX
+	float3 posL = vin.PosL * gPosScale + gPosOffset;
+	float3 normalL = DecodeOctahedral(vin.NormalL);
+#else
+	float3 posL = vin.PosL;
+	float3 normalL = vin.NormalL;
+#endif
 	
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), world);
     vout.PosW = posW.xyz;
 
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
+    vout.NormalW = mul(normalL, (float3x3)world);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
 	
 	// Output vertex attributes for interpolation across triangle.
-	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+	float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), texTransform);
 	vout.TexC = mul(texC, gMatTransform).xy;
 	
     return vout;
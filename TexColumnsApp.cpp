@@ -6,9 +6,26 @@
 #include "Common/MathHelper.h"
 #include "Common/UploadBuffer.h"
 #include "Common/GeometryGenerator.h"
+#include "Common/RadixSort.h"
+#include "Common/DrawStateCache.h"
+#include "Common/ResourceRegistry.h"
+#include "Common/ParallelFor.h"
+#include "Common/MeshOptimizer.h"
+#include "Common/VertexQuantizer.h"
 #include "FrameResource.h"
 #include "Waves.h"
-#include <unordered_set>
+#include "BVH.h"
+#include "OcclusionCuller.h"
+#include "Maze.h"
+#include "Labyrinth.h"
+#include "MazeMesher.h"
+#include "MazeNavigator.h"
+#include "Crowd.h"
+#include "SceneFile.h"
+#include "MeshCache.h"
+#include <map>
+#include <tuple>
+#include <cfloat>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -19,6 +36,235 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// Screen space error, in pixels, a coarser tessellation may add before the next finer
+// one is used, and the fraction a shape's size has to move past a switching point
+// before its level changes.  Without the margin an item sitting at a switching point
+// flips between levels from frame to frame.
+static const float gLodMaxErrorPixels = 0.5f;
+static const float gLodHysteresis = 0.15f;
+
+// How far the camera may move, and turn in radians, from where static items were last
+// queried from the BVH before they are queried again.  Until then only the static items
+// in a frustum widened by these amounts are culled each frame.
+static const float gVisCacheMaxMove = 2.0f;
+static const float gVisCacheMaxTurn = 0.1f;
+
+// Side, in cells, of the chunks the labyrinth walls are meshed and culled in.  Larger
+// chunks merge more walls into each slab, smaller ones cull more closely.
+static const UINT MazeChunkSize = 8;
+
+// RenderItem::MazeChunk of items that are not labyrinth walls.
+static const UINT NoMazeChunk = UINT_MAX;
+
+// An index of a render item, or of an item in the scene file, that names none.
+static const UINT NoItem = UINT_MAX;
+
+// Width of the labyrinth's walls and posts.
+static const float MazeWallThickness = 0.5f;
+
+// Side, in cells, of a randomly generated labyrinth to build in place of the hand-made
+// one, or 0 to keep it, and the seed it is generated from.
+static const UINT gLabyrinthGeneratedSize = 0;
+static const UINT gLabyrinthSeed = 1;
+
+// Agents walking the labyrinth, the goals they walk between, and their radius.
+static const UINT gCrowdAgentCount = 10000;
+static const UINT gCrowdGoalCount = 4;
+static const float gCrowdAgentRadius = 0.3f;
+
+// Hashed into every mesh cache key.  The keys hold what each mesh is generated from
+// but cannot see code, so bump this when a generator, MeshOptimizer or the vertex
+// packing changes.
+static const UINT gMeshGeneratorVersion = 3;
+
+// Lets GeometryGenerator and MazeMesher write the app's vertices directly.  They
+// have no tangents, so none are computed.
+struct AppVertexLayout
+{
+	using VertexType = Vertex;
+	static const bool Tangents = false;
+
+	static void Set(Vertex& v, const XMFLOAT3& position, const XMFLOAT3& normal, const XMFLOAT2& texC)
+	{
+		v.Pos = position;
+		v.Normal = normal;
+		v.TexC = texC;
+	}
+
+	static void SetTangent(Vertex& v, const XMFLOAT3& tangentU) {}
+};
+
+// Reports how much MeshOptimizer improved a geometry's vertex cache use.
+static void ReportVertexCache(const char* geometry, const MeshOptimizer::CacheStats& before,
+	const MeshOptimizer::CacheStats& after)
+{
+	std::string text = std::string(geometry) + " vertex cache: ACMR " + std::to_string(before.Acmr()) +
+		" -> " + std::to_string(after.Acmr()) + ", ATVR " + std::to_string(before.Atvr()) +
+		" -> " + std::to_string(after.Atvr()) + "\n";
+	OutputDebugStringA(text.c_str());
+}
+
+// Splits a mesh MeshOptimizer has ordered into meshlets, appending them to meshlets
+// with their index locations offset by startIndex, and puts the vertices back in
+// order of first use, which regrouping the triangles disturbed.  Returns the cache
+// stats of the final order.
+static MeshOptimizer::CacheStats SplitMeshlets(Vertex* vertices, UINT vertexCount, std::uint16_t* indices,
+	UINT indexCount, UINT startIndex, std::vector<GeometryGenerator::Meshlet>& meshlets)
+{
+	if(vertexCount == 0)
+		return MeshOptimizer::CacheStats();
+
+	size_t first = meshlets.size();
+	GeometryGenerator::BuildMeshlets(indices, indexCount, &vertices->Pos, vertexCount, sizeof(Vertex), meshlets);
+	for(size_t i = first; i < meshlets.size(); ++i)
+		meshlets[i].StartIndex += startIndex;
+
+	MeshOptimizer::OptimizeVertexFetch(vertices, vertexCount, indices, indexCount);
+	return MeshOptimizer::AnalyzeVertexCache(indices, indexCount, vertexCount);
+}
+
+// Reports the largest errors made packing a geometry into CompactVertex, and the
+// vertex memory saved.
+static void ReportQuantization(const char* geometry, const VertexQuantizer::EncodeError& error, size_t vertexCount)
+{
+	std::string text = std::string(geometry) + " compact vertices: " + std::to_string(vertexCount * sizeof(Vertex)) +
+		" -> " + std::to_string(vertexCount * sizeof(CompactVertex)) + " bytes, largest error position " +
+		std::to_string(error.Position) + ", normal " + std::to_string(error.NormalDegrees) + " degrees, texC " +
+		std::to_string(error.TexC) + "\n";
+	OutputDebugStringA(text.c_str());
+}
+
+// Starts the mesh cache key of a geometry with what every key holds: the generator
+// version and the vertex formats.
+static MeshCacheKey GeometryKey(const char* geometry)
+{
+	MeshCacheKey key(geometry);
+	key.Add(gMeshGeneratorVersion).Add(sizeof(Vertex)).Add(sizeof(CompactVertex));
+	return key;
+}
+
+// The generators shapeGeo is made with.  Their parameters are data rather than code
+// so they can be hashed into its cache key.
+enum class ShapeType : std::uint32_t
+{
+	Box, Sphere, Cylinder, Torus, Cone, Pyramid, Wedge, Diamond, Prism
+};
+
+// Size and Count are the dimensions and tessellation, in the order the generator
+// takes them.
+struct ShapeParams
+{
+	ShapeType Type;
+	float Size[3];
+	UINT Count[2];
+};
+
+static GeometryGenerator::MeshSize ShapeMeshSize(const ShapeParams& p)
+{
+	using Gen = GeometryGenerator;
+	switch(p.Type)
+	{
+	case ShapeType::Box: return Gen::BoxSize(p.Count[0]);
+	case ShapeType::Sphere: return Gen::SphereSize(p.Count[0], p.Count[1]);
+	case ShapeType::Cylinder: return Gen::CylinderSize(p.Count[0], p.Count[1]);
+	case ShapeType::Torus: return Gen::TorusSize((int)p.Count[0], (int)p.Count[1]);
+	case ShapeType::Cone: return Gen::CylinderSize(p.Count[0], p.Count[1]);
+	case ShapeType::Pyramid: return Gen::CylinderSize(4, p.Count[0]);
+	case ShapeType::Wedge: return Gen::WedgeSize(p.Count[0]);
+	case ShapeType::Diamond: return Gen::DiamondSize(p.Count[0], p.Count[1]);
+	case ShapeType::Prism: return Gen::CylinderSize(3, p.Count[0]);
+	}
+	assert(false && "Unknown shape.");
+	return GeometryGenerator::MeshSize();
+}
+
+// Writes the shape's ShapeMeshSize vertices and indices where the pointers say.
+static void WriteShape(const ShapeParams& p, Vertex* v, std::uint16_t* i)
+{
+	using Gen = GeometryGenerator;
+	const float* size = p.Size;
+	switch(p.Type)
+	{
+	case ShapeType::Box: Gen::WriteBox<AppVertexLayout>(size[0], size[1], size[2], p.Count[0], v, i); break;
+	case ShapeType::Sphere: Gen::WriteSphere<AppVertexLayout>(size[0], p.Count[0], p.Count[1], v, i); break;
+	case ShapeType::Cylinder: Gen::WriteCylinder<AppVertexLayout>(size[0], size[1], size[2], p.Count[0], p.Count[1], v, i); break;
+	case ShapeType::Torus: Gen::WriteTorus<AppVertexLayout>(size[0], size[1], (int)p.Count[0], (int)p.Count[1], v, i); break;
+	case ShapeType::Cone: Gen::WriteCone<AppVertexLayout>(size[0], size[1], p.Count[0], p.Count[1], v, i); break;
+	case ShapeType::Pyramid: Gen::WritePyramid<AppVertexLayout>(size[0], size[1], size[2], p.Count[0], v, i); break;
+	case ShapeType::Wedge: Gen::WriteWedge<AppVertexLayout>(size[0], size[1], size[2], p.Count[0], v, i); break;
+	case ShapeType::Diamond: Gen::WriteDiamond<AppVertexLayout>(size[0], size[1], p.Count[0], p.Count[1], v, i); break;
+	case ShapeType::Prism: Gen::WriteTriangularPrism<AppVertexLayout>(size[0], size[1], p.Count[0], v, i); break;
+	}
+}
+
+struct ShapeDesc
+{
+	const char* Name;
+	ShapeParams Params;
+};
+
+struct ShapeLodDesc
+{
+	const char* Name;
+	ShapeParams Params;
+
+	// Largest distance from the level's surface to the true one.
+	float Error;
+};
+
+static const ShapeDesc gShapes[] =
+{
+	{ "box", { ShapeType::Box, { 2.0f, 12.0f, 2.0f }, { 3 } } },
+	{ "sphere", { ShapeType::Sphere, { 0.5f }, { 20, 20 } } },
+	{ "cylinder", { ShapeType::Cylinder, { 1.2f, 1.2f, 12.0f }, { 20, 20 } } },
+	{ "torus", { ShapeType::Torus, { 2.0f, 0.5f }, { 40, 40 } } },
+	{ "cone", { ShapeType::Cone, { 2.0f, 5.0f }, { 20, 20 } } },
+	{ "pyramid", { ShapeType::Pyramid, { 2.0f, 0.0f, 5.0f }, { 6 } } },
+	{ "wedge", { ShapeType::Wedge, { 2.0f, 2.0f, 2.0f }, { 3 } } },
+	{ "diamond", { ShapeType::Diamond, { 2.0f, 4.0f }, { 20, 20 } } },
+	{ "prism", { ShapeType::Prism, { 2.0f, 4.0f }, { 20 } } },
+};
+
+// Gap between an arc of the given radius and its chords at this many segments.
+static float ChordError(float radius, UINT segments)
+{
+	return radius * (1.0f - cosf(XM_PI / segments));
+}
+
+//
+// Coarser tessellations of the curved shapes, appended after the full ones.  The
+// flat sided shapes look the same at any tessellation and get none.  Only the
+// slice count changes the silhouette; straight sides need a single stack.
+//
+
+static const ShapeLodDesc gShapeLods[] =
+{
+	{ "sphere", { ShapeType::Sphere, { 0.5f }, { 10, 10 } }, ChordError(0.5f, 10) },
+	{ "sphere", { ShapeType::Sphere, { 0.5f }, { 6, 6 } }, ChordError(0.5f, 6) },
+	{ "cylinder", { ShapeType::Cylinder, { 1.2f, 1.2f, 12.0f }, { 10, 1 } }, ChordError(1.2f, 10) },
+	{ "cylinder", { ShapeType::Cylinder, { 1.2f, 1.2f, 12.0f }, { 6, 1 } }, ChordError(1.2f, 6) },
+	{ "torus", { ShapeType::Torus, { 2.0f, 0.5f }, { 20, 20 } }, ChordError(2.5f, 20) + ChordError(0.5f, 20) },
+	{ "torus", { ShapeType::Torus, { 2.0f, 0.5f }, { 10, 10 } }, ChordError(2.5f, 10) + ChordError(0.5f, 10) },
+	{ "cone", { ShapeType::Cone, { 2.0f, 5.0f }, { 10, 1 } }, ChordError(2.0f, 10) },
+	{ "cone", { ShapeType::Cone, { 2.0f, 5.0f }, { 6, 1 } }, ChordError(2.0f, 6) },
+	{ "diamond", { ShapeType::Diamond, { 2.0f, 4.0f }, { 10, 1 } }, ChordError(2.0f, 10) },
+	{ "diamond", { ShapeType::Diamond, { 2.0f, 4.0f }, { 6, 1 } }, ChordError(2.0f, 6) },
+};
+
+static const UINT MaxLodLevels = 4;
+
+// Tessellations of one shape, finest first.  Level i is drawn while the shape's
+// projected bounding radius is below MaxScreenRadius[i] pixels.
+struct MeshLodChain
+{
+	UINT LevelCount = 0;
+	SubmeshGeometry Levels[MaxLodLevels];
+	float MaxScreenRadius[MaxLodLevels];
+
+	// MeshId of each level, filled in by BuildMeshIds.
+	UINT MeshIds[MaxLodLevels];
+};
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -52,6 +298,73 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Local space bounds of the geometry, and the world space box the BVH
+	// is built from.
+	BoundingBox Bounds;
+	BoundingBox WorldBounds;
+
+	// Bounds of the submesh drawn, the LOD level's if the item has levels.  Compact
+	// vertices are quantized in them.
+	BoundingBox VertexBounds;
+
+	// Items that move or deform go in the dynamic BVH, which is refit
+	// whenever their world bounds change.
+	bool Dynamic = false;
+
+	// Bit per RenderLayer this item is drawn in.
+	UINT LayerMask = 0;
+
+	// Drawn into the occlusion buffer, to hide the items behind it.
+	bool Occluder = false;
+
+	// Small integer identifying the submesh of Geo this item draws.  Used in draw
+	// sort keys; ids of submeshes in the same geometry are consecutive.
+	UINT MeshId = 0;
+
+	// Tessellation levels of the submesh, or null if it has only one.  The index
+	// counts and locations above are those of level Lod.
+	MeshLodChain* Lods = nullptr;
+	UINT Lod = 0;
+
+	// The labyrinth cell the item stands in, or Maze::InvalidCell if it is not
+	// entirely inside one.  Items in cells the camera cannot see are culled.
+	UINT MazeCell = Maze::InvalidCell;
+
+	// Index of the labyrinth chunk the item draws, or NoMazeChunk.
+	UINT MazeChunk = NoMazeChunk;
+
+	// Meshlets of the submesh drawn, culled one by one so large items draw only the
+	// parts that can be seen.  Items with LOD levels have none.
+	const GeometryGenerator::Meshlet* Meshlets = nullptr;
+	UINT MeshletCount = 0;
+
+	// This frame's index ranges left after meshlet culling, RangeCount of them from
+	// FirstRange in mMeshletRanges, holding RangeIndexCount indices in all.  No ranges
+	// means the item is drawn whole.
+	UINT FirstRange = 0;
+	UINT RangeCount = 0;
+	UINT RangeIndexCount = 0;
+};
+
+// A run of an item's indices drawn on its own, what is left of it after meshlet culling.
+struct MeshletRange
+{
+	UINT StartIndex = 0;
+	UINT IndexCount = 0;
+};
+
+// A run of sorted draws that share layer, submesh and material.  Runs of more than
+// one item are drawn with a single instanced draw call, as is the crowd.
+struct DrawBatch
+{
+	UINT First = 0;
+	UINT Count = 0;
+
+	// Drawn with one instanced draw call, the transforms at InstanceOffset in the
+	// frame's instance buffer.
+	bool Instanced = false;
+	UINT InstanceOffset = 0;
 };
 
 enum class RenderLayer : int
@@ -64,6 +377,65 @@ enum class RenderLayer : int
 	Count
 };
 
+// Names of the layers in scene files, indexed by RenderLayer.
+static const char* gLayerNames[(int)RenderLayer::Count] =
+{
+	"Opaque",
+	"Transparent",
+	"AlphaTested",
+	"AlphaTestedTreeSprites"
+};
+
+// Order in which the layers are drawn, indexed by RenderLayer.
+static const std::uint64_t gLayerDrawOrder[(int)RenderLayer::Count] = { 0, 3, 1, 2 };
+
+// Layers whose PSOs cull back faces.  Meshlets facing away are only dropped from items
+// drawn in no other layers.
+static const UINT gBackfaceCulledLayers = (1 << (int)RenderLayer::Opaque) | (1 << (int)RenderLayer::Transparent);
+
+// Every visible (item, layer) pair gets a 64-bit key, and the draw list is sorted
+// on it.  From the most significant bits down:
+//    4 bits  draw order of the layer
+//    8 bits  PSO
+//   12 bits  submesh (MeshId)
+//   12 bits  material
+//   24 bits  depth order
+// For opaque layers the depth order is the quantized view depth, front to back.
+// Transparent layers move it up in front of geometry and material, and use the
+// item's rank in the back to front order kept by SortTransparentItems.  The low
+// 4 bits are unused.
+static std::uint64_t MakeDrawKey(RenderLayer layer, UINT pso, UINT meshId, UINT matId, UINT depthOrder)
+{
+	std::uint64_t depthBits = depthOrder & 0xffffff;
+	std::uint64_t stateBits = ((std::uint64_t)(meshId & 0xfff) << 12) | (matId & 0xfff);
+
+	std::uint64_t key = (gLayerDrawOrder[(int)layer] << 60) | ((std::uint64_t)(pso & 0xff) << 52);
+	if(layer == RenderLayer::Transparent)
+		key |= (depthBits << 28) | (stateBits << 4);
+	else
+		key |= (stateBits << 28) | (depthBits << 4);
+
+	return key;
+}
+
+static UINT DrawKeyPso(std::uint64_t key)
+{
+	return (UINT)(key >> 52) & 0xff;
+}
+
+// Each layer has a PSO for full float vertices and one for CompactVertex, which
+// differ in input layout and vertex shader.  This is the PSO number draw keys hold.
+static const UINT LayerPsoCount = 2 * (UINT)RenderLayer::Count;
+
+static UINT LayerPso(RenderLayer layer, bool compactVertices)
+{
+	return (UINT)layer + (compactVertices ? (UINT)RenderLayer::Count : 0);
+}
+
+typedef ComPtr<ID3D12PipelineState> PsoRef;
+typedef ResourceHandle<PsoRef> PsoHandle;
+typedef ResourceHandle<std::unique_ptr<Material>> MaterialHandle;
+
 class TexColumnsApp : public D3DApp
 {
 public:
@@ -90,6 +462,14 @@ private:
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt);
+	void UpdateVisibility(const GameTimer& gt);
+	void UpdateStaticVisibility(const BoundingFrustum& worldFrustum, FXMMATRIX invView);
+	void UpdateMazeVisibility();
+	void CullMeshlets(const BoundingFrustum& worldFrustum);
+	void UpdateLods();
+	void SortTransparentItems();
+	void UpdateDrawList(const GameTimer& gt);
+	void UpdateStatsCaption();
 
 	void LoadTextures();
     void BuildRootSignature();
@@ -99,15 +479,27 @@ private:
 	void BuildLabyrinthGeometry();
 	void BuildWavesGeometry();
     void BuildShapeGeometry();
+	void GenerateShapeGeometry(MeshGeometry& geo, const std::string lodNames[]);
 	void BuildTreeSpritesGeometry();
+	void StoreInMeshCache(std::uint64_t key, const MeshGeometry& geo);
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void BuildCrowd(const XMFLOAT4X4& mazeWorld, UINT index);
+	void BuildBVHs();
+	void BuildOccluders();
+	void BuildMazeVisibility();
+	void BuildMeshIds();
+	void BuildTransparentOrder();
+    void DrawRenderItems(DrawStateCache& cache, const std::vector<RadixEntry<std::uint64_t>>& drawList,
+		const std::vector<DrawBatch>& batches);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
+	void Pick(int sx, int sy);
+	bool IntersectRitem(const RenderItem* ri, FXMVECTOR rayOrigin, FXMVECTOR rayDir, float& dist)const;
+
 	float GetHillsHeight(float x, float z) const;
 
 	XMFLOAT3 GetHillsNormal(float x, float z) const;
@@ -124,23 +516,138 @@ private:
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
-	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
-	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
-	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
-	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
-	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
+	// Looked up by name while loading only; per-frame code holds handles.
+	ResourceRegistry<std::unique_ptr<MeshGeometry>> mGeometries;
+	ResourceRegistry<std::unique_ptr<Material>> mMaterials;
+	ResourceRegistry<std::unique_ptr<Texture>> mTextures;
+	ResourceRegistry<ComPtr<ID3DBlob>> mShaders;
+	ResourceRegistry<PsoRef> mPSOs;
+
+	MaterialHandle mWaterMat;
+
+	// Tessellation levels of the curved shapes, keyed "geometry/submesh".
+	std::unordered_map<std::string, MeshLodChain> mLodChains;
+
+	// Generated geometry from earlier runs, loaded in place of generating it again.
+	MeshCache mMeshCache;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mCompactInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
  
 	RenderItem* mWavesRitem = nullptr;
 
 	// List of all the render items.
-	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
+	std::vector<RenderItem> mAllRitems;
 
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// Static items are built into one tree once; moving items get their own
+	// small tree that is refit instead of rebuilt.  Ids are ObjCBIndex.
+	BVH mStaticBvh;
+	BVH mDynamicBvh;
+	std::vector<std::uint32_t> mVisibleIds;
+
+	// Static items are culled incrementally.  mStaticCandidates are the static items
+	// in mCamGuardFrustum as of the last BVH query, made from the camera placement in
+	// mStaticQueryInvView; the camera can move by gVisCacheMaxMove and turn by
+	// gVisCacheMaxTurn before anything outside them can come into view.  Of those,
+	// mStaticVisibleIds passed the frustum and occlusion tests from mStaticCullView,
+	// and are reused as they are while the camera does not move.
+	BoundingFrustum mCamGuardFrustum;
+	std::vector<std::uint32_t> mStaticCandidates;
+	std::vector<std::uint32_t> mStaticVisibleIds;
+	UINT mStaticOccluded = 0;
+	XMFLOAT4X4 mStaticQueryInvView = MathHelper::Identity4x4();
+	XMFLOAT4X4 mStaticCullView = MathHelper::Identity4x4();
+	bool mStaticVisibilityDirty = true;
+
+	// Large static items rasterized on the CPU each frame; items the frustum query
+	// finds are dropped from mVisibleIds if they are hidden behind them.
+	OcclusionCuller mOcclusion;
+
+	// The labyrinth's walls, and which of its cells the camera can see.  The walls are
+	// meshed in chunks of MazeChunkSize x MazeChunkSize cells, each a submesh of
+	// wallGeo, and the scene's labyrinth item is split into an item per chunk.  While
+	// the eye is inside the labyrinth, chunks with no visible cells are culled.
+	struct MazeChunk
+	{
+		UINT X0, Z0, X1, Z1;
+		std::string Submesh;
+	};
+	Maze mMaze;
+	std::vector<MazeChunk> mMazeChunks;
+	bool mMazeInScene = false;
+	XMFLOAT4X4 mMazeInvWorld = MathHelper::Identity4x4();
+	std::vector<std::uint8_t> mMazeVisibleCells;
+	std::vector<std::uint8_t> mMazeVisibleChunks;
+
+	// Set while mMazeVisibleCells limits what is drawn of the labyrinth.
+	bool mMazeCellsCulled = false;
+
+	// Agents walking the labyrinth.  They are drawn as one instanced batch of the
+	// crowd item, which draws nothing itself; its bounds cover the labyrinth, so the
+	// crowd is culled with it.  Agents in cells the camera cannot see are skipped.
+	MazeNavigator mMazeNavigator;
+	Crowd mCrowd;
+	UINT mCrowdItem = NoItem;
+
+	// Sorted draws for this frame: the key is built by MakeDrawKey and the
+	// value is the index of the item in mAllRitems.
+	std::vector<RadixEntry<std::uint64_t>> mDrawList;
+	std::vector<RadixEntry<std::uint64_t>> mDrawListScratch;
+
+	// Runs of mDrawList that are drawn with one call each.
+	std::vector<DrawBatch> mDrawBatches;
+
+	// Index ranges of the items cut down by meshlet culling this frame.
+	std::vector<MeshletRange> mMeshletRanges;
+
+	// Transparent items in back to front order as of the last sort (the key is
+	// the negated view depth), and each item's rank in it, indexed by ObjCBIndex.
+	// The order is only re-sorted when the camera or a transparent item moves.
+	std::vector<RadixEntry<std::uint32_t>> mTransparentOrder;
+	std::vector<RadixEntry<std::uint32_t>> mTransparentScratch;
+	std::vector<UINT> mTransparentRank;
+	XMFLOAT4X4 mTransparentSortView = MathHelper::Identity4x4();
+	bool mTransparentSortDirty = true;
+
+	// PSO used by each layer and vertex format, indexed by LayerPso, its instanced
+	// variant (null where there is none), and the state cache the draw list is
+	// recorded through.
+	PsoHandle mLayerPSOs[LayerPsoCount];
+	PsoHandle mLayerInstancedPSOs[LayerPsoCount];
+	DrawStateCache mDrawCache;
+
+	// Per-frame counts shown in the window caption.
+	UINT mStatsVisible = 0;
+	UINT mStatsOccluded = 0;
+	UINT mStatsMazeCells = 0;
+	UINT mStatsCullTests = 0;
+	UINT mStatsMeshlets = 0;
+	UINT mStatsMeshletsCulled = 0;
+	UINT mStatsTriangles = 0;
+	UINT mStatsDraws = 0;
+	UINT mStatsStateChanges = 0;
+	UINT mStatsSkippedStateChanges = 0;
+
+	// Counts the caption was last built from, so it is only rebuilt when one changes.
+	// UINT_MAX until the first build.
+	UINT mCaptionVisible = UINT_MAX;
+	UINT mCaptionOccluded = UINT_MAX;
+	UINT mCaptionCullTests = UINT_MAX;
+	UINT mCaptionMazeCells = UINT_MAX;
+	UINT mCaptionMeshlets = UINT_MAX;
+	UINT mCaptionMeshletsCulled = UINT_MAX;
+	UINT mCaptionTriangles = UINT_MAX;
+	UINT mCaptionDraws = UINT_MAX;
+	UINT mCaptionStateChanges = UINT_MAX;
+	UINT mCaptionSkippedStateChanges = UINT_MAX;
+
+	// View space camera frustum, rebuilt when the projection changes.
+	BoundingFrustum mCamFrustum;
+
 	std::unique_ptr<Waves> mWaves;
 
     PassConstants mMainPassCB;
@@ -177,6 +684,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance,
         MessageBox(nullptr, e.ToString().c_str(), L"HR Failed", MB_OK);
         return 0;
     }
+    catch(std::exception& e)
+    {
+        // Thrown by the code shared with the headless tools, such as GeometryGenerator.
+        MessageBoxA(nullptr, e.what(), "Error", MB_OK);
+        return 0;
+    }
 }
 
 TexColumnsApp::TexColumnsApp(HINSTANCE hInstance)
@@ -208,6 +721,9 @@ bool TexColumnsApp::Initialize()
     BuildRootSignature();
 	BuildDescriptorHeaps();
     BuildShadersAndInputLayout();
+
+	if(FAILED(mMeshCache.Open(L"Scenes/TexColumns.meshcache")))
+		OutputDebugStringA("Could not open Scenes/TexColumns.meshcache; generating all geometry\n");
 	BuildLandGeometry();
 	BuildLabyrinthGeometry();
 	BuildWavesGeometry();
@@ -215,6 +731,11 @@ bool TexColumnsApp::Initialize()
 	BuildTreeSpritesGeometry();
 	BuildMaterials();
     BuildRenderItems();
+	BuildBVHs();
+	BuildOccluders();
+	BuildMazeVisibility();
+	BuildMeshIds();
+	BuildTransparentOrder();
     BuildFrameResources();
     BuildPSOs();
 
@@ -236,6 +757,35 @@ void TexColumnsApp::OnResize()
     // The window resized, so update the aspect ratio and recompute the projection matrix.
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
+
+	BoundingFrustum::CreateFromMatrix(mCamFrustum, P);
+
+	// Widen each side by the turn allowance, then pull the apex back until the near
+	// end of the widened frustum holds a sphere of the move allowance around the eye.
+	// Any frustum within both allowances of the camera's then lies inside it.
+	auto widen = [](float slope) { return std::tan(std::min<float>(std::atan(slope) + gVisCacheMaxTurn, 1.5f)); };
+	mCamGuardFrustum = mCamFrustum;
+	mCamGuardFrustum.RightSlope = widen(mCamFrustum.RightSlope);
+	mCamGuardFrustum.LeftSlope = -widen(-mCamFrustum.LeftSlope);
+	mCamGuardFrustum.TopSlope = widen(mCamFrustum.TopSlope);
+	mCamGuardFrustum.BottomSlope = -widen(-mCamFrustum.BottomSlope);
+
+	float minSlope = std::min<float>(std::min<float>(mCamGuardFrustum.RightSlope, -mCamGuardFrustum.LeftSlope),
+		std::min<float>(mCamGuardFrustum.TopSlope, -mCamGuardFrustum.BottomSlope));
+	float pullBack = gVisCacheMaxMove * std::sqrt(1.0f + 1.0f / (minSlope * minSlope));
+
+	float maxSlopeX = std::max<float>(mCamFrustum.RightSlope, -mCamFrustum.LeftSlope);
+	float maxSlopeY = std::max<float>(mCamFrustum.TopSlope, -mCamFrustum.BottomSlope);
+	float farReach = mCamFrustum.Far * std::sqrt(1.0f + maxSlopeX * maxSlopeX + maxSlopeY * maxSlopeY);
+
+	mCamGuardFrustum.Origin = XMFLOAT3(0.0f, 0.0f, -pullBack);
+	mCamGuardFrustum.Near = 0.0f;
+	mCamGuardFrustum.Far = pullBack + gVisCacheMaxMove + farReach;
+
+	mStaticVisibilityDirty = true;
+
+	// A small buffer is plenty to find what large occluders hide.
+	mOcclusion.Resize(256, 256 * mClientHeight / std::max<int>(mClientWidth, 1));
 }
 
 void TexColumnsApp::Update(const GameTimer& gt)
@@ -262,6 +812,11 @@ void TexColumnsApp::Update(const GameTimer& gt)
 	UpdateMaterialCBs(gt);
 	UpdateMainPassCB(gt);
 	UpdateWaves(gt);
+	if(mMazeInScene)
+		mCrowd.Update(gt.DeltaTime());
+	UpdateVisibility(gt);
+	UpdateLods();
+	UpdateDrawList(gt);
 }
 
 void TexColumnsApp::Draw(const GameTimer& gt)
@@ -274,7 +829,9 @@ void TexColumnsApp::Draw(const GameTimer& gt)
 
     // A command list can be reset after it has been added to the command queue via ExecuteCommandList.
     // Reusing the command list reuses memory.
-    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+	ID3D12PipelineState* opaquePSO = mPSOs.Get(mLayerPSOs[LayerPso(RenderLayer::Opaque, false)]).Get();
+    ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), opaquePSO));
+	mDrawCache.Begin(mCommandList.Get(), opaquePSO);
 
     mCommandList->RSSetViewports(1, &mScreenViewport);
     mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -293,18 +850,13 @@ void TexColumnsApp::Draw(const GameTimer& gt)
 	ID3D12DescriptorHeap* descriptorHeaps[] = { mSrvDescriptorHeap.Get() };
 	mCommandList->SetDescriptorHeaps(_countof(descriptorHeaps), descriptorHeaps);
 
-	mCommandList->SetGraphicsRootSignature(mRootSignature.Get());
+	mDrawCache.SetGraphicsRootSignature(mRootSignature.Get());
 
 	auto passCB = mCurrFrameResource->PassCB->Resource();
-	mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
-
-    DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
+	mDrawCache.SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
 
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
-
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+	// The draw list is sorted by layer first, so opaque, alpha tested, tree sprite
+	// and transparent items are drawn in that order, switching PSO as it goes.
 
 	//when you draw, you can set the blend factor that modulate values for a pixel shader, render target, or both.
 	//You could also use the following blend factor when you set your blend to D3D12_BLEND_BLEND_FACTOR in PSO like following:	
@@ -316,8 +868,11 @@ void TexColumnsApp::Draw(const GameTimer& gt)
 	//float blendFactor[4] = { 0.3f, 0.3f, 0.3f, 1.f };  //change the water to high transparency
 	//mCommandList->OMSetBlendFactor(blendFactor);
 
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+	DrawRenderItems(mDrawCache, mDrawList, mDrawBatches);
+
+	mStatsDraws = mDrawCache.DrawCount;
+	mStatsStateChanges = mDrawCache.StateChangeCount;
+	mStatsSkippedStateChanges = mDrawCache.SkippedStateChangeCount;
 
     // Indicate a state transition on the resource usage.
 	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -341,6 +896,8 @@ void TexColumnsApp::Draw(const GameTimer& gt)
     // Because we are on the GPU timeline, the new fence point won't be 
     // set until the GPU finishes processing all the commands prior to this Signal().
     mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+
+	UpdateStatsCaption();
 }
 
 void TexColumnsApp::OnMouseDown(WPARAM btnState, int x, int y)
@@ -348,6 +905,9 @@ void TexColumnsApp::OnMouseDown(WPARAM btnState, int x, int y)
     mLastMousePos.x = x;
     mLastMousePos.y = y;
 
+	if((btnState & MK_MBUTTON) != 0)
+		Pick(x, y);
+
     SetCapture(mhMainWnd);
 }
 
@@ -411,7 +971,7 @@ void TexColumnsApp::UpdateCamera(const GameTimer& gt)
 void TexColumnsApp::AnimateMaterials(const GameTimer& gt)
 {
 	// Scroll the water material texture coordinates.
-	auto waterMat = mMaterials["water"].get();
+	auto waterMat = mMaterials.Get(mWaterMat).get();
 
 	float& tu = waterMat->MatTransform(3, 0);
 	float& tv = waterMat->MatTransform(3, 1);
@@ -439,19 +999,36 @@ void TexColumnsApp::UpdateObjectCBs(const GameTimer& gt)
 	{
 		// Only update the cbuffer data if the constants have changed.  
 		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
+		if(e.NumFramesDirty > 0)
 		{
-			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			XMMATRIX world = XMLoadFloat4x4(&e.World);
+			XMMATRIX texTransform = XMLoadFloat4x4(&e.TexTransform);
 
 			ObjectConstants objConstants;
 			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
 			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+			currObjectCB->CopyData(e.ObjCBIndex, objConstants);
+
+			// The transform changed since the last frame, so move the item's
+			// bounds in its BVH.  The tree is refit once in UpdateVisibility.
+			if(e.NumFramesDirty == gNumFrameResources)
+			{
+				e.Bounds.Transform(e.WorldBounds, world);
+				if(e.Dynamic)
+					mDynamicBvh.UpdateBounds(e.ObjCBIndex, e.WorldBounds);
+				else
+				{
+					mStaticBvh.UpdateBounds(e.ObjCBIndex, e.WorldBounds);
+					mStaticVisibilityDirty = true;
+				}
+
+				if(e.LayerMask & (1 << (int)RenderLayer::Transparent))
+					mTransparentSortDirty = true;
+			}
 
 			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
+			e.NumFramesDirty--;
 		}
 	}
 }
@@ -463,7 +1040,7 @@ void TexColumnsApp::UpdateMaterialCBs(const GameTimer& gt)
 	{
 		// Only update the cbuffer data if the constants have changed.  If the cbuffer
 		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
+		Material* mat = e.get();
 		if(mat->NumFramesDirty > 0)
 		{
 			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
@@ -557,155 +1134,621 @@ void TexColumnsApp::UpdateWaves(const GameTimer& gt)
 	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
 }
 
-void TexColumnsApp::LoadTextures()
+void TexColumnsApp::UpdateVisibility(const GameTimer& gt)
 {
-	auto bricksTex = std::make_unique<Texture>();
-	bricksTex->Name = "bricksTex";
-	bricksTex->Filename = L"Textures/bricks.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bricksTex->Filename.c_str(),
-		bricksTex->Resource, bricksTex->UploadHeap));
+	// Pick up any bounds that moved in UpdateObjectCBs.
+	mStaticBvh.Refit();
+	mDynamicBvh.Refit();
 
-	auto brickTex = std::make_unique<Texture>();
-	brickTex->Name = "brickTex";
-	brickTex->Filename = L"Textures/bricks3.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), brickTex->Filename.c_str(),
-		brickTex->Resource, brickTex->UploadHeap));
+	// The BVHs store world space boxes, so bring the view space frustum into world space.
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
 
-	auto stoneTex = std::make_unique<Texture>();
-	stoneTex->Name = "stoneTex";
-	stoneTex->Filename = L"Textures/stone.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), stoneTex->Filename.c_str(),
-		stoneTex->Resource, stoneTex->UploadHeap));
+	BoundingFrustum worldFrustum;
+	mCamFrustum.Transform(worldFrustum, invView);
 
-	auto tileTex = std::make_unique<Texture>();
-	tileTex->Name = "tileTex";
-	tileTex->Filename = L"Textures/tile.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), tileTex->Filename.c_str(),
-		tileTex->Resource, tileTex->UploadHeap));
+	// Occluders are static too, so while the camera stands still neither the
+	// occlusion buffer nor the static items' visibility can change.
+	mStatsCullTests = 0;
+	if(mStaticVisibilityDirty || memcmp(&mStaticCullView, &mView, sizeof(XMFLOAT4X4)) != 0)
+	{
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMMatrixMultiply(view, XMLoadFloat4x4(&mProj)));
+		mOcclusion.Render(viewProj);
 
-	auto grassTex = std::make_unique<Texture>();
-	grassTex->Name = "grassTex";
-	grassTex->Filename = L"Textures/grass.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), grassTex->Filename.c_str(),
-		grassTex->Resource, grassTex->UploadHeap));
+		UpdateStaticVisibility(worldFrustum, invView);
+	}
 
-	auto waterTex = std::make_unique<Texture>();
-	waterTex->Name = "waterTex";
-	waterTex->Filename = L"Textures/water1.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), waterTex->Filename.c_str(),
-		waterTex->Resource, waterTex->UploadHeap));
+	mVisibleIds.assign(mStaticVisibleIds.begin(), mStaticVisibleIds.end());
+	mStatsOccluded = mStaticOccluded;
 
-	auto treeArrayTex = std::make_unique<Texture>();
-	treeArrayTex->Name = "treeArrayTex";
-	treeArrayTex->Filename = L"Textures/treeArray.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), treeArrayTex->Filename.c_str(),
-		treeArrayTex->Resource, treeArrayTex->UploadHeap));
+	// Moving items are tested every frame.
+	size_t firstDynamic = mVisibleIds.size();
+	mDynamicBvh.QueryFrustum(worldFrustum, mVisibleIds);
+	mStatsCullTests += (UINT)(mVisibleIds.size() - firstDynamic);
 
-	mTextures[bricksTex->Name] = std::move(bricksTex);
-	mTextures[brickTex->Name] = std::move(brickTex);
-	mTextures[stoneTex->Name] = std::move(stoneTex);
-	mTextures[tileTex->Name] = std::move(tileTex);
-	mTextures[grassTex->Name] = std::move(grassTex);
-	mTextures[waterTex->Name] = std::move(waterTex);
-	mTextures[treeArrayTex->Name] = std::move(treeArrayTex);
+	size_t visibleCount = firstDynamic;
+	for(size_t i = firstDynamic; i < mVisibleIds.size(); ++i)
+	{
+		if(mOcclusion.IsVisible(mAllRitems[mVisibleIds[i]].WorldBounds))
+			mVisibleIds[visibleCount++] = mVisibleIds[i];
+	}
+	mStatsOccluded += (UINT)(mVisibleIds.size() - visibleCount);
+	mVisibleIds.resize(visibleCount);
+
+	UpdateMazeVisibility();
+	CullMeshlets(worldFrustum);
+
+	mStatsVisible = (UINT)mVisibleIds.size();
 }
 
-void TexColumnsApp::BuildRootSignature()
+void TexColumnsApp::UpdateStaticVisibility(const BoundingFrustum& worldFrustum, FXMMATRIX invView)
 {
-	CD3DX12_DESCRIPTOR_RANGE texTable;
-	texTable.Init(
-        D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 
-        1,  // number of descriptors
-        0); // register t0
-
-    // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+	// Query the BVH again only once the camera has left the allowances the guard
+	// frustum was widened by.
+	bool requery = mStaticVisibilityDirty;
+	if(!requery)
+	{
+		XMMATRIX queryInvView = XMLoadFloat4x4(&mStaticQueryInvView);
+		float moved = XMVectorGetX(XMVector3Length(invView.r[3] - queryInvView.r[3]));
 
-	// Perfomance TIP: Order from most frequent to least frequent.
-	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
-    slotRootParameter[1].InitAsConstantBufferView(0); // register b0
-    slotRootParameter[2].InitAsConstantBufferView(1); // register b1
-    slotRootParameter[3].InitAsConstantBufferView(2); // register b2
+		// Angle of the rotation between the two camera orientations.
+		float trace = XMVectorGetX(XMVector3Dot(invView.r[0], queryInvView.r[0])) +
+			XMVectorGetX(XMVector3Dot(invView.r[1], queryInvView.r[1])) +
+			XMVectorGetX(XMVector3Dot(invView.r[2], queryInvView.r[2]));
+		float turned = std::acos(MathHelper::Clamp(0.5f * (trace - 1.0f), -1.0f, 1.0f));
 
-	auto staticSamplers = GetStaticSamplers();
+		requery = moved > gVisCacheMaxMove || turned > gVisCacheMaxTurn;
+	}
 
-    // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
-		(UINT)staticSamplers.size(), staticSamplers.data(),
-		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+	if(requery)
+	{
+		BoundingFrustum worldGuard;
+		mCamGuardFrustum.Transform(worldGuard, invView);
 
-    // create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
-    ComPtr<ID3DBlob> serializedRootSig = nullptr;
-    ComPtr<ID3DBlob> errorBlob = nullptr;
-    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
-        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+		mStaticCandidates.clear();
+		mStaticBvh.QueryFrustum(worldGuard, mStaticCandidates);
+		XMStoreFloat4x4(&mStaticQueryInvView, invView);
+	}
 
-    if(errorBlob != nullptr)
-    {
-        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
-    }
-    ThrowIfFailed(hr);
+	// The occlusion buffer changes with any camera move, so every candidate is tested
+	// again, but candidates are only the items around the view rather than the scene.
+	mStaticVisibleIds.clear();
+	mStaticOccluded = 0;
+	for(auto id : mStaticCandidates)
+	{
+		const BoundingBox& bounds = mAllRitems[id].WorldBounds;
+		if(worldFrustum.Contains(bounds) == DISJOINT)
+			continue;
+
+		if(mOcclusion.IsVisible(bounds))
+			mStaticVisibleIds.push_back(id);
+		else
+			++mStaticOccluded;
+	}
+	mStatsCullTests += (UINT)mStaticCandidates.size();
 
-    ThrowIfFailed(md3dDevice->CreateRootSignature(
-		0,
-        serializedRootSig->GetBufferPointer(),
-        serializedRootSig->GetBufferSize(),
-        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+	mStaticCullView = mView;
+	mStaticVisibilityDirty = false;
 }
 
-void TexColumnsApp::BuildDescriptorHeaps()
+void TexColumnsApp::UpdateMazeVisibility()
 {
-	//
-	// Create the SRV heap.
-	//
-	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = 7;
-	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
+	mStatsMazeCells = 0;
+	mMazeCellsCulled = false;
+	if(!mMazeInScene)
+		return;
+
+	// Outside the labyrinth, or looking over its walls, all of it is drawn.
+	XMFLOAT3 eye;
+	XMStoreFloat3(&eye, XMVector3TransformCoord(XMLoadFloat3(&mEyePos), XMLoadFloat4x4(&mMazeInvWorld)));
+	if(!mMaze.FindVisibleCells(eye, mMazeVisibleCells))
+		return;
+	mMazeCellsCulled = true;
+
+	const std::vector<std::uint8_t>& visible = mMazeVisibleCells;
+	for(auto v : visible)
+		mStatsMazeCells += v;
+
+	// A chunk holds the south and west walls of its cells, which also bound the
+	// cells just south and west of it, so it is drawn if any of those is seen.
+	UINT width = mMaze.Width();
+	mMazeVisibleChunks.assign(mMazeChunks.size(), 0);
+	for(size_t i = 0; i < mMazeChunks.size(); ++i)
+	{
+		const MazeChunk& chunk = mMazeChunks[i];
+		bool draw = false;
+		for(UINT z = chunk.Z0 > 0 ? chunk.Z0 - 1 : 0; z < chunk.Z1 && !draw; ++z)
+		{
+			for(UINT x = chunk.X0 > 0 ? chunk.X0 - 1 : 0; x < chunk.X1 && !draw; ++x)
+				draw = visible[z * width + x] != 0;
+		}
+		mMazeVisibleChunks[i] = draw ? 1 : 0;
+	}
 
-	//
-	// Fill out the heap with actual descriptors.
-	//
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	size_t visibleCount = 0;
+	for(auto id : mVisibleIds)
+	{
+		const RenderItem& ri = mAllRitems[id];
+		if(ri.MazeCell != Maze::InvalidCell && !visible[ri.MazeCell])
+			continue;
+		if(ri.MazeChunk != NoMazeChunk && !mMazeVisibleChunks[ri.MazeChunk])
+			continue;
+		mVisibleIds[visibleCount++] = id;
+	}
+	mStatsOccluded += (UINT)(mVisibleIds.size() - visibleCount);
+	mVisibleIds.resize(visibleCount);
+}
 
-	auto bricksTex = mTextures["bricksTex"]->Resource;
-	auto brickTex = mTextures["brickTex"]->Resource;
-	auto stoneTex = mTextures["stoneTex"]->Resource;
-	auto tileTex = mTextures["tileTex"]->Resource;
-	auto grassTex = mTextures["grassTex"]->Resource;
-	auto waterTex = mTextures["waterTex"]->Resource;
-	auto treeArrayTex = mTextures["treeArrayTex"]->Resource;
+void TexColumnsApp::CullMeshlets(const BoundingFrustum& worldFrustum)
+{
+	mMeshletRanges.clear();
+	mStatsMeshlets = 0;
+	mStatsMeshletsCulled = 0;
 
-	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srvDesc.Format = bricksTex->GetDesc().Format;
-	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	srvDesc.Texture2D.MostDetailedMip = 0;
-	srvDesc.Texture2D.MipLevels = bricksTex->GetDesc().MipLevels;
-	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-	md3dDevice->CreateShaderResourceView(bricksTex.Get(), &srvDesc, hDescriptor);
+	XMVECTOR eyePos = XMLoadFloat3(&mEyePos);
+	size_t visibleCount = 0;
+	for(auto id : mVisibleIds)
+	{
+		RenderItem& ri = mAllRitems[id];
+		ri.FirstRange = (UINT)mMeshletRanges.size();
+		ri.RangeCount = 0;
+		ri.RangeIndexCount = 0;
+		if(ri.MeshletCount == 0)
+		{
+			mVisibleIds[visibleCount++] = id;
+			continue;
+		}
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+		// Spheres are moved into world space, scaled by the largest axis scale.  Facing
+		// is tested in the item's space, where it comes out the same under any
+		// transform that does not mirror.
+		XMMATRIX world = XMLoadFloat4x4(&ri.World);
+		XMVECTOR det;
+		XMMATRIX invWorld = XMMatrixInverse(&det, world);
+		XMVECTOR localEye = XMVector3TransformCoord(eyePos, invWorld);
+		bool cullBackfacing = XMVectorGetX(det) > 0.0f && (ri.LayerMask & ~gBackfaceCulledLayers) == 0;
 
-	srvDesc.Format = stoneTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = stoneTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(stoneTex.Get(), &srvDesc, hDescriptor);
+		float scale = std::sqrt(std::max<float>(XMVectorGetX(XMVector3LengthSq(world.r[0])),
+			std::max<float>(XMVectorGetX(XMVector3LengthSq(world.r[1])), XMVectorGetX(XMVector3LengthSq(world.r[2])))));
 
-	// next descriptor
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+		UINT lastVisible = 0;
+		for(UINT i = 0; i < ri.MeshletCount; ++i)
+		{
+			const GeometryGenerator::Meshlet& m = ri.Meshlets[i];
+			if(cullBackfacing && GeometryGenerator::MeshletBackfacing(m, localEye))
+			{
+				++mStatsMeshletsCulled;
+				continue;
+			}
 
-	srvDesc.Format = tileTex->GetDesc().Format;
-	srvDesc.Texture2D.MipLevels = tileTex->GetDesc().MipLevels;
-	md3dDevice->CreateShaderResourceView(tileTex.Get(), &srvDesc, hDescriptor);
+			BoundingSphere sphere;
+			XMStoreFloat3(&sphere.Center, XMVector3TransformCoord(XMLoadFloat3(&m.Center), world));
+			sphere.Radius = m.Radius * scale;
+			if(worldFrustum.Contains(sphere) == DISJOINT)
+			{
+				++mStatsMeshletsCulled;
+				continue;
+			}
+
+			// Meshlets are stored one after another, so a run of them is one range.  A
+			// single culled meshlet is drawn through rather than split around: its few
+			// triangles cost less than another draw.
+			MeshletRange* last = ri.RangeCount > 0 ? &mMeshletRanges.back() : nullptr;
+			if(last != nullptr && i - lastVisible <= 2)
+				last->IndexCount = m.StartIndex + m.IndexCount - last->StartIndex;
+			else
+			{
+				MeshletRange range;
+				range.StartIndex = m.StartIndex;
+				range.IndexCount = m.IndexCount;
+				mMeshletRanges.push_back(range);
+				ri.RangeCount++;
+			}
+			lastVisible = i;
+		}
+
+		mStatsMeshlets += ri.MeshletCount;
+
+		// Every meshlet culled drops the item; none culled draws it as it is.
+		if(ri.RangeCount == 0)
+			continue;
+
+		for(UINT r = 0; r < ri.RangeCount; ++r)
+			ri.RangeIndexCount += mMeshletRanges[ri.FirstRange + r].IndexCount;
+
+		if(ri.RangeIndexCount == ri.IndexCount)
+		{
+			mMeshletRanges.resize(ri.FirstRange);
+			ri.RangeCount = 0;
+			ri.RangeIndexCount = 0;
+		}
+		mVisibleIds[visibleCount++] = id;
+	}
+	mVisibleIds.resize(visibleCount);
+}
+
+void TexColumnsApp::UpdateLods()
+{
+	// Projected radius in pixels of a unit sphere at unit distance.
+	float pixelScale = 0.5f * mClientHeight * mProj(1, 1);
+	XMVECTOR eyePos = XMLoadFloat3(&mEyePos);
+
+	mStatsTriangles = 0;
+	for(auto id : mVisibleIds)
+	{
+		RenderItem* ri = &mAllRitems[id];
+		const MeshLodChain* lods = ri->Lods;
+		if(lods != nullptr)
+		{
+			XMVECTOR center = XMLoadFloat3(&ri->WorldBounds.Center);
+			float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&ri->WorldBounds.Extents)));
+			float dist = XMVectorGetX(XMVector3Length(center - eyePos));
+
+			UINT lod = ri->Lod;
+			if(dist <= radius)
+			{
+				// The camera is inside the bounds.
+				lod = 0;
+			}
+			else
+			{
+				float screenRadius = radius * pixelScale / dist;
+				while(lod + 1 < lods->LevelCount && screenRadius < lods->MaxScreenRadius[lod + 1] * (1.0f - gLodHysteresis))
+					++lod;
+				while(lod > 0 && screenRadius > lods->MaxScreenRadius[lod] * (1.0f + gLodHysteresis))
+					--lod;
+			}
+
+			if(lod != ri->Lod)
+			{
+				const SubmeshGeometry& level = lods->Levels[lod];
+				ri->Lod = lod;
+				ri->IndexCount = level.IndexCount;
+				ri->StartIndexLocation = level.StartIndexLocation;
+				ri->BaseVertexLocation = level.BaseVertexLocation;
+				ri->VertexBounds = level.Bounds;
+				ri->MeshId = lods->MeshIds[lod];
+			}
+		}
+
+		if(ri->PrimitiveType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+			mStatsTriangles += (ri->RangeCount > 0 ? ri->RangeIndexCount : ri->IndexCount) / 3;
+	}
+}
+
+void TexColumnsApp::SortTransparentItems()
+{
+	if(!mTransparentSortDirty && memcmp(&mTransparentSortView, &mView, sizeof(XMFLOAT4X4)) == 0)
+		return;
+
+	mTransparentSortView = mView;
+	mTransparentSortDirty = false;
+
+	// Negate the view depth so ascending keys run back to front.
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	for(auto& e : mTransparentOrder)
+	{
+		XMVECTOR center = XMLoadFloat3(&mAllRitems[e.Value].WorldBounds.Center);
+		e.Key = FloatToSortableUint(-XMVectorGetZ(XMVector3TransformCoord(center, view)));
+	}
+
+	// Last frame's order is usually still almost right.
+	SortNearlySorted(mTransparentOrder, mTransparentScratch);
+
+	for(UINT i = 0; i < (UINT)mTransparentOrder.size(); ++i)
+		mTransparentRank[mTransparentOrder[i].Value] = i;
+}
+
+void TexColumnsApp::UpdateDrawList(const GameTimer& gt)
+{
+	SortTransparentItems();
+
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	const float farZ = 1000.0f;
+
+	// One draw per visible item per layer it is in.
+	mDrawList.clear();
+	bool crowdVisible = false;
+	for(std::uint32_t id : mVisibleIds)
+	{
+		RenderItem* ri = &mAllRitems[id];
+		if(id == mCrowdItem)
+			crowdVisible = true;
+
+		XMVECTOR center = XMLoadFloat3(&ri->WorldBounds.Center);
+		float depth = XMVectorGetZ(XMVector3TransformCoord(center, view)) / farZ;
+		UINT depthOrder = (UINT)(MathHelper::Clamp(depth, 0.0f, 1.0f)*0xffffff);
+
+		for(int i = 0; i < (int)RenderLayer::Count; ++i)
+		{
+			if((ri->LayerMask & (1 << i)) == 0)
+				continue;
+
+			UINT order = i == (int)RenderLayer::Transparent ? mTransparentRank[id] : depthOrder;
+
+			RadixEntry<std::uint64_t> draw;
+			draw.Key = MakeDrawKey((RenderLayer)i, LayerPso((RenderLayer)i, ri->Geo->CompactVertices),
+				ri->MeshId, ri->Mat->MatCBIndex, order);
+			draw.Value = id;
+			mDrawList.push_back(draw);
+		}
+	}
+
+	RadixSort(mDrawList, mDrawListScratch);
+
+	// Sorting put draws of the same submesh and material next to each other; turn
+	// each such run into one batch and upload the instance transforms it needs.
+	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+	UINT instanceCount = 0;
+
+	mDrawBatches.clear();
+	for(UINT i = 0; i < (UINT)mDrawList.size(); )
+	{
+		UINT pso = DrawKeyPso(mDrawList[i].Key);
+		const RenderItem* first = &mAllRitems[mDrawList[i].Value];
+
+		DrawBatch batch;
+		batch.First = i++;
+		batch.Count = 1;
+
+		// Items cut down by meshlet culling draw their own ranges.
+		if(!mLayerInstancedPSOs[pso].IsNull() && first->RangeCount == 0)
+		{
+			for(; i < (UINT)mDrawList.size(); ++i)
+			{
+				const RenderItem* ri = &mAllRitems[mDrawList[i].Value];
+				if(DrawKeyPso(mDrawList[i].Key) != pso || ri->MeshId != first->MeshId ||
+					ri->Mat != first->Mat || ri->PrimitiveType != first->PrimitiveType || ri->RangeCount > 0)
+					break;
+				batch.Count++;
+			}
+		}
+
+		if(batch.Count > 1)
+		{
+			batch.Instanced = true;
+			batch.InstanceOffset = instanceCount;
+			for(UINT k = 0; k < batch.Count; ++k)
+			{
+				const RenderItem* ri = &mAllRitems[mDrawList[batch.First + k].Value];
+
+				InstanceData data;
+				XMStoreFloat4x4(&data.World, XMMatrixTranspose(XMLoadFloat4x4(&ri->World)));
+				XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&ri->TexTransform)));
+				currInstanceBuffer->CopyData(instanceCount++, data);
+			}
+		}
+
+		mDrawBatches.push_back(batch);
+	}
+
+	// The crowd is one more opaque batch.  Its draw goes past the sorted ones, for the
+	// batch to take its state from, and the batch goes where its key sorts.
+	if(crowdVisible)
+	{
+		const RenderItem& ri = mAllRitems[mCrowdItem];
+		const auto& transforms = mCrowd.Transforms();
+
+		// UpdateLods counted the crowd item, which draws nothing itself.
+		mStatsTriangles -= ri.IndexCount / 3;
+
+		DrawBatch batch;
+		batch.First = (UINT)mDrawList.size();
+		batch.Instanced = true;
+		batch.InstanceOffset = instanceCount;
+
+		InstanceData data;
+		XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&ri.TexTransform)));
+		for(UINT i = 0; i < mCrowd.AgentCount(); ++i)
+		{
+			if(mMazeCellsCulled && !mMazeVisibleCells[mCrowd.AgentCell(i)])
+				continue;
+
+			XMStoreFloat4x4(&data.World, XMMatrixTranspose(XMLoadFloat4x4(&transforms[i])));
+			currInstanceBuffer->CopyData(instanceCount++, data);
+			batch.Count++;
+		}
+
+		if(batch.Count > 0)
+		{
+			RadixEntry<std::uint64_t> draw;
+			draw.Key = MakeDrawKey(RenderLayer::Opaque, LayerPso(RenderLayer::Opaque, ri.Geo->CompactVertices),
+				ri.MeshId, ri.Mat->MatCBIndex, 0);
+			draw.Value = mCrowdItem;
+			mDrawList.push_back(draw);
+
+			auto at = std::upper_bound(mDrawBatches.begin(), mDrawBatches.end(), draw.Key,
+				[this](std::uint64_t key, const DrawBatch& b) { return key < mDrawList[b.First].Key; });
+			mDrawBatches.insert(at, batch);
+
+			mStatsTriangles += batch.Count * (ri.IndexCount / 3);
+		}
+	}
+}
+
+void TexColumnsApp::UpdateStatsCaption()
+{
+	if(mStatsVisible == mCaptionVisible && mStatsOccluded == mCaptionOccluded && mStatsCullTests == mCaptionCullTests &&
+		mStatsMazeCells == mCaptionMazeCells && mStatsMeshlets == mCaptionMeshlets &&
+		mStatsMeshletsCulled == mCaptionMeshletsCulled && mStatsTriangles == mCaptionTriangles &&
+		mStatsDraws == mCaptionDraws && mStatsStateChanges == mCaptionStateChanges &&
+		mStatsSkippedStateChanges == mCaptionSkippedStateChanges)
+		return;
+
+	mCaptionVisible = mStatsVisible;
+	mCaptionOccluded = mStatsOccluded;
+	mCaptionCullTests = mStatsCullTests;
+	mCaptionMazeCells = mStatsMazeCells;
+	mCaptionMeshlets = mStatsMeshlets;
+	mCaptionMeshletsCulled = mStatsMeshletsCulled;
+	mCaptionTriangles = mStatsTriangles;
+	mCaptionDraws = mStatsDraws;
+	mCaptionStateChanges = mStatsStateChanges;
+	mCaptionSkippedStateChanges = mStatsSkippedStateChanges;
+
+	mMainWndCaption = L"d3d App    visible: " + std::to_wstring(mStatsVisible) +
+		L"/" + std::to_wstring(mAllRitems.size()) +
+		L" (" + std::to_wstring(mStatsOccluded) + L" occluded, " + std::to_wstring(mStatsCullTests) + L" tested)" +
+		L"    maze cells: " + std::to_wstring(mStatsMazeCells) +
+		L"    meshlets culled: " + std::to_wstring(mStatsMeshletsCulled) + L"/" + std::to_wstring(mStatsMeshlets) +
+		L"    triangles: " + std::to_wstring(mStatsTriangles) +
+		L"    draws: " + std::to_wstring(mStatsDraws) +
+		L"    state changes: " + std::to_wstring(mStatsStateChanges) +
+		L" (" + std::to_wstring(mStatsSkippedStateChanges) + L" skipped)";
+}
+
+void TexColumnsApp::LoadTextures()
+{
+	auto bricksTex = std::make_unique<Texture>();
+	bricksTex->Name = "bricksTex";
+	bricksTex->Filename = L"Textures/bricks.dds";
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+		mCommandList.Get(), bricksTex->Filename.c_str(),
+		bricksTex->Resource, bricksTex->UploadHeap));
+
+	auto brickTex = std::make_unique<Texture>();
+	brickTex->Name = "brickTex";
+	brickTex->Filename = L"Textures/bricks3.dds";
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+		mCommandList.Get(), brickTex->Filename.c_str(),
+		brickTex->Resource, brickTex->UploadHeap));
+
+	auto stoneTex = std::make_unique<Texture>();
+	stoneTex->Name = "stoneTex";
+	stoneTex->Filename = L"Textures/stone.dds";
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+		mCommandList.Get(), stoneTex->Filename.c_str(),
+		stoneTex->Resource, stoneTex->UploadHeap));
+
+	auto tileTex = std::make_unique<Texture>();
+	tileTex->Name = "tileTex";
+	tileTex->Filename = L"Textures/tile.dds";
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+		mCommandList.Get(), tileTex->Filename.c_str(),
+		tileTex->Resource, tileTex->UploadHeap));
+
+	auto grassTex = std::make_unique<Texture>();
+	grassTex->Name = "grassTex";
+	grassTex->Filename = L"Textures/grass.dds";
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+		mCommandList.Get(), grassTex->Filename.c_str(),
+		grassTex->Resource, grassTex->UploadHeap));
+
+	auto waterTex = std::make_unique<Texture>();
+	waterTex->Name = "waterTex";
+	waterTex->Filename = L"Textures/water1.dds";
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+		mCommandList.Get(), waterTex->Filename.c_str(),
+		waterTex->Resource, waterTex->UploadHeap));
+
+	auto treeArrayTex = std::make_unique<Texture>();
+	treeArrayTex->Name = "treeArrayTex";
+	treeArrayTex->Filename = L"Textures/treeArray.dds";
+	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+		mCommandList.Get(), treeArrayTex->Filename.c_str(),
+		treeArrayTex->Resource, treeArrayTex->UploadHeap));
+
+	mTextures.Add(bricksTex->Name, std::move(bricksTex));
+	mTextures.Add(brickTex->Name, std::move(brickTex));
+	mTextures.Add(stoneTex->Name, std::move(stoneTex));
+	mTextures.Add(tileTex->Name, std::move(tileTex));
+	mTextures.Add(grassTex->Name, std::move(grassTex));
+	mTextures.Add(waterTex->Name, std::move(waterTex));
+	mTextures.Add(treeArrayTex->Name, std::move(treeArrayTex));
+}
+
+void TexColumnsApp::BuildRootSignature()
+{
+	CD3DX12_DESCRIPTOR_RANGE texTable;
+	texTable.Init(
+        D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 
+        1,  // number of descriptors
+        0); // register t0
+
+    // Root parameter can be a table, root descriptor or root constants.
+    CD3DX12_ROOT_PARAMETER slotRootParameter[6];
+
+	// Perfomance TIP: Order from most frequent to least frequent.
+	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
+    slotRootParameter[1].InitAsConstantBufferView(0); // register b0
+    slotRootParameter[2].InitAsConstantBufferView(1); // register b1
+    slotRootParameter[3].InitAsConstantBufferView(2); // register b2
+	slotRootParameter[4].InitAsShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_VERTEX); // register t0, space1
+	slotRootParameter[5].InitAsConstants(sizeof(VertexQuantizer::PositionDecode) / 4, 3, 0, D3D12_SHADER_VISIBILITY_VERTEX); // register b3
+
+	auto staticSamplers = GetStaticSamplers();
+
+    // A root signature is an array of root parameters.
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(6, slotRootParameter,
+		(UINT)staticSamplers.size(), staticSamplers.data(),
+		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
+
+    // create a root signature with a single slot which points to a descriptor range consisting of a single constant buffer
+    ComPtr<ID3DBlob> serializedRootSig = nullptr;
+    ComPtr<ID3DBlob> errorBlob = nullptr;
+    HRESULT hr = D3D12SerializeRootSignature(&rootSigDesc, D3D_ROOT_SIGNATURE_VERSION_1,
+        serializedRootSig.GetAddressOf(), errorBlob.GetAddressOf());
+
+    if(errorBlob != nullptr)
+    {
+        ::OutputDebugStringA((char*)errorBlob->GetBufferPointer());
+    }
+    ThrowIfFailed(hr);
+
+    ThrowIfFailed(md3dDevice->CreateRootSignature(
+		0,
+        serializedRootSig->GetBufferPointer(),
+        serializedRootSig->GetBufferSize(),
+        IID_PPV_ARGS(mRootSignature.GetAddressOf())));
+}
+
+void TexColumnsApp::BuildDescriptorHeaps()
+{
+	//
+	// Create the SRV heap.
+	//
+	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
+	srvHeapDesc.NumDescriptors = 7;
+	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
+
+	//
+	// Fill out the heap with actual descriptors.
+	//
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+
+	auto bricksTex = mTextures.Get("bricksTex")->Resource;
+	auto brickTex = mTextures.Get("brickTex")->Resource;
+	auto stoneTex = mTextures.Get("stoneTex")->Resource;
+	auto tileTex = mTextures.Get("tileTex")->Resource;
+	auto grassTex = mTextures.Get("grassTex")->Resource;
+	auto waterTex = mTextures.Get("waterTex")->Resource;
+	auto treeArrayTex = mTextures.Get("treeArrayTex")->Resource;
+
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.Format = bricksTex->GetDesc().Format;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.MipLevels = bricksTex->GetDesc().MipLevels;
+	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+	md3dDevice->CreateShaderResourceView(bricksTex.Get(), &srvDesc, hDescriptor);
+
+	// next descriptor
+	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+
+	srvDesc.Format = stoneTex->GetDesc().Format;
+	srvDesc.Texture2D.MipLevels = stoneTex->GetDesc().MipLevels;
+	md3dDevice->CreateShaderResourceView(stoneTex.Get(), &srvDesc, hDescriptor);
+
+	// next descriptor
+	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+
+	srvDesc.Format = tileTex->GetDesc().Format;
+	srvDesc.Texture2D.MipLevels = tileTex->GetDesc().MipLevels;
+	md3dDevice->CreateShaderResourceView(tileTex.Get(), &srvDesc, hDescriptor);
 
 	// next descriptor
 	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
@@ -760,13 +1803,35 @@ void TexColumnsApp::BuildShadersAndInputLayout()
 		NULL, NULL
 	};
 
-	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1");
-	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	const D3D_SHADER_MACRO instancedDefines[] =
+	{
+		"INSTANCED", "1",
+		NULL, NULL
+	};
+
+	const D3D_SHADER_MACRO compactDefines[] =
+	{
+		"COMPACT_VERTEX", "1",
+		NULL, NULL
+	};
+
+	const D3D_SHADER_MACRO compactInstancedDefines[] =
+	{
+		"COMPACT_VERTEX", "1",
+		"INSTANCED", "1",
+		NULL, NULL
+	};
+
+	mShaders.Add("standardVS", d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1"));
+	mShaders.Add("instancedVS", d3dUtil::CompileShader(L"Shaders\\Default.hlsl", instancedDefines, "VS", "vs_5_1"));
+	mShaders.Add("compactVS", d3dUtil::CompileShader(L"Shaders\\Default.hlsl", compactDefines, "VS", "vs_5_1"));
+	mShaders.Add("compactInstancedVS", d3dUtil::CompileShader(L"Shaders\\Default.hlsl", compactInstancedDefines, "VS", "vs_5_1"));
+	mShaders.Add("opaquePS", d3dUtil::CompileShader(L"Shaders\\Default.hlsl", defines, "PS", "ps_5_1"));
+	mShaders.Add("alphaTestedPS", d3dUtil::CompileShader(L"Shaders\\Default.hlsl", alphaTestDefines, "PS", "ps_5_1"));
     
-	mShaders["treeSpriteVS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["treeSpriteGS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1");
-	mShaders["treeSpritePS"] = d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1");
+	mShaders.Add("treeSpriteVS", d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "VS", "vs_5_1"));
+	mShaders.Add("treeSpriteGS", d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", nullptr, "GS", "gs_5_1"));
+	mShaders.Add("treeSpritePS", d3dUtil::CompileShader(L"Shaders\\TreeSprite.hlsl", alphaTestDefines, "PS", "ps_5_1"));
 
 	mInputLayout =
     {
@@ -775,6 +1840,14 @@ void TexColumnsApp::BuildShadersAndInputLayout()
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     };
 
+	// CompactVertex.  The fourth position value is padding the shader does not read.
+	mCompactInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+
 	mTreeSpriteInputLayout =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -784,210 +1857,236 @@ void TexColumnsApp::BuildShadersAndInputLayout()
 
 void TexColumnsApp::BuildLandGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData grid = geoGen.CreateGrid(160.0f, 160.0f, 50, 50);
+	const float landSize = 160.0f;
+	const UINT landQuads = 50;
+
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "landGeo";
+
+	// The height function is code, covered by the generator version.
+	std::uint64_t key = GeometryKey("landGeo").Add(landSize).Add(landQuads).Value();
+	if(mMeshCache.Load(key, md3dDevice.Get(), mCommandList.Get(), *geo))
+	{
+		mGeometries.Add("landGeo", std::move(geo));
+		return;
+	}
+
+	GeometryGenerator::MeshSize size = GeometryGenerator::GridSize(landQuads, landQuads);
+	std::vector<Vertex> vertices(size.VertexCount);
+	std::vector<std::uint16_t> indices(size.IndexCount);
+	GeometryGenerator::WriteGrid<AppVertexLayout>(landSize, landSize, landQuads, landQuads, vertices.data(), indices.data());
 
 	//
-	// Extract the vertex elements we are interested and apply the height function to
-	// each vertex.  In addition, color the vertices based on their height so we have
-	// sandy looking beaches, grassy low hills, and snow mountain peaks.
+	// Apply the height function to each vertex of the flat grid.
 	//
 
-	std::vector<Vertex> vertices(grid.Vertices.size());
-	for (size_t i = 0; i < grid.Vertices.size(); ++i)
+	for (auto& v : vertices)
 	{
-		auto& p = grid.Vertices[i].Position;
-		vertices[i].Pos = p;
-		vertices[i].Pos.y = GetHillsHeight(p.x, p.z);
-		vertices[i].Normal = GetHillsNormal(p.x, p.z);
-		vertices[i].TexC = grid.Vertices[i].TexC;
+		v.Normal = GetHillsNormal(v.Pos.x, v.Pos.z);
+		v.Pos.y = GetHillsHeight(v.Pos.x, v.Pos.z);
 	}
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	// The hills are one large item, so it is split into meshlets for the parts out of
+	// view or facing away to be culled.
+	MeshOptimizer::CacheStats before, optimized;
+	MeshOptimizer::Optimize(vertices.data(), (UINT)vertices.size(), indices.data(), (UINT)indices.size(),
+		&Vertex::Pos, before, optimized);
+	MeshOptimizer::CacheStats after = SplitMeshlets(vertices.data(), (UINT)vertices.size(), indices.data(),
+		(UINT)indices.size(), 0, geo->Meshlets);
+	ReportVertexCache("landGeo", before, after);
 
-	std::vector<std::uint16_t> indices = grid.GetIndices16();
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	SubmeshGeometry submesh;
+	submesh.IndexCount = (UINT)indices.size();
+	submesh.StartIndexLocation = 0;
+	submesh.BaseVertexLocation = 0;
+	submesh.MeshletCount = (UINT)geo->Meshlets.size();
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "landGeo";
+	std::vector<CompactVertex> compactVertices(vertices.size());
+	VertexQuantizer::EncodeError error;
+	VertexQuantizer::Encode(vertices.data(), (UINT)vertices.size(), submesh.Bounds,
+		&Vertex::Pos, &Vertex::Normal, &Vertex::TexC, compactVertices.data(), error);
+	ReportQuantization("landGeo", error, vertices.size());
+
+	const UINT vbByteSize = (UINT)compactVertices.size() * sizeof(CompactVertex);
+	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), compactVertices.data(), vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		mCommandList.Get(), compactVertices.data(), vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = sizeof(CompactVertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
-
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+	geo->CompactVertices = true;
 
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["landGeo"] = std::move(geo);
+	StoreInMeshCache(key, *geo);
+	mGeometries.Add("landGeo", std::move(geo));
 }
 
 void TexColumnsApp::BuildLabyrinthGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData wallh = geoGen.CreateBox(2.0f, 2.0f, 0.5f, 1);
-	GeometryGenerator::MeshData wallv = geoGen.CreateBox(0.5f, 2.0f, 2.0f, 1);
-	GeometryGenerator::MeshData walld = geoGen.CreateBox(0.5f, 2.0f, 0.5f, 1);
-
-	std::vector<Vertex> vertices;
-	std::vector<std::uint16_t> indices;
-
-	std::vector<std::unordered_set<size_t>> emptyHorizontal{
-		{0},
-		{3, 4, 6, 8, 12, 13, 15, 17},
-		{0, 1, 3, 6, 9, 13, 15, 16, 17},
-		{0, 2, 3, 5, 6, 8, 10, 12, 14, 17},
-		{1, 5, 6, 8, 10, 11, 13, 14, 15, 17},
-		{0, 1, 2, 5, 7, 8, 10, 11, 13, 15},
-		{0, 2, 4, 5, 8, 9, 11, 12, 15, 16},
-		{2, 3, 5, 6, 8, 11, 12, 14, 16},
-		{2, 5, 8, 11, 12, 14, 16},
-		{0, 2, 3, 4, 5, 7, 8, 10, 13, 14, 16, 17},
-		{1, 4, 5, 8, 10, 11, 15, 16, 17},
-		{1, 2, 5, 8, 9, 11, 14, 16},
-		{0, 1, 3, 5, 8, 9, 11, 12, 13, 16},
-		{0, 4, 5, 6, 8, 11, 14, 16},
-		{3, 4, 9, 10, 11, 12, 13, 15, 16},
-		{0, 2, 5, 7, 10, 11, 13, 14, 15, 16},
-		{1, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 15, 16},
-		{2, 3, 5, 6, 7, 8, 11, 12, 14, 16},
-		{17}
-	};
+	BuildLabyrinthMaze(mMaze, gLabyrinthGeneratedSize, gLabyrinthSeed);
+	mMazeNavigator.Build(mMaze);
+
+	// Mesh the walls in chunks, in parallel.  Each chunk is its own submesh with
+	// indices relative to its first vertex, so 16-bit indices hold any maze size.
+	UINT chunksX = (mMaze.Width() + MazeChunkSize - 1) / MazeChunkSize;
+	UINT chunksZ = (mMaze.Depth() + MazeChunkSize - 1) / MazeChunkSize;
+	mMazeChunks.resize(chunksX * chunksZ);
+	for (UINT i = 0; i < (UINT)mMazeChunks.size(); ++i) {
+		MazeChunk& chunk = mMazeChunks[i];
+		chunk.X0 = (i % chunksX) * MazeChunkSize;
+		chunk.Z0 = (i / chunksX) * MazeChunkSize;
+		chunk.X1 = std::min<UINT>(chunk.X0 + MazeChunkSize, mMaze.Width());
+		chunk.Z1 = std::min<UINT>(chunk.Z0 + MazeChunkSize, mMaze.Depth());
+		chunk.Submesh = "wall" + std::to_string(i);
+	}
 
-	std::vector<std::vector<size_t>> drawVertical{
-		{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 ,11, 12, 13, 14, 15, 16, 17},
-		{1, 2, 4, 6, 9, 11, 15},
-		{2, 4, 11, 13, 15},
-		{3, 4, 6, 9, 11, 15, 17},
-		{0, 1, 5, 6, 8, 9, 13, 17},
-		{2, 3, 5, 7 , 8, 9, 10, 11, 13, 14, 15},
-		{1, 2, 4, 6, 8, 9, 11, 12, 14, 15, 17},
-		{1, 4, 7, 10, 15, 16},
-		{2, 3, 4, 5, 6, 8, 12, 14, 15, 16},
-		{1, 2, 5, 9, 10, 12, 15, 16},
-		{0, 1, 3, 5, 6, 8, 10, 14, 15},
-		{3, 4, 5, 7, 9, 11, 12, 13, 14, 16},
-		{2, 3, 4, 5, 6, 7, 11, 14, 15, 16},
-		{1, 3, 5, 8, 9, 12, 13, 14, 15, 16},
-		{3, 4, 6, 7, 8, 10, 12, 13, 14, 15},
-		{0, 2, 3, 6, 9, 10, 11, 13, 14},
-		{1, 2, 5, 7, 9, 13, 14, 15, 17},
-		{0, 2, 4, 8, 9},
-		{0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 ,11, 12, 13, 14, 15, 16, 17}
-	};
+	const float wallTexTileLength = 2.0f;
 
-	uint16_t index = 0;
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "wallGeo";
 
-	for (size_t j = 0; j < 19; ++j) {
-		for (size_t i = 0; i < 18; ++i) {
-			if (emptyHorizontal.at(j).find(i) != emptyHorizontal.at(j).end())
-			{
-				continue;
-			}
-			for (size_t k = 0; k < wallh.Vertices.size(); ++k) {
-				Vertex vertex;
-				vertex.Normal = wallh.Vertices.at(k).Normal;
-				vertex.TexC = wallh.Vertices.at(k).TexC;
-				vertex.Pos.x = wallh.Vertices.at(k).Position.x + 1.0f + 2.0f * (i - 9.0f);
-				vertex.Pos.y = wallh.Vertices.at(k).Position.y + 2.8f;
-				vertex.Pos.z = wallh.Vertices.at(k).Position.z + 2.0f * (j - 9.0f);
-				vertices.push_back(vertex);
-			}
-			for (size_t k = 0; k < wallh.Indices32.size(); ++k) {
-				indices.push_back(wallh.Indices32.at(k) + index);
-			}
-			index += wallh.Vertices.size();
-		}
+	// Everything the walls are meshed from; the chunk layout follows from the maze
+	// size and MazeChunkSize.
+	std::uint64_t key = GeometryKey("wallGeo").Add(mMaze.WallHash()).Add(mMaze.Origin()).Add(mMaze.CellSize())
+		.Add(mMaze.WallBottom()).Add(mMaze.WallTop()).Add(MazeWallThickness).Add(wallTexTileLength)
+		.Add(MazeChunkSize).Value();
+	if(mMeshCache.Load(key, md3dDevice.Get(), mCommandList.Get(), *geo))
+	{
+		mGeometries.Add("wallGeo", std::move(geo));
+		return;
 	}
 
-	for (size_t j = 0; j < 19; ++j) {
-		for (size_t i = 0; i < 19; ++i) {
-			for (size_t k = 0; k < walld.Vertices.size(); ++k) {
-				Vertex vertex;
-				vertex.Normal = walld.Vertices.at(k).Normal;
-				vertex.TexC = walld.Vertices.at(k).TexC;
-				vertex.Pos.x = walld.Vertices.at(k).Position.x + 2.0f * (i - 9.0f);
-				vertex.Pos.y = walld.Vertices.at(k).Position.y + 2.8f;
-				vertex.Pos.z = walld.Vertices.at(k).Position.z + 2.0f * (j - 9.0f);
-				vertices.push_back(vertex);
-			}
-			for (size_t k = 0; k < walld.Indices32.size(); ++k) {
-				indices.push_back(walld.Indices32.at(k) + index);
-			}
-			index += walld.Vertices.size();
+	MazeMesher mesher(mMaze, MazeWallThickness, wallTexTileLength);
+	std::vector<std::vector<MazeMesher::Quad>> quads(mMazeChunks.size());
+	ParallelFor(0, (int)mMazeChunks.size(), [&](int i) {
+		const MazeChunk& chunk = mMazeChunks[i];
+		mesher.BuildQuads(chunk.X0, chunk.Z0, chunk.X1, chunk.Z1, quads[i]);
+	});
+
+	// Lay the chunks out one after another, then write each straight into its place.
+	std::vector<SubmeshGeometry> submeshes(mMazeChunks.size());
+	UINT vertexCount = 0;
+	UINT indexCount = 0;
+	for (size_t i = 0; i < quads.size(); ++i) {
+		// Each chunk's indices count from its own first vertex; a MazeChunkSize too large
+		// for 16-bit indices fails here, in every build.
+		UINT chunkVertexCount = MazeMesher::QuadVertexCount * (UINT)quads[i].size();
+		if(chunkVertexCount > GeometryGenerator::MaxVertices16)
+		{
+			OutputDebugStringA("A labyrinth chunk has too many vertices for 16-bit indices\n");
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW));
 		}
+
+		submeshes[i].IndexCount = MazeMesher::QuadIndexCount * (UINT)quads[i].size();
+		submeshes[i].StartIndexLocation = indexCount;
+		submeshes[i].BaseVertexLocation = (INT)vertexCount;
+		vertexCount += chunkVertexCount;
+		indexCount += submeshes[i].IndexCount;
 	}
 
-	for (size_t j = 0; j < 19; ++j) {
-		for (auto i : drawVertical.at(j)) {
-			for (size_t k = 0; k < wallv.Vertices.size(); ++k) {
-				Vertex vertex;
-				vertex.Normal = wallv.Vertices.at(k).Normal;
-				vertex.TexC = wallv.Vertices.at(k).TexC;
-				vertex.Pos.x = wallv.Vertices.at(k).Position.x + 2.0f * (j - 9.0f);
-				vertex.Pos.y = wallv.Vertices.at(k).Position.y + 2.8f;
-				vertex.Pos.z = wallv.Vertices.at(k).Position.z + 1.0f + 2.0f * (i - 9.0f);
-				vertices.push_back(vertex);
-			}
-			for (size_t k = 0; k < wallv.Indices32.size(); ++k) {
-				indices.push_back(wallv.Indices32.at(k) + index);
-			}
-			index += wallv.Vertices.size();
-		}
+	std::vector<Vertex> vertices(vertexCount);
+	std::vector<CompactVertex> compactVertices(vertexCount);
+	std::vector<std::uint16_t> indices(indexCount);
+	std::vector<MeshOptimizer::CacheStats> chunkBefore(quads.size()), chunkAfter(quads.size());
+	std::vector<VertexQuantizer::EncodeError> chunkErrors(quads.size());
+	std::vector<std::vector<GeometryGenerator::Meshlet>> chunkMeshlets(quads.size());
+	ParallelFor(0, (int)quads.size(), [&](int i) {
+		SubmeshGeometry& submesh = submeshes[i];
+		UINT chunkVertexCount = MazeMesher::QuadVertexCount * (UINT)quads[i].size();
+		Vertex* chunkVertices = vertices.data() + submesh.BaseVertexLocation;
+		std::uint16_t* chunkIndices = indices.data() + submesh.StartIndexLocation;
+		mesher.WriteQuads<AppVertexLayout>(quads[i], chunkVertices, chunkIndices);
+		MeshOptimizer::CacheStats optimized;
+		MeshOptimizer::Optimize(chunkVertices, chunkVertexCount, chunkIndices, submesh.IndexCount,
+			&Vertex::Pos, chunkBefore[i], optimized);
+		chunkAfter[i] = SplitMeshlets(chunkVertices, chunkVertexCount, chunkIndices, submesh.IndexCount,
+			submesh.StartIndexLocation, chunkMeshlets[i]);
+		BoundingBox::CreateFromPoints(submesh.Bounds, chunkVertexCount, &chunkVertices->Pos, sizeof(Vertex));
+		VertexQuantizer::Encode(chunkVertices, chunkVertexCount, submesh.Bounds, &Vertex::Pos, &Vertex::Normal,
+			&Vertex::TexC, compactVertices.data() + submesh.BaseVertexLocation, chunkErrors[i]);
+	});
+
+	MeshOptimizer::CacheStats before, after;
+	VertexQuantizer::EncodeError error;
+	for (size_t i = 0; i < quads.size(); ++i) {
+		before += chunkBefore[i];
+		after += chunkAfter[i];
+		error += chunkErrors[i];
+
+		// Each chunk's meshlets follow the last's, so walls facing away or out of view
+		// within a chunk the camera sees are culled too.
+		submeshes[i].FirstMeshlet = (UINT)geo->Meshlets.size();
+		submeshes[i].MeshletCount = (UINT)chunkMeshlets[i].size();
+		geo->Meshlets.insert(geo->Meshlets.end(), chunkMeshlets[i].begin(), chunkMeshlets[i].end());
 	}
+	ReportVertexCache("wallGeo", before, after);
+	ReportQuantization("wallGeo", error, vertices.size());
 
+	for (size_t i = 0; i < submeshes.size(); ++i)
+		geo->DrawArgs[mMazeChunks[i].Submesh] = submeshes[i];
 
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT vbByteSize = (UINT)compactVertices.size() * sizeof(CompactVertex);
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "wallGeo";
-
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), compactVertices.data(), vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		mCommandList.Get(), compactVertices.data(), vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = sizeof(CompactVertex);
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
+	geo->CompactVertices = true;
 
+	// The whole labyrinth, which scenes place.  Its indices are chunk relative, so it
+	// is never drawn as it is: BuildRenderItems replaces its item with the chunks.
 	SubmeshGeometry submesh;
 	submesh.IndexCount = (UINT)indices.size();
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(Vertex));
 
 	geo->DrawArgs["wall"] = submesh;
 
-	mGeometries["wallGeo"] = std::move(geo);
+	StoreInMeshCache(key, *geo);
+	mGeometries.Add("wallGeo", std::move(geo));
 }
 
 void TexColumnsApp::BuildWavesGeometry()
 {
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "waterGeo";
+
+	// Only the index buffer is static, and the grid's dimensions are all it depends on.
+	std::uint64_t key = GeometryKey("waterGeo").Add(mWaves->RowCount()).Add(mWaves->ColumnCount()).Value();
+	if(mMeshCache.Load(key, md3dDevice.Get(), mCommandList.Get(), *geo))
+	{
+		mGeometries.Add("waterGeo", std::move(geo));
+		return;
+	}
+
 	std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
 	assert(mWaves->VertexCount() < 0x0000ffff);
 
@@ -1011,12 +2110,16 @@ void TexColumnsApp::BuildWavesGeometry()
 		}
 	}
 
+	// Waves writes its vertices in grid order every frame, so only the triangles are
+	// reordered, and the flat grid has no overdraw to sort out.
+	MeshOptimizer::CacheStats before = MeshOptimizer::AnalyzeVertexCache(indices.data(), (UINT)indices.size(), mWaves->VertexCount());
+	MeshOptimizer::OptimizeVertexCache(indices.data(), (UINT)indices.size(), mWaves->VertexCount());
+	MeshOptimizer::CacheStats after = MeshOptimizer::AnalyzeVertexCache(indices.data(), (UINT)indices.size(), mWaves->VertexCount());
+	ReportVertexCache("waterGeo", before, after);
+
 	UINT vbByteSize = mWaves->VertexCount() * sizeof(Vertex);
 	UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "waterGeo";
-
 	// Set dynamically.
 	geo->VertexBufferCPU = nullptr;
 	geo->VertexBufferGPU = nullptr;
@@ -1037,227 +2140,177 @@ void TexColumnsApp::BuildWavesGeometry()
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
+	// The surface moves every frame, so bound the grid with some vertical slack
+	// for the wave heights instead of recomputing it.
+	submesh.Bounds = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f),
+		XMFLOAT3(0.5f*mWaves->Width(), 2.0f, 0.5f*mWaves->Depth()));
+
 	geo->DrawArgs["grid"] = submesh;
 
-	mGeometries["waterGeo"] = std::move(geo);
+	StoreInMeshCache(key, *geo);
+	mGeometries.Add("waterGeo", std::move(geo));
 }
 
 void TexColumnsApp::BuildShapeGeometry()
 {
-	GeometryGenerator geoGen;
-	GeometryGenerator::MeshData torus = geoGen.CreateTorus(2.0f, 0.5f, 40, 40);
-	GeometryGenerator::MeshData cone = geoGen.CreateCone(2.0f, 5.0f, 20, 20);
-	GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(2.0f, 0.0f, 5.0f, 6u);
-	GeometryGenerator::MeshData wedge = geoGen.CreateWedge(2.0f, 2.0f, 2.0f, 3u);
-	GeometryGenerator::MeshData diamond = geoGen.CreateDiamond(2.0f, 4.0f, 20, 20);
-	GeometryGenerator::MeshData prism = geoGen.CreateTriangularPrism(2.0f, 4.0f, 20);
-	GeometryGenerator::MeshData box = geoGen.CreateBox(2.0f, 12.f, 2.f, 3);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(1.2f, 1.2f, 12.f, 20, 20);
+	// Level i of a shape, counting from 1 past the full tessellation, is the submesh
+	// "<shape>_lod<i>".
+	std::string lodNames[_countof(gShapeLods)];
+	std::unordered_map<std::string, UINT> levelCounts;
+	for(size_t i = 0; i < _countof(gShapeLods); ++i)
+		lodNames[i] = std::string(gShapeLods[i].Name) + "_lod" + std::to_string(++levelCounts[gShapeLods[i].Name]);
 
-	//
-	// We are concatenating all the geometry into one big vertex/index buffer.  So
-	// define the regions in the buffer each submesh covers.
-	//
-
-	// Cache the vertex offsets to each object in the concatenated vertex buffer.
-	UINT boxVertexOffset = 0;
-	UINT sphereVertexOffset = (UINT)box.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-	UINT torusVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-	UINT coneVertexOffset = torusVertexOffset + (UINT)torus.Vertices.size();
-	UINT pyramidVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-	UINT wedgeVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
-	UINT diamondVertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
-	UINT prismVertexOffset = diamondVertexOffset + (UINT)diamond.Vertices.size();
-
-	// Cache the starting index for each object in the concatenated index buffer.
-	UINT boxIndexOffset = 0;
-	UINT sphereIndexOffset = (UINT)box.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-	UINT torusIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-	UINT coneIndexOffset = torusIndexOffset + (UINT)torus.Indices32.size();
-	UINT pyramidIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-	UINT wedgeIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-	UINT diamondIndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size();
-	UINT prismIndexOffset = diamondIndexOffset + (UINT)diamond.Indices32.size();
-
-	// Define the SubmeshGeometry that cover different 
-	// regions of the vertex/index buffers.
-
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-	SubmeshGeometry torusSubmesh;
-	torusSubmesh.IndexCount = (UINT)torus.Indices32.size();
-	torusSubmesh.StartIndexLocation = torusIndexOffset;
-	torusSubmesh.BaseVertexLocation = torusVertexOffset;
-
-	SubmeshGeometry coneSubmesh;
-	coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-	coneSubmesh.StartIndexLocation = coneIndexOffset;
-	coneSubmesh.BaseVertexLocation = coneVertexOffset;
-
-	SubmeshGeometry pyramidSubmesh;
-	pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-	pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-	pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;
-
-	SubmeshGeometry wedgeSubmesh;
-	wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-	wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-	wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
-
-	SubmeshGeometry diamondSubmesh;
-	diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-	diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-	diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
-
-	SubmeshGeometry prismSubmesh;
-	prismSubmesh.IndexCount = (UINT)prism.Indices32.size();
-	prismSubmesh.StartIndexLocation = prismIndexOffset;
-	prismSubmesh.BaseVertexLocation = prismVertexOffset;
-
-	//
-	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
-	//
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "shapeGeo";
 
-	auto totalVertexCount =
-		box.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size() +
-		torus.Vertices.size() +
-		cone.Vertices.size() +
-		pyramid.Vertices.size() +
-		wedge.Vertices.size() +
-		diamond.Vertices.size() +
-		prism.Vertices.size();
-
-	std::vector<Vertex> vertices(totalVertexCount);
-
-	UINT k = 0;
-	for (size_t i = 0; i < box.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Normal = box.Vertices[i].Normal;
-		vertices[k].TexC = box.Vertices[i].TexC;
-	}
+	MeshCacheKey key = GeometryKey("shapeGeo");
+	for(const ShapeDesc& shape : gShapes)
+		key.AddString(shape.Name).Add(shape.Params);
+	for(size_t i = 0; i < _countof(gShapeLods); ++i)
+		key.AddString(lodNames[i].c_str()).Add(gShapeLods[i].Params);
 
-	for (size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	if(!mMeshCache.Load(key.Value(), md3dDevice.Get(), mCommandList.Get(), *geo))
 	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
+		GenerateShapeGeometry(*geo, lodNames);
+		StoreInMeshCache(key.Value(), *geo);
 	}
 
-	for (size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+	for(size_t i = 0; i < _countof(gShapeLods); ++i)
 	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-		vertices[k].TexC = cylinder.Vertices[i].TexC;
-	}
+		const ShapeLodDesc& level = gShapeLods[i];
+		const SubmeshGeometry& finest = geo->DrawArgs[level.Name];
 
-	for (size_t i = 0; i < torus.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = torus.Vertices[i].Position;
-		vertices[k].Normal = torus.Vertices[i].Normal;
-		vertices[k].TexC = torus.Vertices[i].TexC;
+		MeshLodChain& chain = mLodChains[std::string("shapeGeo/") + level.Name];
+		if(chain.LevelCount == 0)
+		{
+			chain.Levels[0] = finest;
+			chain.MaxScreenRadius[0] = FLT_MAX;
+			chain.LevelCount = 1;
+		}
+		assert(chain.LevelCount < MaxLodLevels);
+
+		// The error as a fraction of the bounding radius is the same on screen, so the
+		// level is good enough while that fraction of the projected radius is below
+		// the pixel budget.
+		float boundsRadius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&finest.Bounds.Extents)));
+		chain.Levels[chain.LevelCount] = geo->DrawArgs[lodNames[i]];
+		chain.MaxScreenRadius[chain.LevelCount] = gLodMaxErrorPixels * boundsRadius / level.Error;
+		chain.LevelCount++;
 	}
 
-	for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = cone.Vertices[i].Position;
-		vertices[k].Normal = cone.Vertices[i].Normal;
-		vertices[k].TexC = cone.Vertices[i].TexC;
-	}
+	mGeometries.Add(geo->Name, std::move(geo));
+}
 
-	for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = pyramid.Vertices[i].Position;
-		vertices[k].Normal = pyramid.Vertices[i].Normal;
-		vertices[k].TexC = pyramid.Vertices[i].TexC;
-	}
+void TexColumnsApp::GenerateShapeGeometry(MeshGeometry& geo, const std::string lodNames[])
+{
+	using Gen = GeometryGenerator;
 
-	for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = wedge.Vertices[i].Position;
-		vertices[k].Normal = wedge.Vertices[i].Normal;
-		vertices[k].TexC = wedge.Vertices[i].TexC;
-	}
+	//
+	// We are concatenating all the geometry into one big vertex/index buffer.  So
+	// define the regions in the buffer each submesh covers, then have the generators
+	// write every shape straight into its region.
+	//
 
-	for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
+	// Every submesh has its own base vertex and indices counting from it, so 16-bit
+	// indices only limit the size of each shape, not of the whole buffer.
+	UINT vertexCount = 0;
+	UINT indexCount = 0;
+	auto place = [&vertexCount, &indexCount](const Gen::MeshSize& size)
 	{
-		vertices[k].Pos = diamond.Vertices[i].Position;
-		vertices[k].Normal = diamond.Vertices[i].Normal;
-		vertices[k].TexC = diamond.Vertices[i].TexC;
-	}
+		if(!Gen::Fits16(size))
+		{
+			OutputDebugStringA("A shape has too many vertices for 16-bit indices\n");
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW));
+		}
 
-	for (size_t i = 0; i < prism.Vertices.size(); ++i, ++k)
-	{
-		vertices[k].Pos = prism.Vertices[i].Position;
-		vertices[k].Normal = prism.Vertices[i].Normal;
-		vertices[k].TexC = prism.Vertices[i].TexC;
-	}
+		SubmeshGeometry submesh;
+		submesh.IndexCount = size.IndexCount;
+		submesh.StartIndexLocation = indexCount;
+		submesh.BaseVertexLocation = (INT)vertexCount;
+		vertexCount += size.VertexCount;
+		indexCount += size.IndexCount;
+		return submesh;
+	};
 
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-	indices.insert(indices.end(), std::begin(torus.GetIndices16()), std::end(torus.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-	indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-	indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
-	indices.insert(indices.end(), std::begin(prism.GetIndices16()), std::end(prism.GetIndices16()));
-
-	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
-	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	SubmeshGeometry shapeSubmeshes[_countof(gShapes)];
+	for(size_t i = 0; i < _countof(gShapes); ++i)
+		shapeSubmeshes[i] = place(ShapeMeshSize(gShapes[i].Params));
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "shapeGeo";
+	SubmeshGeometry lodSubmeshes[_countof(gShapeLods)];
+	for(size_t i = 0; i < _countof(gShapeLods); ++i)
+		lodSubmeshes[i] = place(ShapeMeshSize(gShapeLods[i].Params));
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	const UINT vbByteSize = vertexCount * sizeof(CompactVertex);
+	const UINT ibByteSize = indexCount * sizeof(std::uint16_t);
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	// Indices and compact vertices go straight into the system memory copies, which
+	// are then uploaded as they are.  Shapes are written as floats first, optimized,
+	// and packed into CompactVertex in their own bounds.
+	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo.VertexBufferCPU));
+	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo.IndexBufferCPU));
+	auto compactVertices = static_cast<CompactVertex*>(geo.VertexBufferCPU->GetBufferPointer());
+	auto indices = static_cast<std::uint16_t*>(geo.IndexBufferCPU->GetBufferPointer());
+	std::vector<Vertex> vertices(vertexCount);
 
-	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+	struct ShapeJob
+	{
+		const ShapeParams* Params;
+		SubmeshGeometry* Submesh;
+		MeshOptimizer::CacheStats Before;
+		MeshOptimizer::CacheStats After;
+		VertexQuantizer::EncodeError Error;
+	};
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+	std::vector<ShapeJob> jobs;
+	jobs.reserve(_countof(gShapes) + _countof(gShapeLods));
+	for(size_t i = 0; i < _countof(gShapes); ++i)
+		jobs.push_back({ &gShapes[i].Params, &shapeSubmeshes[i] });
+	for(size_t i = 0; i < _countof(gShapeLods); ++i)
+		jobs.push_back({ &gShapeLods[i].Params, &lodSubmeshes[i] });
+
+	// The regions do not overlap, so every shape and level is built at once.
+	ParallelFor(0, (int)jobs.size(), [&](int i) {
+		ShapeJob& job = jobs[i];
+		SubmeshGeometry& submesh = *job.Submesh;
+		UINT shapeVertexCount = ShapeMeshSize(*job.Params).VertexCount;
+		Vertex* shapeVertices = vertices.data() + submesh.BaseVertexLocation;
+		std::uint16_t* shapeIndices = indices + submesh.StartIndexLocation;
+		WriteShape(*job.Params, shapeVertices, shapeIndices);
+		MeshOptimizer::Optimize(shapeVertices, shapeVertexCount, shapeIndices, submesh.IndexCount, &Vertex::Pos,
+			job.Before, job.After);
+		BoundingBox::CreateFromPoints(submesh.Bounds, shapeVertexCount, &shapeVertices->Pos, sizeof(Vertex));
+		VertexQuantizer::Encode(shapeVertices, shapeVertexCount, submesh.Bounds, &Vertex::Pos, &Vertex::Normal,
+			&Vertex::TexC, compactVertices + submesh.BaseVertexLocation, job.Error);
+	});
+
+	MeshOptimizer::CacheStats before, after;
+	VertexQuantizer::EncodeError error;
+	for(const ShapeJob& job : jobs)
+	{
+		before += job.Before;
+		after += job.After;
+		error += job.Error;
+	}
+	ReportVertexCache("shapeGeo", before, after);
+	ReportQuantization("shapeGeo", error, vertices.size());
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+	geo.VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), compactVertices, vbByteSize, geo.VertexBufferUploader);
+
+	geo.IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), indices, ibByteSize, geo.IndexBufferUploader);
 
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
-	geo->DrawArgs["torus"] = torusSubmesh;
-	geo->DrawArgs["cone"] = coneSubmesh;
-	geo->DrawArgs["pyramid"] = pyramidSubmesh;
-	geo->DrawArgs["wedge"] = wedgeSubmesh;
-	geo->DrawArgs["diamond"] = diamondSubmesh;
-	geo->DrawArgs["prism"] = prismSubmesh;
+	geo.VertexByteStride = sizeof(CompactVertex);
+	geo.VertexBufferByteSize = vbByteSize;
+	geo.IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo.IndexBufferByteSize = ibByteSize;
+	geo.CompactVertices = true;
 
+	for(size_t i = 0; i < _countof(gShapes); ++i)
+		geo.DrawArgs[gShapes[i].Name] = shapeSubmeshes[i];
 
-	mGeometries[geo->Name] = std::move(geo);
+	for(size_t i = 0; i < _countof(gShapeLods); ++i)
+		geo.DrawArgs[lodNames[i]] = lodSubmeshes[i];
 }
 
 void TexColumnsApp::BuildTreeSpritesGeometry()
@@ -1320,7 +2373,7 @@ void TexColumnsApp::BuildTreeSpritesGeometry()
 
 	//geo->DrawArgs["points"] = submesh;
 
-	//mGeometries["treeSpritesGeo"] = std::move(geo);
+	//mGeometries.Add("treeSpritesGeo", std::move(geo));
 
 
 
@@ -1404,14 +2457,38 @@ void TexColumnsApp::BuildTreeSpritesGeometry()
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
+	// The geometry shader expands each point into a camera facing quad around it,
+	// so grow the box of the points by the largest half size in every direction.
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(TreeSpriteVertex));
+	submesh.Bounds.Extents.x += 10.0f;
+	submesh.Bounds.Extents.y += 10.0f;
+	submesh.Bounds.Extents.z += 10.0f;
+
 	geo->DrawArgs["points"] = submesh;
 
-	mGeometries["treeSpritesGeo"] = std::move(geo);
+	mGeometries.Add("treeSpritesGeo", std::move(geo));
+
+}
 
+void TexColumnsApp::StoreInMeshCache(std::uint64_t key, const MeshGeometry& geo)
+{
+	// The geometry is built either way; without its entry it is built again next run.
+	if(FAILED(mMeshCache.Store(key, geo)))
+	{
+		std::string text = "Could not store " + geo.Name + " in the mesh cache\n";
+		OutputDebugStringA(text.c_str());
+	}
 }
 
 void TexColumnsApp::BuildPSOs()
 {
+	auto createPso = [this](const std::string& name, const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc)
+	{
+		PsoRef pso;
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso)));
+		mPSOs.Add(name, std::move(pso));
+	};
+
     D3D12_GRAPHICS_PIPELINE_STATE_DESC opaquePsoDesc;
 
 	//
@@ -1422,13 +2499,13 @@ void TexColumnsApp::BuildPSOs()
 	opaquePsoDesc.pRootSignature = mRootSignature.Get();
 	opaquePsoDesc.VS = 
 	{ 
-		reinterpret_cast<BYTE*>(mShaders["standardVS"]->GetBufferPointer()), 
-		mShaders["standardVS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("standardVS")->GetBufferPointer()), 
+		mShaders.Get("standardVS")->GetBufferSize()
 	};
 	opaquePsoDesc.PS = 
 	{ 
-		reinterpret_cast<BYTE*>(mShaders["opaquePS"]->GetBufferPointer()),
-		mShaders["opaquePS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("opaquePS")->GetBufferPointer()),
+		mShaders.Get("opaquePS")->GetBufferSize()
 	};
 	opaquePsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
 	opaquePsoDesc.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
@@ -1440,7 +2517,7 @@ void TexColumnsApp::BuildPSOs()
 	opaquePsoDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
 	opaquePsoDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
 	opaquePsoDesc.DSVFormat = mDepthStencilFormat;
-    ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&opaquePsoDesc, IID_PPV_ARGS(&mPSOs["opaque"])));
+    createPso("opaque", opaquePsoDesc);
 
 
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC transparentPsoDesc = opaquePsoDesc;
@@ -1480,7 +2557,7 @@ void TexColumnsApp::BuildPSOs()
 	//transparencyBlendDesc.RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_BLUE;
 	//Direct3D supports rendering to up to eight render targets simultaneously.
 	transparentPsoDesc.BlendState.RenderTarget[0] = transparencyBlendDesc;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&transparentPsoDesc, IID_PPV_ARGS(&mPSOs["transparent"])));
+	createPso("transparent", transparentPsoDesc);
 
 	//
 	// PSO for alpha tested objects
@@ -1489,11 +2566,11 @@ void TexColumnsApp::BuildPSOs()
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedPsoDesc = opaquePsoDesc;
 	alphaTestedPsoDesc.PS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["alphaTestedPS"]->GetBufferPointer()),
-		mShaders["alphaTestedPS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("alphaTestedPS")->GetBufferPointer()),
+		mShaders.Get("alphaTestedPS")->GetBufferSize()
 	};
 	alphaTestedPsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&alphaTestedPsoDesc, IID_PPV_ARGS(&mPSOs["alphaTested"])));
+	createPso("alphaTested", alphaTestedPsoDesc);
 
 	
 	//
@@ -1502,33 +2579,105 @@ void TexColumnsApp::BuildPSOs()
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC treeSpritePsoDesc = opaquePsoDesc;
 	treeSpritePsoDesc.VS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteVS"]->GetBufferPointer()),
-		mShaders["treeSpriteVS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("treeSpriteVS")->GetBufferPointer()),
+		mShaders.Get("treeSpriteVS")->GetBufferSize()
 	};
 	treeSpritePsoDesc.GS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpriteGS"]->GetBufferPointer()),
-		mShaders["treeSpriteGS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("treeSpriteGS")->GetBufferPointer()),
+		mShaders.Get("treeSpriteGS")->GetBufferSize()
 	};
 	treeSpritePsoDesc.PS =
 	{
-		reinterpret_cast<BYTE*>(mShaders["treeSpritePS"]->GetBufferPointer()),
-		mShaders["treeSpritePS"]->GetBufferSize()
+		reinterpret_cast<BYTE*>(mShaders.Get("treeSpritePS")->GetBufferPointer()),
+		mShaders.Get("treeSpritePS")->GetBufferSize()
 	};
 	//step1
 	treeSpritePsoDesc.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
 	treeSpritePsoDesc.InputLayout = { mTreeSpriteInputLayout.data(), (UINT)mTreeSpriteInputLayout.size() };
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
-	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+	createPso("treeSprites", treeSpritePsoDesc);
+
+	//
+	// Instanced variants, which read World and TexTransform from the instance buffer.
+	//
+	D3D12_SHADER_BYTECODE instancedVS =
+	{
+		reinterpret_cast<BYTE*>(mShaders.Get("instancedVS")->GetBufferPointer()),
+		mShaders.Get("instancedVS")->GetBufferSize()
+	};
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC opaqueInstancedPsoDesc = opaquePsoDesc;
+	opaqueInstancedPsoDesc.VS = instancedVS;
+	createPso("opaqueInstanced", opaqueInstancedPsoDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC transparentInstancedPsoDesc = transparentPsoDesc;
+	transparentInstancedPsoDesc.VS = instancedVS;
+	createPso("transparentInstanced", transparentInstancedPsoDesc);
+
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC alphaTestedInstancedPsoDesc = alphaTestedPsoDesc;
+	alphaTestedInstancedPsoDesc.VS = instancedVS;
+	createPso("alphaTestedInstanced", alphaTestedInstancedPsoDesc);
+
+	//
+	// Compact vertex variants of the above, for the static geometry.
+	//
+	D3D12_SHADER_BYTECODE compactVS =
+	{
+		reinterpret_cast<BYTE*>(mShaders.Get("compactVS")->GetBufferPointer()),
+		mShaders.Get("compactVS")->GetBufferSize()
+	};
+	D3D12_SHADER_BYTECODE compactInstancedVS =
+	{
+		reinterpret_cast<BYTE*>(mShaders.Get("compactInstancedVS")->GetBufferPointer()),
+		mShaders.Get("compactInstancedVS")->GetBufferSize()
+	};
+	D3D12_INPUT_LAYOUT_DESC compactInputLayout = { mCompactInputLayout.data(), (UINT)mCompactInputLayout.size() };
+
+	const char* compactPsoNames[] = { "opaque", "transparent", "alphaTested" };
+	const D3D12_GRAPHICS_PIPELINE_STATE_DESC* compactPsoDescs[] = { &opaquePsoDesc, &transparentPsoDesc, &alphaTestedPsoDesc };
+	for(size_t i = 0; i < _countof(compactPsoDescs); ++i)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC compactPsoDesc = *compactPsoDescs[i];
+		compactPsoDesc.InputLayout = compactInputLayout;
+		compactPsoDesc.VS = compactVS;
+		createPso(std::string(compactPsoNames[i]) + "Compact", compactPsoDesc);
+
+		compactPsoDesc.VS = compactInstancedVS;
+		createPso(std::string(compactPsoNames[i]) + "CompactInstanced", compactPsoDesc);
+	}
+
+	// The draw loop picks PSOs by layer and vertex format, so resolve the names once here.
+	mLayerPSOs[LayerPso(RenderLayer::Opaque, false)] = mPSOs.Find("opaque");
+	mLayerPSOs[LayerPso(RenderLayer::Transparent, false)] = mPSOs.Find("transparent");
+	mLayerPSOs[LayerPso(RenderLayer::AlphaTested, false)] = mPSOs.Find("alphaTested");
+	mLayerPSOs[LayerPso(RenderLayer::AlphaTestedTreeSprites, false)] = mPSOs.Find("treeSprites");
+	mLayerPSOs[LayerPso(RenderLayer::Opaque, true)] = mPSOs.Find("opaqueCompact");
+	mLayerPSOs[LayerPso(RenderLayer::Transparent, true)] = mPSOs.Find("transparentCompact");
+	mLayerPSOs[LayerPso(RenderLayer::AlphaTested, true)] = mPSOs.Find("alphaTestedCompact");
+
+	// Tree sprites have a single item and their own shaders, so they are never instanced,
+	// and their points are never compact.
+	mLayerInstancedPSOs[LayerPso(RenderLayer::Opaque, false)] = mPSOs.Find("opaqueInstanced");
+	mLayerInstancedPSOs[LayerPso(RenderLayer::Transparent, false)] = mPSOs.Find("transparentInstanced");
+	mLayerInstancedPSOs[LayerPso(RenderLayer::AlphaTested, false)] = mPSOs.Find("alphaTestedInstanced");
+	mLayerInstancedPSOs[LayerPso(RenderLayer::Opaque, true)] = mPSOs.Find("opaqueCompactInstanced");
+	mLayerInstancedPSOs[LayerPso(RenderLayer::Transparent, true)] = mPSOs.Find("transparentCompactInstanced");
+	mLayerInstancedPSOs[LayerPso(RenderLayer::AlphaTested, true)] = mPSOs.Find("alphaTestedCompactInstanced");
 }
 
 void TexColumnsApp::BuildFrameResources()
 {
+	// At most every item of every layer, and every agent, is instanced in one frame.
+	UINT maxInstanceCount = mCrowd.AgentCount();
+	for(auto& layer : mRitemLayer)
+		maxInstanceCount += (UINT)layer.size();
+
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            1, (UINT)mAllRitems.size(), mMaterials.Count(), mWaves->VertexCount(), maxInstanceCount));
     }
 }
 
@@ -1594,710 +2743,563 @@ void TexColumnsApp::BuildMaterials()
 	treeSprites->Roughness = 0.125f;
 
 	
-	mMaterials["bricks0"] = std::move(bricks0);
-	mMaterials["bricks3"] = std::move(bricks3);
-	mMaterials["stone0"] = std::move(stone0);
-	mMaterials["tile0"] = std::move(tile0);
-	mMaterials["grass"] = std::move(grass);
-	mMaterials["water"] = std::move(water);
-	mMaterials["treeSprites"] = std::move(treeSprites);
+	mMaterials.Add("bricks0", std::move(bricks0));
+	mMaterials.Add("bricks3", std::move(bricks3));
+	mMaterials.Add("stone0", std::move(stone0));
+	mMaterials.Add("tile0", std::move(tile0));
+	mMaterials.Add("grass", std::move(grass));
+	mWaterMat = mMaterials.Add("water", std::move(water));
+	mMaterials.Add("treeSprites", std::move(treeSprites));
 
 }
 
 void TexColumnsApp::BuildRenderItems()
 {
+	// The scene is edited as text and converted whenever the text is newer than the
+	// binary file, so scene changes do not need a rebuild.
+	std::vector<std::string> layerNames(gLayerNames, gLayerNames + (int)RenderLayer::Count);
+	std::string error;
+	HRESULT hr = SceneFile::ConvertTextIfNewer(L"Scenes/TexColumns.txt", L"Scenes/TexColumns.scene", layerNames, error);
+	if(FAILED(hr))
+		OutputDebugStringA((error + "\n").c_str());
+	ThrowIfFailed(hr);
+
+	SceneFile scene;
+	ThrowIfFailed(scene.Open(L"Scenes/TexColumns.scene"));
+
+	// Resolve the names in the mesh and material tables once; items refer to the
+	// tables by index.
+	std::vector<MeshGeometry*> meshGeos(scene.MeshCount());
+	std::vector<const SubmeshGeometry*> submeshes(scene.MeshCount());
+	std::vector<MeshLodChain*> meshLods(scene.MeshCount(), nullptr);
+	for(UINT i = 0; i < scene.MeshCount(); ++i)
+	{
+		const SceneFileMesh& mesh = scene.Mesh(i);
 
-	UINT objCBIndex = 0;
-
-	auto wavesRitem = std::make_unique<RenderItem>();
-	wavesRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&wavesRitem->TexTransform, XMMatrixScaling(5.0f, 5.0f, 1.0f));
-	wavesRitem->ObjCBIndex = objCBIndex++;
-	wavesRitem->Mat = mMaterials["water"].get();
-	wavesRitem->Geo = mGeometries["waterGeo"].get();
-	wavesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wavesRitem->IndexCount = wavesRitem->Geo->DrawArgs["grid"].IndexCount;
-	wavesRitem->StartIndexLocation = wavesRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	wavesRitem->BaseVertexLocation = wavesRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-
-	mWavesRitem = wavesRitem.get();
-
-	mRitemLayer[(int)RenderLayer::Transparent].push_back(wavesRitem.get());
-	mAllRitems.push_back(std::move(wavesRitem));
-
-	auto wallRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&wallRitem->World,  XMMatrixTranslation(0.0f, 0.0f, -40.0f)); //-7.5f
-	wallRitem->ObjCBIndex = objCBIndex++;
-	wallRitem->Mat = mMaterials["tile0"].get();
-	wallRitem->Geo = mGeometries["wallGeo"].get();
-	wallRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	wallRitem->IndexCount = wallRitem->Geo->DrawArgs["wall"].IndexCount;
-	wallRitem->StartIndexLocation = wallRitem->Geo->DrawArgs["wall"].StartIndexLocation;
-	wallRitem->BaseVertexLocation = wallRitem->Geo->DrawArgs["wall"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(wallRitem.get());
-	mAllRitems.push_back(std::move(wallRitem));
-	
-	
-	auto boxRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.2f, 1.3f, 2.2f) * XMMatrixTranslation(-4.4f, 1.5f + 6.f, -10.9f)); //-7.5f
-	boxRitem->ObjCBIndex = objCBIndex++;
-	boxRitem->Mat = mMaterials["bricks3"].get();
-	boxRitem->Geo = mGeometries["shapeGeo"].get();
-	boxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
-	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem.get());
-	mAllRitems.push_back(std::move(boxRitem));
-
-
-	auto boxRitem1 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem1->World, XMMatrixScaling(2.2f, 1.3f, 2.2f) * XMMatrixTranslation(4.4f, 1.5f + 6.f, -10.9f)); //-7.5f
-	boxRitem1->ObjCBIndex = objCBIndex++;
-	boxRitem1->Mat = mMaterials["bricks3"].get();
-	boxRitem1->Geo = mGeometries["shapeGeo"].get();
-	boxRitem1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem1->IndexCount = boxRitem1->Geo->DrawArgs["box"].IndexCount;
-	boxRitem1->StartIndexLocation = boxRitem1->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem1->BaseVertexLocation = boxRitem1->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem1.get());
-	mAllRitems.push_back(std::move(boxRitem1));
-
-
-	auto boxRitem2 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem2->World, XMMatrixScaling(8.5f, 1.3f, 1.3f) * XMMatrixTranslation(0.f, 1.5f + 6.f, -10.3f)); //-7.5f
-	boxRitem2->ObjCBIndex = objCBIndex++;
-	boxRitem2->Mat = mMaterials["bricks3"].get();
-	boxRitem2->Geo = mGeometries["shapeGeo"].get();
-	boxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem2->IndexCount = boxRitem2->Geo->DrawArgs["box"].IndexCount;
-	boxRitem2->StartIndexLocation = boxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem2->BaseVertexLocation = boxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem2.get());
-	mAllRitems.push_back(std::move(boxRitem2));
-
-	
-	auto boxRitem3 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem3->World, XMMatrixScaling(5.8f, 0.86f, 0.9f) * XMMatrixTranslation(-13.7f, -1.06f + 6.f, -9.8f)); //-7.5f
-	boxRitem3->ObjCBIndex = objCBIndex++;
-	boxRitem3->Mat = mMaterials["bricks3"].get();
-	boxRitem3->Geo = mGeometries["shapeGeo"].get();
-	boxRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem3->IndexCount = boxRitem3->Geo->DrawArgs["box"].IndexCount;
-	boxRitem3->StartIndexLocation = boxRitem3->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem3->BaseVertexLocation = boxRitem3->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem3.get());
-	mAllRitems.push_back(std::move(boxRitem3));
-
-	auto boxRitem4 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem4->World, XMMatrixScaling(5.8f, 0.86f, 0.9f) * XMMatrixTranslation(13.7f, -1.06f + 6.f, -9.8f)); //-7.5f
-	boxRitem4->ObjCBIndex = objCBIndex++;
-	boxRitem4->Mat = mMaterials["bricks3"].get();
-	boxRitem4->Geo = mGeometries["shapeGeo"].get();
-	boxRitem4->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem4->IndexCount = boxRitem4->Geo->DrawArgs["box"].IndexCount;
-	boxRitem4->StartIndexLocation = boxRitem4->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem4->BaseVertexLocation = boxRitem4->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem4.get());
-	mAllRitems.push_back(std::move(boxRitem4));
-
-
-
-	//left wall
-	auto boxRitem6 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem6->World, XMMatrixScaling(2.9f, 1.1f, 2.9f)* XMMatrixTranslation(-17.8f, 0.7f + 6.f, 4.f)); //-7.5f
-	boxRitem6->ObjCBIndex = objCBIndex++;
-	boxRitem6->Mat = mMaterials["bricks3"].get();
-	boxRitem6->Geo = mGeometries["shapeGeo"].get();
-	boxRitem6->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem6->IndexCount = boxRitem6->Geo->DrawArgs["box"].IndexCount;
-	boxRitem6->StartIndexLocation = boxRitem6->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem6->BaseVertexLocation = boxRitem6->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem6.get());
-	mAllRitems.push_back(std::move(boxRitem6));
-
-	auto boxRitem5 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem5->World, XMMatrixScaling(6.2f, 0.86f, 0.9f)* XMMatrixRotationY(XM_PIDIV2)* XMMatrixTranslation(-17.8f, -0.65f + 6.f, -2.15f)); //-7.5f
-	boxRitem5->ObjCBIndex = objCBIndex++;
-	boxRitem5->Mat = mMaterials["bricks3"].get();
-	boxRitem5->Geo = mGeometries["shapeGeo"].get();
-	boxRitem5->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem5->IndexCount = boxRitem5->Geo->DrawArgs["box"].IndexCount;
-	boxRitem5->StartIndexLocation = boxRitem5->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem5->BaseVertexLocation = boxRitem5->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem5.get());
-	mAllRitems.push_back(std::move(boxRitem5));
-
-	auto boxRitem7 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem7->World, XMMatrixScaling(6.2f, 0.86f, 0.9f)* XMMatrixRotationY(XM_PIDIV2)* XMMatrixTranslation(-17.8f, -0.65f + 6.f, 12.15f)); //-7.5f
-	boxRitem7->ObjCBIndex = objCBIndex++;
-	boxRitem7->Mat = mMaterials["bricks3"].get();
-	boxRitem7->Geo = mGeometries["shapeGeo"].get();
-	boxRitem7->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem7->IndexCount = boxRitem7->Geo->DrawArgs["box"].IndexCount;
-	boxRitem7->StartIndexLocation = boxRitem7->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem7->BaseVertexLocation = boxRitem7->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem7.get());
-	mAllRitems.push_back(std::move(boxRitem7));
-
-
-
-	//right wall
-
-
-	auto boxRitem8 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem8->World, XMMatrixScaling(2.9f, 1.1f, 2.9f)* XMMatrixTranslation(17.8f, 0.7f + 6.f, 4.f)); //-7.5f
-	boxRitem8->ObjCBIndex = objCBIndex++;
-	boxRitem8->Mat = mMaterials["bricks3"].get();
-	boxRitem8->Geo = mGeometries["shapeGeo"].get();
-	boxRitem8->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem8->IndexCount = boxRitem8->Geo->DrawArgs["box"].IndexCount;
-	boxRitem8->StartIndexLocation = boxRitem8->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem8->BaseVertexLocation = boxRitem8->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem8.get());
-	mAllRitems.push_back(std::move(boxRitem8));
-
-	auto boxRitem9 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem9->World, XMMatrixScaling(6.2f, 0.86f, 0.9f)* XMMatrixRotationY(XM_PIDIV2)* XMMatrixTranslation(17.8f, -0.65f + 6.f, -2.15f)); //-7.5f
-	boxRitem9->ObjCBIndex = objCBIndex++;
-	boxRitem9->Mat = mMaterials["bricks3"].get();
-	boxRitem9->Geo = mGeometries["shapeGeo"].get();
-	boxRitem9->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem9->IndexCount = boxRitem9->Geo->DrawArgs["box"].IndexCount;
-	boxRitem9->StartIndexLocation = boxRitem9->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem9->BaseVertexLocation = boxRitem9->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem9.get());
-	mAllRitems.push_back(std::move(boxRitem9));
-
-	auto boxRitem10 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem10->World, XMMatrixScaling(6.2f, 0.86f, 0.9f)* XMMatrixRotationY(XM_PIDIV2)* XMMatrixTranslation(17.8f, -0.65f + 6.f, 12.15f)); //-7.5f
-	boxRitem10->ObjCBIndex = objCBIndex++;
-	boxRitem10->Mat = mMaterials["bricks3"].get();
-	boxRitem10->Geo = mGeometries["shapeGeo"].get();
-	boxRitem10->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem10->IndexCount = boxRitem10->Geo->DrawArgs["box"].IndexCount;
-	boxRitem10->StartIndexLocation = boxRitem10->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem10->BaseVertexLocation = boxRitem10->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem10.get());
-	mAllRitems.push_back(std::move(boxRitem10));
-
-
-	//back Wall
-
-	auto boxRitem11 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&boxRitem11->World, XMMatrixScaling(15.6f, 0.86f, 0.9f) * XMMatrixTranslation(0.f, -1.06f + 6.f, 20.8f)); //-7.5f
-	boxRitem11->ObjCBIndex = objCBIndex++;
-	boxRitem11->Mat = mMaterials["bricks3"].get();
-	boxRitem11->Geo = mGeometries["shapeGeo"].get();
-	boxRitem11->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	boxRitem11->IndexCount = boxRitem11->Geo->DrawArgs["box"].IndexCount;
-	boxRitem11->StartIndexLocation = boxRitem11->Geo->DrawArgs["box"].StartIndexLocation;
-	boxRitem11->BaseVertexLocation = boxRitem11->Geo->DrawArgs["box"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::AlphaTested].push_back(boxRitem11.get());
-	mAllRitems.push_back(std::move(boxRitem11));
+		auto geoHandle = mGeometries.Find(scene.String(mesh.Geometry));
+		if(geoHandle.IsNull())
+		{
+			OutputDebugStringA((std::string("Scene uses unknown geometry ") + scene.String(mesh.Geometry) + "\n").c_str());
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+		}
+		meshGeos[i] = mGeometries.Get(geoHandle).get();
 
-	
-	//sculpture
-
-	auto CylRitem = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&CylRitem->World, XMMatrixScaling(2.2f, 2.f, 2.2f)* XMMatrixTranslation(0.f, 4.5f + 6.f, 4.f));
-	CylRitem->ObjCBIndex = objCBIndex++;
-	CylRitem->Geo = mGeometries["shapeGeo"].get();
-	CylRitem->Mat = mMaterials["bricks0"].get();
-	CylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	CylRitem->IndexCount = CylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-	CylRitem->StartIndexLocation = CylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-	CylRitem->BaseVertexLocation = CylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(CylRitem));
-
-	auto torusRitem = std::make_unique<RenderItem>();
-	// torusRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&torusRitem->World, XMMatrixScaling(1.2f, 1.2f, 1.2f) * XMMatrixRotationX(XM_PIDIV2) *XMMatrixTranslation(0.0f, 17.f + 6.f, 4.f));
-	torusRitem->ObjCBIndex = objCBIndex++;
-	torusRitem->Geo = mGeometries["shapeGeo"].get();
-	torusRitem->Mat = mMaterials["stone0"].get();
-	torusRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	torusRitem->IndexCount = torusRitem->Geo->DrawArgs["torus"].IndexCount;
-	torusRitem->StartIndexLocation = torusRitem->Geo->DrawArgs["torus"].StartIndexLocation;
-	torusRitem->BaseVertexLocation = torusRitem->Geo->DrawArgs["torus"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(torusRitem));
-	
-	
-	auto coneRitem = std::make_unique<RenderItem>();
-	// coneRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&coneRitem->World, XMMatrixScaling(1.35f, 1.35f, 1.35f) * XMMatrixTranslation(0.0f, 21.f + 6.f, 4.f));
-	coneRitem->ObjCBIndex = objCBIndex++;
-	coneRitem->Geo = mGeometries["shapeGeo"].get();
-	coneRitem->Mat = mMaterials["stone0"].get();
-	coneRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	coneRitem->IndexCount = coneRitem->Geo->DrawArgs["cone"].IndexCount;
-	coneRitem->StartIndexLocation = coneRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-	coneRitem->BaseVertexLocation = coneRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(coneRitem));
-
-	auto diamondRitem = std::make_unique<RenderItem>();
-	// diamondRitem->World = MathHelper::Identity4x4();
-	XMStoreFloat4x4(&diamondRitem->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixTranslation(0.0f, 27.6f + 6.f, 4.f));
-	diamondRitem->ObjCBIndex = objCBIndex++;
-	diamondRitem->Geo = mGeometries["shapeGeo"].get();
-	diamondRitem->Mat = mMaterials["stone0"].get();
-	diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-	diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-	diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(diamondRitem));
-
-
-	//Front Ornamental
+		auto submesh = meshGeos[i]->DrawArgs.find(scene.String(mesh.Submesh));
+		if(submesh == meshGeos[i]->DrawArgs.end())
+		{
+			OutputDebugStringA((std::string("Scene uses unknown submesh ") + scene.String(mesh.Submesh) + "\n").c_str());
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+		}
+		submeshes[i] = &submesh->second;
 
-	
-	
-	for (int i = 0; i < 2; ++i)
-	{
-		auto leftwedgeRitem = std::make_unique<RenderItem>();
-		auto rightwedgeRitem = std::make_unique<RenderItem>();
-		auto leftboxRitem = std::make_unique<RenderItem>();
-		auto rightboxRitem = std::make_unique<RenderItem>();
-		//right forward corner
-		// wedgeRitem->World = MathHelper::Identity4x4();
-		XMStoreFloat4x4(&leftwedgeRitem->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(-17.8f, 8.f + 6.f, 16.f - i * 30));
-		leftwedgeRitem->ObjCBIndex = objCBIndex++;
-		leftwedgeRitem->Geo = mGeometries["shapeGeo"].get();
-		leftwedgeRitem->Mat = mMaterials["stone0"].get();
-		leftwedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftwedgeRitem->IndexCount = leftwedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-		leftwedgeRitem->StartIndexLocation = leftwedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-		leftwedgeRitem->BaseVertexLocation = leftwedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(leftwedgeRitem));
-
-		XMStoreFloat4x4(&rightwedgeRitem->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(17.8f, 8.f + 6.f, 16.f - i * 30));
-		rightwedgeRitem->ObjCBIndex = objCBIndex++;
-		rightwedgeRitem->Geo = mGeometries["shapeGeo"].get();
-		rightwedgeRitem->Mat = mMaterials["stone0"].get();
-		rightwedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightwedgeRitem->IndexCount = rightwedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-		rightwedgeRitem->StartIndexLocation = rightwedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-		rightwedgeRitem->BaseVertexLocation = rightwedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(rightwedgeRitem));
-
-		XMStoreFloat4x4(&leftboxRitem->World, XMMatrixScaling(1.55f, 0.2f, 1.55f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(-17.8f, 10.5f + 6.f, 16.f - i * 30));
-		leftboxRitem->ObjCBIndex = objCBIndex++;
-		leftboxRitem->Geo = mGeometries["shapeGeo"].get();
-		leftboxRitem->Mat = mMaterials["stone0"].get();
-		leftboxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftboxRitem->IndexCount = leftboxRitem->Geo->DrawArgs["box"].IndexCount;
-		leftboxRitem->StartIndexLocation = leftboxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-		leftboxRitem->BaseVertexLocation = leftboxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(leftboxRitem));
-
-		XMStoreFloat4x4(&rightboxRitem->World, XMMatrixScaling(1.55f, 0.2f, 1.55f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(17.8f, 10.5f + 6.f, 16.f - i * 30));
-		rightboxRitem->ObjCBIndex = objCBIndex++;
-		rightboxRitem->Geo = mGeometries["shapeGeo"].get();
-		rightboxRitem->Mat = mMaterials["stone0"].get();
-		rightboxRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightboxRitem->IndexCount = rightboxRitem->Geo->DrawArgs["box"].IndexCount;
-		rightboxRitem->StartIndexLocation = rightboxRitem->Geo->DrawArgs["box"].StartIndexLocation;
-		rightboxRitem->BaseVertexLocation = rightboxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(rightboxRitem));
+		auto lods = mLodChains.find(meshGeos[i]->Name + "/" + submesh->first);
+		if(lods != mLodChains.end())
+			meshLods[i] = &lods->second;
+	}
 
+	std::vector<Material*> materials(scene.MaterialCount());
+	for(UINT i = 0; i < scene.MaterialCount(); ++i)
+	{
+		auto matHandle = mMaterials.Find(scene.MaterialName(i));
+		if(matHandle.IsNull())
+		{
+			OutputDebugStringA((std::string("Scene uses unknown material ") + scene.MaterialName(i) + "\n").c_str());
+			ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+		}
+		materials[i] = mMaterials.Get(matHandle).get();
+	}
 
+	// The item named labyrinth is split into an item per chunk of its walls, placed
+	// like it, so the chunks are culled one by one.
+	UINT sceneItemCount = scene.ItemCount();
+	UINT mazeItem = NoItem;
+	for(UINT i = 0; i < sceneItemCount; ++i)
+	{
+		const SceneFileItem& item = scene.Item(i);
+		if(item.Name != SceneFile::NoString && std::strcmp(scene.String(item.Name), "labyrinth") == 0)
+			mazeItem = i;
 	}
 
+	// One allocation for all the items; the layers point into it.  The labyrinth also
+	// brings the crowd item.
+	UINT itemCount = sceneItemCount;
+	if(mazeItem != NoItem)
+		itemCount += (UINT)mMazeChunks.size();
 
+	mAllRitems = std::vector<RenderItem>(itemCount);
+	for(int i = 0; i < (int)RenderLayer::Count; ++i)
+		mRitemLayer[i].reserve(itemCount);
 
-	//left Ornamental
+	UINT nextItem = 0;
+	auto addItem = [&](const SceneFileItem& item, const SubmeshGeometry* submesh) -> RenderItem&
+	{
+		UINT index = nextItem++;
+
+		RenderItem& ri = mAllRitems[index];
+		ri.World = item.World;
+		ri.TexTransform = item.TexTransform;
+		ri.ObjCBIndex = index;
+		ri.Mat = materials[item.Material];
+		ri.Geo = meshGeos[item.Mesh];
+		ri.PrimitiveType = (D3D12_PRIMITIVE_TOPOLOGY)item.Topology;
+		ri.IndexCount = submesh->IndexCount;
+		ri.StartIndexLocation = submesh->StartIndexLocation;
+		ri.BaseVertexLocation = submesh->BaseVertexLocation;
+		ri.Bounds = submesh->Bounds;
+		ri.VertexBounds = submesh->Bounds;
+		ri.Dynamic = (item.Flags & SceneFile::ItemDynamic) != 0;
+		ri.Occluder = (item.Flags & SceneFile::ItemOccluder) != 0;
+		ri.LayerMask = item.LayerMask;
+		if(submesh->MeshletCount > 0)
+		{
+			ri.Meshlets = &ri.Geo->Meshlets[submesh->FirstMeshlet];
+			ri.MeshletCount = submesh->MeshletCount;
+		}
 
-	/*auto leftwedgeRitem1 = std::make_unique<RenderItem>();
-	XMStoreFloat4x4(&leftwedgeRitem1->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixRotationY(XM_PIDIV2)* XMMatrixTranslation(-21.8f, 8.f, 20.f));
-	leftwedgeRitem1->ObjCBIndex = objCBIndex++;
-	leftwedgeRitem1->Geo = mGeometries["shapeGeo"].get();
-	leftwedgeRitem1->Mat = mMaterials["stone0"].get();
-	leftwedgeRitem1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	leftwedgeRitem1->IndexCount = leftwedgeRitem1->Geo->DrawArgs["wedge"].IndexCount;
-	leftwedgeRitem1->StartIndexLocation = leftwedgeRitem1->Geo->DrawArgs["wedge"].StartIndexLocation;
-	leftwedgeRitem1->BaseVertexLocation = leftwedgeRitem1->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(leftwedgeRitem1));*/
+		for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+		{
+			if(ri.LayerMask & (1 << layer))
+				mRitemLayer[layer].push_back(&ri);
+		}
+		return ri;
+	};
 
-	for (int i = 0; i < 2; ++i)
+	for(UINT i = 0; i < sceneItemCount; ++i)
 	{
-	auto leftwedgeRitem1 = std::make_unique<RenderItem>();
-	auto rightwedgeRitem1 = std::make_unique<RenderItem>();
-	auto leftboxRitem1 = std::make_unique<RenderItem>();
-	auto rightboxRitem1 = std::make_unique<RenderItem>();
+		const SceneFileItem& item = scene.Item(i);
 
+		if(i == mazeItem)
+		{
+			assert(!(item.Flags & SceneFile::ItemDynamic) && "The labyrinth must be static.");
 
-	
-	XMStoreFloat4x4(&leftwedgeRitem1->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixRotationY(XM_PIDIV2)* XMMatrixTranslation(-21.8f, 8.f + 6.f, 20.f - i * 30));
-	leftwedgeRitem1->ObjCBIndex = objCBIndex++;
-	leftwedgeRitem1->Geo = mGeometries["shapeGeo"].get();
-	leftwedgeRitem1->Mat = mMaterials["stone0"].get();
-	leftwedgeRitem1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	leftwedgeRitem1->IndexCount = leftwedgeRitem1->Geo->DrawArgs["wedge"].IndexCount;
-	leftwedgeRitem1->StartIndexLocation = leftwedgeRitem1->Geo->DrawArgs["wedge"].StartIndexLocation;
-	leftwedgeRitem1->BaseVertexLocation = leftwedgeRitem1->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(leftwedgeRitem1));
-
-	XMStoreFloat4x4(&rightwedgeRitem1->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixRotationY(XM_PIDIV2) * XMMatrixTranslation(13.8f, 8.f + 6.f, 20.f - i * 30));
-	rightwedgeRitem1->ObjCBIndex = objCBIndex++;
-	rightwedgeRitem1->Geo = mGeometries["shapeGeo"].get();
-	rightwedgeRitem1->Mat = mMaterials["stone0"].get();
-	rightwedgeRitem1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	rightwedgeRitem1->IndexCount = rightwedgeRitem1->Geo->DrawArgs["wedge"].IndexCount;
-	rightwedgeRitem1->StartIndexLocation = rightwedgeRitem1->Geo->DrawArgs["wedge"].StartIndexLocation;
-	rightwedgeRitem1->BaseVertexLocation = rightwedgeRitem1->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(rightwedgeRitem1));
-
-
-	XMStoreFloat4x4(&leftboxRitem1->World, XMMatrixScaling(1.55f, 0.2f, 1.55f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(-21.8f, 10.5f + 6.f, 20.f - i * 30));
-	leftboxRitem1->ObjCBIndex = objCBIndex++;
-	leftboxRitem1->Geo = mGeometries["shapeGeo"].get();
-	leftboxRitem1->Mat = mMaterials["stone0"].get();
-	leftboxRitem1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	leftboxRitem1->IndexCount = leftboxRitem1->Geo->DrawArgs["box"].IndexCount;
-	leftboxRitem1->StartIndexLocation = leftboxRitem1->Geo->DrawArgs["box"].StartIndexLocation;
-	leftboxRitem1->BaseVertexLocation = leftboxRitem1->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(leftboxRitem1));
-
-	XMStoreFloat4x4(&rightboxRitem1->World, XMMatrixScaling(1.55f, 0.2f, 1.55f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(13.8f, 10.5f + 6.f, 20.f - i * 30));
-	rightboxRitem1->ObjCBIndex = objCBIndex++;
-	rightboxRitem1->Geo = mGeometries["shapeGeo"].get();
-	rightboxRitem1->Mat = mMaterials["stone0"].get();
-	rightboxRitem1->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	rightboxRitem1->IndexCount = rightboxRitem1->Geo->DrawArgs["box"].IndexCount;
-	rightboxRitem1->StartIndexLocation = rightboxRitem1->Geo->DrawArgs["box"].StartIndexLocation;
-	rightboxRitem1->BaseVertexLocation = rightboxRitem1->Geo->DrawArgs["box"].BaseVertexLocation;
-	mAllRitems.push_back(std::move(rightboxRitem1));
+			for(UINT c = 0; c < (UINT)mMazeChunks.size(); ++c)
+			{
+				auto chunk = meshGeos[item.Mesh]->DrawArgs.find(mMazeChunks[c].Submesh);
+				assert(chunk != meshGeos[item.Mesh]->DrawArgs.end());
+
+				RenderItem& ri = addItem(item, &chunk->second);
+				ri.MazeChunk = c;
+			}
+
+			XMMATRIX world = XMLoadFloat4x4(&item.World);
+			XMStoreFloat4x4(&mMazeInvWorld, XMMatrixInverse(&XMMatrixDeterminant(world), world));
+			mMazeInScene = true;
+
+			BuildCrowd(item.World, nextItem++);
+			continue;
+		}
 
+		RenderItem& ri = addItem(item, submeshes[item.Mesh]);
+		ri.Lods = meshLods[item.Mesh];
+		if(ri.Lods != nullptr)
+			ri.MeshletCount = 0;
 
+		if(item.Name != SceneFile::NoString && std::strcmp(scene.String(item.Name), "waves") == 0)
+			mWavesRitem = &ri;
+	}
+	assert(nextItem == itemCount);
 
+	// UpdateWaves streams the simulation into this item's vertex buffer.
+	if(mWavesRitem == nullptr)
+	{
+		OutputDebugStringA("Scene has no item named waves\n");
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
 	}
+}
+
+void TexColumnsApp::BuildCrowd(const XMFLOAT4X4& mazeWorld, UINT index)
+{
+	mCrowd.Init(mMaze, mMazeNavigator, gCrowdAgentCount, gCrowdGoalCount, gCrowdAgentRadius, MazeWallThickness, gLabyrinthSeed);
 
+	// Agents are the 2 x 12 x 2 box scaled down to 0.4 x 0.9 x 0.6, standing on the
+	// bottom of the walls.
+	mCrowd.SetModelTransform(XMFLOAT3(0.2f, 0.075f, 0.3f), 0.45f, mazeWorld);
 
-	//right Ornamental
+	auto geoHandle = mGeometries.Find("shapeGeo");
+	auto matHandle = mMaterials.Find("stone0");
+	if(geoHandle.IsNull() || matHandle.IsNull())
+	{
+		OutputDebugStringA("The crowd needs shapeGeo and stone0\n");
+		ThrowIfFailed(HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+	}
+	MeshGeometry* geo = mGeometries.Get(geoHandle).get();
+	const SubmeshGeometry& box = geo->DrawArgs["box"];
+
+	// In no layer: UpdateDrawList draws the agents when the item is visible.
+	RenderItem& ri = mAllRitems[index];
+	mCrowdItem = index;
+	ri.World = mazeWorld;
+	ri.ObjCBIndex = index;
+	ri.Mat = mMaterials.Get(matHandle).get();
+	ri.Geo = geo;
+	ri.PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
+	ri.IndexCount = box.IndexCount;
+	ri.StartIndexLocation = box.StartIndexLocation;
+	ri.BaseVertexLocation = box.BaseVertexLocation;
+	ri.VertexBounds = box.Bounds;
+
+	// The space inside the labyrinth, where the agents are.
+	float width = mMaze.Width() * mMaze.CellSize();
+	float depth = mMaze.Depth() * mMaze.CellSize();
+	ri.Bounds.Center = XMFLOAT3(mMaze.Origin().x + 0.5f * width, 0.5f * (mMaze.WallBottom() + mMaze.WallTop()),
+		mMaze.Origin().y + 0.5f * depth);
+	ri.Bounds.Extents = XMFLOAT3(0.5f * width, 0.5f * (mMaze.WallTop() - mMaze.WallBottom()), 0.5f * depth);
+}
 
-	for (int i = 0; i < 2; ++i)
+void TexColumnsApp::BuildBVHs()
+{
+	std::vector<BVH::Item> staticItems;
+	std::vector<BVH::Item> dynamicItems;
+	for(size_t i = 0; i < mAllRitems.size(); ++i)
 	{
-		auto leftwedgeRitem2 = std::make_unique<RenderItem>();
-		auto rightwedgeRitem2 = std::make_unique<RenderItem>();
-		auto leftboxRitem2 = std::make_unique<RenderItem>();
-		auto rightboxRitem2 = std::make_unique<RenderItem>();
+		auto ri = &mAllRitems[i];
+
+		// The BVH ids double as indices into mAllRitems.
+		assert(ri->ObjCBIndex == (UINT)i);
 
+		XMMATRIX world = XMLoadFloat4x4(&ri->World);
+		ri->Bounds.Transform(ri->WorldBounds, world);
 
+		BVH::Item item;
+		item.Id = ri->ObjCBIndex;
+		item.Bounds = ri->WorldBounds;
 
-		XMStoreFloat4x4(&leftwedgeRitem2->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixRotationY(XM_PIDIV2 + XM_PI) * XMMatrixTranslation(-13.8f, 8.f + 6.f, 20.f - i * 30));
-		leftwedgeRitem2->ObjCBIndex = objCBIndex++;
-		leftwedgeRitem2->Geo = mGeometries["shapeGeo"].get();
-		leftwedgeRitem2->Mat = mMaterials["stone0"].get();
-		leftwedgeRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftwedgeRitem2->IndexCount = leftwedgeRitem2->Geo->DrawArgs["wedge"].IndexCount;
-		leftwedgeRitem2->StartIndexLocation = leftwedgeRitem2->Geo->DrawArgs["wedge"].StartIndexLocation;
-		leftwedgeRitem2->BaseVertexLocation = leftwedgeRitem2->Geo->DrawArgs["wedge"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(leftwedgeRitem2));
+		if(ri->Dynamic)
+			dynamicItems.push_back(item);
+		else
+			staticItems.push_back(item);
+	}
 
-		XMStoreFloat4x4(&rightwedgeRitem2->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixRotationY(XM_PIDIV2 + XM_PI) * XMMatrixTranslation(21.8f, 8.f + 6.f, 20.f - i * 30));
-		rightwedgeRitem2->ObjCBIndex = objCBIndex++;
-		rightwedgeRitem2->Geo = mGeometries["shapeGeo"].get();
-		rightwedgeRitem2->Mat = mMaterials["stone0"].get();
-		rightwedgeRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightwedgeRitem2->IndexCount = rightwedgeRitem2->Geo->DrawArgs["wedge"].IndexCount;
-		rightwedgeRitem2->StartIndexLocation = rightwedgeRitem2->Geo->DrawArgs["wedge"].StartIndexLocation;
-		rightwedgeRitem2->BaseVertexLocation = rightwedgeRitem2->Geo->DrawArgs["wedge"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(rightwedgeRitem2));
+	mStaticBvh.Build(staticItems);
+	mDynamicBvh.Build(dynamicItems);
+}
 
+void TexColumnsApp::BuildOccluders()
+{
+	// Occluders share meshes the way items share submeshes.
+	typedef std::tuple<const MeshGeometry*, UINT, int, UINT> MeshKey;
+	std::map<MeshKey, UINT> meshes;
 
-		XMStoreFloat4x4(&leftboxRitem2->World, XMMatrixScaling(1.55f, 0.2f, 1.55f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(-13.8f, 10.5f + 6.f, 20.f - i * 30));
-		leftboxRitem2->ObjCBIndex = objCBIndex++;
-		leftboxRitem2->Geo = mGeometries["shapeGeo"].get();
-		leftboxRitem2->Mat = mMaterials["stone0"].get();
-		leftboxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftboxRitem2->IndexCount = leftboxRitem2->Geo->DrawArgs["box"].IndexCount;
-		leftboxRitem2->StartIndexLocation = leftboxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
-		leftboxRitem2->BaseVertexLocation = leftboxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(leftboxRitem2));
+	for(auto& e : mAllRitems)
+	{
+		if(!e.Occluder)
+			continue;
 
-		XMStoreFloat4x4(&rightboxRitem2->World, XMMatrixScaling(1.55f, 0.2f, 1.55f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(21.8f, 10.5f + 6.f, 20.f - i * 30));
-		rightboxRitem2->ObjCBIndex = objCBIndex++;
-		rightboxRitem2->Geo = mGeometries["shapeGeo"].get();
-		rightboxRitem2->Mat = mMaterials["stone0"].get();
-		rightboxRitem2->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightboxRitem2->IndexCount = rightboxRitem2->Geo->DrawArgs["box"].IndexCount;
-		rightboxRitem2->StartIndexLocation = rightboxRitem2->Geo->DrawArgs["box"].StartIndexLocation;
-		rightboxRitem2->BaseVertexLocation = rightboxRitem2->Geo->DrawArgs["box"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(rightboxRitem2));
+		// The occlusion buffer is only drawn once; moving occluders would need
+		// their transforms updated every frame.
+		assert(!e.Dynamic && "Occluders must be static.");
+		assert(e.Geo->IndexFormat == DXGI_FORMAT_R16_UINT);
 
+		MeshKey key(e.Geo, e.StartIndexLocation, e.BaseVertexLocation, e.IndexCount);
+		auto it = meshes.find(key);
+		if(it == meshes.end())
+		{
+			auto indices = reinterpret_cast<const std::uint16_t*>(e.Geo->IndexBufferCPU->GetBufferPointer()) +
+				e.StartIndexLocation;
 
+			UINT vertexCount = 0;
+			for(UINT i = 0; i < e.IndexCount; ++i)
+				vertexCount = std::max<UINT>(vertexCount, (UINT)indices[i] + 1);
 
-	}
+			// Positions lead each vertex.  Compact ones are decoded first.
+			auto vertices = reinterpret_cast<const BYTE*>(e.Geo->VertexBufferCPU->GetBufferPointer()) +
+				e.BaseVertexLocation * e.Geo->VertexByteStride;
+			auto positions = reinterpret_cast<const XMFLOAT3*>(vertices);
+			UINT stride = e.Geo->VertexByteStride;
 
-	//back Ornamental
-	for (int i = 0; i < 2; ++i)
-	{
-		auto leftwedgeRitem3 = std::make_unique<RenderItem>();
-		auto rightwedgeRitem3 = std::make_unique<RenderItem>();
-		auto leftboxRitem3 = std::make_unique<RenderItem>();
-		auto rightboxRitem3 = std::make_unique<RenderItem>();
-		//right forward corner
-		// wedgeRitem->World = MathHelper::Identity4x4();
-		XMStoreFloat4x4(&leftwedgeRitem3->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixRotationY(XM_PI)* XMMatrixTranslation(-17.8f, 8.f + 6.f, 16.f - i * 30 + 8.f));
-		leftwedgeRitem3->ObjCBIndex = objCBIndex++;
-		leftwedgeRitem3->Geo = mGeometries["shapeGeo"].get();
-		leftwedgeRitem3->Mat = mMaterials["stone0"].get();
-		leftwedgeRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftwedgeRitem3->IndexCount = leftwedgeRitem3->Geo->DrawArgs["wedge"].IndexCount;
-		leftwedgeRitem3->StartIndexLocation = leftwedgeRitem3->Geo->DrawArgs["wedge"].StartIndexLocation;
-		leftwedgeRitem3->BaseVertexLocation = leftwedgeRitem3->Geo->DrawArgs["wedge"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(leftwedgeRitem3));
-
-		XMStoreFloat4x4(&rightwedgeRitem3->World, XMMatrixScaling(1.5f, 1.5f, 1.5f) * XMMatrixRotationX(XM_PI) * XMMatrixRotationY(XM_PI) * XMMatrixTranslation(17.8f, 8.f + 6.f, 16.f - i * 30 + 8.f));
-		rightwedgeRitem3->ObjCBIndex = objCBIndex++;
-		rightwedgeRitem3->Geo = mGeometries["shapeGeo"].get();
-		rightwedgeRitem3->Mat = mMaterials["stone0"].get();
-		rightwedgeRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightwedgeRitem3->IndexCount = rightwedgeRitem3->Geo->DrawArgs["wedge"].IndexCount;
-		rightwedgeRitem3->StartIndexLocation = rightwedgeRitem3->Geo->DrawArgs["wedge"].StartIndexLocation;
-		rightwedgeRitem3->BaseVertexLocation = rightwedgeRitem3->Geo->DrawArgs["wedge"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(rightwedgeRitem3));
-
-		XMStoreFloat4x4(&leftboxRitem3->World, XMMatrixScaling(1.55f, 0.2f, 1.55f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(-17.8f, 10.5f + 6.f, 16.f - i * 30 + 8.f));
-		leftboxRitem3->ObjCBIndex = objCBIndex++;
-		leftboxRitem3->Geo = mGeometries["shapeGeo"].get();
-		leftboxRitem3->Mat = mMaterials["stone0"].get();
-		leftboxRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftboxRitem3->IndexCount = leftboxRitem3->Geo->DrawArgs["box"].IndexCount;
-		leftboxRitem3->StartIndexLocation = leftboxRitem3->Geo->DrawArgs["box"].StartIndexLocation;
-		leftboxRitem3->BaseVertexLocation = leftboxRitem3->Geo->DrawArgs["box"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(leftboxRitem3));
-
-		XMStoreFloat4x4(&rightboxRitem3->World, XMMatrixScaling(1.55f, 0.2f, 1.55f) * XMMatrixRotationX(XM_PI) * XMMatrixTranslation(17.8f, 10.5f + 6.f, 16.f - i * 30 + 8.f));
-		rightboxRitem3->ObjCBIndex = objCBIndex++;
-		rightboxRitem3->Geo = mGeometries["shapeGeo"].get();
-		rightboxRitem3->Mat = mMaterials["stone0"].get();
-		rightboxRitem3->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightboxRitem3->IndexCount = rightboxRitem3->Geo->DrawArgs["box"].IndexCount;
-		rightboxRitem3->StartIndexLocation = rightboxRitem3->Geo->DrawArgs["box"].StartIndexLocation;
-		rightboxRitem3->BaseVertexLocation = rightboxRitem3->Geo->DrawArgs["box"].BaseVertexLocation;
-		mAllRitems.push_back(std::move(rightboxRitem3));
+			std::vector<XMFLOAT3> decoded;
+			if(e.Geo->CompactVertices)
+			{
+				auto compact = reinterpret_cast<const CompactVertex*>(vertices);
+				decoded.resize(vertexCount);
+				for(UINT i = 0; i < vertexCount; ++i)
+					decoded[i] = VertexQuantizer::DecodePosition(compact[i].Pos, e.VertexBounds);
+				positions = decoded.data();
+				stride = sizeof(XMFLOAT3);
+			}
 
+			UINT mesh = mOcclusion.AddMesh(positions, stride, vertexCount, indices, e.IndexCount);
+			it = meshes.insert(std::make_pair(key, mesh)).first;
+		}
 
+		mOcclusion.AddOccluder(it->second, e.World);
 	}
+}
+
+void TexColumnsApp::BuildMazeVisibility()
+{
+	// Scenes without the labyrinth draw everything as before.
+	if(!mMazeInScene)
+		return;
 
+	// Visible sets only change with the walls; the file is rebuilt when they do.
+	const std::string pvsFile = "Scenes/TexColumns.pvs";
+	if(!mMaze.LoadPvs(pvsFile))
+	{
+		mMaze.BuildPvs();
+		if(!mMaze.SavePvs(pvsFile))
+			OutputDebugStringA("Could not write Scenes/TexColumns.pvs\n");
+	}
 
+	XMMATRIX invWorld = XMLoadFloat4x4(&mMazeInvWorld);
 
+	// Static items that fit in one cell between the floor and top of the walls
+	// are culled with it.
+	for(auto& e : mAllRitems)
+	{
+		if(e.MazeChunk != NoMazeChunk || e.Dynamic)
+			continue;
 
+		BoundingBox local;
+		e.WorldBounds.Transform(local, invWorld);
 
+		XMFLOAT3 minCorner(local.Center.x - local.Extents.x, local.Center.y - local.Extents.y, local.Center.z - local.Extents.z);
+		XMFLOAT3 maxCorner(local.Center.x + local.Extents.x, local.Center.y + local.Extents.y, local.Center.z + local.Extents.z);
+		if(minCorner.y < mMaze.WallBottom() || maxCorner.y > mMaze.WallTop())
+			continue;
 
+		UINT cell = mMaze.CellAt(minCorner.x, minCorner.z);
+		if(cell != Maze::InvalidCell && cell == mMaze.CellAt(maxCorner.x, maxCorner.z))
+			e.MazeCell = cell;
+	}
+}
 
+void TexColumnsApp::BuildMeshIds()
+{
+	// Number every distinct submesh the items draw.  The ids are handed out in
+	// (geometry, submesh) order, so sorting on them keeps items that share buffers
+	// together and items that share a submesh adjacent, ready to be instanced.
+	std::unordered_map<const MeshGeometry*, UINT> geoIndices;
+	for(auto& e : mGeometries)
+	{
+		UINT index = (UINT)geoIndices.size();
+		geoIndices[e.get()] = index;
+	}
 
+	typedef std::tuple<UINT, UINT, int, UINT> MeshKey;
+	std::map<MeshKey, UINT> meshIds;
+	for(auto& e : mAllRitems)
+	{
+		meshIds[MeshKey(geoIndices[e.Geo], e.StartIndexLocation, e.BaseVertexLocation, e.IndexCount)] = 0;
 
-	auto gridRitem = std::make_unique<RenderItem>();
-	gridRitem->World = MathHelper::Identity4x4();
-	gridRitem->ObjCBIndex = objCBIndex++;
-	gridRitem->Mat = mMaterials["grass"].get();
-	gridRitem->Geo = mGeometries["landGeo"].get();
-	gridRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
-	gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
-	gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-	mRitemLayer[(int)RenderLayer::Opaque].push_back(gridRitem.get());
-	mAllRitems.push_back(std::move(gridRitem));
-
-	auto treeSpritesRitem = std::make_unique<RenderItem>();
-	treeSpritesRitem->World = MathHelper::Identity4x4();
-	treeSpritesRitem->ObjCBIndex = objCBIndex++;
-	treeSpritesRitem->Mat = mMaterials["treeSprites"].get();
-	treeSpritesRitem->Geo = mGeometries["treeSpritesGeo"].get();
-	//step2
-	treeSpritesRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_POINTLIST;
-	treeSpritesRitem->IndexCount = treeSpritesRitem->Geo->DrawArgs["points"].IndexCount;
-	treeSpritesRitem->StartIndexLocation = treeSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
-	treeSpritesRitem->BaseVertexLocation = treeSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
-
-	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(treeSpritesRitem.get());
-	mAllRitems.push_back(std::move(treeSpritesRitem));
-
-	//UINT objCBIndex = 6;
-	for (int i = 0; i < 2; ++i)
-	{
-		auto leftCylRitem = std::make_unique<RenderItem>();
-		auto rightCylRitem = std::make_unique<RenderItem>();
-		auto leftSphereRitem = std::make_unique<RenderItem>();
-		auto rightSphereRitem = std::make_unique<RenderItem>();
-
-		XMMATRIX leftCylWorld = XMMatrixScaling(2.2f, 1.3f, 2.2f) * XMMatrixTranslation(-17.8f, 1.5f + 6.f, -10.f + i * 30.f);
-		//XMMATRIX leftCylWorld = XMMatrixTranslation(-2.5f, 1.5f, -10.0f + i * 5.0f);
-		XMMATRIX rightCylWorld = XMMatrixScaling(2.2f, 1.3f, 2.2f) * XMMatrixTranslation(17.8f, 1.5f + 6.f, -10.0f + i * 30.f);
-		//XMMATRIX rightCylWorld = XMMatrixTranslation(+2.5f, 1.5f, -10.0f + i * 5.0f);
-		//XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.2f, 1.3f, 2.2f) * XMMatrixTranslation(0.0f, 1.5f, -7.5f));
-
-		/*XMMATRIX leftSphereWorld = XMMatrixTranslation(-5.0f, 3.5f, -10.0f + i*5.0f);
-		XMMATRIX rightSphereWorld = XMMatrixTranslation(+5.0f, 3.5f, -10.0f + i*5.0f);*/
-
-		XMStoreFloat4x4(&leftCylRitem->World, rightCylWorld);
-		leftCylRitem->ObjCBIndex = objCBIndex++;
-		leftCylRitem->Geo = mGeometries["shapeGeo"].get();
-		leftCylRitem->Mat = mMaterials["bricks0"].get();
-		leftCylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-
-		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
-		rightCylRitem->ObjCBIndex = objCBIndex++;
-		rightCylRitem->Geo = mGeometries["shapeGeo"].get();
-		rightCylRitem->Mat = mMaterials["bricks0"].get();
-		rightCylRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
-		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
-		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
-
-		/*XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
-		leftSphereRitem->ObjCBIndex = objCBIndex++;
-		leftSphereRitem->Geo = mGeometries["shapeGeo"].get();
-		leftSphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-		leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-		leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
-
-		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
-		rightSphereRitem->ObjCBIndex = objCBIndex++;
-		rightSphereRitem->Geo = mGeometries["shapeGeo"].get();
-		rightSphereRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
-		rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
-		rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;*/
-
-		mAllRitems.push_back(std::move(leftCylRitem));
-		mAllRitems.push_back(std::move(rightCylRitem));
-		/*mAllRitems.push_back(std::move(leftSphereRitem));
-		mAllRitems.push_back(std::move(rightSphereRitem));*/
+		// Every level an item can switch to needs an id too.
+		for(UINT i = 0; e.Lods != nullptr && i < e.Lods->LevelCount; ++i)
+		{
+			const SubmeshGeometry& level = e.Lods->Levels[i];
+			meshIds[MeshKey(geoIndices[e.Geo], level.StartIndexLocation, level.BaseVertexLocation, level.IndexCount)] = 0;
+		}
 	}
 
-	
-	
-	
-	
-	
+	UINT nextId = 0;
+	for(auto& e : meshIds)
+		e.second = nextId++;
+	assert(nextId <= 0x1000 && "Draw sort keys hold 12-bit mesh ids.");
+
+	for(auto& e : mAllRitems)
+		e.MeshId = meshIds[MeshKey(geoIndices[e.Geo], e.StartIndexLocation, e.BaseVertexLocation, e.IndexCount)];
 
+	for(auto& e : mAllRitems)
+	{
+		if(e.Lods == nullptr)
+			continue;
 
+		// Chains are shared between items; filling them in once per item is harmless.
+		MeshLodChain* lods = e.Lods;
+		for(UINT i = 0; i < lods->LevelCount; ++i)
+		{
+			const SubmeshGeometry& level = lods->Levels[i];
+			lods->MeshIds[i] = meshIds[MeshKey(geoIndices[e.Geo], level.StartIndexLocation, level.BaseVertexLocation, level.IndexCount)];
+		}
+	}
+}
 
+void TexColumnsApp::BuildTransparentOrder()
+{
+	mTransparentRank.assign(mAllRitems.size(), 0);
 
-	
-	
-	
-	
-	
-	
-	//auto torusRitem = std::make_unique<RenderItem>();
-	//// torusRitem->World = MathHelper::Identity4x4();
-	//XMStoreFloat4x4(&torusRitem->World, XMMatrixScaling(0.5f, 0.5f, 0.5f) * XMMatrixTranslation(0.0f, 5.0f, -7.5));
-	//torusRitem->ObjCBIndex = objCBIndex++;
-	//torusRitem->Geo = mGeometries["shapeGeo"].get();
-	//torusRitem->Mat = mMaterials["stone0"].get();
-	//torusRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	//torusRitem->IndexCount = torusRitem->Geo->DrawArgs["torus"].IndexCount;
-	//torusRitem->StartIndexLocation = torusRitem->Geo->DrawArgs["torus"].StartIndexLocation;
-	//torusRitem->BaseVertexLocation = torusRitem->Geo->DrawArgs["torus"].BaseVertexLocation;
-	//mAllRitems.push_back(std::move(torusRitem));
-
-	//auto coneRitem = std::make_unique<RenderItem>();
-	//// coneRitem->World = MathHelper::Identity4x4();
-	//XMStoreFloat4x4(&coneRitem->World, XMMatrixScaling(0.8f, 0.8f, 0.8f) * XMMatrixTranslation(0.0f, 4.0f, -7.5f));
-	//coneRitem->ObjCBIndex = objCBIndex++;
-	//coneRitem->Geo = mGeometries["shapeGeo"].get();
-	//coneRitem->Mat = mMaterials["stone0"].get();
-	//coneRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	//coneRitem->IndexCount = coneRitem->Geo->DrawArgs["cone"].IndexCount;
-	//coneRitem->StartIndexLocation = coneRitem->Geo->DrawArgs["cone"].StartIndexLocation;
-	//coneRitem->BaseVertexLocation = coneRitem->Geo->DrawArgs["cone"].BaseVertexLocation;
-	//mAllRitems.push_back(std::move(coneRitem));
-
-	//auto pyramidRitem = std::make_unique<RenderItem>();
-	//// pyramidRitem->World = MathHelper::Identity4x4();
-	////left forward corner
-	//XMStoreFloat4x4(&pyramidRitem->World, XMMatrixScaling(0.3f, 0.3f, 0.3f) * XMMatrixTranslation(-2.5f, 3.7f, -10.0f));
-	//pyramidRitem->ObjCBIndex = objCBIndex++;
-	//pyramidRitem->Geo = mGeometries["shapeGeo"].get();
-	//pyramidRitem->Mat = mMaterials["stone0"].get();
-	//pyramidRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	//pyramidRitem->IndexCount = pyramidRitem->Geo->DrawArgs["pyramid"].IndexCount;
-	//pyramidRitem->StartIndexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].StartIndexLocation;
-	//pyramidRitem->BaseVertexLocation = pyramidRitem->Geo->DrawArgs["pyramid"].BaseVertexLocation;
-	//mAllRitems.push_back(std::move(pyramidRitem));
-
-	//auto wedgeRitem = std::make_unique<RenderItem>();
-	////right forward corner
-	//// wedgeRitem->World = MathHelper::Identity4x4();
-	//XMStoreFloat4x4(&wedgeRitem->World, XMMatrixScaling(0.3f, 0.3f, 0.3f) * XMMatrixTranslation(2.5f, 3.2f, -10.0f));
-	//wedgeRitem->ObjCBIndex = objCBIndex++;
-	//wedgeRitem->Geo = mGeometries["shapeGeo"].get();
-	//wedgeRitem->Mat = mMaterials["stone0"].get();
-	//wedgeRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	//wedgeRitem->IndexCount = wedgeRitem->Geo->DrawArgs["wedge"].IndexCount;
-	//wedgeRitem->StartIndexLocation = wedgeRitem->Geo->DrawArgs["wedge"].StartIndexLocation;
-	//wedgeRitem->BaseVertexLocation = wedgeRitem->Geo->DrawArgs["wedge"].BaseVertexLocation;
-	//mAllRitems.push_back(std::move(wedgeRitem));
-
-	//auto diamondRitem = std::make_unique<RenderItem>();
-	//// diamondRitem->World = MathHelper::Identity4x4();
-	//XMStoreFloat4x4(&diamondRitem->World, XMMatrixScaling(0.3f, 0.3f, 0.3f) * XMMatrixTranslation(-2.5f, 3.5f, -5.0f));
-	//diamondRitem->ObjCBIndex = objCBIndex++;
-	//diamondRitem->Geo = mGeometries["shapeGeo"].get();
-	//diamondRitem->Mat = mMaterials["stone0"].get();
-	//diamondRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	//diamondRitem->IndexCount = diamondRitem->Geo->DrawArgs["diamond"].IndexCount;
-	//diamondRitem->StartIndexLocation = diamondRitem->Geo->DrawArgs["diamond"].StartIndexLocation;
-	//diamondRitem->BaseVertexLocation = diamondRitem->Geo->DrawArgs["diamond"].BaseVertexLocation;
-	//mAllRitems.push_back(std::move(diamondRitem));
-
-	//auto prismRitem = std::make_unique<RenderItem>();
-	//// prismRitem->World = MathHelper::Identity4x4();
-	//XMStoreFloat4x4(&prismRitem->World, XMMatrixScaling(0.3f, 0.3f, 0.3f) * XMMatrixTranslation(2.5f, 3.5f, -5.0f));
-	//prismRitem->ObjCBIndex = objCBIndex++;
-	//prismRitem->Geo = mGeometries["shapeGeo"].get();
-	//prismRitem->Mat = mMaterials["stone0"].get();
-	//prismRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	//prismRitem->IndexCount = prismRitem->Geo->DrawArgs["prism"].IndexCount;
-	//prismRitem->StartIndexLocation = prismRitem->Geo->DrawArgs["prism"].StartIndexLocation;
-	//prismRitem->BaseVertexLocation = prismRitem->Geo->DrawArgs["prism"].BaseVertexLocation;
-	//mAllRitems.push_back(std::move(prismRitem));
-
-	int count = 0;
-	// All the render items are opaque.
-	for (auto& e : mAllRitems) {
-		if (count++ < 4) continue;
-		mRitemLayer[(int)RenderLayer::Opaque].push_back(e.get());
+	mTransparentOrder.clear();
+	for(auto ri : mRitemLayer[(int)RenderLayer::Transparent])
+	{
+		RadixEntry<std::uint32_t> e;
+		e.Key = 0;
+		e.Value = ri->ObjCBIndex;
+		mTransparentOrder.push_back(e);
 	}
+	assert(mTransparentOrder.size() <= 0xffffff && "Draw sort keys hold 24-bit transparent ranks.");
+
+	mTransparentSortDirty = true;
 }
 
-void TexColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void TexColumnsApp::DrawRenderItems(DrawStateCache& cache, const std::vector<RadixEntry<std::uint64_t>>& drawList,
+	const std::vector<DrawBatch>& batches)
 {
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
- 
+	UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
+	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+
 	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
 	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
-    {
-        auto ri = ritems[i];
+	D3D12_GPU_VIRTUAL_ADDRESS objectCBBase = objectCB->GetGPUVirtualAddress();
+	D3D12_GPU_VIRTUAL_ADDRESS matCBBase = matCB->GetGPUVirtualAddress();
+	D3D12_GPU_VIRTUAL_ADDRESS instanceBase = instanceBuffer->GetGPUVirtualAddress();
+
+	// For each batch...  The cache drops every call that sets state the previous
+	// batch already set, which the sort order makes the common case.
+	for(size_t i = 0; i < batches.size(); ++i)
+	{
+		const DrawBatch& batch = batches[i];
+		UINT pso = DrawKeyPso(drawList[batch.First].Key);
+
+		// Every item in the batch shares the state of the first.
+		auto ri = &mAllRitems[drawList[batch.First].Value];
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+		cache.SetGeometry(ri->Geo);
+		cache.SetPrimitiveTopology(ri->PrimitiveType);
 
 		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
 		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCBBase + ri->Mat->MatCBIndex*matCBByteSize;
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
-        cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+		cache.SetGraphicsRootDescriptorTable(0, tex);
+		cache.SetGraphicsRootConstantBufferView(3, matCBAddress);
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+		if(batch.Instanced)
+		{
+			// Point the instance buffer SRV at the batch, so instance ids start at zero.
+			cache.SetPipelineState(mPSOs.Get(mLayerInstancedPSOs[pso]).Get());
+			cache.SetGraphicsRootShaderResourceView(4, instanceBase + batch.InstanceOffset*sizeof(InstanceData));
+		}
+		else
+		{
+			D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCBBase + ri->ObjCBIndex*objCBByteSize;
+
+			cache.SetPipelineState(mPSOs.Get(mLayerPSOs[pso]).Get());
+			cache.SetGraphicsRootConstantBufferView(1, objCBAddress);
+		}
+
+		// Every item of a batch draws the same submesh, so one box decodes them all.
+		if(ri->Geo->CompactVertices)
+		{
+			VertexQuantizer::PositionDecode decode = VertexQuantizer::GetPositionDecode(ri->VertexBounds);
+			cache.SetGraphicsRoot32BitConstants(5, sizeof(decode) / 4, &decode);
+		}
+
+		if(ri->RangeCount > 0)
+		{
+			for(UINT r = 0; r < ri->RangeCount; ++r)
+			{
+				const MeshletRange& range = mMeshletRanges[ri->FirstRange + r];
+				cache.DrawIndexedInstanced(range.IndexCount, 1, range.StartIndex, ri->BaseVertexLocation, 0);
+			}
+		}
+		else
+			cache.DrawIndexedInstanced(ri->IndexCount, batch.Count, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
+	}
+}
+
+void TexColumnsApp::Pick(int sx, int sy)
+{
+	XMFLOAT4X4 P = mProj;
+
+	// Compute picking ray in view space.
+	float vx = (+2.0f*sx / mClientWidth - 1.0f) / P(0, 0);
+	float vy = (-2.0f*sy / mClientHeight + 1.0f) / P(1, 1);
+
+	// Transform the ray to world space, where the BVHs live.
+	XMMATRIX view = XMLoadFloat4x4(&mView);
+	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+
+	XMVECTOR rayOrigin = XMVector3TransformCoord(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f), invView);
+	XMVECTOR rayDir = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView));
+
+	// Gather the items whose bounds the ray crosses and test them front to back,
+	// stopping once the next box starts beyond the closest exact hit.
+	const float farZ = 1000.0f;
+	std::vector<BVH::RayHit> hits;
+	mStaticBvh.QueryRay(rayOrigin, rayDir, farZ, hits);
+	mDynamicBvh.QueryRay(rayOrigin, rayDir, farZ, hits);
+	std::sort(hits.begin(), hits.end(),
+		[](const BVH::RayHit& a, const BVH::RayHit& b) { return a.Dist < b.Dist; });
+
+	std::uint32_t pickedId = BVH::InvalidId;
+	float pickedDist = farZ;
+	for(auto& hit : hits)
+	{
+		if(hit.Dist >= pickedDist)
+			break;
+
+		// The crowd item draws nothing of its own.
+		if(mAllRitems[hit.Id].LayerMask == 0)
+			continue;
+
+		float dist = 0.0f;
+		if(IntersectRitem(&mAllRitems[hit.Id], rayOrigin, rayDir, dist) && dist < pickedDist)
+		{
+			pickedId = hit.Id;
+			pickedDist = dist;
+		}
+	}
+
+	if(pickedId != BVH::InvalidId)
+	{
+		std::wstring text = L"Picked render item " + std::to_wstring(pickedId) +
+			L" at distance " + std::to_wstring(pickedDist) + L"\n";
+		OutputDebugString(text.c_str());
+	}
+}
+
+bool TexColumnsApp::IntersectRitem(const RenderItem* ri, FXMVECTOR rayOrigin, FXMVECTOR rayDir, float& dist)const
+{
+	// Without CPU side triangles (the dynamic water, the sprite points) the box hit
+	// is as exact as it gets.
+	if(ri->Geo->VertexBufferCPU == nullptr || ri->PrimitiveType != D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+		return ri->WorldBounds.Intersects(rayOrigin, rayDir, dist);
+
+	// Test the triangles in the local space of the item.
+	XMMATRIX W = XMLoadFloat4x4(&ri->World);
+	XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(W), W);
+
+	XMVECTOR localOrigin = XMVector3TransformCoord(rayOrigin, invWorld);
+	XMVECTOR localDir = XMVector3Normalize(XMVector3TransformNormal(rayDir, invWorld));
+
+	auto vertices = (const BYTE*)ri->Geo->VertexBufferCPU->GetBufferPointer();
+	auto indices = ri->Geo->IndexBufferCPU->GetBufferPointer();
+	bool indices32 = ri->Geo->IndexFormat == DXGI_FORMAT_R32_UINT;
+	UINT stride = ri->Geo->VertexByteStride;
+	bool compact = ri->Geo->CompactVertices;
+
+	// Every vertex format here starts with the position.
+	auto position = [&](UINT i)
+	{
+		UINT index = indices32 ?
+			((const std::uint32_t*)indices)[ri->StartIndexLocation + i] :
+			((const std::uint16_t*)indices)[ri->StartIndexLocation + i];
+		const BYTE* vertex = vertices + (ri->BaseVertexLocation + index)*stride;
+		if(compact)
+		{
+			XMFLOAT3 p = VertexQuantizer::DecodePosition(((const CompactVertex*)vertex)->Pos, ri->VertexBounds);
+			return XMLoadFloat3(&p);
+		}
+		return XMLoadFloat3((const XMFLOAT3*)vertex);
+	};
+
+	float tmin = MathHelper::Infinity;
+	for(UINT i = 0; i + 2 < ri->IndexCount; i += 3)
+	{
+		float t = 0.0f;
+		if(TriangleTests::Intersects(localOrigin, localDir, position(i), position(i + 1), position(i + 2), t) && t < tmin)
+			tmin = t;
+	}
+
+	if(tmin == MathHelper::Infinity)
+		return false;
+
+	// Measure the hit in world units so items with different scales compare.
+	XMVECTOR hit = XMVector3TransformCoord(XMVectorMultiplyAdd(XMVectorReplicate(tmin), localDir, localOrigin), W);
+	dist = XMVectorGetX(XMVector3Length(XMVectorSubtract(hit, rayOrigin)));
+	return true;
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> TexColumnsApp::GetStaticSamplers()